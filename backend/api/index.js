@@ -11,6 +11,7 @@ const helmet = require('helmet');
 const morgan = require('morgan');
 const Database = require('better-sqlite3');
 const { startSimulator, deviceStates, activeIncidents } = require('./live-simulator');
+const { decodeTelemetry } = require('./telemetry');
 require('dotenv').config();
 
 const app = express();
@@ -48,10 +49,131 @@ db.exec(`
     created_at DATETIME DEFAULT CURRENT_TIMESTAMP
   );
 
+  CREATE TABLE IF NOT EXISTS device_incidents (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    site TEXT NOT NULL,
+    type TEXT NOT NULL,
+    zone INTEGER,
+    value INTEGER,
+    baseline INTEGER,
+    started_at INTEGER NOT NULL,
+    cleared_at INTEGER,
+    created_at DATETIME DEFAULT CURRENT_TIMESTAMP,
+    stream INTEGER,
+    seq INTEGER
+  );
+
+  CREATE TABLE IF NOT EXISTS metric_summaries (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    site TEXT NOT NULL,
+    received_at INTEGER NOT NULL,
+    interval_ms INTEGER NOT NULL,
+    vehicles INTEGER NOT NULL,
+    headway_ms TEXT,
+    gap_ms TEXT,
+    speed_dkmh TEXT,
+    confidence TEXT
+  );
+
+  CREATE INDEX IF NOT EXISTS idx_metric_summaries_site ON metric_summaries(site, received_at);
+
+  CREATE TABLE IF NOT EXISTS device_radio (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    site TEXT NOT NULL,
+    received_at INTEGER NOT NULL,
+    period_ms INTEGER NOT NULL,
+    active_ms INTEGER NOT NULL,
+    awake_ms INTEGER NOT NULL,
+    wakes INTEGER NOT NULL,
+    health INTEGER,
+    tau_s INTEGER,
+    active_time_s INTEGER,
+    edrx_ms INTEGER
+  );
+
+  CREATE INDEX IF NOT EXISTS idx_device_radio_site ON device_radio(site, received_at);
+
+  CREATE TABLE IF NOT EXISTS detection_rollups (
+    site TEXT NOT NULL,
+    period_start INTEGER NOT NULL,
+    period_minutes INTEGER NOT NULL,
+    vehicles INTEGER NOT NULL,
+    peak_minute INTEGER,
+    coverage INTEGER,
+    PRIMARY KEY (site, period_minutes, period_start)
+  );
+
+  CREATE TABLE IF NOT EXISTS detection_intervals (
+    site TEXT NOT NULL,
+    stream INTEGER NOT NULL,
+    interval_seq INTEGER NOT NULL,
+    recorded_at INTEGER,
+    total_count INTEGER NOT NULL,
+    hour_count INTEGER,
+    minute_count INTEGER,
+    avg_confidence REAL,
+    uptime INTEGER,
+    replayed BOOLEAN DEFAULT 0,
+    received_at INTEGER NOT NULL,
+    PRIMARY KEY (site, stream, interval_seq)
+  );
+
+  CREATE TABLE IF NOT EXISTS heatmaps (
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    site TEXT NOT NULL,
+    received_at INTEGER NOT NULL,
+    seconds INTEGER NOT NULL,
+    frame_width INTEGER NOT NULL,
+    frame_height INTEGER NOT NULL,
+    line_y INTEGER NOT NULL,
+    cols INTEGER NOT NULL,
+    rows INTEGER NOT NULL,
+    cells TEXT NOT NULL
+  );
+
+  CREATE TABLE IF NOT EXISTS device_images (
+    site TEXT NOT NULL,
+    image_seq INTEGER NOT NULL,
+    size INTEGER NOT NULL,
+    crc INTEGER NOT NULL,
+    received INTEGER NOT NULL,
+    data BLOB NOT NULL,
+    captured_at INTEGER,
+    min_confidence REAL,
+    max_confidence REAL,
+    zone INTEGER,
+    vehicles INTEGER,
+    flags INTEGER,
+    crop_x INTEGER,
+    crop_y INTEGER,
+    complete BOOLEAN DEFAULT 0,
+    received_at INTEGER NOT NULL,
+    PRIMARY KEY (site, image_seq)
+  );
+
+  CREATE TABLE IF NOT EXISTS device_image_parts (
+    site TEXT NOT NULL,
+    image_seq INTEGER NOT NULL,
+    part_offset INTEGER NOT NULL,
+    data BLOB NOT NULL,
+    PRIMARY KEY (site, image_seq, part_offset)
+  );
+
   CREATE INDEX IF NOT EXISTS idx_detections_site ON detections(site);
   CREATE INDEX IF NOT EXISTS idx_detections_timestamp ON detections(timestamp);
+  CREATE INDEX IF NOT EXISTS idx_device_incidents_open ON device_incidents(site, type, cleared_at);
 `);
 
+// Databases created before incidents carried (stream, seq)
+const incidentColumns = db.prepare('PRAGMA table_info(device_incidents)').all().map(c => c.name);
+if (!incidentColumns.includes('seq')) {
+  db.exec(`
+    ALTER TABLE device_incidents ADD COLUMN stream INTEGER;
+    ALTER TABLE device_incidents ADD COLUMN seq INTEGER;
+  `);
+}
+db.exec('CREATE UNIQUE INDEX IF NOT EXISTS idx_device_incidents_event ON device_incidents(site, stream, seq)');
+
 console.log('Database initialized');
 
 // ============================================================================
@@ -128,6 +250,415 @@ if (siteCount.count === 0) {
   console.log(`✓ Found ${siteCount.count} existing monitoring sites`);
 }
 
+// ============================================================================
+// Metric Histograms
+// ============================================================================
+// Devices send log-bucket histograms as {n, sum, b: [bucket, count, ...]}.
+// Buckets below 8 hold exact values; above that each power of two is split
+// into 8 buckets. Matches LogHistogram in the firmware.
+function bucketLowerBound(bucket) {
+  if (bucket < 8) return bucket;
+  const msb = Math.floor(bucket / 8) + 2;
+  return (8 + (bucket % 8)) * Math.pow(2, msb - 3);
+}
+
+function mergeHistograms(histograms) {
+  const merged = { n: 0, sum: 0, buckets: new Map() };
+
+  for (const hist of histograms) {
+    if (!hist || !Array.isArray(hist.b)) continue;
+    merged.n += hist.n || 0;
+    merged.sum += hist.sum || 0;
+    for (let i = 0; i + 1 < hist.b.length; i += 2) {
+      const bucket = hist.b[i];
+      merged.buckets.set(bucket, (merged.buckets.get(bucket) || 0) + hist.b[i + 1]);
+    }
+  }
+
+  return merged;
+}
+
+function histogramPercentile(merged, q) {
+  const total = Array.from(merged.buckets.values()).reduce((a, b) => a + b, 0);
+  if (total === 0) return null;
+
+  const target = q * total;
+  let seen = 0;
+  for (const bucket of Array.from(merged.buckets.keys()).sort((a, b) => a - b)) {
+    seen += merged.buckets.get(bucket);
+    if (seen > target) return bucketLowerBound(bucket);
+  }
+  return null;
+}
+
+function summarizeHistograms(histograms, scale = 1) {
+  const merged = mergeHistograms(histograms);
+  const pct = q => {
+    const value = histogramPercentile(merged, q);
+    return value === null ? null : value * scale;
+  };
+
+  return {
+    samples: merged.n,
+    mean: merged.n > 0 ? (merged.sum / merged.n) * scale : null,
+    p15: pct(0.15),
+    p50: pct(0.5),
+    p85: pct(0.85),
+    p95: pct(0.95),
+    histogram: [].concat(...Array.from(merged.buckets.entries()).sort((a, b) => a[0] - b[0]))
+  };
+}
+
+// ============================================================================
+// Rollup Records
+// ============================================================================
+// Binary batch uploaded by devices after an outage:
+//   "SFRU", version (1), tier, count (LE16), site name length, site name,
+//   then count 16-byte records matching RollupRecord in the firmware.
+const ROLLUP_TIER_MINUTES = [1, 15, 60];
+
+function crc16(buf, start, end) {
+  // CRC-16/CCITT-FALSE
+  let crc = 0xFFFF;
+  for (let i = start; i < end; i++) {
+    crc ^= buf[i] << 8;
+    for (let b = 0; b < 8; b++) {
+      crc = crc & 0x8000 ? ((crc << 1) ^ 0x1021) & 0xFFFF : (crc << 1) & 0xFFFF;
+    }
+  }
+  return crc;
+}
+
+function parseRollupBatch(buf) {
+  if (buf.length < 9 || buf.toString('ascii', 0, 4) !== 'SFRU' || buf[4] !== 1) {
+    throw new Error('Not a rollup batch');
+  }
+
+  const tier = buf[5];
+  const count = buf.readUInt16LE(6);
+  const nameLen = buf[8];
+  const site = buf.toString('utf8', 9, 9 + nameLen);
+  const minutes = ROLLUP_TIER_MINUTES[tier];
+
+  if (!minutes || buf.length < 9 + nameLen + count * 16) {
+    throw new Error('Truncated rollup batch');
+  }
+
+  const records = [];
+  for (let i = 0; i < count; i++) {
+    const offset = 9 + nameLen + i * 16;
+    if (crc16(buf, offset, offset + 14) !== buf.readUInt16LE(offset + 14)) continue;
+
+    records.push({
+      periodStart: buf.readUInt32LE(offset) * minutes * 60 * 1000,
+      vehicles: buf.readUInt16LE(offset + 4),
+      peakMinute: buf.readUInt16LE(offset + 6),
+      coverage: buf.readUInt16LE(offset + 8)
+    });
+  }
+
+  return { site, minutes, count, records };
+}
+
+// ============================================================================
+// Interval Backlog
+// ============================================================================
+// Devices number each upload interval within a stream (a random ID chosen
+// at cold start) and replay intervals that failed to upload. The
+// detection_intervals table records which ones have arrived, so replays
+// of intervals already received live are dropped.
+
+// "SFIB", version (1), count (LE16), site name length, site name, then
+// 40-byte records: interval, stream, boot ID, device millis, unix seconds
+// (0 = unknown), total, hour and minute counts (LE32), avg confidence
+// (float32), uptime seconds (LE32)
+function parseIntervalBatch(buf) {
+  if (buf.length < 8 || buf.toString('ascii', 0, 4) !== 'SFIB' || buf[4] !== 1) {
+    throw new Error('Not an interval batch');
+  }
+
+  const count = buf.readUInt16LE(5);
+  const nameLen = buf[7];
+  const site = buf.toString('utf8', 8, 8 + nameLen);
+
+  if (buf.length < 8 + nameLen + count * 40) {
+    throw new Error('Truncated interval batch');
+  }
+
+  const records = [];
+  for (let i = 0; i < count; i++) {
+    const offset = 8 + nameLen + i * 40;
+    const epoch = buf.readUInt32LE(offset + 16);
+
+    records.push({
+      interval: buf.readUInt32LE(offset),
+      stream: buf.readUInt32LE(offset + 4),
+      timestamp: buf.readUInt32LE(offset + 12),
+      recordedAt: epoch ? epoch * 1000 : null,
+      totalCount: buf.readUInt32LE(offset + 20),
+      hourCount: buf.readUInt32LE(offset + 24),
+      minuteCount: buf.readUInt32LE(offset + 28),
+      avgConfidence: buf.readFloatLE(offset + 32),
+      uptime: buf.readUInt32LE(offset + 36)
+    });
+  }
+
+  return { site, records };
+}
+
+// true if this is the first time (site, stream, interval) has been seen
+function recordInterval(site, r, replayed) {
+  const result = db.prepare(`
+    INSERT OR IGNORE INTO detection_intervals (
+      site, stream, interval_seq, recorded_at, total_count, hour_count,
+      minute_count, avg_confidence, uptime, replayed, received_at
+    ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+  `).run(
+    site, r.stream, r.interval, r.recordedAt, r.totalCount, r.hourCount,
+    r.minuteCount, r.avgConfidence, r.uptime, replayed ? 1 : 0, Date.now()
+  );
+  return result.changes > 0;
+}
+
+// Record where a site's device is, adding the site if it is new
+function upsertSite(site, lat, lon) {
+  db.prepare(`
+    INSERT INTO sites (name, latitude, longitude)
+    VALUES (?, ?, ?)
+    ON CONFLICT(name) DO UPDATE SET
+      latitude = excluded.latitude,
+      longitude = excluded.longitude
+  `).run(site, lat || null, lon || null);
+}
+
+// Insert intervals as detections rows in one transaction, skipping any
+// already received. Returns how many were stored.
+function storeIntervals(site, records, replayed, lat = null, lon = null) {
+  const insert = db.prepare(`
+    INSERT INTO detections (
+      site, latitude, longitude, timestamp, total_count, hour_count,
+      minute_count, avg_confidence, uptime, created_at
+    ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, COALESCE(?, CURRENT_TIMESTAMP))
+  `);
+
+  let stored = 0;
+  db.transaction(() => {
+    for (const r of records) {
+      if (!recordInterval(site, r, replayed)) continue;
+
+      const createdAt = r.recordedAt
+        ? new Date(r.recordedAt).toISOString().replace('T', ' ').slice(0, 19)
+        : null;
+      insert.run(site, lat, lon, r.timestamp, r.totalCount, r.hourCount, r.minuteCount,
+                 r.avgConfidence, r.uptime, createdAt);
+      stored++;
+    }
+  })();
+
+  return stored;
+}
+
+// ============================================================================
+// Heatmaps
+// ============================================================================
+// Devices upload their calibration heatmap after a stats upload whose
+// response carries "X-SwanFlow-Request: heatmap". Requests stay pending
+// until the heatmap arrives.
+const pendingHeatmapRequests = new Set();
+
+// "SFHM", version (1), cols, rows, site name length, site name,
+// frame width, frame height, counting line Y (LE16), seconds (LE32),
+// then per cell: hits (LE16), mean vx, vy (LE16 signed, px/s), confidence (0-255)
+function parseHeatmap(buf) {
+  if (buf.length < 8 || buf.toString('ascii', 0, 4) !== 'SFHM' || buf[4] !== 1) {
+    throw new Error('Not a heatmap');
+  }
+
+  const cols = buf[5];
+  const rows = buf[6];
+  const nameLen = buf[7];
+  const site = buf.toString('utf8', 8, 8 + nameLen);
+  let offset = 8 + nameLen;
+
+  if (buf.length < offset + 10 + cols * rows * 7) {
+    throw new Error('Truncated heatmap');
+  }
+
+  const frameWidth = buf.readUInt16LE(offset);
+  const frameHeight = buf.readUInt16LE(offset + 2);
+  const lineY = buf.readUInt16LE(offset + 4);
+  const seconds = buf.readUInt32LE(offset + 6);
+  offset += 10;
+
+  const cells = [];
+  for (let i = 0; i < cols * rows; i++, offset += 7) {
+    cells.push({
+      hits: buf.readUInt16LE(offset),
+      vx: buf.readInt16LE(offset + 2),
+      vy: buf.readInt16LE(offset + 4),
+      confidence: Math.round(buf[offset + 6] / 255 * 100) / 100
+    });
+  }
+
+  return { site, cols, rows, frameWidth, frameHeight, lineY, seconds, cells };
+}
+
+// ============================================================================
+// Detection Images
+// ============================================================================
+// Stored JPEGs arrive raw, a part per request, so a dropped link only costs
+// the part in flight. Parts are appended in order; a part starting past
+// what has been received gets 409 and the device starts the image again.
+// Each part's new bytes get their own row in device_image_parts, so a part
+// costs its own size however far into the image it is; reads put the
+// parts back together (device_images.data holds images from before).
+// "SFIM", version (1), site name length, site name, then LE32 image seq,
+// size, part offset, CRC32 of the whole image, Unix seconds (0 = unknown),
+// capture millis, then min/max confidence (0-255), zone, vehicles, flags,
+// crop X/Y (8 px units), then the part's bytes
+function parseImagePart(buf) {
+  if (buf.length < 6 || buf.toString('ascii', 0, 4) !== 'SFIM' || buf[4] !== 1) {
+    throw new Error('Not an image part');
+  }
+
+  const nameLen = buf[5];
+  const site = buf.toString('utf8', 6, 6 + nameLen);
+  let offset = 6 + nameLen;
+
+  if (buf.length < offset + 31) {
+    throw new Error('Truncated image part');
+  }
+
+  const part = {
+    site,
+    seq: buf.readUInt32LE(offset),
+    size: buf.readUInt32LE(offset + 4),
+    offset: buf.readUInt32LE(offset + 8),
+    crc: buf.readUInt32LE(offset + 12),
+    epoch: buf.readUInt32LE(offset + 16),
+    timestamp: buf.readUInt32LE(offset + 20),
+    minConfidence: Math.round(buf[offset + 24] / 255 * 100) / 100,
+    maxConfidence: Math.round(buf[offset + 25] / 255 * 100) / 100,
+    zone: buf[offset + 26],
+    vehicles: buf[offset + 27],
+    flags: buf[offset + 28],
+    cropX: buf[offset + 29] * 8,
+    cropY: buf[offset + 30] * 8,
+    data: buf.subarray(offset + 31)
+  };
+
+  if (part.offset + part.data.length > part.size) {
+    throw new Error('Image part past the end of the image');
+  }
+  return part;
+}
+
+// CRC-32 (IEEE, as zlib and the ESP32 ROM's crc32_le)
+const CRC32_TABLE = new Int32Array(256).map((_, n) => {
+  let c = n;
+  for (let k = 0; k < 8; k++) {
+    c = c & 1 ? 0xEDB88320 ^ (c >>> 1) : c >>> 1;
+  }
+  return c;
+});
+
+// crc continues a CRC over earlier bytes
+function crc32(buf, crc = 0) {
+  crc = ~crc;
+  for (let i = 0; i < buf.length; i++) {
+    crc = CRC32_TABLE[(crc ^ buf[i]) & 0xFF] ^ (crc >>> 8);
+  }
+  return (crc ^ -1) >>> 0;
+}
+
+function deleteImage(site, seq) {
+  db.prepare('DELETE FROM device_image_parts WHERE site = ? AND image_seq = ?').run(site, seq);
+  db.prepare('DELETE FROM device_images WHERE site = ? AND image_seq = ?').run(site, seq);
+}
+
+function imageParts(site, seq) {
+  return db.prepare(`
+    SELECT data FROM device_image_parts WHERE site = ? AND image_seq = ? ORDER BY part_offset
+  `).all(site, seq).map(row => row.data);
+}
+
+// A complete image's JPEG, or null
+function loadImage(site, seq) {
+  const row = db.prepare(`
+    SELECT data FROM device_images WHERE site = ? AND image_seq = ? AND complete = 1
+  `).get(site, seq);
+  if (!row) return null;
+  return row.data.length ? row.data : Buffer.concat(imageParts(site, seq));
+}
+
+// Apply a part. Returns the HTTP status: 200 stored (or already had it),
+// 201 image complete, 409 not contiguous (or the CRC failed: start over).
+function storeImagePart(part) {
+  return db.transaction(() => {
+    let row = db.prepare(`
+      SELECT size, crc, received, complete FROM device_images WHERE site = ? AND image_seq = ?
+    `).get(part.site, part.seq);
+
+    // Same seq but a different image (device store reset): replace it
+    if (row && (row.size !== part.size || row.crc !== part.crc)) {
+      deleteImage(part.site, part.seq);
+      row = null;
+    }
+
+    if (!row) {
+      if (part.offset !== 0) return 409;
+      db.prepare(`
+        INSERT INTO device_images (
+          site, image_seq, size, crc, received, data, captured_at, min_confidence,
+          max_confidence, zone, vehicles, flags, crop_x, crop_y, received_at
+        ) VALUES (?, ?, ?, ?, 0, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+      `).run(
+        part.site, part.seq, part.size, part.crc, Buffer.alloc(0),
+        part.epoch ? part.epoch * 1000 : null, part.minConfidence, part.maxConfidence,
+        part.zone, part.vehicles, part.flags, part.cropX, part.cropY, Date.now()
+      );
+      row = { received: 0, complete: 0 };
+    }
+
+    if (row.complete) return 200;
+    if (part.offset > row.received) return 409;
+
+    // A re-sent part overlaps what we have; keep only the new bytes
+    const fresh = part.data.subarray(row.received - part.offset);
+    if (fresh.length === 0) return 200;
+
+    db.prepare(`
+      INSERT INTO device_image_parts (site, image_seq, part_offset, data) VALUES (?, ?, ?, ?)
+    `).run(part.site, part.seq, row.received, fresh);
+
+    const received = row.received + fresh.length;
+    const complete = received === part.size;
+
+    // Once, at the end: the CRC over the parts in order
+    const crcOf = parts => parts.reduce((crc, data) => crc32(data, crc), 0);
+    if (complete && crcOf(imageParts(part.site, part.seq)) !== part.crc) {
+      deleteImage(part.site, part.seq);
+      return 409;
+    }
+
+    db.prepare(`
+      UPDATE device_images SET received = ?, complete = ?, received_at = ?
+      WHERE site = ? AND image_seq = ?
+    `).run(received, complete ? 1 : 0, Date.now(), part.site, part.seq);
+    return complete ? 201 : 200;
+  })();
+}
+
+// ============================================================================
+// Binary Telemetry
+// ============================================================================
+// Compact stats upload (TelemetryEncoder in the firmware), an alternative to
+// the JSON body of POST /api/detections; decoded in telemetry.js
+function parseTelemetry(buf) {
+  return decodeTelemetry(buf, id =>
+    db.prepare('SELECT name, latitude, longitude FROM sites WHERE id = ?').get(id));
+}
+
 // ============================================================================
 // Middleware
 // ============================================================================
@@ -178,7 +709,101 @@ app.get('/health', (req, res) => {
 });
 
 // POST /api/detections - Receive detection data from ESP32-CAM
-app.post('/api/detections', requireApiKey, (req, res) => {
+function storeMetricSummary(site, metrics) {
+  if (!metrics || !metrics.interval_ms) return;
+
+  db.prepare(`
+    INSERT INTO metric_summaries (
+      site, received_at, interval_ms, vehicles,
+      headway_ms, gap_ms, speed_dkmh, confidence
+    ) VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+  `).run(
+    site,
+    Date.now(),
+    metrics.interval_ms,
+    metrics.vehicles || 0,
+    JSON.stringify(metrics.headway_ms || null),
+    JSON.stringify(metrics.gap_ms || null),
+    JSON.stringify(metrics.speed_dkmh || null),
+    JSON.stringify(metrics.confidence || null)
+  );
+}
+
+// Radio-on time since the device's last report (power saving)
+function storeRadioStats(site, radio) {
+  if (!radio || !radio.period_ms) return;
+
+  db.prepare(`
+    INSERT INTO device_radio (
+      site, received_at, period_ms, active_ms, awake_ms, wakes,
+      health, tau_s, active_time_s, edrx_ms
+    ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+  `).run(
+    site,
+    Date.now(),
+    radio.period_ms,
+    radio.active_ms || 0,
+    radio.awake_ms || 0,
+    radio.wakes || 0,
+    radio.health || 0,
+    radio.tau_s || 0,
+    radio.active_time_s || 0,
+    radio.edrx_ms || 0
+  );
+}
+
+// Body is JSON, or a binary telemetry record (application/octet-stream)
+// carrying one interval or a batch of them
+app.post('/api/detections', requireApiKey, express.raw({ type: 'application/octet-stream', limit: '64kb' }), (req, res) => {
+  let body = req.body;
+  if (Buffer.isBuffer(body)) {
+    try {
+      body = parseTelemetry(body);
+    } catch (error) {
+      return res.status(400).json({ error: error.message });
+    }
+  }
+
+  if (body.records) {
+    if (body.records.length === 0) {
+      return res.status(400).json({ error: 'No intervals' });
+    }
+
+    try {
+      // Without network time, place intervals by their age on the device clock
+      const now = Date.now();
+      const newest = body.records[body.records.length - 1];
+      const records = body.records.map(r => Object.assign({}, r, {
+        recordedAt: r.recordedAt || now - ((newest.timestamp - r.timestamp) >>> 0)
+      }));
+
+      let stored = 0;
+      db.transaction(() => {
+        stored = storeIntervals(body.site, records, false, body.lat, body.lon);
+        upsertSite(body.site, body.lat, body.lon);
+        storeMetricSummary(body.site, body.metrics);
+        storeRadioStats(body.site, body.radio);
+      })();
+
+      if (pendingHeatmapRequests.has(body.site)) {
+        res.set('X-SwanFlow-Request', 'heatmap');
+      }
+
+      res.status(201).json({
+        success: true,
+        stored,
+        duplicates: records.length - stored
+      });
+
+      console.log(`Recorded ${stored} intervals from ${body.site}: ${newest.totalCount} total vehicles`);
+
+    } catch (error) {
+      console.error('Database error:', error);
+      res.status(500).json({ error: 'Database error' });
+    }
+    return;
+  }
+
   const {
     site,
     lat,
@@ -189,7 +814,7 @@ app.post('/api/detections', requireApiKey, (req, res) => {
     minute_count,
     avg_confidence,
     uptime
-  } = req.body;
+  } = body;
 
   // Validate required fields
   if (!site || !timestamp || total_count === undefined) {
@@ -197,37 +822,68 @@ app.post('/api/detections', requireApiKey, (req, res) => {
   }
 
   try {
-    // Insert detection record
-    const stmt = db.prepare(`
+    // Placed at the device's wall-clock time when it knew it (binary
+    // version 1 with Unix time), as storeIntervals() does for batches
+    const insert = db.prepare(`
       INSERT INTO detections (
         site, latitude, longitude, timestamp,
         total_count, hour_count, minute_count,
-        avg_confidence, uptime
-      ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+        avg_confidence, uptime, created_at
+      ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, COALESCE(?, CURRENT_TIMESTAMP))
     `);
+    const createdAt = body.recorded_at
+      ? new Date(body.recorded_at).toISOString().replace('T', ' ').slice(0, 19)
+      : null;
+
+    // The interval is noted (so a later replay of it is recognised) in the
+    // same transaction as its row: if the insert fails, so does the note,
+    // and the device's retry is stored rather than taken for a duplicate
+    const { interval, stream } = body;
+    const result = db.transaction(() => {
+      if (interval !== undefined && stream !== undefined) {
+        const isNew = recordInterval(site, {
+          interval, stream,
+          recordedAt: body.recorded_at || Date.now(),
+          totalCount: total_count,
+          hourCount: hour_count || 0,
+          minuteCount: minute_count || 0,
+          avgConfidence: avg_confidence || 0,
+          uptime: uptime || 0
+        }, false);
+        if (!isNew) return null;
+      }
 
-    const result = stmt.run(
-      site,
-      lat || null,
-      lon || null,
-      timestamp,
-      total_count,
-      hour_count || 0,
-      minute_count || 0,
-      avg_confidence || 0,
-      uptime || 0
-    );
+      const inserted = insert.run(
+        site,
+        lat || null,
+        lon || null,
+        timestamp,
+        total_count,
+        hour_count || 0,
+        minute_count || 0,
+        avg_confidence || 0,
+        uptime || 0,
+        createdAt
+      );
+      upsertSite(site, lat, lon);
 
-    // Upsert site info
-    const siteStmt = db.prepare(`
-      INSERT INTO sites (name, latitude, longitude)
-      VALUES (?, ?, ?)
-      ON CONFLICT(name) DO UPDATE SET
-        latitude = excluded.latitude,
-        longitude = excluded.longitude
-    `);
+      // Per-interval distributions (headway, gap, speed, confidence)
+      storeMetricSummary(site, body.metrics);
+      storeRadioStats(site, body.radio);
+      return inserted;
+    })();
 
-    siteStmt.run(site, lat || null, lon || null);
+    if (!result) {
+      return res.status(200).json({
+        success: true,
+        duplicate: true,
+        message: 'Interval already recorded'
+      });
+    }
+
+    if (pendingHeatmapRequests.has(site)) {
+      res.set('X-SwanFlow-Request', 'heatmap');
+    }
 
     res.status(201).json({
       success: true,
@@ -243,6 +899,239 @@ app.post('/api/detections', requireApiKey, (req, res) => {
   }
 });
 
+// POST /api/detections/batch - Intervals replayed from the device's SD card
+// after an outage, oldest first ("SFIB", or "SFTM" telemetry). Intervals
+// already received are skipped.
+app.post('/api/detections/batch', requireApiKey, express.raw({ type: 'application/octet-stream', limit: '1mb' }), (req, res) => {
+  let batch;
+  try {
+    const isTelemetry = Buffer.isBuffer(req.body) && req.body.toString('ascii', 0, 4) === 'SFTM';
+    batch = isTelemetry ? parseTelemetry(req.body) : parseIntervalBatch(req.body);
+    if (!batch.records) throw new Error('Not an interval batch');
+  } catch (error) {
+    return res.status(400).json({ error: error.message });
+  }
+
+  try {
+    const stored = storeIntervals(batch.site, batch.records, true, batch.lat, batch.lon);
+
+    res.status(201).json({
+      success: true,
+      stored,
+      duplicates: batch.records.length - stored
+    });
+
+    console.log(`Replayed ${stored} intervals from ${batch.site}`);
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// POST /api/rollups - Backfill per-period counts recorded on the device's SD
+// card while it was offline. Re-sent periods replace earlier copies.
+app.post('/api/rollups', requireApiKey, express.raw({ type: 'application/octet-stream', limit: '1mb' }), (req, res) => {
+  let batch;
+  try {
+    batch = parseRollupBatch(req.body);
+  } catch (error) {
+    return res.status(400).json({ error: error.message });
+  }
+
+  try {
+    const insert = db.prepare(`
+      INSERT OR REPLACE INTO detection_rollups (
+        site, period_start, period_minutes, vehicles, peak_minute, coverage
+      ) VALUES (?, ?, ?, ?, ?, ?)
+    `);
+
+    db.transaction(() => {
+      for (const r of batch.records) {
+        insert.run(batch.site, r.periodStart, batch.minutes, r.vehicles, r.peakMinute, r.coverage);
+      }
+    })();
+
+    res.status(201).json({
+      success: true,
+      stored: batch.records.length,
+      rejected: batch.count - batch.records.length
+    });
+
+    console.log(`Backfilled ${batch.records.length} ${batch.minutes}-minute rollups from ${batch.site}`);
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// GET /api/rollups/:site - Get backfilled count history
+app.get('/api/rollups/:site', (req, res) => {
+  const { site } = req.params;
+  const { minutes = 1, hours = 24 } = req.query;
+
+  try {
+    const rollups = db.prepare(`
+      SELECT period_start, vehicles, peak_minute, coverage FROM detection_rollups
+      WHERE site = ? AND period_minutes = ? AND period_start > ?
+      ORDER BY period_start
+    `).all(site, parseInt(minutes), Date.now() - parseInt(hours) * 60 * 60 * 1000);
+
+    res.json({
+      success: true,
+      site,
+      period_minutes: parseInt(minutes),
+      count: rollups.length,
+      rollups
+    });
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// POST /api/heatmap/:site/request - Ask a device for its calibration heatmap
+app.post('/api/heatmap/:site/request', requireApiKey, (req, res) => {
+  pendingHeatmapRequests.add(req.params.site);
+  res.json({ success: true, message: 'Heatmap will be sent after the next stats upload' });
+});
+
+// POST /api/heatmap - Calibration heatmap from a device
+app.post('/api/heatmap', requireApiKey, express.raw({ type: 'application/octet-stream', limit: '64kb' }), (req, res) => {
+  let heatmap;
+  try {
+    heatmap = parseHeatmap(req.body);
+  } catch (error) {
+    return res.status(400).json({ error: error.message });
+  }
+
+  try {
+    const result = db.prepare(`
+      INSERT INTO heatmaps (
+        site, received_at, seconds, frame_width, frame_height, line_y, cols, rows, cells
+      ) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+    `).run(
+      heatmap.site,
+      Date.now(),
+      heatmap.seconds,
+      heatmap.frameWidth,
+      heatmap.frameHeight,
+      heatmap.lineY,
+      heatmap.cols,
+      heatmap.rows,
+      JSON.stringify(heatmap.cells)
+    );
+
+    pendingHeatmapRequests.delete(heatmap.site);
+    res.status(201).json({ success: true, id: result.lastInsertRowid });
+
+    console.log(`Received heatmap from ${heatmap.site} (${Math.round(heatmap.seconds / 3600)} h)`);
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// GET /api/heatmap/:site - Latest calibration heatmap
+app.get('/api/heatmap/:site', (req, res) => {
+  try {
+    const row = db.prepare(`
+      SELECT * FROM heatmaps WHERE site = ? ORDER BY received_at DESC LIMIT 1
+    `).get(req.params.site);
+
+    if (!row) {
+      return res.status(404).json({
+        error: 'No heatmap received',
+        pending: pendingHeatmapRequests.has(req.params.site)
+      });
+    }
+
+    res.json({
+      success: true,
+      site: row.site,
+      received_at: row.received_at,
+      seconds: row.seconds,
+      frame_width: row.frame_width,
+      frame_height: row.frame_height,
+      line_y: row.line_y,
+      cols: row.cols,
+      rows: row.rows,
+      cells: JSON.parse(row.cells)
+    });
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// POST /api/images - One part of a stored detection image
+app.post('/api/images', requireApiKey, express.raw({ type: 'application/octet-stream', limit: '64kb' }), (req, res) => {
+  let part;
+  try {
+    part = parseImagePart(req.body);
+  } catch (error) {
+    return res.status(400).json({ error: error.message });
+  }
+
+  try {
+    const status = storeImagePart(part);
+    if (status === 409) {
+      return res.status(409).json({ error: 'Missing earlier parts; resend the image from the start' });
+    }
+
+    res.status(status).json({ success: true, received: part.offset + part.data.length });
+
+    if (status === 201) {
+      console.log(`Received image ${part.seq} from ${part.site} (${part.size} bytes)`);
+    }
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// GET /api/images/:site - Complete images from a site, newest first
+app.get('/api/images/:site', (req, res) => {
+  const { limit = 50 } = req.query;
+
+  try {
+    const rows = db.prepare(`
+      SELECT image_seq, size, captured_at, min_confidence, max_confidence, zone,
+             vehicles, flags, crop_x, crop_y, received_at
+      FROM device_images WHERE site = ? AND complete = 1
+      ORDER BY image_seq DESC LIMIT ?
+    `).all(req.params.site, parseInt(limit));
+
+    res.json({ success: true, site: req.params.site, images: rows });
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// GET /api/images/:site/:seq - The JPEG itself
+app.get('/api/images/:site/:seq', (req, res) => {
+  try {
+    const jpeg = loadImage(req.params.site, parseInt(req.params.seq));
+
+    if (!jpeg) {
+      return res.status(404).json({ error: 'Image not found' });
+    }
+
+    res.type('image/jpeg').send(jpeg);
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
 // GET /api/detections - Get detection history
 app.get('/api/detections', (req, res) => {
   const { site, limit = 100, offset = 0 } = req.query;
@@ -360,6 +1249,102 @@ app.get('/api/stats/:site', (req, res) => {
   }
 });
 
+// GET /api/metrics/:site - Merged headway/gap/speed/confidence distributions
+app.get('/api/metrics/:site', (req, res) => {
+  const { site } = req.params;
+  const { period = '24h' } = req.query;
+
+  try {
+    let hours = 24;
+    if (period === '1h') hours = 1;
+    else if (period === '6h') hours = 6;
+    else if (period === '7d') hours = 24 * 7;
+    else if (period === '30d') hours = 24 * 30;
+
+    const rows = db.prepare(`
+      SELECT * FROM metric_summaries
+      WHERE site = ? AND received_at > ?
+    `).all(site, Date.now() - hours * 60 * 60 * 1000);
+
+    if (rows.length === 0) {
+      return res.status(404).json({ error: 'No metrics found for site' });
+    }
+
+    const column = name => rows.map(row => JSON.parse(row[name]));
+
+    // Confidence is a fixed 20-bin (5%) linear histogram: merge by summing
+    const confidence = new Array(20).fill(0);
+    for (const bins of column('confidence')) {
+      if (Array.isArray(bins)) bins.forEach((count, i) => { confidence[i] += count; });
+    }
+
+    res.json({
+      success: true,
+      site,
+      period,
+      intervals: rows.length,
+      vehicles: rows.reduce((sum, row) => sum + row.vehicles, 0),
+      headway_s: summarizeHistograms(column('headway_ms'), 0.001),
+      gap_s: summarizeHistograms(column('gap_ms'), 0.001),
+      speed_kmh: summarizeHistograms(column('speed_dkmh'), 0.1),
+      confidence
+    });
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// GET /api/radio/:site - Radio duty cycle (power saving)
+app.get('/api/radio/:site', (req, res) => {
+  const { site } = req.params;
+  const { period = '24h' } = req.query;
+
+  try {
+    let hours = 24;
+    if (period === '1h') hours = 1;
+    else if (period === '6h') hours = 6;
+    else if (period === '7d') hours = 24 * 7;
+    else if (period === '30d') hours = 24 * 30;
+
+    const rows = db.prepare(`
+      SELECT * FROM device_radio
+      WHERE site = ? AND received_at > ?
+      ORDER BY received_at
+    `).all(site, Date.now() - hours * 60 * 60 * 1000);
+
+    if (rows.length === 0) {
+      return res.status(404).json({ error: 'No radio stats found for site' });
+    }
+
+    const sum = name => rows.reduce((total, row) => total + row[name], 0);
+    const periodMs = sum('period_ms');
+    const latest = rows[rows.length - 1];
+
+    res.json({
+      success: true,
+      site,
+      period,
+      reports: rows.length,
+      period_s: Math.round(periodMs / 1000),
+      active_s: Math.round(sum('active_ms') / 1000),
+      awake_s: Math.round(sum('awake_ms') / 1000),
+      active_ratio: periodMs ? sum('active_ms') / periodMs : null,
+      awake_ratio: periodMs ? sum('awake_ms') / periodMs : null,
+      wakes: sum('wakes'),
+      health: latest.health,
+      tau_s: latest.tau_s,
+      active_time_s: latest.active_time_s,
+      edrx_ms: latest.edrx_ms
+    });
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
 // GET /api/stats/:site/hourly - Get hourly breakdown
 app.get('/api/stats/:site/hourly', (req, res) => {
   const { site } = req.params;
@@ -465,10 +1450,69 @@ app.get('/api/devices', (req, res) => {
   }
 });
 
-// GET /api/incidents - Get active simulated traffic incidents
+// POST /api/incidents - Receive queue/flow/blockage events from ESP32-CAM
+// Devices push these immediately, outside the regular stats upload interval
+app.post('/api/incidents', requireApiKey, (req, res) => {
+  const { site, type, zone, active, value, baseline, age_ms, stream, seq } = req.body;
+
+  if (!site || !type || active === undefined) {
+    return res.status(400).json({ error: 'Missing required fields' });
+  }
+
+  // Device clocks are uptime-based; convert the event age to wall-clock time
+  const eventTime = Date.now() - (age_ms || 0);
+  const zoneValue = zone === undefined ? null : zone;
+
+  try {
+    if (active) {
+      // A device resends an event whose response it didn't get: the same
+      // (site, stream, seq) is stored once. Older firmware sends neither.
+      const result = db.prepare(`
+        INSERT OR IGNORE INTO device_incidents (site, type, zone, value, baseline, started_at, stream, seq)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+      `).run(site, type, zoneValue, value || 0, baseline || 0, eventTime,
+             stream === undefined ? null : stream, seq === undefined ? null : seq);
+
+      if (result.changes === 0) {
+        return res.status(200).json({ success: true, duplicate: true });
+      }
+
+      console.log(`Incident raised at ${site}: ${type} (zone ${zoneValue ?? 'all'})`);
+      return res.status(201).json({ success: true, id: result.lastInsertRowid });
+    }
+
+    const result = db.prepare(`
+      UPDATE device_incidents SET cleared_at = ?
+      WHERE site = ? AND type = ? AND zone IS ? AND cleared_at IS NULL
+    `).run(eventTime, site, type, zoneValue);
+
+    console.log(`Incident cleared at ${site}: ${type} (zone ${zoneValue ?? 'all'})`);
+    res.status(200).json({ success: true, cleared: result.changes });
+
+  } catch (error) {
+    console.error('Database error:', error);
+    res.status(500).json({ error: 'Database error' });
+  }
+});
+
+// GET /api/incidents - Get active traffic incidents (simulated and device-reported)
 app.get('/api/incidents', (req, res) => {
   try {
-    const incidents = Array.from(activeIncidents.values());
+    const deviceIncidents = db.prepare(`
+      SELECT * FROM device_incidents WHERE cleared_at IS NULL ORDER BY started_at DESC
+    `).all().map(row => ({
+      id: `device-${row.id}`,
+      source: 'device',
+      site: row.site,
+      type: row.type,
+      zone: row.zone,
+      value: row.value,
+      baseline: row.baseline,
+      startTime: row.started_at,
+      severity: row.type === 'blockage' ? 'high' : row.type === 'queue' ? 'medium' : 'low'
+    }));
+
+    const incidents = [...Array.from(activeIncidents.values()), ...deviceIncidents];
 
     // Calculate summary
     const bySeverity = {
@@ -511,7 +1555,7 @@ app.get('*', (req, res) => {
 // ============================================================================
 // Server Start
 // ============================================================================
-app.listen(PORT, () => {
+const server = app.listen(PORT, () => {
   console.log(`\n=================================`);
   console.log(`SwanFlow API`);
   console.log(`=================================`);
@@ -522,17 +1566,30 @@ app.listen(PORT, () => {
   console.log(`  GET  /health`);
   console.log(`  POST /api/detections (requires API key)`);
   console.log(`  GET  /api/detections`);
+  console.log(`  POST /api/detections/batch (requires API key)`);
+  console.log(`  POST /api/rollups (requires API key)`);
+  console.log(`  GET  /api/rollups/:site`);
+  console.log(`  POST /api/heatmap/:site/request (requires API key)`);
+  console.log(`  POST /api/heatmap (requires API key)`);
+  console.log(`  GET  /api/heatmap/:site`);
   console.log(`  GET  /api/sites`);
   console.log(`  GET  /api/stats/:site`);
   console.log(`  GET  /api/stats/:site/hourly`);
+  console.log(`  GET  /api/metrics/:site`);
   console.log(`  GET  /api/devices (simulated device states)`);
-  console.log(`  GET  /api/incidents (simulated traffic incidents)`);
+  console.log(`  POST /api/incidents (requires API key)`);
+  console.log(`  GET  /api/incidents (simulated and device-reported incidents)`);
   console.log(`=================================\n`);
 
   // Start live traffic simulator for arterial roads
   startSimulator();
 });
 
+// Devices keep one connection open between uploads (every 60 s), so idle
+// connections must outlive that (firmware HTTP_KEEPALIVE_IDLE_MS is 90 s)
+server.keepAliveTimeout = 120000;
+server.headersTimeout = 125000;
+
 // Graceful shutdown
 process.on('SIGINT', () => {
   console.log('\nShutting down gracefully...');
@@ -0,0 +1,256 @@
+/**
+ * MQTT-SN Gateway
+ * Receives telemetry published by devices over MQTT-SN (UDP) and forwards
+ * it to the API, so the firmware's MQTTSN_ENABLED path can be run and
+ * measured against a local backend without a live network.
+ *
+ * Implements the subset the firmware uses: CONNECT, PUBLISH at QoS 0/1 to
+ * short topic names, PINGREQ and DISCONNECT. Each publish becomes one
+ * POST; the PUBACK carries the outcome (0 stored, 1 backend unavailable,
+ * 3 refused). A resent PUBLISH with an ID already answered gets the same
+ * PUBACK again without a second POST.
+ *
+ * Usage: BACKEND_URL=http://localhost:3000 API_KEY=... node scripts/mqttsn-gateway.js
+ */
+
+const dgram = require('dgram');
+
+const PORT = parseInt(process.env.MQTTSN_PORT || '1885', 10);
+const BACKEND_URL = process.env.BACKEND_URL || 'http://localhost:3000';
+const API_KEY = process.env.API_KEY || 'dev_key_change_in_production';
+
+// Short topic names (firmware lte_modem.cpp) and their routes
+const TOPICS = {
+  st: '/api/detections',
+  sb: '/api/detections/batch'
+};
+const REQUEST_TOPIC = 'rq';
+
+const CONNECT = 0x04;
+const CONNACK = 0x05;
+const REGISTER = 0x0A;
+const REGACK = 0x0B;
+const PUBLISH = 0x0C;
+const PUBACK = 0x0D;
+const PINGREQ = 0x16;
+const PINGRESP = 0x17;
+const DISCONNECT = 0x18;
+
+const RC_ACCEPTED = 0x00;
+const RC_CONGESTION = 0x01;
+const RC_INVALID_TOPIC = 0x02;
+const RC_NOT_SUPPORTED = 0x03;
+
+// Length (one byte, or 0x01 and BE16), type, body
+function packet(type, body) {
+  const total = body.length + 2;
+  if (total <= 255) {
+    return Buffer.concat([Buffer.from([total, type]), body]);
+  }
+  const header = Buffer.from([0x01, (total + 2) >> 8, (total + 2) & 0xFF, type]);
+  return Buffer.concat([header, body]);
+}
+
+// Messages in a datagram as { type, body }; null if malformed
+function parsePackets(buf) {
+  const packets = [];
+  let offset = 0;
+  while (offset < buf.length) {
+    let total = buf[offset];
+    let headerLength = 1;
+    if (total === 0x01) {
+      if (offset + 3 > buf.length) return null;
+      total = buf.readUInt16BE(offset + 1);
+      headerLength = 3;
+    }
+    if (total < headerLength + 1 || offset + total > buf.length) return null;
+    packets.push({
+      type: buf[offset + headerLength],
+      body: buf.subarray(offset + headerLength + 1, offset + total)
+    });
+    offset += total;
+  }
+  return packets;
+}
+
+function createGateway(options = {}) {
+  const backendUrl = options.backendUrl || BACKEND_URL;
+  const apiKey = options.apiKey || API_KEY;
+  const log = options.log || console.log;
+
+  const socket = dgram.createSocket('udp4');
+  const sessions = new Map();  // "address:port" -> session
+  const stats = { publishes: 0, forwarded: 0, duplicates: 0, failed: 0, bytesIn: 0, bytesOut: 0 };
+
+  function send(rinfo, type, body) {
+    const buf = packet(type, body);
+    stats.bytesOut += buf.length;
+    socket.send(buf, rinfo.port, rinfo.address);
+  }
+
+  function puback(rinfo, topic, msgId, rc) {
+    const body = Buffer.alloc(5);
+    topic.copy(body, 0);
+    body.writeUInt16BE(msgId, 2);
+    body[4] = rc;
+    send(rinfo, PUBACK, body);
+  }
+
+  async function forward(session, route, data) {
+    const started = Date.now();
+    try {
+      const response = await fetch(backendUrl + route, {
+        method: 'POST',
+        headers: {
+          'Authorization': `Bearer ${apiKey}`,
+          'Content-Type': 'application/octet-stream'
+        },
+        body: data
+      });
+      await response.arrayBuffer();
+      log(`${session.clientId}: ${data.length} bytes -> ${route} ${response.status} (${Date.now() - started} ms)`);
+
+      if (response.ok) {
+        return { rc: RC_ACCEPTED, request: response.headers.get('x-swanflow-request') };
+      }
+      return { rc: response.status < 500 ? RC_NOT_SUPPORTED : RC_CONGESTION };
+    } catch (error) {
+      log(`${session.clientId}: backend unavailable (${error.message})`);
+      return { rc: RC_CONGESTION };
+    }
+  }
+
+  async function handlePublish(rinfo, session, body) {
+    // Flags, topic (2), message ID (BE16), data
+    if (body.length < 5) return;
+    const flags = body[0];
+    const qos = (flags >> 5) & 0x03;
+    const topic = body.subarray(1, 3);
+    const msgId = body.readUInt16BE(3);
+    const data = body.subarray(5);
+    const route = (flags & 0x03) === 0x02 ? TOPICS[topic.toString('ascii')] : undefined;
+
+    stats.publishes++;
+    if (qos === 1 && !session) {
+      // No session (the gateway restarted, or it expired): reconnect first
+      send(rinfo, DISCONNECT, Buffer.alloc(0));
+      return;
+    }
+    if (!route) {
+      if (qos === 1) puback(rinfo, topic, msgId, RC_INVALID_TOPIC);
+      return;
+    }
+
+    if (qos === 1 && session.msgId === msgId) {
+      // Resent before or after its answer: answer once it is known
+      stats.duplicates++;
+      if (session.rc !== undefined) puback(rinfo, topic, msgId, session.rc);
+      return;
+    }
+    if (qos === 1) {
+      session.msgId = msgId;
+      session.rc = undefined;
+    }
+
+    const result = await forward(session || { clientId: rinfo.address }, route, data);
+    if (result.rc === RC_ACCEPTED) {
+      stats.forwarded++;
+    } else {
+      stats.failed++;
+    }
+
+    // A request from the backend goes out before the PUBACK, so the
+    // device sees it while still waiting
+    if (result.request) {
+      const request = Buffer.concat([
+        Buffer.from([0x02]),  // QoS 0, short topic name
+        Buffer.from(REQUEST_TOPIC, 'ascii'),
+        Buffer.from([0, 0]),
+        Buffer.from(result.request, 'ascii')
+      ]);
+      send(rinfo, PUBLISH, request);
+    }
+
+    if (qos === 1) {
+      session.rc = result.rc;
+      puback(rinfo, topic, msgId, result.rc);
+    }
+  }
+
+  socket.on('message', (buf, rinfo) => {
+    stats.bytesIn += buf.length;
+    const key = `${rinfo.address}:${rinfo.port}`;
+    const packets = parsePackets(buf);
+    if (!packets) return;
+
+    let session = sessions.get(key);
+    if (session && Date.now() - session.lastSeen > session.keepAliveMs * 1.5) {
+      sessions.delete(key);
+      session = undefined;
+    }
+    if (session) session.lastSeen = Date.now();
+
+    for (const { type, body } of packets) {
+      switch (type) {
+        case CONNECT: {
+          // Flags, protocol ID, keep-alive (BE16), client ID
+          if (body.length < 4) break;
+          session = {
+            clientId: body.subarray(4).toString('ascii') || key,
+            keepAliveMs: body.readUInt16BE(2) * 1000 || Infinity,
+            lastSeen: Date.now(),
+            msgId: undefined,
+            rc: undefined
+          };
+          sessions.set(key, session);
+          send(rinfo, CONNACK, Buffer.from([RC_ACCEPTED]));
+          log(`${session.clientId} connected from ${key}`);
+          break;
+        }
+
+        case PUBLISH:
+          handlePublish(rinfo, session, body);
+          break;
+
+        case REGISTER:
+          // Short topic names only
+          if (body.length >= 4) {
+            send(rinfo, REGACK, Buffer.from([0, 0, body[2], body[3], RC_NOT_SUPPORTED]));
+          }
+          break;
+
+        case PINGREQ:
+          send(rinfo, PINGRESP, Buffer.alloc(0));
+          break;
+
+        case DISCONNECT:
+          sessions.delete(key);
+          session = undefined;
+          send(rinfo, DISCONNECT, Buffer.alloc(0));
+          break;
+
+        default:
+          break;
+      }
+    }
+  });
+
+  socket.stats = stats;
+  return socket;
+}
+
+module.exports = { createGateway, packet, parsePackets };
+
+if (require.main === module) {
+  const gateway = createGateway();
+  gateway.bind(PORT, () => {
+    console.log(`MQTT-SN gateway on udp/${PORT}, forwarding to ${BACKEND_URL}`);
+  });
+
+  process.on('SIGINT', () => {
+    const s = gateway.stats;
+    console.log(`\n${s.publishes} publishes, ${s.forwarded} forwarded, ${s.duplicates} duplicates, ` +
+                `${s.failed} failed; ${s.bytesIn} bytes in, ${s.bytesOut} out`);
+    process.exit(0);
+  });
+}
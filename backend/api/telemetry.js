@@ -0,0 +1,234 @@
+/**
+ * SwanFlow - Binary Telemetry Decoding
+ *
+ * Reads the "SFTM" records of TelemetryEncoder and the LZ4 blocks of
+ * LzCompressor (firmware src/telemetry.*, src/lz_block.*). Kept apart
+ * from index.js so the firmware host tests can decode what the encoder
+ * writes (firmware test/telemetry_decode.js).
+ */
+
+// Layout (an alternative to the JSON body of POST /api/detections).
+// Integers are unsigned varints.
+//   "SFTM", version, flags, then the body; with TELEMETRY_LZ the body's
+//   length and the body as an LZ4 block
+// Version 2 body: site ID (sites.id), stream (LE32), interval count, then
+//   per interval: number, device millis, uptime, total, hour and minute
+//   counts, avg confidence (per mille), [unix seconds]. The first interval
+//   is sent as is; later ones as zigzag deltas from the one before, with
+//   clocks as the change in their step. Then [metrics], [SD writer],
+//   [network], [radio].
+// Version 1 body (one interval): site ID, interval, stream (LE32), then
+//   the interval fields as plain varints, [metrics], [SD writer], [network]
+// metrics: seq, interval ms, vehicles, headway/gap/speed histograms as
+// samples, sum, bucket count, (gap from previous bucket, count) pairs,
+// then 20 confidence bins.
+// radio: period, radio-on and awake ms, wakes, link health (0-100),
+// granted TAU and active time (s), eDRX cycle (ms; 0 = off).
+const TELEMETRY_METRICS = 0x01;
+const TELEMETRY_SD = 0x02;
+const TELEMETRY_NET = 0x04;
+const TELEMETRY_EPOCH = 0x08;
+const TELEMETRY_LZ = 0x10;
+const TELEMETRY_RADIO = 0x20;
+
+// LZ4 block format: sequences of token, literals, offset (LE16), match
+function lz4Decode(src, rawLength) {
+  const out = Buffer.alloc(rawLength);
+  let ip = 0;
+  let op = 0;
+
+  const length = base => {
+    let len = base;
+    if (base === 15) {
+      let b;
+      do {
+        if (ip >= src.length) throw new Error('Truncated LZ block');
+        b = src[ip++];
+        len += b;
+      } while (b === 255);
+    }
+    return len;
+  };
+
+  while (ip < src.length) {
+    const token = src[ip++];
+    const literals = length(token >> 4);
+    if (ip + literals > src.length || op + literals > rawLength) throw new Error('Bad LZ block');
+    src.copy(out, op, ip, ip + literals);
+    ip += literals;
+    op += literals;
+    if (ip === src.length) break;
+
+    if (ip + 2 > src.length) throw new Error('Truncated LZ block');
+    const offset = src.readUInt16LE(ip);
+    ip += 2;
+    const match = length(token & 15) + 4;
+    if (offset === 0 || offset > op || op + match > rawLength) throw new Error('Bad LZ block');
+    for (let i = 0; i < match; i++, op++) out[op] = out[op - offset];
+  }
+
+  if (op !== rawLength) throw new Error('Bad LZ block');
+  return out;
+}
+
+// Version 1 returns a body shaped like the JSON upload; version 2 returns
+// { site, lat, lon, records, metrics, sd, net } with records shaped like
+// parseIntervalBatch()'s. findSite(id) returns the sites row
+// ({ name, latitude, longitude }) for a site ID, or undefined.
+function decodeTelemetry(buf, findSite) {
+  if (buf.length < 6 || buf.toString('ascii', 0, 4) !== 'SFTM' || (buf[4] !== 1 && buf[4] !== 2)) {
+    throw new Error('Not a telemetry record');
+  }
+
+  const version = buf[4];
+  const flags = buf[5];
+  let data = buf;
+  let offset = 6;
+
+  const varint = () => {
+    let value = 0;
+    for (let shift = 0; shift < 35; shift += 7) {
+      if (offset >= data.length) throw new Error('Truncated telemetry record');
+      const b = data[offset++];
+      value += (b & 0x7F) * Math.pow(2, shift);
+      if (!(b & 0x80)) return value;
+    }
+    throw new Error('Bad varint');
+  };
+
+  const uint32 = () => {
+    if (offset + 4 > data.length) throw new Error('Truncated telemetry record');
+    offset += 4;
+    return data.readUInt32LE(offset - 4);
+  };
+
+  // Zigzag delta added to a 32-bit value (wrapping like the device's)
+  const delta = base => {
+    const v = varint();
+    return (base + (v % 2 ? -(v + 1) / 2 : v / 2)) >>> 0;
+  };
+
+  const histogram = () => {
+    const hist = { n: varint(), sum: varint(), b: [] };
+    const used = varint();
+    let bucket = -1;
+    for (let i = 0; i < used; i++) {
+      bucket += varint() + 1;
+      hist.b.push(bucket, varint());
+    }
+    return hist;
+  };
+
+  if (flags & TELEMETRY_LZ) {
+    const rawLength = varint();
+    if (rawLength > 1024 * 1024) throw new Error('Telemetry record too large');
+    data = lz4Decode(buf.subarray(offset), rawLength);
+    offset = 0;
+  }
+
+  const siteId = varint();
+  const site = findSite(siteId);
+  if (!site) throw new Error(`Unknown site ID ${siteId}`);
+
+  const body = { site: site.name, lat: site.latitude, lon: site.longitude };
+
+  if (version === 1) {
+    body.interval = varint();
+    body.stream = uint32();
+    body.timestamp = varint();
+    body.uptime = varint();
+    body.total_count = varint();
+    body.hour_count = varint();
+    body.minute_count = varint();
+    body.avg_confidence = varint() / 1000;
+    if (flags & TELEMETRY_EPOCH) body.recorded_at = varint() * 1000;
+  } else {
+    const stream = uint32();
+    const count = varint();
+    if (count > 10000) throw new Error('Too many intervals');
+
+    body.records = [];
+    let p = null;
+    let timestampStep = 0;
+    let uptimeStep = 0;
+    let epochStep = 0;
+
+    for (let i = 0; i < count; i++) {
+      const r = { stream };
+      if (!p) {
+        r.interval = varint();
+        r.timestamp = varint();
+        r.uptime = varint();
+        r.totalCount = varint();
+        r.hourCount = varint();
+        r.minuteCount = varint();
+        r.confidence = varint();
+        r.epoch = flags & TELEMETRY_EPOCH ? varint() : 0;
+      } else {
+        r.interval = delta(p.interval + 1);
+        timestampStep = delta(timestampStep);
+        r.timestamp = (p.timestamp + timestampStep) >>> 0;
+        uptimeStep = delta(uptimeStep);
+        r.uptime = (p.uptime + uptimeStep) >>> 0;
+        r.totalCount = delta(p.totalCount);
+        r.hourCount = delta(p.hourCount);
+        r.minuteCount = delta(p.minuteCount);
+        r.confidence = delta(p.confidence);
+        if (flags & TELEMETRY_EPOCH) {
+          epochStep = delta(epochStep);
+          r.epoch = (p.epoch + epochStep) >>> 0;
+        } else {
+          r.epoch = 0;
+        }
+      }
+      body.records.push(r);
+      p = r;
+    }
+
+    body.records = body.records.map(r => ({
+      interval: r.interval,
+      stream: r.stream,
+      timestamp: r.timestamp,
+      recordedAt: r.epoch ? r.epoch * 1000 : null,
+      totalCount: r.totalCount,
+      hourCount: r.hourCount,
+      minuteCount: r.minuteCount,
+      avgConfidence: r.confidence / 1000,
+      uptime: r.uptime
+    }));
+  }
+
+  if (flags & TELEMETRY_METRICS) {
+    body.metrics = {
+      seq: varint(),
+      interval_ms: varint(),
+      vehicles: varint(),
+      headway_ms: histogram(),
+      gap_ms: histogram(),
+      speed_dkmh: histogram(),
+      confidence: Array.from({ length: 20 }, varint)
+    };
+  }
+
+  if (flags & TELEMETRY_SD) {
+    const [written, failed, dropped, queue, queue_max, p50_us, p95_us, p99_us] =
+      Array.from({ length: 8 }, varint);
+    body.sd = { written, failed, dropped, queue, queue_max, p50_us, p95_us, p99_us };
+  }
+
+  if (flags & TELEMETRY_NET) {
+    const [rtt_ms, connect_ms, sent, received, connects, reused, stale] =
+      Array.from({ length: 7 }, varint);
+    body.net = { rtt_ms, connect_ms, sent, received, connects, reused, stale };
+  }
+
+  if (flags & TELEMETRY_RADIO) {
+    const [period_ms, active_ms, awake_ms, wakes, health, tau_s, active_time_s, edrx_ms] =
+      Array.from({ length: 8 }, varint);
+    body.radio = { period_ms, active_ms, awake_ms, wakes, health, tau_s, active_time_s, edrx_ms };
+  }
+
+  return body;
+}
+
+module.exports = { lz4Decode, decodeTelemetry };
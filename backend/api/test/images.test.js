@@ -0,0 +1,212 @@
+/**
+ * SwanFlow - Image Part Upload Tests
+ *
+ * POST /api/images against the API started on a fresh database: images
+ * sent a part at a time come back byte for byte, a part resent after a
+ * lost reply (or overlapping what was received) isn't stored twice, a
+ * part past what was received gets 409, and an image is only complete
+ * once its size is reached with a matching CRC.
+ *
+ *   npm test
+ */
+
+const { test, before, after } = require('node:test');
+const assert = require('node:assert');
+const { spawn } = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const Database = require('better-sqlite3');
+
+const PORT = 3917;
+const API_KEY = 'test-key';
+const BASE = `http://127.0.0.1:${PORT}`;
+const SITE = 'Test Site';
+const PART = 4096;  // IMAGE_UPLOAD_PART in the firmware
+
+let server;
+let dir;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+function crc32(buf) {
+  let crc = -1;
+  for (let i = 0; i < buf.length; i++) {
+    crc ^= buf[i];
+    for (let k = 0; k < 8; k++) {
+      crc = crc & 1 ? 0xEDB88320 ^ (crc >>> 1) : crc >>> 1;
+    }
+  }
+  return (crc ^ -1) >>> 0;
+}
+
+// A JPEG-sized buffer whose bytes follow from seed
+function makeImage(size, seed) {
+  const buf = Buffer.alloc(size);
+  for (let i = 0; i < size; i++) buf[i] = (i * 31 + seed * 17 + (i >> 8)) & 0xFF;
+  return buf;
+}
+
+// The body LTEModem::uploadImage() sends
+function encodePart(seq, image, offset, length, { crc = crc32(image), size = image.length } = {}) {
+  const name = Buffer.from(SITE, 'utf8');
+  const header = Buffer.alloc(6 + name.length + 31);
+  header.write('SFIM', 0, 'ascii');
+  header[4] = 1;
+  header[5] = name.length;
+  name.copy(header, 6);
+  let p = 6 + name.length;
+  header.writeUInt32LE(seq, p);
+  header.writeUInt32LE(size, p + 4);
+  header.writeUInt32LE(offset, p + 8);
+  header.writeUInt32LE(crc, p + 12);
+  header.writeUInt32LE(1760000000, p + 16);
+  header.writeUInt32LE(123456, p + 20);
+  header.set([100, 240, 1, 2, 0x01, 3, 4], p + 24);
+  return Buffer.concat([header, image.subarray(offset, offset + length)]);
+}
+
+async function sendPart(seq, image, offset, length = PART, options) {
+  const res = await fetch(`${BASE}/api/images`, {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/octet-stream', Authorization: `Bearer ${API_KEY}` },
+    body: encodePart(seq, image, offset, length, options)
+  });
+  await res.arrayBuffer();
+  return res.status;
+}
+
+async function sendAll(seq, image) {
+  const statuses = [];
+  for (let offset = 0; offset < image.length; offset += PART) {
+    statuses.push(await sendPart(seq, image, offset));
+  }
+  return statuses;
+}
+
+async function getImage(seq) {
+  const res = await fetch(`${BASE}/api/images/${encodeURIComponent(SITE)}/${seq}`);
+  return { status: res.status, data: Buffer.from(await res.arrayBuffer()) };
+}
+
+async function listImages() {
+  const res = await fetch(`${BASE}/api/images/${encodeURIComponent(SITE)}`);
+  return (await res.json()).images;
+}
+
+// ============================================================================
+// Server
+// ============================================================================
+before(async () => {
+  dir = fs.mkdtempSync(path.join(os.tmpdir(), 'swanflow-api-'));
+  server = spawn(process.execPath, [path.join(__dirname, '..', 'index.js')], {
+    cwd: dir,
+    env: { ...process.env, PORT: String(PORT), API_KEY },
+    stdio: ['ignore', 'pipe', 'inherit']
+  });
+
+  await new Promise((resolve, reject) => {
+    let out = '';
+    server.stdout.on('data', chunk => {
+      out += chunk;
+      if (out.includes('Server running')) resolve();
+    });
+    server.on('exit', code => reject(new Error(`API exited (${code})`)));
+  });
+});
+
+after(() => {
+  server.kill();
+  fs.rmSync(dir, { recursive: true, force: true });
+});
+
+// ============================================================================
+// Tests
+// ============================================================================
+test('parts in order make the image, byte for byte', async () => {
+  const image = makeImage(3 * PART + 1000, 1);
+  assert.deepStrictEqual(await sendAll(1, image), [200, 200, 200, 201]);
+
+  const { status, data } = await getImage(1);
+  assert.strictEqual(status, 200);
+  assert.ok(data.equals(image));
+
+  const listed = (await listImages()).find(row => row.image_seq === 1);
+  assert.strictEqual(listed.size, image.length);
+  assert.strictEqual(listed.vehicles, 2);
+  assert.strictEqual(listed.crop_x, 24);
+});
+
+test('a part resent after a lost reply resumes at its offset', async () => {
+  const image = makeImage(3 * PART, 2);
+  assert.strictEqual(await sendPart(2, image, 0), 200);
+  assert.strictEqual(await sendPart(2, image, PART), 200);
+  assert.strictEqual((await getImage(2)).status, 404);  // Not complete yet
+
+  // The same part again, then one overlapping it: only new bytes are kept
+  assert.strictEqual(await sendPart(2, image, PART), 200);
+  assert.strictEqual(await sendPart(2, image, PART + PART / 2), 200);
+  assert.strictEqual(await sendPart(2, image, 2 * PART + PART / 2, PART / 2), 201);
+
+  assert.ok((await getImage(2)).data.equals(image));
+
+  // Each byte stored once, in a row of its own part
+  const db = new Database(path.join(dir, 'traffic-watch.db'), { readonly: true });
+  const parts = db.prepare(`
+    SELECT part_offset, length(data) AS length FROM device_image_parts
+    WHERE site = ? AND image_seq = 2 ORDER BY part_offset
+  `).all(SITE);
+  const row = db.prepare('SELECT length(data) AS length FROM device_images WHERE site = ? AND image_seq = 2').get(SITE);
+  db.close();
+  assert.deepStrictEqual(parts.map(part => [part.part_offset, part.length]),
+    [[0, PART], [PART, PART], [2 * PART, PART / 2], [2 * PART + PART / 2, PART / 2]]);
+  assert.strictEqual(row.length, 0);
+});
+
+test('a part past what was received gets 409', async () => {
+  const image = makeImage(3 * PART, 3);
+  assert.strictEqual(await sendPart(3, image, PART), 409);  // Nothing yet
+  assert.strictEqual(await sendPart(3, image, 0), 200);
+  assert.strictEqual(await sendPart(3, image, 2 * PART), 409);  // Skips one
+
+  // In order from where the server is, it completes
+  assert.strictEqual(await sendPart(3, image, PART), 200);
+  assert.strictEqual(await sendPart(3, image, 2 * PART), 201);
+  assert.ok((await getImage(3)).data.equals(image));
+});
+
+test('parts of a complete image change nothing', async () => {
+  const image = makeImage(2 * PART, 4);
+  assert.deepStrictEqual(await sendAll(4, image), [200, 201]);
+  assert.strictEqual(await sendPart(4, image, PART), 200);
+  assert.strictEqual(await sendPart(4, image, 0), 200);
+
+  assert.ok((await getImage(4)).data.equals(image));
+  assert.strictEqual((await listImages()).filter(row => row.image_seq === 4).length, 1);
+});
+
+test('an image is complete only at its size, with its CRC', async () => {
+  const image = makeImage(PART + 100, 5);
+
+  // Past the declared size: refused outright
+  assert.strictEqual(await sendPart(5, image, 0, PART + 100, { size: PART }), 400);
+
+  // Size reached but the CRC doesn't match: dropped, start again
+  const wrong = { crc: crc32(image) ^ 1 };
+  assert.strictEqual(await sendPart(5, image, 0, PART, wrong), 200);
+  assert.strictEqual(await sendPart(5, image, PART, PART, wrong), 409);
+  assert.strictEqual((await getImage(5)).status, 404);
+  assert.strictEqual(await sendPart(5, image, PART), 409);
+
+  assert.deepStrictEqual(await sendAll(5, image), [200, 201]);
+  assert.ok((await getImage(5)).data.equals(image));
+});
+
+test('a different image under the same seq replaces the old one', async () => {
+  const first = makeImage(2 * PART, 6);
+  const second = makeImage(PART + 10, 7);
+  assert.strictEqual(await sendPart(6, first, 0), 200);
+  assert.deepStrictEqual(await sendAll(6, second), [200, 201]);
+  assert.ok((await getImage(6)).data.equals(second));
+});
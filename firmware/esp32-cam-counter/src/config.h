@@ -31,6 +31,30 @@
 // Band 1 (2100MHz) - Urban
 #define LTE_BANDS "1,3,28"
 
+// TLS on the modem's own SSL stack. TLS_CA_CERT is the PEM of the CA that
+// signed the backend's certificate (Let's Encrypt: ISRG Root X1) and must
+// be set: while it is empty the modem refuses to set up TLS and nothing is
+// uploaded. With MODEM_TLS false, https URLs are sent in the clear.
+#define MODEM_TLS true
+#define TLS_CA_FILE "swanflow-ca.pem"  // Name on the modem's file system
+#define TLS_CA_CERT ""
+
+// LTE-M power saving (ModemPower). The network may grant other timers
+// than these; the granted ones are used and reported.
+// PSM: after MODEM_PSM_ACTIVE_S without traffic the modem sleeps (no AT,
+// no paging) until its next periodic TAU, MODEM_PSM_TAU_S later. This
+// board can't wake it sooner (no PWRKEY line), so uploads, incidents
+// included, wait for that wake window. Keep the TAU within
+// UPLOAD_BATCH_MAX minutes so the held intervals fit one batch.
+// eDRX: while idle the modem listens for paging once per cycle instead
+// of every 1.28 s; uploads aren't delayed.
+#define MODEM_PSM false
+#define MODEM_PSM_TAU_S 600             // Periodic TAU (T3412): the wake interval
+#define MODEM_PSM_ACTIVE_S 30           // Active time (T3324): reachable after traffic
+#define MODEM_EDRX true
+#define MODEM_EDRX_CYCLE_MS 81920       // Paging cycle (5120 to 10485760, doubling steps)
+#define MODEM_RRC_TAIL_MS 15000         // Radio stays connected this long after traffic
+
 // ============================================================================
 // CAMERA CONFIGURATION
 // ============================================================================
@@ -61,7 +85,65 @@
 // SD CARD CONFIGURATION
 // ============================================================================
 #define SD_CS_PIN 13  // ESP32-CAM default SD CS pin
-#define SD_BUFFER_SIZE 512
+#define SD_BUFFER_SIZE 512  // Sector size; event log writes are whole, aligned sectors
+
+// Count history (rollups) kept on SD for backfill after outages
+#define ROLLUP_FLUSH_MINUTES 5     // Write pending rollup sectors this often
+#define ROLLUP_BACKFILL_BATCH 256  // Records per backfill upload (16 bytes each)
+
+// Event log: stats and crossings appended to one preallocated file
+#define EVENT_LOG_SIZE_MB 256              // Ring size; oldest records are overwritten
+#define EVENT_LOG_CHECKPOINT_BYTES 65536   // Checkpoint at least this often, which
+#define EVENT_LOG_CHECKPOINT_RECORDS 64    // bounds the boot recovery scan
+
+// SD writer task: event log appends run on the other core, off the capture path.
+// Requests are queued without blocking and dropped if the queue is full.
+#define SD_WRITER_CORE 0                      // loop() (capture, inference) runs on core 1
+#define SD_WRITER_QUEUE_DEPTH 32              // Pending write requests
+#define SD_WRITER_MAX_PENDING_BYTES 262144    // Queued payload bytes before dropping
+#define SD_WRITER_FLUSH_MS 2000               // Longest staged data waits in RAM
+#define SD_WRITE_BUFFER_SECTORS 8             // Per staging buffer (two, DMA-capable RAM)
+// Task stack (bytes). Deepest path is storing a cropped image: the latency
+// histogram copy, the crop decoder's frames, then FATFS and the SDMMC
+// driver; a failure adds a printf. The least free stack seen is reported
+// with the stats (stack_free); raise this if it falls below 1 KB.
+#define SD_WRITER_STACK 8192
+
+// Detection images: fixed slots in one preallocated file under a byte quota,
+// with an on-card index. When full, the lowest-scoring image is replaced:
+// oldest first, but low-confidence frames (training data) and high-value
+// frames (busy or during an incident) each outlive the rest by
+// IMAGE_KEEP_BONUS_PERCENT of the store.
+#define IMAGE_STORE_MB 64                // Quota (the data file is this size)
+#define IMAGE_SLOT_KB 24                 // Largest JPEG kept (QVGA q12 is ~5-15KB)
+#define IMAGE_KEEP_BONUS_PERCENT 50
+#define IMAGE_LOW_CONFIDENCE_BELOW 0.75  // A detection below this = low confidence
+#define IMAGE_HIGH_VALUE_VEHICLES 3      // This many detections = high value
+#define IMAGE_MAINTAIN_ENTRIES 128       // Index entries swept per idle step
+
+// Keep only the part of the frame around the detections. Cropped in the
+// compressed domain (no decode/re-encode), widened to whole 16x8 MCUs.
+#define IMAGE_CROP true
+#define IMAGE_CROP_MARGIN_PX 16          // Context kept around the detection boxes
+
+// Training data capture: sampled whole frames plus their detections and
+// track IDs, logged to the event log for tools/export_training.py. Each
+// frame costs its JPEG size in the log ring (~10-20KB at QVGA), so the
+// hourly cap also bounds how fast it pushes out the upload backlog.
+#define TRAINING_CAPTURE false
+#define TRAINING_SAMPLE_UNIFORM true
+#define TRAINING_SAMPLE_LOW_CONFIDENCE true  // Below IMAGE_LOW_CONFIDENCE_BELOW
+#define TRAINING_SAMPLE_NEAR_CROSSING true
+#define TRAINING_SAMPLE_NIGHT true
+#define TRAINING_UNIFORM_INTERVAL_MS 300000  // Uniform: one frame this often
+#define TRAINING_NEAR_LINE_PX 20             // Near crossing: centre this close to the line
+#define TRAINING_MIN_GAP_MS 10000            // Between low-confidence/near-crossing frames
+#define TRAINING_NIGHT_PER_HOUR 6            // Night quota
+#define TRAINING_NIGHT_START_HOUR 19         // Local time (needs network time)
+#define TRAINING_NIGHT_END_HOUR 6
+#define TRAINING_UTC_OFFSET_HOURS 8          // Perth (AWST)
+#define TRAINING_MAX_PER_HOUR 30             // Uniform and triggered frames together...
+#define TRAINING_BURST 4                     // ...spread out, at most this many back to back
 
 // ============================================================================
 // VEHICLE DETECTION CONFIGURATION (FOMO)
@@ -70,14 +152,51 @@
 #define DETECTION_CONFIDENCE_THRESHOLD 0.6  // 60% confidence minimum
 #define MAX_DETECTIONS_PER_FRAME 10       // Max vehicles to track
 
-// Counting zone (pixels from top-left, for QVGA 320x240)
+// Counting zone (pixels from top-left, in CAMERA_FRAME_SIZE coordinates)
 // Define a "virtual line" that vehicles cross
 #define COUNTING_LINE_Y 120  // Middle of frame (horizontal line)
-#define COUNTING_ZONE_MARGIN 20  // Pixels above/below line
+#define COUNTING_ZONE_MARGIN 8   // Pixels above/below line
+// A vehicle is counted when one frame-to-frame step takes it from above
+// the margin to below it, and steps only match a track within 10% of the
+// frame height (24 px at QVGA): 2 x margin must stay under that
+#define COUNTING_ZONES 2     // Lanes: frame split into equal-width columns
 
 // Direction detection (optional, for future)
 #define ENABLE_DIRECTION_TRACKING false
 
+// Crossing event log (interpolated crossing times for headway analysis)
+#define CROSSING_LOG_SIZE 64  // Events kept in RAM ring buffer
+
+// Traffic metrics (headway, gap, speed and confidence distributions)
+#define METRICS_INTERVAL_MS UPLOAD_INTERVAL_MS  // One summary per upload
+#define METERS_PER_PIXEL 0.05     // Ground distance per pixel near the line (site survey)
+
+// Re-identification across occlusion (e.g. a bus passing in front of a car)
+// Expired tracks are kept briefly with an appearance descriptor and revived
+// if a matching vehicle reappears in the same lane.
+#define ENABLE_REID true
+#define REID_WINDOW_MS 5000       // How long an expired track can be revived
+#define REID_MAX_DISTANCE 10      // Max descriptor distance (0-120) to match
+#define REID_LOST_TRACKS 8        // Expired tracks remembered
+
+// Incident detection (queues, flow drops, blocked lanes)
+// Incidents are pushed to INCIDENT_URL as soon as they are raised or cleared,
+// independent of UPLOAD_INTERVAL_MS.
+#define ENABLE_INCIDENT_DETECTION true
+#define STATIONARY_MOVE_PX 4          // Movement below this = not moving
+#define STATIONARY_TIME_MS 10000      // Not moving this long = queued vehicle
+#define QUEUE_MIN_VEHICLES 2          // Queued vehicles in a zone to raise a queue
+#define BLOCKAGE_TIME_MS 60000        // One vehicle stopped this long = blocked lane
+#define FLOW_WINDOW_MS 60000          // Flow measured over this window
+#define FLOW_DROP_RATIO 0.3           // Flow below 30% of baseline = flow drop
+#define FLOW_DROP_MIN_BASELINE 5      // Ignore drops when baseline is below this
+#define INCIDENT_QUEUE_SIZE 8         // Incident events held for upload
+
+// Detection heatmap for site calibration (where to put the line and zones)
+// Accumulated since boot; uploaded to HEATMAP_URL when the backend asks.
+#define HEATMAP_COLS 12  // Grid cells across the frame
+#define HEATMAP_ROWS 8   // Grid cells down the frame
+
 // ============================================================================
 // EDGE IMPULSE MODEL CONFIGURATION
 // ============================================================================
@@ -90,13 +209,64 @@
 // SERVER CONFIGURATION
 // ============================================================================
 #define SERVER_URL "https://your-backend.com/api/detections"  // Change this
+#define INCIDENT_URL "https://your-backend.com/api/incidents"  // Change this
+#define ROLLUP_URL "https://your-backend.com/api/rollups"  // Change this
+#define HEATMAP_URL "https://your-backend.com/api/heatmap"  // Change this
+#define BACKLOG_URL "https://your-backend.com/api/detections/batch"  // Change this
+#define IMAGE_URL "https://your-backend.com/api/images"  // Change this
 #define API_KEY "your-api-key-here"  // For authentication
 
 // Upload settings
 #define UPLOAD_INTERVAL_MS 60000  // Upload stats every 60 seconds
 #define UPLOAD_IMAGES true         // Upload detection images (uses more data)
+#define IMAGE_UPLOAD_PART 4096     // Image bytes per request; a failure resends one part
 #define UPLOAD_STATS_ONLY false    // Only upload counts (saves data)
 
+// Stats uploads in the compact binary format (telemetry.h) rather than
+// JSON. Needs SITE_ID; with SITE_ID 0 stats are still sent as JSON.
+#define TELEMETRY_BINARY true
+#define TELEMETRY_COMPRESS true  // LZ-compress binary uploads when that makes them smaller
+
+// Batched uploads (binary format only): intervals are held and sent
+// several to a request, more of them while the link is poor
+#define UPLOAD_BATCH_INTERVALS 5         // Intervals per upload on a good link
+#define UPLOAD_BATCH_MAX 15              // Most intervals held for one upload
+#define UPLOAD_BATCH_ADAPTIVE true       // Hold 2x on a fair link, 3x on a poor one
+#define UPLOAD_BATCH_SLOW_RTT_MS 3000    // Upload round trip that counts as poor
+
+// Store-and-forward: each interval is logged to SD before it is uploaded,
+// and intervals that didn't get through are replayed from the event log
+// after an outage. At 60 per batch every 10 s a three-day outage (4320
+// intervals) drains in about 12 minutes. How far back this reaches is
+// bounded by EVENT_LOG_SIZE_MB.
+#define BACKLOG_BATCH_RECORDS 60          // Intervals per replay upload (40 bytes each)
+#define BACKLOG_REPLAY_INTERVAL_MS 10000  // At most one replay upload this often
+#define BACKLOG_SCAN_RECORDS 4096         // Log records examined per replay pass
+
+// HTTP keep-alive: uploads reuse one connection instead of connecting for
+// each. Set the backend's keep-alive timeout above HTTP_KEEPALIVE_IDLE_MS.
+#define HTTP_KEEPALIVE_IDLE_MS 90000    // Reconnect rather than reuse after this idle
+#define HTTP_RESPONSE_TIMEOUT_MS 10000  // Whole response, from the end of the request
+#define HTTP_CONNECT_TIMEOUT_S 10       // Opening a connection (TinyGSM's default is 75)
+#define HTTP_WRITE_CHUNK 1024           // Body bytes written per poll
+#define HTTP_READ_CHUNK 128             // Response bytes read per poll
+
+// MQTT-SN over UDP (binary telemetry only): stats and backlog records are
+// published with QoS 1 to a gateway that forwards them to the backend
+// (backend/api/scripts/mqttsn-gateway.js), a few bytes of overhead each
+// instead of HTTP headers and a TCP/TLS connection. Unanswered publishes
+// fall back to HTTP, which is used alone for MQTTSN_FALLBACK_MS after.
+// Needs the modem's CA socket stack (MODEM_TLS true). Not encrypted.
+#define MQTTSN_ENABLED false
+#define MQTTSN_GATEWAY_HOST "your-backend.com"  // Change this
+#define MQTTSN_GATEWAY_PORT 1885
+#define MQTTSN_KEEPALIVE_S 900           // Session lifetime at the gateway between publishes
+#define MQTTSN_RETRY_MS 3000             // Resend an unacknowledged CONNECT or PUBLISH
+#define MQTTSN_RETRIES 3                 // Resends before giving up
+#define MQTTSN_RECEIVE_POLL_MS 250       // Between checks for the gateway's reply
+#define MQTTSN_FALLBACK_MS 600000        // HTTP only, after the gateway didn't answer
+#define MQTTSN_MAX_PACKET 1024           // Largest datagram (the modem sends up to 1460)
+
 // ============================================================================
 // TIMING CONFIGURATION
 // ============================================================================
@@ -104,6 +274,42 @@
 #define WATCHDOG_TIMEOUT_S 30      // Reboot if frozen
 #define MODEM_RETRY_DELAY_MS 5000  // Wait before modem reconnect
 
+// Reconnects back off exponentially from MODEM_RETRY_DELAY_MS, doubling
+// again while the link-health score (LinkHealth) is poor, with random
+// jitter so sites don't retry in step after a network outage
+#define MODEM_BACKOFF_MAX_MS 1800000      // Longest wait between reconnects
+
+// Modem connection steps (LTEModem::poll()): status is queried every
+// MODEM_POLL_MS instead of blocking until the modem is ready
+#define MODEM_BOOT_MS 3000                // After a reset, before the modem answers
+#define MODEM_START_TIMEOUT_MS 20000      // Modem to answer AT after a reset
+#define MODEM_REGISTER_TIMEOUT_MS 60000   // LTE registration (then restart the modem)
+#define MODEM_POLL_MS 1000                // Between status queries while connecting
+#define MODEM_LINK_CHECK_MS 30000         // Between link checks once connected
+
+// ============================================================================
+// WARM RESTART
+// ============================================================================
+// Counter state is mirrored into RTC slow memory, which survives
+// ESP.restart(), watchdog and panic resets. On boot it is restored in
+// place of a cold start, so counts, tracks and pending incidents carry on.
+#define WARM_RTC_INTERVAL_MS 1000  // Mirror interval (~4KB copy + CRC32 each)
+
+// Cumulative totals are also checkpointed to NVS (survives power loss) just
+// before each stats upload, so the count the backend sees never goes
+// backwards, together with the backlog position and the last image sent.
+// That is one 56-byte blob (WarmState::NvsRecord, two zones) per minute,
+// four of a page's 126 NVS entries with its header and index, so NVS
+// wear-levels to roughly 9 erases per flash page per day on the default
+// 20KB partition: decades at the rated 100k cycles.
+#define WARM_NVS_CHECKPOINT true
+
+// Saved state is only restored by firmware with the same build ID. Change
+// it with an update that changes what the counts mean (a new counting
+// line, zones or site), so the counter starts afresh instead of carrying
+// on the old totals.
+#define WARM_BUILD_ID 1
+
 // ============================================================================
 // DEBUGGING
 // ============================================================================
@@ -122,5 +328,6 @@
 #define SITE_LAT -31.9614  // Latitude (update after site survey)
 #define SITE_LON 115.8417  // Longitude (update after site survey)
 #define SITE_DIRECTION "Northbound"  // Traffic direction monitored
+#define SITE_ID 0  // Backend site ID (GET /api/sites, after the first JSON upload)
 
 #endif // CONFIG_H
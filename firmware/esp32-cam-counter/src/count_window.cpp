@@ -0,0 +1,87 @@
+/**
+ * SwanFlow - Count Window Implementation
+ */
+
+#include "count_window.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+CountWindow::CountWindow() {
+  memset(buckets, 0, sizeof(buckets));
+  headIndex = 0;
+  headMs = 0;
+  minuteSum = 0;
+  hourSum = 0;
+}
+
+// ============================================================================
+// Window Maintenance
+// ============================================================================
+void CountWindow::advance(uint32_t nowMs) {
+  // Wrap-safe: millis() rolls over after ~49 days
+  uint32_t elapsed = nowMs - headMs;
+  if (elapsed < 1000) return;
+
+  // Idle for over an hour: everything has expired
+  if (elapsed >= (uint32_t)SECONDS * 1000) {
+    memset(buckets, 0, sizeof(buckets));
+    minuteSum = 0;
+    hourSum = 0;
+    headMs = nowMs - (elapsed % 1000);
+    return;
+  }
+
+  while (nowMs - headMs >= 1000) {
+    headMs += 1000;
+    headIndex = (headIndex + 1) % SECONDS;
+
+    // Second leaving the minute window, and the one leaving the hour
+    // window (which is the bucket the new second reuses)
+    minuteSum -= buckets[(headIndex + SECONDS - 60) % SECONDS];
+    hourSum -= buckets[headIndex];
+    buckets[headIndex] = 0;
+  }
+}
+
+void CountWindow::add(uint32_t timestampMs) {
+  if (ageSeconds(timestampMs) < 0) {
+    advance(timestampMs);
+  }
+
+  int32_t age = ageSeconds(timestampMs);
+  if (age >= SECONDS) return;  // Older than the window
+
+  uint16_t index = (headIndex + SECONDS - age) % SECONDS;
+  if (buckets[index] == 255) return;  // Saturated
+
+  buckets[index]++;
+  hourSum++;
+  if (age < 60) minuteSum++;
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+uint32_t CountWindow::countBetween(uint32_t fromMs, uint32_t toMs) const {
+  // Ages are counted backwards from the head: [toAge, fromAge]
+  int32_t fromAge = ageSeconds(fromMs);
+  int32_t toAge = ageSeconds(toMs - 1);
+  if (toAge < 0) toAge = 0;
+  if (fromAge >= SECONDS) fromAge = SECONDS - 1;
+  if (fromAge < toAge) return 0;
+
+  uint32_t sum = 0;
+  for (int32_t age = toAge; age <= fromAge; age++) {
+    sum += buckets[(headIndex + SECONDS - age) % SECONDS];
+  }
+  return sum;
+}
+
+int32_t CountWindow::ageSeconds(uint32_t timestampMs) const {
+  int32_t diff = (int32_t)(headMs - timestampMs);
+  if (diff <= 0) {
+    return diff > -1000 ? 0 : -1;  // Current second, or in the future
+  }
+  return (diff + 999) / 1000;
+}
@@ -0,0 +1,51 @@
+/**
+ * SwanFlow - Count Window
+ *
+ * Per-second vehicle counts for the last hour in a fixed ring buffer,
+ * with O(1) rolling minute and hour sums
+ */
+
+#ifndef COUNT_WINDOW_H
+#define COUNT_WINDOW_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// Count Window Class
+// ============================================================================
+class CountWindow {
+public:
+  static const uint16_t SECONDS = 3600;  // Ring length (one hour)
+
+  CountWindow();
+
+  // Move the window forward to nowMs, expiring buckets that fall out.
+  // Call once per frame so the sums stay exact when nothing is counted.
+  void advance(uint32_t nowMs);
+
+  // Count a vehicle at timestampMs (may be up to an hour in the past)
+  void add(uint32_t timestampMs);
+
+  // Shift the window's clock by deltaMs (e.g. onto a new boot's millis())
+  void rebase(uint32_t deltaMs) { headMs += deltaMs; }
+
+  // Rolling sums as of the last advance()
+  uint32_t lastMinute() const { return minuteSum; }
+  uint32_t lastHour() const { return hourSum; }
+
+  // Vehicles counted in [fromMs, toMs), at one second resolution.
+  // Only the last hour is held; older seconds count as zero.
+  uint32_t countBetween(uint32_t fromMs, uint32_t toMs) const;
+
+private:
+  uint8_t buckets[SECONDS];  // Vehicles per second (a lane can't do 255/s)
+  uint16_t headIndex;        // Bucket for the current second
+  uint32_t headMs;           // Start of the current second (millis)
+  uint32_t minuteSum;
+  uint32_t hourSum;
+
+  // Seconds between the head and timestampMs (0 = current second)
+  int32_t ageSeconds(uint32_t timestampMs) const;
+};
+
+#endif // COUNT_WINDOW_H
@@ -0,0 +1,561 @@
+/**
+ * SwanFlow - Event Log Implementation
+ */
+
+#include "event_log.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp32/rom/crc.h"
+
+#define EVENT_LOG_PATH "/log/events.bin"
+#define EVENT_LOG_MAGIC 0x474C4653  // "SFLG"
+#define EVENT_LOG_VERSION 1
+
+// ============================================================================
+// Constructor
+// ============================================================================
+EventLog::EventLog() {
+  fs = nullptr;
+  ready = false;
+  lock = nullptr;
+  capacity = 0;
+  generation = 0;
+  nextSeq = 1;
+  head = 0;
+  checkpointCounter = 0;
+  recordsSinceCheckpoint = 0;
+  bytesSinceCheckpoint = 0;
+  memset(index, 0, sizeof(index));
+  indexCount = 0;
+  indexNext = 0;
+  buffers[0] = nullptr;
+  buffers[1] = nullptr;
+  fillIndex = 0;
+  bufferBase = 0;
+  durableSeq = 1;
+  durableHead = 0;
+  writtenEnd = 0;
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+bool EventLog::begin(fs::FS &filesystem, SemaphoreHandle_t cardLock) {
+  static_assert(sizeof(Checkpoint) <= SECTOR_SIZE, "Checkpoint must fit in a sector");
+
+  fs = &filesystem;
+
+  // Staging buffers must be reachable by the SD host's DMA
+  for (int i = 0; i < 2; i++) {
+    buffers[i] = (uint8_t*)heap_caps_malloc(BUFFER_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!buffers[i]) {
+      Serial.println("Event log: no DMA memory for staging buffers");
+      return false;
+    }
+  }
+
+  lock = cardLock ? cardLock : xSemaphoreCreateMutex();
+  if (!lock) return false;
+
+  capacity = (uint32_t)EVENT_LOG_SIZE_MB * 1024 * 1024 - 2 * SECTOR_SIZE;
+  uint32_t fileSize = 2 * SECTOR_SIZE + capacity;
+
+  if (!fs->exists("/log")) {
+    fs->mkdir("/log");
+  }
+
+  // First use (or a size change): extend the file to full size without
+  // writing the ring. Old card data in its clusters can't pass for
+  // records because format() picks a new generation.
+  bool fresh = false;
+  File probe = fs->open(EVENT_LOG_PATH, FILE_READ);
+  if (!probe || probe.size() != fileSize) {
+    if (probe) probe.close();
+    Serial.printf("Event log: allocating %s (%lu bytes)\n", EVENT_LOG_PATH, (unsigned long)fileSize);
+
+    File created = fs->open(EVENT_LOG_PATH, FILE_WRITE);
+    if (!created) return false;
+    bool ok = created.seek(fileSize - 1) && created.write((uint8_t)0) == 1;
+    created.close();
+    if (!ok) return false;
+    fresh = true;
+  } else {
+    probe.close();
+  }
+
+  // Kept open: appends are a seek and a write, no directory lookups
+  file = fs->open(EVENT_LOG_PATH, "r+");
+  if (!file) return false;
+
+  if (fresh || !loadCheckpoint()) {
+    if (!format()) return false;
+  } else {
+    recover();
+  }
+
+  // Continue staging from the sector holding the head
+  if (!loadTailSector()) return false;
+  durableSeq = nextSeq;
+  durableHead = head;
+
+  ready = true;
+  Serial.printf("Event log ready (next record #%lu)\n", (unsigned long)nextSeq);
+  return true;
+}
+
+bool EventLog::format() {
+  generation = esp_random();
+  if (generation == 0) generation = 1;
+  nextSeq = 1;
+  head = 0;
+  checkpointCounter = 0;
+  indexCount = 0;
+  indexNext = 0;
+
+  // Invalidate both checkpoint slots, then write the first checkpoint
+  uint8_t zero[SECTOR_SIZE];
+  memset(zero, 0, sizeof(zero));
+  bool ok = file.seek(0) && file.write(zero, SECTOR_SIZE) == SECTOR_SIZE &&
+            file.write(zero, SECTOR_SIZE) == SECTOR_SIZE;
+  file.flush();
+
+  return ok && writeCheckpoint();
+}
+
+// ============================================================================
+// Checkpoints
+// ============================================================================
+bool EventLog::loadCheckpoint() {
+  Checkpoint slots[2];
+  int newest = -1;
+
+  for (int i = 0; i < 2; i++) {
+    Checkpoint& cp = slots[i];
+    bool ok = file.seek(i * SECTOR_SIZE) &&
+              file.read((uint8_t*)&cp, sizeof(cp)) == sizeof(cp) &&
+              cp.magic == EVENT_LOG_MAGIC && cp.version == EVENT_LOG_VERSION &&
+              cp.capacity == capacity &&
+              cp.crc == crc32(&cp, offsetof(Checkpoint, crc));
+    if (ok && (newest < 0 || cp.counter > slots[newest].counter)) newest = i;
+  }
+
+  if (newest < 0) return false;
+
+  const Checkpoint& cp = slots[newest];
+  checkpointCounter = cp.counter;
+  generation = cp.generation;
+  nextSeq = cp.nextSeq;
+  head = cp.head;
+  memcpy(index, cp.index, sizeof(index));
+  indexCount = cp.indexCount;
+  indexNext = cp.indexNext;
+  return true;
+}
+
+bool EventLog::writeCheckpoint() {
+  Checkpoint cp;
+  memset(&cp, 0, sizeof(cp));
+  cp.magic = EVENT_LOG_MAGIC;
+  cp.version = EVENT_LOG_VERSION;
+  cp.counter = ++checkpointCounter;
+  cp.generation = generation;
+  cp.capacity = capacity;
+  cp.nextSeq = nextSeq;
+  cp.head = head;
+  cp.indexCount = indexCount;
+  cp.indexNext = indexNext;
+  memcpy(cp.index, index, sizeof(index));
+  cp.crc = crc32(&cp, offsetof(Checkpoint, crc));
+
+  // Alternate slots: a torn write leaves the previous checkpoint intact
+  bool ok = file.seek((cp.counter % 2) * SECTOR_SIZE) &&
+            file.write((const uint8_t*)&cp, sizeof(cp)) == sizeof(cp);
+  file.flush();
+
+  recordsSinceCheckpoint = 0;
+  bytesSinceCheckpoint = 0;
+  return ok;
+}
+
+void EventLog::flush() {
+  if (!ready) return;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  flushLocked();
+  xSemaphoreGive(lock);
+}
+
+void EventLog::flushLocked() {
+  if (durableSeq == nextSeq) return;
+
+  if (writeBuffer()) {
+    writeCheckpoint();
+    durableSeq = nextSeq;
+    durableHead = head;
+  }
+}
+
+void EventLog::recover() {
+  // Records appended after the checkpoint: follow them while they are
+  // complete, and stop at the first torn or stale one
+  unsigned long start = millis();
+  uint32_t recovered = 0;
+  LogRecordHeader header;
+
+  while (readHeader(head, header) && headerValid(header, nextSeq)) {
+    if (header.type == LOG_PAD) {
+      head = nextLap(head);
+      continue;
+    }
+    if (!payloadCrcMatches(head, header)) break;
+
+    addIndexEntry(head, nextSeq);
+    head += recordSize(header.length);
+    nextSeq++;
+    recovered++;
+  }
+
+  if (recovered > 0) writeCheckpoint();
+
+  Serial.printf("Event log: recovered %lu records in %lu ms\n",
+                (unsigned long)recovered, millis() - start);
+}
+
+void EventLog::addIndexEntry(uint64_t pos, uint32_t seq) {
+  // Sparse: about one entry per 1/16 of the ring, so the index always
+  // reaches back over everything still intact
+  if (indexCount > 0) {
+    const IndexEntry& last = index[(indexNext + INDEX_ENTRIES - 1) % INDEX_ENTRIES];
+    if (pos - last.pos < capacity / 16) return;
+  }
+
+  index[indexNext].pos = pos;
+  index[indexNext].seq = seq;
+  indexNext = (indexNext + 1) % INDEX_ENTRIES;
+  if (indexCount < INDEX_ENTRIES) indexCount++;
+}
+
+// ============================================================================
+// Append
+// ============================================================================
+bool EventLog::append(uint8_t type, uint32_t timestamp, const void* payload, size_t length) {
+  if (!ready) return false;
+
+  uint32_t size = recordSize(length);
+  if (size > capacity / 4) {
+    Serial.println("Event log: record too large");
+    return false;
+  }
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  // Won't fit before the end of the ring: pad out this lap and wrap
+  bool ok = size <= capacity - head % capacity || wrap();
+
+  LogRecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = RECORD_MAGIC;
+  header.type = type;
+  header.seq = nextSeq;
+  header.generation = generation;
+  header.timestamp = timestamp;
+  header.length = length;
+  header.payloadCrc = crc32(payload, length);
+  header.headerCrc = crc32(&header, offsetof(LogRecordHeader, headerCrc));
+
+  uint64_t start = head;
+  ok = ok && stage(&header, sizeof(header)) && stage(payload, length) &&
+       stage(nullptr, size - sizeof(header) - length);  // Zero fill to 32-byte alignment
+
+  if (ok) {
+    addIndexEntry(start, nextSeq);
+    nextSeq++;
+
+    // Bound how much the next boot has to scan
+    recordsSinceCheckpoint++;
+    bytesSinceCheckpoint += size;
+    if (recordsSinceCheckpoint >= EVENT_LOG_CHECKPOINT_RECORDS ||
+        bytesSinceCheckpoint >= EVENT_LOG_CHECKPOINT_BYTES) {
+      flushLocked();
+    }
+  }
+
+  xSemaphoreGive(lock);
+  return ok;
+}
+
+bool EventLog::wrap() {
+  LogRecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = RECORD_MAGIC;
+  header.type = LOG_PAD;
+  header.seq = nextSeq;  // Pads don't use up a sequence number
+  header.generation = generation;
+  header.length = capacity - head % capacity - sizeof(header);
+  header.headerCrc = crc32(&header, offsetof(LogRecordHeader, headerCrc));
+
+  // Only the pad header is written; the next lap starts a fresh buffer.
+  // Staging it can itself reach the end of the lap (an empty pad).
+  uint64_t lapEnd = nextLap(head);
+  if (!stage(&header, sizeof(header)) || !writeBuffer()) return false;
+
+  head = lapEnd;
+  bufferBase = head;
+  return true;
+}
+
+// ============================================================================
+// Staging
+// ============================================================================
+bool EventLog::stage(const void* data, size_t length) {
+  const uint8_t* src = (const uint8_t*)data;
+
+  while (length > 0) {
+    // A buffer never spans the end of the ring
+    uint32_t lapLeft = capacity - bufferBase % capacity;
+    uint32_t limit = lapLeft < BUFFER_SIZE ? lapLeft : BUFFER_SIZE;
+    uint32_t used = head - bufferBase;
+    uint32_t n = length < limit - used ? length : limit - used;
+
+    if (src) {
+      memcpy(buffers[fillIndex] + used, src, n);
+      src += n;
+    } else {
+      memset(buffers[fillIndex] + used, 0, n);
+    }
+    head += n;
+    length -= n;
+
+    if (used + n == limit && !writeBuffer()) return false;
+  }
+
+  return true;
+}
+
+bool EventLog::writeBuffer() {
+  uint32_t used = head - bufferBase;
+  if (used == 0) return true;
+
+  uint8_t* buffer = buffers[fillIndex];
+  uint32_t sectors = (used + SECTOR_SIZE - 1) / SECTOR_SIZE;
+  memset(buffer + used, 0, sectors * SECTOR_SIZE - used);
+
+  // One multi-sector write at a sector-aligned offset. After a wrap the
+  // zero fill lands on the oldest records, so they count as overwritten.
+  uint64_t end = bufferBase + sectors * SECTOR_SIZE;
+  if (end > writtenEnd) writtenEnd = end;
+  bool ok = file.seek(offsetOf(bufferBase)) &&
+            file.write(buffer, sectors * SECTOR_SIZE) == sectors * SECTOR_SIZE;
+  file.flush();
+
+  if (!ok) {
+    // Card gone or failing: stop rather than leave a gap in the log
+    Serial.println("Event log: write failed, logging stopped");
+    ready = false;
+    return false;
+  }
+
+  // Carry a partly filled last sector over to the other buffer; it is
+  // rewritten whole, with what follows it, next time
+  uint32_t keep = used % SECTOR_SIZE;
+  uint8_t* other = buffers[fillIndex ^ 1];
+  if (keep) memcpy(other, buffer + used - keep, keep);
+
+  bufferBase = head - keep;
+  fillIndex ^= 1;
+  return true;
+}
+
+bool EventLog::loadTailSector() {
+  fillIndex = 0;
+  bufferBase = head - head % SECTOR_SIZE;
+
+  // The last write before the reset was zero filled to the sector end
+  uint32_t keep = head - bufferBase;
+  writtenEnd = keep ? bufferBase + SECTOR_SIZE : head;
+  if (keep == 0) return true;
+
+  return file.seek(offsetOf(bufferBase)) && file.read(buffers[0], keep) == keep;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+bool EventLog::seek(uint32_t seq, LogCursor& cursor, TickType_t wait) {
+  if (!ready) return false;
+
+  if (xSemaphoreTake(lock, wait) != pdTRUE) return false;
+  bool ok = seekLocked(seq, cursor);
+  xSemaphoreGive(lock);
+  return ok;
+}
+
+bool EventLog::seekLocked(uint32_t seq, LogCursor& cursor) {
+  if (seq >= durableSeq) {
+    cursor.pos = durableHead;
+    cursor.seq = durableSeq;
+    return true;
+  }
+
+  // Closest indexed record at or before seq, else the oldest one left
+  int best = -1;
+  int oldest = -1;
+  for (int i = 0; i < indexCount; i++) {
+    if (!intact(index[i].pos)) continue;
+    if (index[i].seq <= seq && (best < 0 || index[i].seq > index[best].seq)) best = i;
+    if (oldest < 0 || index[i].seq < index[oldest].seq) oldest = i;
+  }
+
+  int from = best >= 0 ? best : oldest;
+  if (from < 0) return false;
+
+  cursor.pos = index[from].pos;
+  cursor.seq = index[from].seq;
+
+  // Walk the headers forward to seq; an unreadable one stops the walk
+  // there, for read() to report and skip() to get past
+  LogRecordHeader header;
+  while (cursor.seq < seq) {
+    if (!readHeader(cursor.pos, header) || !headerValid(header, cursor.seq)) return true;
+
+    if (header.type == LOG_PAD) {
+      cursor.pos = nextLap(cursor.pos);
+    } else {
+      cursor.pos += recordSize(header.length);
+      cursor.seq++;
+    }
+  }
+
+  return true;
+}
+
+LogReadResult EventLog::read(LogCursor& cursor, LogEntry& entry, uint8_t* buf, size_t maxLen,
+                            TickType_t wait) {
+  if (!ready) return LOG_READ_INVALID;
+
+  if (xSemaphoreTake(lock, wait) != pdTRUE) return LOG_READ_BUSY;
+  LogReadResult result = readLocked(cursor, entry, buf, maxLen);
+  xSemaphoreGive(lock);
+  return result;
+}
+
+LogReadResult EventLog::readLocked(LogCursor& cursor, LogEntry& entry, uint8_t* buf, size_t maxLen) {
+  if (cursor.seq >= durableSeq) return LOG_READ_END;
+
+  // Overwritten since the cursor was taken: skip ahead to what's left
+  if (!intact(cursor.pos) && !seekLocked(cursor.seq, cursor)) return LOG_READ_INVALID;
+
+  LogRecordHeader header;
+  for (;;) {
+    if (!readHeader(cursor.pos, header) || !headerValid(header, cursor.seq)) return LOG_READ_INVALID;
+    if (header.type != LOG_PAD) break;
+    cursor.pos = nextLap(cursor.pos);
+  }
+
+  entry.seq = header.seq;
+  entry.timestamp = header.timestamp;
+  entry.length = header.length;
+  entry.type = header.type;
+  entry.intact = false;
+
+  if (buf) {
+    size_t toRead = header.length < maxLen ? header.length : maxLen;
+    bool ok = file.seek(offsetOf(cursor.pos) + sizeof(header)) &&
+              file.read(buf, toRead) == toRead;
+    entry.intact = ok && toRead == header.length && crc32(buf, toRead) == header.payloadCrc;
+  }
+
+  cursor.pos += recordSize(header.length);
+  cursor.seq++;
+  return LOG_READ_OK;
+}
+
+bool EventLog::skip(LogCursor& cursor, TickType_t wait) {
+  if (!ready) return false;
+
+  if (xSemaphoreTake(lock, wait) != pdTRUE) return false;
+  skipLocked(cursor);
+  xSemaphoreGive(lock);
+  return true;
+}
+
+void EventLog::skipLocked(LogCursor& cursor) {
+  if (cursor.seq >= durableSeq) return;
+
+  // The search ends at the next indexed record, or the end of the log
+  LogCursor limit = { durableHead, durableSeq };
+  for (int i = 0; i < indexCount; i++) {
+    if (index[i].seq > cursor.seq && index[i].seq < limit.seq && intact(index[i].pos)) {
+      limit.pos = index[i].pos;
+      limit.seq = index[i].seq;
+    }
+  }
+
+  if (!intact(cursor.pos)) {
+    cursor = limit;
+    return;
+  }
+
+  // Records start on 32-byte boundaries: check each one in the next
+  // sector (without crossing the end of the ring) for a valid header
+  // further on. Only this log's generation and a later seq count, so
+  // older records left in the ring are passed over.
+  uint8_t chunk[SECTOR_SIZE];
+  uint64_t pos = cursor.pos + 32;
+  uint64_t lapLeft = capacity - pos % capacity;
+  uint64_t n = limit.pos - pos;
+  if (n > lapLeft) n = lapLeft;
+  if (n > SECTOR_SIZE) n = SECTOR_SIZE;
+
+  if (pos >= limit.pos || !file.seek(offsetOf(pos)) || file.read(chunk, n) != n) {
+    cursor = limit;
+    return;
+  }
+
+  for (uint32_t at = 0; at + sizeof(LogRecordHeader) <= n; at += 32) {
+    LogRecordHeader header;
+    memcpy(&header, chunk + at, sizeof(header));
+    if (header.seq > cursor.seq && header.seq < limit.seq && headerValid(header, header.seq)) {
+      cursor.pos = pos + at;  // A pad is fine too: read() steps over it
+      cursor.seq = header.seq;
+      return;
+    }
+  }
+
+  // Nothing in this sector: the next call carries on after it
+  cursor.pos = pos + n - 32;
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+bool EventLog::readHeader(uint64_t pos, LogRecordHeader& header) {
+  return file.seek(offsetOf(pos)) &&
+         file.read((uint8_t*)&header, sizeof(header)) == sizeof(header);
+}
+
+bool EventLog::headerValid(const LogRecordHeader& header, uint32_t seq) const {
+  return header.magic == RECORD_MAGIC && header.generation == generation &&
+         header.seq == seq && header.length <= capacity &&
+         header.headerCrc == crc32(&header, offsetof(LogRecordHeader, headerCrc));
+}
+
+bool EventLog::payloadCrcMatches(uint64_t pos, const LogRecordHeader& header) {
+  uint8_t chunk[SECTOR_SIZE];
+  uint32_t crc = 0;
+
+  if (!file.seek(offsetOf(pos) + sizeof(header))) return false;
+
+  for (uint32_t done = 0; done < header.length; ) {
+    size_t n = header.length - done < SECTOR_SIZE ? header.length - done : SECTOR_SIZE;
+    if (file.read(chunk, n) != n) return false;
+    crc = crc32(chunk, n, crc);
+    done += n;
+  }
+
+  return crc == header.payloadCrc;
+}
+
+uint32_t EventLog::crc32(const void* data, size_t len, uint32_t crc) {
+  return crc32_le(crc, (const uint8_t*)data, len);  // ROM implementation
+}
@@ -0,0 +1,222 @@
+/**
+ * SwanFlow - Event Log
+ *
+ * Append-only log of typed records (stats, crossing events) in one
+ * preallocated file on the SD card. Appends never touch the FAT
+ * directory, so their cost doesn't grow with the number of records.
+ *
+ * Layout: two checkpoint sectors, then a ring of records aligned to 32
+ * bytes. Each record has a header with its own CRC, a payload CRC, a
+ * sequence number and the log's generation (so stale records from an
+ * earlier log on the same card never look valid). When a record won't
+ * fit before the end of the ring a pad record is written and the log
+ * wraps, overwriting the oldest records.
+ *
+ * Checkpoints alternate between the two sectors and hold the write
+ * position, next sequence number and a sparse index of sequence number
+ * to position. At boot the newest valid checkpoint is loaded and only
+ * records appended after it are scanned, at most
+ * EVENT_LOG_CHECKPOINT_BYTES.
+ *
+ * Appends are staged in two sector-aligned buffers in DMA-capable RAM and
+ * reach the card as whole multi-sector writes. A partly filled last
+ * sector moves to the other buffer and is rewritten whole next time, so
+ * every write starts on a sector boundary. Staged records become readable
+ * at the next flush(), which also writes a checkpoint.
+ *
+ * Thread safety: one task appends (see SdWriter); any task may read. A
+ * reader that must not wait for the writer (the loop task) passes
+ * wait = 0 and tries again later if the log is busy. The lock can be
+ * shared with the ImageStore, so such a reader doesn't queue behind an
+ * image write either (the card does one thing at a time).
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "config.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+enum EventLogType : uint8_t {
+  LOG_STATS = 1,     // IntervalRecord, at each upload
+  LOG_CROSSING = 2,  // CrossingEvent
+  LOG_IMAGE = 3,     // Reserved: detection images are kept in the ImageStore
+  LOG_TRAINING = 4,  // TrainingHeader, TrainingBox[], JPEG (training_capture.h)
+  LOG_PAD = 0xFF     // Filler before the ring wraps
+};
+
+struct LogRecordHeader {
+  uint16_t magic;       // EventLog::RECORD_MAGIC
+  uint8_t type;         // EventLogType
+  uint8_t flags;
+  uint32_t seq;         // 1 = first record of this log
+  uint32_t generation;  // Log instance (random, set when the file is formatted)
+  uint32_t timestamp;   // millis() when the event happened
+  uint32_t length;      // Payload bytes
+  uint32_t payloadCrc;  // CRC32 of the payload
+  uint32_t reserved;
+  uint32_t headerCrc;   // CRC32 of the preceding 28 bytes
+};
+
+static_assert(sizeof(LogRecordHeader) == 32, "LogRecordHeader must be 32 bytes");
+
+// Read position. Plain data, so a reader can keep it across reboots.
+struct LogCursor {
+  uint64_t pos;  // Logical byte position (grows forever; ring offset = pos % capacity)
+  uint32_t seq;  // Sequence number of the record at pos
+};
+
+// Why read() did or didn't return a record
+enum LogReadResult : uint8_t {
+  LOG_READ_OK,
+  LOG_READ_END,      // Caught up with the last flush()
+  LOG_READ_BUSY,     // The lock wasn't free within wait; try again later
+  LOG_READ_INVALID   // The record at the cursor is unreadable
+};
+
+struct LogEntry {
+  uint32_t seq;
+  uint32_t timestamp;
+  uint32_t length;  // Full payload length, even if the read was truncated
+  uint8_t type;
+  bool intact;      // Payload read completely and its CRC matched
+};
+
+// ============================================================================
+// Event Log Class
+// ============================================================================
+class EventLog {
+public:
+  static const uint16_t SECTOR_SIZE = SD_BUFFER_SIZE;
+  static const uint32_t BUFFER_SIZE = SD_WRITE_BUFFER_SECTORS * SECTOR_SIZE;
+  static const uint16_t RECORD_MAGIC = 0x5352;  // "RS"
+  static const uint8_t INDEX_ENTRIES = 24;
+
+  EventLog();
+
+  // Open (and on first use, preallocate) the log, then recover the tail.
+  // cardLock, if given, is shared with the card's other stores; otherwise
+  // the log makes its own.
+  bool begin(fs::FS &fs, SemaphoreHandle_t cardLock = nullptr);
+  bool isReady() const { return ready; }
+
+  // Append a record; false if the log isn't ready or the write failed.
+  // May write to the card (whenever a staging buffer fills).
+  bool append(uint8_t type, uint32_t timestamp, const void* payload, size_t length);
+
+  // Write staged records and a checkpoint
+  void flush();
+
+  // Sequence number the next record will get
+  uint32_t getNextSeq() const { return nextSeq; }
+
+  // Position a cursor at record seq. If seq has been overwritten, the
+  // cursor lands on the oldest record that can still be found instead;
+  // if a record before seq can't be read, it stops there (read() then
+  // says LOG_READ_INVALID). False if the log is empty of intact records,
+  // or the lock isn't free within wait.
+  bool seek(uint32_t seq, LogCursor& cursor, TickType_t wait = portMAX_DELAY);
+
+  // Read the record at cursor and advance past it. Up to maxLen payload
+  // bytes are copied to buf (buf may be nullptr to skip the payload).
+  LogReadResult read(LogCursor& cursor, LogEntry& entry, uint8_t* buf, size_t maxLen,
+                     TickType_t wait = portMAX_DELAY);
+
+  // Same; false for anything but LOG_READ_OK
+  bool next(LogCursor& cursor, LogEntry& entry, uint8_t* buf, size_t maxLen) {
+    return read(cursor, entry, buf, maxLen) == LOG_READ_OK;
+  }
+
+  // After LOG_READ_INVALID: move the cursor on towards the next readable
+  // record, looking for its header one sector at a time, so a torn or
+  // corrupt record doesn't end a scan. Call read() again afterwards; it
+  // says LOG_READ_INVALID again while the search is still going. False
+  // if the lock isn't free within wait.
+  bool skip(LogCursor& cursor, TickType_t wait = portMAX_DELAY);
+
+private:
+  struct IndexEntry {
+    uint64_t pos;
+    uint32_t seq;
+    uint32_t reserved;
+  };
+
+  struct Checkpoint {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t counter;     // Newer checkpoint has the higher counter
+    uint32_t generation;
+    uint32_t capacity;    // Ring bytes
+    uint32_t nextSeq;
+    uint64_t head;        // Logical position of the next record
+    uint8_t indexCount;
+    uint8_t indexNext;    // Ring position of the next index entry
+    uint8_t reserved[6];
+    IndexEntry index[INDEX_ENTRIES];
+    uint32_t crc;         // CRC32 of everything above
+  };
+
+  fs::FS* fs;
+  File file;
+  bool ready;
+  SemaphoreHandle_t lock;  // Guards the file handle and log state (may be the card's)
+
+  uint32_t capacity;
+  uint32_t generation;
+  uint32_t nextSeq;
+  uint64_t head;
+  uint32_t checkpointCounter;
+  uint32_t recordsSinceCheckpoint;
+  uint32_t bytesSinceCheckpoint;
+
+  IndexEntry index[INDEX_ENTRIES];
+  uint8_t indexCount;
+  uint8_t indexNext;
+
+  // Staging: buffers[fillIndex] holds the bytes from bufferBase (sector
+  // aligned) up to head
+  uint8_t* buffers[2];
+  uint8_t fillIndex;
+  uint64_t bufferBase;
+  uint32_t durableSeq;   // Records below this are on the card...
+  uint64_t durableHead;  // ...and end here
+  uint64_t writtenEnd;   // End of the last sector written, zero fill included
+
+  bool format();
+  bool loadCheckpoint();
+  bool writeCheckpoint();
+  void recover();
+  void addIndexEntry(uint64_t pos, uint32_t seq);
+  void flushLocked();
+  bool seekLocked(uint32_t seq, LogCursor& cursor);
+  LogReadResult readLocked(LogCursor& cursor, LogEntry& entry, uint8_t* buf, size_t maxLen);
+  void skipLocked(LogCursor& cursor);
+
+  bool stage(const void* data, size_t length);
+  bool writeBuffer();
+  bool loadTailSector();
+
+  bool readHeader(uint64_t pos, LogRecordHeader& header);
+  bool headerValid(const LogRecordHeader& header, uint32_t seq) const;
+  bool payloadCrcMatches(uint64_t pos, const LogRecordHeader& header);
+  bool wrap();
+
+  // Records at logical positions older than one ring behind the head, or
+  // behind the zero fill of the last sector written, have been overwritten
+  bool intact(uint64_t pos) const {
+    uint64_t reach = writtenEnd > head ? writtenEnd : head;
+    return pos <= head && reach - pos <= capacity;
+  }
+  uint32_t offsetOf(uint64_t pos) const { return 2 * SECTOR_SIZE + pos % capacity; }
+  uint64_t nextLap(uint64_t pos) const { return (pos / capacity + 1) * capacity; }
+  static uint32_t recordSize(uint32_t length) { return (sizeof(LogRecordHeader) + length + 31) & ~31u; }
+  static uint32_t crc32(const void* data, size_t len, uint32_t crc = 0);
+};
+
+#endif // EVENT_LOG_H
@@ -0,0 +1,34 @@
+/**
+ * SwanFlow - Detection Heatmap Implementation
+ */
+
+#include "heatmap.h"
+
+// ============================================================================
+// Heatmap
+// ============================================================================
+Heatmap::Heatmap() {
+  clear();
+}
+
+void Heatmap::clear() {
+  memset(cells, 0, sizeof(cells));
+}
+
+void Heatmap::serialize(uint8_t* out) const {
+  for (int i = 0; i < CELLS; i++) {
+    const Cell& cell = cells[i];
+    int16_t vx = cell.moves > 0 ? cell.vxSum / cell.moves : 0;
+    int16_t vy = cell.moves > 0 ? cell.vySum / cell.moves : 0;
+    uint8_t confidence = cell.hits > 0 ? cell.confidenceSum / cell.hits : 0;
+
+    uint8_t* p = out + i * CELL_BYTES;
+    p[0] = cell.hits & 0xFF;
+    p[1] = cell.hits >> 8;
+    p[2] = (uint16_t)vx & 0xFF;
+    p[3] = (uint16_t)vx >> 8;
+    p[4] = (uint16_t)vy & 0xFF;
+    p[5] = (uint16_t)vy >> 8;
+    p[6] = confidence;
+  }
+}
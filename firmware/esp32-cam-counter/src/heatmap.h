@@ -0,0 +1,64 @@
+/**
+ * SwanFlow - Detection Heatmap
+ *
+ * Coarse grid of detection hits, mean motion and mean confidence,
+ * accumulated over hours to place the counting line and zones
+ */
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Heatmap Class
+// ============================================================================
+class Heatmap {
+public:
+  static const uint8_t COLS = HEATMAP_COLS;
+  static const uint8_t ROWS = HEATMAP_ROWS;
+  static const uint16_t CELLS = COLS * ROWS;
+
+  // Serialized cell: hits (LE16), mean vx and vy (LE16, px/s),
+  // mean confidence (0-255)
+  static const size_t CELL_BYTES = 7;
+  static const size_t SERIALIZED_SIZE = CELLS * CELL_BYTES;
+
+  Heatmap();
+
+  void clear();
+
+  // Count a detection in a cell. vx/vy is the track's motion since its
+  // previous frame in px/s; moving is false for a track's first frame.
+  // A cell stops accumulating once its hit count saturates, so its
+  // means stay consistent.
+  void add(uint8_t col, uint8_t row, int16_t vx, int16_t vy, uint8_t confidence, bool moving) {
+    Cell& cell = cells[row * COLS + col];
+    if (cell.hits == UINT16_MAX) return;
+
+    cell.hits++;
+    cell.confidenceSum += confidence;
+    if (moving) {
+      cell.moves++;
+      cell.vxSum += vx;
+      cell.vySum += vy;
+    }
+  }
+
+  // Writes SERIALIZED_SIZE bytes, row by row from the top left
+  void serialize(uint8_t* out) const;
+
+private:
+  struct Cell {
+    uint16_t hits;
+    uint16_t moves;          // Hits with a motion sample
+    int32_t vxSum;           // px/s
+    int32_t vySum;
+    uint32_t confidenceSum;  // 0-255 per hit
+  };
+
+  Cell cells[CELLS];
+};
+
+#endif // HEATMAP_H
@@ -0,0 +1,318 @@
+/**
+ * SwanFlow - HTTP Connection Implementation
+ */
+
+#include "http_connection.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+HttpConnection::HttpConnection() {
+  client = nullptr;
+  open = false;
+  host[0] = '\0';
+  port = 0;
+  lastUsed = 0;
+  state = HTTP_IDLE;
+  targetHost[0] = '\0';
+  targetPort = 0;
+  path = nullptr;
+  contentType = nullptr;
+  prefix = nullptr;
+  prefixLength = 0;
+  prefixSent = 0;
+  body = nullptr;
+  bodyLength = 0;
+  bodySent = 0;
+  head[0] = '\0';
+  headLength = 0;
+  headSent = 0;
+  reused = false;
+  attempt = 0;
+  requestStart = 0;
+  sentAt = 0;
+  heapAtStart = 0;
+  captureName = nullptr;
+  lastSucceeded = false;
+  memset(&stats, 0, sizeof(stats));
+}
+
+void HttpConnection::begin(Client& c) {
+  client = &c;
+}
+
+void HttpConnection::close() {
+  if (open) client->stop();
+  open = false;
+}
+
+// ============================================================================
+// Requests
+// ============================================================================
+bool HttpConnection::start(const char* url, const char* type, const uint8_t* data, size_t length) {
+  return start(url, type, nullptr, 0, data, length);
+}
+
+bool HttpConnection::start(const char* url, const char* type, const uint8_t* before,
+                           size_t beforeLength, const uint8_t* data, size_t length) {
+  if (state != HTTP_IDLE) return false;
+
+  stats.requests++;
+  lastSucceeded = false;
+  parser.begin(captureName);
+  heapAtStart = ESP.getFreeHeap();
+  stats.lastHeapDip = 0;
+
+  if (!client || !parseUrl(url, targetHost, targetPort, path)) {
+    Serial.printf("Bad upload URL: %s\n", url);
+    stats.failures++;
+    return false;
+  }
+
+  Serial.printf("POST %s%s\n", targetHost, path);
+
+  contentType = type;
+  prefix = before;
+  prefixLength = beforeLength;
+  body = data;
+  bodyLength = length;
+  attempt = 0;
+  state = HTTP_CONNECTING;
+  return true;
+}
+
+bool HttpConnection::poll() {
+  trackHeap();
+
+  switch (state) {
+    case HTTP_CONNECTING: connectStep(); break;
+    case HTTP_SENDING: sendStep(); break;
+    case HTTP_WAITING: waitStep(); break;
+    case HTTP_READING: readStep(); break;
+    case HTTP_IDLE: break;
+  }
+  return state != HTTP_IDLE;
+}
+
+bool HttpConnection::ensureOpen() {
+  if (open && (strcmp(host, targetHost) != 0 || port != targetPort ||
+               millis() - lastUsed >= HTTP_KEEPALIVE_IDLE_MS || !client->connected())) {
+    close();
+  }
+
+  if (open) {
+    // Anything unread belongs to no request of ours
+    while (client->available() > 0) client->read();
+    reused = true;
+    stats.reused++;
+    return true;
+  }
+
+  reused = false;
+  if (!client->connect(targetHost, targetPort)) return false;
+
+  strncpy(host, targetHost, MAX_HOST - 1);
+  host[MAX_HOST - 1] = '\0';
+  port = targetPort;
+  open = true;
+  stats.connects++;
+  return true;
+}
+
+// One connect (bounded by the client's connect timeout)
+void HttpConnection::connectStep() {
+  uint32_t connectStart = millis();
+  if (!ensureOpen()) {
+    Serial.println("Connection to server failed");
+    finish(false);
+    return;
+  }
+  stats.lastConnectMs = reused ? 0 : millis() - connectStart;
+
+  // Request line and headers, written in one go so they leave the modem
+  // in one segment
+  int length = snprintf(head, sizeof(head),
+                        "POST %s HTTP/1.1\r\n"
+                        "Host: %s\r\n"
+                        "Content-Type: %s\r\n"
+                        "Content-Length: %u\r\n"
+                        "Authorization: Bearer %s\r\n"
+                        "Connection: keep-alive\r\n\r\n",
+                        path, host, contentType, (unsigned)(prefixLength + bodyLength), API_KEY);
+  if (length <= 0 || length >= (int)sizeof(head)) {
+    Serial.println("Request headers too long");
+    close();
+    finish(false);
+    return;
+  }
+
+  headLength = length;
+  headSent = 0;
+  prefixSent = 0;
+  bodySent = 0;
+  stats.lastBytesSent = 0;
+  stats.lastBytesReceived = 0;
+  state = HTTP_SENDING;
+}
+
+// One write: the headers, the prefix, or the next HTTP_WRITE_CHUNK bytes
+// of body
+void HttpConnection::sendStep() {
+  size_t expected;
+  size_t sent;
+
+  if (headSent < headLength) {
+    if (headSent == 0) requestStart = millis();
+    expected = headLength - headSent;
+    sent = client->write((const uint8_t*)head + headSent, expected);
+    headSent += sent;
+  } else if (prefixSent < prefixLength) {
+    expected = prefixLength - prefixSent;
+    sent = client->write(prefix + prefixSent, expected);
+    prefixSent += sent;
+  } else {
+    expected = min(bodyLength - bodySent, (size_t)HTTP_WRITE_CHUNK);
+    sent = client->write(body + bodySent, expected);
+    bodySent += sent;
+  }
+
+  stats.lastBytesSent += sent;
+  stats.bytesSent += sent;
+  if (sent != expected) {
+    retryOrFail();
+    return;
+  }
+
+  if (headSent == headLength && prefixSent == prefixLength && bodySent == bodyLength) {
+    sentAt = millis();
+    state = HTTP_WAITING;
+  }
+}
+
+// Closed with no answer = dead connection (retried). No answer in time
+// is a failure: the request did go out, and may have been acted on.
+void HttpConnection::waitStep() {
+  if (client->available() > 0) {
+    parser.begin(captureName);
+    state = HTTP_READING;
+    readStep();
+    return;
+  }
+
+  if (!client->connected()) {
+    retryOrFail();
+  } else if (millis() - sentAt >= HTTP_RESPONSE_TIMEOUT_MS) {
+    Serial.println("Request timeout or incomplete response");
+    close();
+    finish(false);
+  }
+}
+
+// One read of up to HTTP_READ_CHUNK bytes, parsed as they come
+void HttpConnection::readStep() {
+  int available = client->available();
+  if (available <= 0) {
+    if (!client->connected() || millis() - sentAt >= HTTP_RESPONSE_TIMEOUT_MS) {
+      Serial.println("Request timeout or incomplete response");
+      close();
+      finish(false);
+    }
+    return;
+  }
+
+  uint8_t chunk[HTTP_READ_CHUNK];
+  size_t want = min((size_t)available, sizeof(chunk));
+  // The body has to be consumed for the next response to line up, but
+  // nothing past it
+  uint32_t bodyLeft = parser.bodyRemaining();
+  if (bodyLeft > 0) want = min(want, (size_t)bodyLeft);
+  int n = client->read(chunk, want);
+  if (n <= 0) return;
+  stats.lastBytesReceived += n;
+
+  size_t consumed;
+  HttpParseResult result = parser.feed(chunk, n, consumed);
+  if (result == HTTP_PARSE_DONE) {
+    complete();
+  } else if (result == HTTP_PARSE_ERROR) {
+    Serial.println("Malformed response");
+    close();
+    finish(false);
+  }
+}
+
+void HttpConnection::complete() {
+  stats.lastRttMs = millis() - requestStart;
+  stats.bytesReceived += stats.lastBytesReceived;
+
+  if (parser.isKeepAlive()) {
+    lastUsed = millis();
+  } else {
+    close();
+  }
+
+  bool success = parser.isSuccess();
+  if (!success) Serial.printf("HTTP %d\n", parser.getStatus());
+  finish(success);
+}
+
+// The write failed, or the connection closed before any answer. A reused
+// connection may have been dead: try once more on a fresh one.
+void HttpConnection::retryOrFail() {
+  close();
+  if (!reused || attempt > 0) {
+    Serial.println("Request timeout or incomplete response");
+    finish(false);
+    return;
+  }
+
+  stats.stale++;
+  Serial.println("Kept-alive connection was dead, reconnecting");
+  attempt++;
+  state = HTTP_CONNECTING;
+}
+
+void HttpConnection::finish(bool success) {
+  trackHeap();
+  if (!success) stats.failures++;
+  lastSucceeded = success;
+  state = HTTP_IDLE;
+}
+
+// Heap churn: how far free heap fell below its level when the request
+// started (the modem library and String bodies allocate along the way)
+void HttpConnection::trackHeap() {
+  if (state == HTTP_IDLE) return;
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < heapAtStart && heapAtStart - freeHeap > stats.lastHeapDip) {
+    stats.lastHeapDip = heapAtStart - freeHeap;
+    if (stats.lastHeapDip > stats.maxHeapDip) stats.maxHeapDip = stats.lastHeapDip;
+  }
+}
+
+// ============================================================================
+// URL Parsing
+// ============================================================================
+bool HttpConnection::parseUrl(const char* url, char* hostOut, uint16_t& portOut, const char*& pathOut) {
+  const char* hostStart = strstr(url, "://");
+  if (!hostStart) return false;
+  portOut = strncmp(url, "https", 5) == 0 ? 443 : 80;
+  hostStart += 3;
+
+  const char* slash = strchr(hostStart, '/');
+  const char* hostEnd = slash ? slash : hostStart + strlen(hostStart);
+  pathOut = slash ? slash : "/";
+
+  const char* colon = (const char*)memchr(hostStart, ':', hostEnd - hostStart);
+  if (colon) {
+    portOut = atoi(colon + 1);
+    hostEnd = colon;
+  }
+
+  size_t hostLength = hostEnd - hostStart;
+  if (hostLength == 0 || hostLength >= MAX_HOST) return false;
+  memcpy(hostOut, hostStart, hostLength);
+  hostOut[hostLength] = '\0';
+  return true;
+}
@@ -0,0 +1,154 @@
+/**
+ * SwanFlow - HTTP Connection
+ *
+ * Sends HTTP/1.1 POSTs over one keep-alive connection, so uploads after
+ * the first skip TCP connection setup (several round trips on Cat-M1).
+ *
+ * The connection is reopened when the host changes, when the server
+ * closes it (Connection: close, or a response without a length), and
+ * before it would have sat idle longer than HTTP_KEEPALIVE_IDLE_MS (the
+ * server's keep-alive timeout should be longer than that). A reused
+ * connection can still be dead, e.g. after a carrier NAT timeout or the
+ * server closing it as the request went out: if writing the request
+ * fails, or the server closes the connection without answering, the
+ * request is retried once on a fresh connection. A request that was sent
+ * but not answered in time is not: the server may have acted on it.
+ *
+ * Requests are driven by poll(), which does one bounded step at a time
+ * (open the connection, write one chunk, read what has arrived), so the
+ * caller's loop keeps running while a request is in flight. Headers are
+ * formatted into one fixed buffer and the body is written from the
+ * caller's, a chunk at a time; responses go through HttpResponseParser. Nothing on the
+ * request path allocates.
+ *
+ * Per-request round-trip time and bytes are kept for reporting.
+ */
+
+#ifndef HTTP_CONNECTION_H
+#define HTTP_CONNECTION_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "http_response_parser.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+struct HttpStats {
+  uint32_t requests;           // POSTs attempted
+  uint32_t failures;           // Not answered with a 2xx
+  uint32_t connects;           // Connections opened
+  uint32_t reused;             // Requests sent on an open connection
+  uint32_t stale;              // Reused connections found dead (retried)
+  uint32_t lastConnectMs;      // Connection setup for the last request (0 = reused)
+  uint32_t lastRttMs;          // Request written to response read
+  uint32_t lastBytesSent;      // Headers and body
+  uint32_t lastBytesReceived;  // Status line, headers and body
+  uint32_t bytesSent;          // Since boot
+  uint32_t bytesReceived;
+  uint32_t lastHeapDip;        // Free heap low point below its level at start()
+  uint32_t maxHeapDip;         // Since boot
+};
+
+// Where a request is (see poll())
+enum HttpState : uint8_t {
+  HTTP_IDLE,        // No request in flight
+  HTTP_CONNECTING,  // Opening the connection, or checking the open one
+  HTTP_SENDING,     // Writing headers, then the body a chunk at a time
+  HTTP_WAITING,     // Waiting for the first byte of the response
+  HTTP_READING      // Status line, headers, then the body
+};
+
+// ============================================================================
+// HTTP Connection Class
+// ============================================================================
+class HttpConnection {
+public:
+  static const uint8_t MAX_HOST = 64;
+  static const uint8_t MAX_HEADER_VALUE = HttpResponseParser::MAX_HEADER_VALUE;
+  static const size_t MAX_HEAD = 320;  // Request line and headers
+
+  HttpConnection();
+
+  void begin(Client& client);
+
+  // Start a POST of body to url (http[s]://host[:port]/path). url,
+  // contentType and body must stay valid until the request finishes.
+  // False if a request is already in flight or the URL is bad.
+  bool start(const char* url, const char* contentType, const uint8_t* body, size_t length);
+
+  // The same, with a small header of the caller's written ahead of body;
+  // each is sent from where it is, without copying them together
+  bool start(const char* url, const char* contentType, const uint8_t* prefix,
+             size_t prefixLength, const uint8_t* body, size_t length);
+
+  // Advance the request in flight by one step. Returns true while it is
+  // still running; once it returns false, succeeded() has the outcome.
+  bool poll();
+
+  bool isBusy() const { return state != HTTP_IDLE; }
+  HttpState getState() const { return state; }
+
+  // The last request was answered with a 2xx status
+  bool succeeded() const { return lastSucceeded; }
+
+  // Close the connection (e.g. before the modem drops the data session)
+  void close();
+
+  // Split http[s]://host[:port]/path; the scheme picks the default port.
+  // Whether the connection is encrypted is up to the client (MODEM_TLS).
+  static bool parseUrl(const char* url, char* hostOut, uint16_t& portOut, const char*& pathOut);
+
+  // Value of one response header from the last request ("" if absent)
+  void setCaptureHeader(const char* name) { captureName = name; }
+  const char* getCapturedHeader() const { return parser.getCaptured(); }
+
+  int getLastStatus() const { return parser.getStatus(); }
+  const HttpStats& getStats() const { return stats; }
+  const HttpParserStats& getParserStats() const { return parser.getStats(); }
+
+private:
+  Client* client;
+  bool open;
+  char host[MAX_HOST];
+  uint16_t port;
+  uint32_t lastUsed;  // millis() when the last response finished
+
+  // Request in flight
+  HttpState state;
+  char targetHost[MAX_HOST];
+  uint16_t targetPort;
+  const char* path;
+  const char* contentType;
+  const uint8_t* prefix;
+  size_t prefixLength;
+  size_t prefixSent;
+  const uint8_t* body;
+  size_t bodyLength;
+  size_t bodySent;
+  char head[MAX_HEAD];  // Formatted once per attempt
+  size_t headLength;
+  size_t headSent;
+  bool reused;         // Sent on a kept-alive connection
+  uint8_t attempt;     // 1 = retrying after a dead kept-alive connection
+  uint32_t requestStart;
+  uint32_t sentAt;     // millis() when the last byte of the request was written
+  uint32_t heapAtStart;
+
+  HttpResponseParser parser;
+  const char* captureName;
+  bool lastSucceeded;
+  HttpStats stats;
+
+  bool ensureOpen();
+  void connectStep();
+  void sendStep();
+  void waitStep();
+  void readStep();
+  void complete();
+  void trackHeap();
+  void retryOrFail();
+  void finish(bool success);
+};
+
+#endif // HTTP_CONNECTION_H
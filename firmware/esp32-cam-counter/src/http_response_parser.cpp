@@ -0,0 +1,220 @@
+/**
+ * SwanFlow - HTTP Response Parser Implementation
+ */
+
+#include "http_response_parser.h"
+#include <errno.h>
+
+// ============================================================================
+// Constructor
+// ============================================================================
+HttpResponseParser::HttpResponseParser() {
+  memset(&stats, 0, sizeof(stats));
+  begin();
+}
+
+void HttpResponseParser::begin(const char* name) {
+  captureName = name;
+  startResponse();
+}
+
+// Fresh status and headers, for a response or the one after a 1xx
+void HttpResponseParser::startResponse() {
+  state = STATE_STATUS;
+  lineLength = 0;
+  status = 0;
+  interim = false;
+  keepAlive = false;
+  lengthKnown = false;
+  chunked = false;
+  remaining = 0;
+  captured[0] = '\0';
+}
+
+// ============================================================================
+// Parsing
+// ============================================================================
+HttpParseResult HttpResponseParser::feed(const uint8_t* data, size_t length, size_t& consumed) {
+  size_t i = 0;
+
+  while (i < length && state != STATE_DONE && state != STATE_ERROR) {
+    // Body bytes are only counted off
+    if (state == STATE_BODY || state == STATE_CHUNK_DATA) {
+      uint32_t take = min((uint32_t)(length - i), remaining);
+      remaining -= take;
+      i += take;
+      if (remaining == 0) {
+        if (state == STATE_BODY) {
+          state = STATE_DONE;
+        } else {
+          state = STATE_CHUNK_END;
+        }
+      }
+      continue;
+    }
+
+    char c = data[i++];
+    if (c != '\n') {
+      // Long lines are cut short: only the start of a header matters
+      if (lineLength < sizeof(line) - 1) {
+        line[lineLength++] = c;
+      } else if (lineLength == sizeof(line) - 1) {
+        stats.longLines++;
+        lineLength++;  // Count it once
+      }
+      continue;
+    }
+
+    size_t len = min(lineLength, sizeof(line) - 1);
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+    lineLength = 0;
+
+    if (!handleLine()) state = STATE_ERROR;
+  }
+
+  consumed = i;
+  stats.bytes += i;
+
+  if (state == STATE_DONE) {
+    stats.responses++;
+    return HTTP_PARSE_DONE;
+  }
+  if (state == STATE_ERROR) {
+    stats.errors++;
+    return HTTP_PARSE_ERROR;
+  }
+  return HTTP_PARSE_MORE;
+}
+
+uint32_t HttpResponseParser::bodyRemaining() const {
+  return state == STATE_BODY || state == STATE_CHUNK_DATA ? remaining : 0;
+}
+
+// A complete line (CRLF removed). False if the response is malformed.
+bool HttpResponseParser::handleLine() {
+  switch (state) {
+    case STATE_STATUS:
+      return handleStatus();
+
+    case STATE_HEADERS:
+      if (line[0] == '\0') {
+        endOfHeaders();
+        return true;
+      }
+      return handleHeader();
+
+    case STATE_CHUNK_SIZE:
+      return handleChunkSize();
+
+    case STATE_CHUNK_END:
+      if (line[0] != '\0') return false;
+      state = STATE_CHUNK_SIZE;
+      return true;
+
+    case STATE_TRAILERS:
+      if (line[0] == '\0') state = STATE_DONE;
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+// "HTTP/1.1 200 OK"; HTTP/1.0 connections aren't kept alive
+bool HttpResponseParser::handleStatus() {
+  if (strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ') return false;
+  for (int i = 9; i < 12; i++) {
+    if (line[i] < '0' || line[i] > '9') return false;
+  }
+  if (line[12] != ' ' && line[12] != '\0') return false;  // "2000" is no status
+
+  keepAlive = line[7] == '1';
+  status = atoi(line + 9);
+  if (status == 101) return false;
+  interim = status >= 100 && status < 200;
+  DEBUG_PRINTLN(line);
+  state = STATE_HEADERS;
+  return true;
+}
+
+// False for a Content-Length that isn't a number: where the body ends,
+// and so where the next response starts, would be a guess
+bool HttpResponseParser::handleHeader() {
+  char* value = strchr(line, ':');
+  if (!value) return true;
+  *value++ = '\0';
+  while (*value == ' ' || *value == '\t') value++;
+
+  if (strcasecmp(line, "Content-Length") == 0) {
+    if (*value < '0' || *value > '9') return false;  // strtoul takes "-1"
+    char* end;
+    errno = 0;
+    unsigned long length = strtoul(value, &end, 10);
+    while (*end == ' ' || *end == '\t') end++;
+    if (*end != '\0' || errno == ERANGE || length > 0xFFFFFFFFUL) return false;
+    remaining = (uint32_t)length;
+    lengthKnown = true;
+  } else if (strcasecmp(line, "Connection") == 0 && strncasecmp(value, "close", 5) == 0) {
+    keepAlive = false;
+  } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+    // "chunked" is always the last coding when present
+    size_t len = strlen(value);
+    while (len > 0 && value[len - 1] == ' ') len--;
+    chunked = len >= 7 && strncasecmp(value + len - 7, "chunked", 7) == 0;
+  } else if (captureName && strcasecmp(line, captureName) == 0) {
+    strncpy(captured, value, MAX_HEADER_VALUE - 1);
+    captured[MAX_HEADER_VALUE - 1] = '\0';
+  }
+  return true;
+}
+
+// Chunked wins over Content-Length; with neither, the body runs to the
+// end of the connection and isn't read. A 1xx has no body: the real
+// response comes next.
+void HttpResponseParser::endOfHeaders() {
+  if (interim) {
+    stats.interim++;
+    startResponse();
+  } else if (chunked) {
+    stats.chunkedBodies++;
+    state = STATE_CHUNK_SIZE;
+  } else if (lengthKnown && remaining > 0) {
+    state = STATE_BODY;
+  } else {
+    state = STATE_DONE;
+  }
+}
+
+// Hex size, then optional ";extensions"; size 0 is the last chunk
+bool HttpResponseParser::handleChunkSize() {
+  uint32_t size = 0;
+  int digits = 0;
+  for (const char* p = line; *p && *p != ';' && *p != ' '; p++) {
+    char c = *p;
+    uint8_t nibble;
+    if (c >= '0' && c <= '9') {
+      nibble = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      nibble = c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      nibble = c - 'A' + 10;
+    } else {
+      return false;
+    }
+    size = (size << 4) | nibble;
+    if (size > MAX_CHUNK) return false;
+    digits++;
+  }
+  if (digits == 0) return false;
+
+  if (size == 0) {
+    state = STATE_TRAILERS;
+    return true;
+  }
+
+  stats.chunks++;
+  remaining = size;
+  state = STATE_CHUNK_DATA;
+  return true;
+}
@@ -0,0 +1,111 @@
+/**
+ * SwanFlow - HTTP Response Parser
+ *
+ * Streaming HTTP/1.x response parser: bytes are fed in as they arrive, in
+ * any split, and it works through the status line, headers and body
+ * (Content-Length or chunked) without allocating or buffering more than
+ * one line. The body isn't kept, only consumed, so that the next response
+ * on a kept-alive connection lines up.
+ *
+ * A response with neither a length nor chunked encoding ends at the end
+ * of its headers, and isn't kept alive (its body is dropped with the
+ * connection).
+ *
+ * Interim 1xx responses (100 Continue, 103 Early Hints) are skipped up to
+ * their empty line; the final status line follows them. 101 Switching
+ * Protocols is rejected, as no upgrade is ever asked for.
+ */
+
+#ifndef HTTP_RESPONSE_PARSER_H
+#define HTTP_RESPONSE_PARSER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+enum HttpParseResult : uint8_t {
+  HTTP_PARSE_MORE,   // Needs more bytes
+  HTTP_PARSE_DONE,   // Response complete
+  HTTP_PARSE_ERROR   // Not a valid response
+};
+
+// Parser counters since boot
+struct HttpParserStats {
+  uint32_t responses;       // Parsed to completion
+  uint32_t errors;          // Rejected as malformed
+  uint32_t bytes;           // Fed in, whole responses
+  uint32_t longLines;       // Header lines truncated to the line buffer
+  uint32_t chunkedBodies;
+  uint32_t chunks;
+  uint32_t interim;         // 1xx responses skipped
+};
+
+// ============================================================================
+// HTTP Response Parser Class
+// ============================================================================
+class HttpResponseParser {
+public:
+  static const uint8_t MAX_HEADER_VALUE = 32;
+  static const uint32_t MAX_CHUNK = 0x1000000;  // Larger chunk sizes are rejected
+
+  HttpResponseParser();
+
+  // Start on a new response; the value of captureName (if not null) is
+  // kept for getCaptured()
+  void begin(const char* captureName = nullptr);
+
+  // Parse length bytes. consumed is set to how many were used: all of
+  // them, unless the response ended (or was rejected) part way through.
+  HttpParseResult feed(const uint8_t* data, size_t length, size_t& consumed);
+
+  // Body bytes still expected before the response can end (0 if unknown),
+  // so a reader can avoid taking bytes past it
+  uint32_t bodyRemaining() const;
+
+  bool isDone() const { return state == STATE_DONE; }
+  int getStatus() const { return status; }
+  bool isSuccess() const { return status >= 200 && status < 300; }
+  // The connection can carry another request
+  bool isKeepAlive() const { return keepAlive && (lengthKnown || chunked); }
+  const char* getCaptured() const { return captured; }
+  const HttpParserStats& getStats() const { return stats; }
+
+private:
+  enum State : uint8_t {
+    STATE_STATUS,       // "HTTP/1.1 200 OK"
+    STATE_HEADERS,      // Up to the empty line
+    STATE_BODY,         // Content-Length bytes
+    STATE_CHUNK_SIZE,   // Hex size [;extensions]
+    STATE_CHUNK_DATA,
+    STATE_CHUNK_END,    // CRLF after the data
+    STATE_TRAILERS,     // After the last chunk, up to the empty line
+    STATE_DONE,
+    STATE_ERROR
+  };
+
+  State state;
+  char line[128];
+  size_t lineLength;
+
+  int status;
+  bool interim;        // Headers of a 1xx response
+  bool keepAlive;
+  bool lengthKnown;
+  bool chunked;
+  uint32_t remaining;  // Body or chunk bytes left
+
+  const char* captureName;
+  char captured[MAX_HEADER_VALUE];
+  HttpParserStats stats;
+
+  void startResponse();
+  bool handleLine();
+  bool handleStatus();
+  bool handleHeader();
+  bool handleChunkSize();
+  void endOfHeaders();
+};
+
+#endif // HTTP_RESPONSE_PARSER_H
@@ -0,0 +1,325 @@
+/**
+ * SwanFlow - Image Store Implementation
+ */
+
+#include "image_store.h"
+#include "esp_heap_caps.h"
+#include "esp32/rom/crc.h"
+
+#define IMAGE_DATA_PATH "/images/data.bin"
+#define IMAGE_INDEX_PATH "/images/index.bin"
+
+static const uint32_t INDEX_SECTORS =
+    (ImageStore::SLOTS + ImageStore::ENTRIES_PER_SECTOR - 1) / ImageStore::ENTRIES_PER_SECTOR;
+
+// ============================================================================
+// Constructor
+// ============================================================================
+ImageStore::ImageStore() {
+  fs = nullptr;
+  ready = false;
+  lock = nullptr;
+  entries = nullptr;
+  nextSeq = 1;
+  memset(&stats, 0, sizeof(stats));
+  stats.slots = SLOTS;
+  sweepPos = 0;
+  sweepCount = 0;
+  sweepBest = -1;
+  sweepBestScore = 0;
+  victim = -1;
+  victimSeq = 0;
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+bool ImageStore::begin(fs::FS &filesystem, SemaphoreHandle_t cardLock) {
+  fs = &filesystem;
+
+  // Whole index sectors, so an entry's sector is written straight from RAM
+  size_t indexBytes = INDEX_SECTORS * SECTOR_SIZE;
+  entries = (ImageEntry*)heap_caps_malloc(indexBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!entries) {
+    Serial.println("Image store: no memory for the index");
+    return false;
+  }
+  memset(entries, 0, indexBytes);
+
+  lock = cardLock ? cardLock : xSemaphoreCreateMutex();
+  if (!lock) return false;
+
+  if (!fs->exists("/images")) {
+    fs->mkdir("/images");
+  }
+
+  if (!allocate()) {
+    Serial.println("Image store: failed to prepare files");
+    return false;
+  }
+
+  // Kept open: a store is two seeks and two writes
+  data = fs->open(IMAGE_DATA_PATH, "r+");
+  indexFile = fs->open(IMAGE_INDEX_PATH, "r+");
+  if (!data || !indexFile || !loadIndex()) return false;
+
+  ready = true;
+  Serial.printf("Image store ready (%lu of %lu slots used)\n",
+                (unsigned long)stats.images, (unsigned long)SLOTS);
+  return true;
+}
+
+bool ImageStore::allocate() {
+  uint32_t dataSize = SLOTS * SLOT_SIZE;
+  uint32_t indexSize = INDEX_SECTORS * SECTOR_SIZE;
+
+  File dataProbe = fs->open(IMAGE_DATA_PATH, FILE_READ);
+  File indexProbe = fs->open(IMAGE_INDEX_PATH, FILE_READ);
+  bool sized = dataProbe && dataProbe.size() == dataSize &&
+               indexProbe && indexProbe.size() == indexSize;
+  if (dataProbe) dataProbe.close();
+  if (indexProbe) indexProbe.close();
+  if (sized) return true;
+
+  // First use (or a size change). The data file is only extended: entries
+  // are what make a slot valid, and the index starts out zeroed.
+  Serial.printf("Image store: allocating %lu slots of %lu KB\n",
+                (unsigned long)SLOTS, (unsigned long)IMAGE_SLOT_KB);
+
+  File created = fs->open(IMAGE_DATA_PATH, FILE_WRITE);
+  if (!created) return false;
+  bool ok = created.seek(dataSize - 1) && created.write((uint8_t)0) == 1;
+  created.close();
+  if (!ok) return false;
+
+  created = fs->open(IMAGE_INDEX_PATH, FILE_WRITE);
+  if (!created) return false;
+  uint8_t zero[SECTOR_SIZE];
+  memset(zero, 0, sizeof(zero));
+  for (uint32_t i = 0; i < INDEX_SECTORS && ok; i++) {
+    ok = created.write(zero, SECTOR_SIZE) == SECTOR_SIZE;
+  }
+  created.close();
+  return ok;
+}
+
+bool ImageStore::loadIndex() {
+  size_t indexBytes = INDEX_SECTORS * SECTOR_SIZE;
+  if (!indexFile.seek(0) || indexFile.read((uint8_t*)entries, indexBytes) != indexBytes) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < SLOTS; i++) {
+    ImageEntry& entry = entries[i];
+    if (entry.seq == 0) continue;
+
+    // Torn or stale entries free their slot
+    if (!entryValid(entry)) {
+      memset(&entry, 0, sizeof(entry));
+      continue;
+    }
+
+    stats.images++;
+    stats.usedBytes += entry.size;
+    if (entry.seq >= nextSeq) nextSeq = entry.seq + 1;
+  }
+
+  return true;
+}
+
+// ============================================================================
+// Storing
+// ============================================================================
+bool ImageStore::store(const ImageMeta& meta, const uint8_t* jpeg, size_t length) {
+  if (!ready) return false;
+
+  if (length > SLOT_SIZE) {
+    stats.rejected++;
+    return false;
+  }
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  int32_t slot = takeVictim();
+  ImageEntry& entry = entries[slot];
+
+  if (entry.seq != 0) {
+    stats.evicted++;
+    stats.images--;
+    stats.usedBytes -= entry.size;
+  }
+
+  // Data first: until the new entry lands, the old one fails its data CRC
+  bool ok = data.seek(slot * SLOT_SIZE) && data.write(jpeg, length) == length;
+  data.flush();
+
+  memset(&entry, 0, sizeof(entry));
+  if (ok) {
+    entry.seq = nextSeq++;
+    entry.epoch = meta.epoch;
+    entry.timestamp = meta.timestamp;
+    entry.size = length;
+    entry.dataCrc = crc32(jpeg, length);
+    entry.minConfidence = meta.minConfidence;
+    entry.maxConfidence = meta.maxConfidence;
+    entry.zone = meta.zone;
+    entry.vehicles = meta.vehicles;
+    entry.flags = meta.flags;
+    entry.cropX8 = meta.crop.x / 8;
+    entry.cropY8 = meta.crop.y / 8;
+    entry.crc = crc32(&entry, offsetof(ImageEntry, crc));
+  }
+
+  ok = writeEntry(slot) && ok;
+
+  if (ok) {
+    stats.stored++;
+    stats.images++;
+    stats.usedBytes += length;
+  } else {
+    stats.rejected++;
+  }
+
+  xSemaphoreGive(lock);
+  return ok;
+}
+
+bool ImageStore::writeEntry(uint32_t slot) {
+  uint32_t sector = slot / ENTRIES_PER_SECTOR;
+  bool ok = indexFile.seek(sector * SECTOR_SIZE) &&
+            indexFile.write((const uint8_t*)&entries[sector * ENTRIES_PER_SECTOR],
+                            SECTOR_SIZE) == SECTOR_SIZE;
+  indexFile.flush();
+  return ok;
+}
+
+// ============================================================================
+// Retention
+// ============================================================================
+uint32_t ImageStore::score(const ImageEntry& entry) const {
+  if (entry.seq == 0) return 0;  // Empty: use first
+
+  // Each reason to keep a frame buys it this many more stores before
+  // it is replaced
+  const uint32_t bonus = SLOTS * IMAGE_KEEP_BONUS_PERCENT / 100;
+
+  uint32_t s = entry.seq;
+  if (entry.flags & IMAGE_LOW_CONFIDENCE) s += bonus;
+  if (entry.flags & IMAGE_HIGH_VALUE) s += bonus;
+  return s;
+}
+
+void ImageStore::maintain() {
+  if (!ready) return;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+
+  // Slots only change by being stored into, which raises their score, so
+  // a victim stays the lowest until it is used
+  bool victimValid = victim >= 0 && entries[victim].seq == victimSeq;
+
+  for (int i = 0; i < IMAGE_MAINTAIN_ENTRIES && !victimValid; i++) {
+    uint32_t s = score(entries[sweepPos]);
+    if (sweepBest < 0 || s < sweepBestScore) {
+      sweepBest = sweepPos;
+      sweepBestScore = s;
+    }
+
+    sweepPos = (sweepPos + 1) % SLOTS;
+    sweepCount++;
+
+    // A full lap, or an empty slot (nothing scores lower)
+    if (sweepCount >= SLOTS || sweepBestScore == 0) {
+      // Stored into since the sweep passed it: start the lap again
+      if (score(entries[sweepBest]) != sweepBestScore) {
+        sweepBest = -1;
+        sweepCount = 0;
+        continue;
+      }
+
+      victim = sweepBest;
+      victimSeq = entries[victim].seq;
+      victimValid = true;
+      sweepBest = -1;
+      sweepCount = 0;
+    }
+  }
+
+  xSemaphoreGive(lock);
+}
+
+int32_t ImageStore::takeVictim() {
+  int32_t slot = victim;
+  victim = -1;
+  if (slot >= 0 && entries[slot].seq == victimSeq) return slot;
+
+  // The sweep hasn't kept up: scan the whole index now
+  stats.fullScans++;
+  slot = 0;
+  uint32_t best = score(entries[0]);
+  for (uint32_t i = 1; i < SLOTS && best > 0; i++) {
+    uint32_t s = score(entries[i]);
+    if (s < best) {
+      best = s;
+      slot = i;
+    }
+  }
+  return slot;
+}
+
+// ============================================================================
+// Reading
+// ============================================================================
+bool ImageStore::find(uint32_t afterSeq, ImageEntry& entry, TickType_t wait) {
+  if (!ready) return false;
+
+  if (xSemaphoreTake(lock, wait) != pdTRUE) return false;
+  int32_t found = -1;
+  for (uint32_t i = 0; i < SLOTS; i++) {
+    uint32_t seq = entries[i].seq;
+    if (seq > afterSeq && (found < 0 || seq < entries[found].seq)) found = i;
+  }
+  if (found >= 0) entry = entries[found];
+  xSemaphoreGive(lock);
+
+  return found >= 0;
+}
+
+ImageReadResult ImageStore::read(const ImageEntry& entry, uint8_t* buf, size_t maxLen,
+                                 TickType_t wait) {
+  if (!ready || entry.seq == 0 || entry.size > maxLen) return IMAGE_READ_GONE;
+
+  if (xSemaphoreTake(lock, wait) != pdTRUE) return IMAGE_READ_BUSY;
+  ImageReadResult result = IMAGE_READ_GONE;
+  for (uint32_t i = 0; i < SLOTS; i++) {
+    if (entries[i].seq != entry.seq) continue;
+
+    bool ok = data.seek(i * SLOT_SIZE) && data.read(buf, entry.size) == entry.size &&
+              crc32(buf, entry.size) == entry.dataCrc;
+    if (ok) result = IMAGE_READ_OK;
+    break;
+  }
+  xSemaphoreGive(lock);
+
+  return result;
+}
+
+ImageStoreStats ImageStore::getStats() {
+  if (!ready) return stats;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  ImageStoreStats copy = stats;
+  xSemaphoreGive(lock);
+  return copy;
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+bool ImageStore::entryValid(const ImageEntry& entry) const {
+  return entry.size <= SLOT_SIZE && entry.crc == crc32(&entry, offsetof(ImageEntry, crc));
+}
+
+uint32_t ImageStore::crc32(const void* data, size_t len) {
+  return crc32_le(0, (const uint8_t*)data, len);  // ROM implementation
+}
@@ -0,0 +1,157 @@
+/**
+ * SwanFlow - Image Store
+ *
+ * Detection JPEGs on the SD card under a fixed byte quota, without a FAT
+ * file per image. Images go into fixed-size slots of one preallocated
+ * file. A compact index (one 32-byte entry per slot: sequence number,
+ * time, size, confidence, zone, vehicles) lives in a second file and is
+ * mirrored in PSRAM, so finding an image or a slot to reuse never lists
+ * a directory.
+ *
+ * Retention: when the store is full the image with the lowest retention
+ * score is replaced. The score is the image's sequence number (oldest
+ * goes first), raised by IMAGE_KEEP_BONUS_PERCENT of the store for each
+ * of: a low-confidence detection (training data) and a high-value frame
+ * (several vehicles, or an incident in progress). The next victim is
+ * picked by a sweep of the index that advances a little at a time in
+ * idle time, so storing an image normally doesn't scan anything.
+ *
+ * An image's data is written before its index entry, and the entry holds
+ * a CRC of the data, so an image torn by a reset is never served.
+ *
+ * Thread safety: one task stores (see SdWriter); any task may read. A
+ * reader that must not wait for the writer passes wait = 0 (see
+ * EventLog, which can share the lock).
+ */
+
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "config.h"
+#include "jpeg_crop.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+enum ImageFlags : uint8_t {
+  IMAGE_LOW_CONFIDENCE = 0x01,  // A detection below IMAGE_LOW_CONFIDENCE_BELOW
+  IMAGE_HIGH_VALUE = 0x02       // IMAGE_HIGH_VALUE_VEHICLES or more, or an incident
+};
+
+// What the capture path knows about a frame
+struct ImageMeta {
+  uint32_t timestamp;     // Capture time (millis)
+  uint32_t epoch;         // Unix seconds (0 = unknown)
+  uint8_t minConfidence;  // Lowest detection confidence (0-255)
+  uint8_t maxConfidence;  // Highest detection confidence (0-255)
+  uint8_t zone;           // Zone of the most confident detection
+  uint8_t vehicles;       // Detections in the frame
+  uint8_t flags;          // ImageFlags
+  CropRect crop;          // Area to keep (width 0 = whole frame)
+};
+
+// Index entry, as stored on the card
+struct ImageEntry {
+  uint32_t seq;           // Store order (0 = empty slot)
+  uint32_t epoch;
+  uint32_t timestamp;
+  uint32_t size;          // JPEG bytes
+  uint32_t dataCrc;       // CRC32 of the JPEG
+  uint8_t minConfidence;
+  uint8_t maxConfidence;
+  uint8_t zone;
+  uint8_t vehicles;
+  uint8_t flags;
+  uint8_t cropX8;         // Where the image sits in the frame (8-pixel units;
+  uint8_t cropY8;         // 0 for a whole frame)
+  uint8_t reserved;
+  uint32_t crc;           // CRC32 of the preceding 28 bytes
+};
+
+static_assert(sizeof(ImageEntry) == 32, "ImageEntry must be 32 bytes");
+
+// Outcome of ImageStore::read()
+enum ImageReadResult : uint8_t {
+  IMAGE_READ_OK,
+  IMAGE_READ_GONE,  // Replaced since find(), too large for the buffer, or failed its CRC
+  IMAGE_READ_BUSY   // The lock wasn't free within wait; try again later
+};
+
+struct ImageStoreStats {
+  uint32_t images;      // Slots in use
+  uint32_t slots;
+  uint32_t usedBytes;   // JPEG bytes held
+  uint32_t stored;      // Since boot
+  uint32_t evicted;     // Replaced to make room, since boot
+  uint32_t rejected;    // Larger than a slot, or the write failed
+  uint32_t fullScans;   // Stores that had to scan because the sweep fell behind
+};
+
+// ============================================================================
+// Image Store Class
+// ============================================================================
+class ImageStore {
+public:
+  static const uint16_t SECTOR_SIZE = SD_BUFFER_SIZE;
+  static const uint32_t SLOT_SIZE = IMAGE_SLOT_KB * 1024;
+  static const uint32_t SLOTS = (uint32_t)IMAGE_STORE_MB * 1024 / IMAGE_SLOT_KB;
+  static const uint16_t ENTRIES_PER_SECTOR = SECTOR_SIZE / sizeof(ImageEntry);
+
+  ImageStore();
+
+  // Open (and on first use, preallocate) the store and load the index.
+  // cardLock, if given, is shared with the card's other stores.
+  bool begin(fs::FS &fs, SemaphoreHandle_t cardLock = nullptr);
+  bool isReady() const { return ready; }
+
+  // Store a JPEG, replacing the lowest-scoring image if full. meta.crop
+  // is where jpeg sits in the frame (it has already been cropped). Writes
+  // to the card; call from the SD writer task.
+  bool store(const ImageMeta& meta, const uint8_t* jpeg, size_t length);
+
+  // One step of the victim sweep (IMAGE_MAINTAIN_ENTRIES entries)
+  void maintain();
+
+  // Oldest image with seq > afterSeq; false if there is none, or the
+  // lock isn't free within wait
+  bool find(uint32_t afterSeq, ImageEntry& entry, TickType_t wait = portMAX_DELAY);
+
+  // Copy an image found with find() (entry.size bytes) to buf
+  ImageReadResult read(const ImageEntry& entry, uint8_t* buf, size_t maxLen,
+                       TickType_t wait = portMAX_DELAY);
+
+  ImageStoreStats getStats();
+
+private:
+  fs::FS* fs;
+  File data;
+  File indexFile;
+  bool ready;
+  SemaphoreHandle_t lock;  // Guards the files and index (may be the card's)
+
+  ImageEntry* entries;  // SLOTS entries, in PSRAM
+  uint32_t nextSeq;
+  ImageStoreStats stats;
+
+  // Victim sweep
+  uint32_t sweepPos;
+  uint32_t sweepCount;  // Entries examined in this lap
+  int32_t sweepBest;
+  uint32_t sweepBestScore;
+  int32_t victim;       // Lowest score found by the last full sweep
+  uint32_t victimSeq;   // Its seq then, to spot a slot reused since
+
+  bool allocate();
+  bool loadIndex();
+  bool writeEntry(uint32_t slot);
+  int32_t takeVictim();
+  uint32_t score(const ImageEntry& entry) const;
+  bool entryValid(const ImageEntry& entry) const;
+  static uint32_t crc32(const void* data, size_t len);
+};
+
+#endif // IMAGE_STORE_H
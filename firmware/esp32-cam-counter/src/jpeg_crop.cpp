@@ -0,0 +1,543 @@
+/**
+ * SwanFlow - JPEG Crop Implementation
+ */
+
+#include "jpeg_crop.h"
+
+// ============================================================================
+// Standard Huffman Tables (JPEG Annex K.3)
+// ============================================================================
+static const uint8_t DC_LUMA_COUNTS[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t DC_CHROMA_COUNTS[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t DC_SYMBOLS[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+
+static const uint8_t AC_LUMA_COUNTS[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t AC_LUMA_SYMBOLS[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t AC_CHROMA_COUNTS[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t AC_CHROMA_SYMBOLS[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+// Order matches stdCodes: DC luma, AC luma, DC chroma, AC chroma
+static const uint8_t* const STD_COUNTS[4] = {DC_LUMA_COUNTS, AC_LUMA_COUNTS, DC_CHROMA_COUNTS, AC_CHROMA_COUNTS};
+static const uint8_t* const STD_SYMBOLS[4] = {DC_SYMBOLS, AC_LUMA_SYMBOLS, DC_SYMBOLS, AC_CHROMA_SYMBOLS};
+static const uint8_t STD_CLASS_ID[4] = {0x00, 0x10, 0x01, 0x11};  // DHT Tc/Th
+
+JpegCropper::HuffCode JpegCropper::stdCodes[4][256];
+bool JpegCropper::stdReady = false;
+
+// Bits needed for |v| (the JPEG "category")
+static inline uint8_t bitLength(int32_t v) {
+  if (v < 0) v = -v;
+  uint8_t n = 0;
+  while (v) {
+    n++;
+    v >>= 1;
+  }
+  return n;
+}
+
+// ============================================================================
+// Constructor
+// ============================================================================
+JpegCropper::JpegCropper() {
+  memset(&cropped, 0, sizeof(cropped));
+}
+
+void JpegCropper::buildStandardCodes() {
+  // Canonical code assignment (Annex C)
+  for (int t = 0; t < 4; t++) {
+    memset(stdCodes[t], 0, sizeof(stdCodes[t]));
+    uint16_t code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+      for (int i = 0; i < STD_COUNTS[t][len - 1]; i++) {
+        HuffCode& c = stdCodes[t][STD_SYMBOLS[t][k++]];
+        c.code = code++;
+        c.length = len;
+      }
+      code <<= 1;
+    }
+  }
+  stdReady = true;
+}
+
+void JpegCropper::buildTable(HuffTable& table, const uint8_t* counts, const uint8_t* symbols) {
+  // Decoder tables (Annex F.2.2.3)
+  int32_t code = 0;
+  int32_t k = 0;
+  for (int len = 1; len <= 16; len++) {
+    table.valPtr[len] = k;
+    table.minCode[len] = code;
+    code += counts[len - 1];
+    k += counts[len - 1];
+    table.maxCode[len] = counts[len - 1] ? code - 1 : -1;
+    code <<= 1;
+  }
+  table.maxCode[17] = INT32_MAX;
+  memcpy(table.values, symbols, k);
+  table.defined = true;
+}
+
+// ============================================================================
+// Crop
+// ============================================================================
+size_t JpegCropper::crop(const uint8_t* jpeg, size_t length, const CropRect& rect,
+                         uint8_t* output, size_t maxOut) {
+  if (!stdReady) buildStandardCodes();
+
+  in = jpeg;
+  inLength = length;
+  inPos = 0;
+  bitBuffer = 0;
+  bitCount = 0;
+  markerHit = false;
+  out = output;
+  outMax = maxOut;
+  outPos = 0;
+  putBuffer = 0;
+  putCount = 0;
+  overflow = false;
+  width = 0;
+  height = 0;
+  componentCount = 0;
+  restartInterval = 0;
+  quantCount = 0;
+  for (int i = 0; i < 4; i++) {
+    dcTables[i].defined = false;
+    acTables[i].defined = false;
+  }
+
+  if (rect.width == 0 || rect.height == 0 || !parseHeaders()) return 0;
+  if (rect.x >= width || rect.y >= height) return 0;
+
+  // Widen to whole MCUs
+  uint16_t mcuWidth = 8 * maxH;
+  uint16_t mcuHeight = 8 * maxV;
+  uint16_t mcusX = (width + mcuWidth - 1) / mcuWidth;
+  uint16_t mcusY = (height + mcuHeight - 1) / mcuHeight;
+
+  uint32_t right = min((uint32_t)rect.x + rect.width, (uint32_t)width);
+  uint32_t bottom = min((uint32_t)rect.y + rect.height, (uint32_t)height);
+  uint16_t mcuX0 = rect.x / mcuWidth;
+  uint16_t mcuY0 = rect.y / mcuHeight;
+  uint16_t mcuX1 = min((uint32_t)(right + mcuWidth - 1) / mcuWidth, (uint32_t)mcusX);
+  uint16_t mcuY1 = min((uint32_t)(bottom + mcuHeight - 1) / mcuHeight, (uint32_t)mcusY);
+
+  // The last MCU column/row may be partly outside the frame
+  cropped.x = mcuX0 * mcuWidth;
+  cropped.y = mcuY0 * mcuHeight;
+  cropped.width = min((uint32_t)mcuX1 * mcuWidth, (uint32_t)width) - cropped.x;
+  cropped.height = min((uint32_t)mcuY1 * mcuHeight, (uint32_t)height) - cropped.y;
+
+  writeHeaders(cropped.width, cropped.height);
+  if (!transcodeScan(mcuX0, mcuY0, mcuX1, mcuY1)) return 0;
+
+  flushBits();
+  putMarker(0xD9);  // EOI
+
+  return overflow ? 0 : outPos;
+}
+
+// ============================================================================
+// Header Parsing
+// ============================================================================
+bool JpegCropper::parseHeaders() {
+  if (inLength < 4 || in[0] != 0xFF || in[1] != 0xD8) return false;
+
+  size_t pos = 2;
+  bool haveFrame = false;
+
+  while (pos + 4 <= inLength) {
+    if (in[pos] != 0xFF) return false;
+    while (pos < inLength && in[pos] == 0xFF) pos++;  // Fill bytes
+    if (pos + 3 > inLength) return false;
+
+    uint8_t marker = in[pos++];
+    uint16_t len = (in[pos] << 8) | in[pos + 1];
+    if (len < 2 || pos + len > inLength) return false;
+    const uint8_t* seg = in + pos + 2;
+    uint16_t segLen = len - 2;
+
+    switch (marker) {
+      case 0xC0:  // Baseline
+      case 0xC1:  // Extended sequential, Huffman
+        if (!parseSOF(seg, segLen)) return false;
+        haveFrame = true;
+        break;
+
+      case 0xC4:
+        if (!parseDHT(seg, segLen)) return false;
+        break;
+
+      case 0xDB:
+        if (quantCount >= 4) return false;
+        quantSegments[quantCount] = seg;
+        quantLengths[quantCount] = segLen;
+        quantCount++;
+        break;
+
+      case 0xDD:
+        if (segLen < 2) return false;
+        restartInterval = (seg[0] << 8) | seg[1];
+        break;
+
+      case 0xDA:
+        if (!haveFrame || !parseSOS(seg, segLen)) return false;
+        inPos = pos + len;
+        return true;
+
+      default:
+        // Other frame types (progressive, lossless, arithmetic) can't be cropped
+        if (marker >= 0xC2 && marker <= 0xCF) return false;
+        break;  // APPn, COM, ...: dropped from the output
+    }
+
+    pos += len;
+  }
+
+  return false;
+}
+
+bool JpegCropper::parseSOF(const uint8_t* seg, uint16_t len) {
+  if (len < 6 || seg[0] != 8) return false;
+
+  height = (seg[1] << 8) | seg[2];
+  width = (seg[3] << 8) | seg[4];
+  componentCount = seg[5];
+  if (width == 0 || height == 0) return false;
+  if (componentCount != 1 && componentCount != 3) return false;
+  if (len < 6 + 3 * componentCount) return false;
+
+  maxH = 1;
+  maxV = 1;
+  for (int i = 0; i < componentCount; i++) {
+    Component& c = components[i];
+    c.id = seg[6 + 3 * i];
+    c.h = seg[7 + 3 * i] >> 4;
+    c.v = seg[7 + 3 * i] & 15;
+    c.tq = seg[8 + 3 * i];
+    if (c.h < 1 || c.h > 2 || c.v < 1 || c.v > 2) return false;
+    if (c.h > maxH) maxH = c.h;
+    if (c.v > maxV) maxV = c.v;
+  }
+
+  // A single-component scan is non-interleaved: one block per MCU
+  if (componentCount == 1) {
+    components[0].h = components[0].v = 1;
+    maxH = maxV = 1;
+  }
+
+  return true;
+}
+
+bool JpegCropper::parseDHT(const uint8_t* seg, uint16_t len) {
+  uint16_t pos = 0;
+  while (pos + 17 <= len) {
+    uint8_t tc = seg[pos] >> 4;
+    uint8_t th = seg[pos] & 15;
+    if (tc > 1 || th > 3) return false;
+
+    const uint8_t* counts = seg + pos + 1;
+    uint16_t total = 0;
+    for (int i = 0; i < 16; i++) total += counts[i];
+    if (total > 256 || pos + 17 + total > len) return false;
+
+    buildTable(tc == 0 ? dcTables[th] : acTables[th], counts, seg + pos + 17);
+    pos += 17 + total;
+  }
+  return pos == len;
+}
+
+bool JpegCropper::parseSOS(const uint8_t* seg, uint16_t len) {
+  // Only a single scan holding every component (sequential JPEG)
+  if (len < 1 || seg[0] != componentCount || len < 4 + 2 * componentCount) return false;
+
+  for (int i = 0; i < componentCount; i++) {
+    uint8_t id = seg[1 + 2 * i];
+    uint8_t tables = seg[2 + 2 * i];
+    if (components[i].id != id) return false;
+
+    components[i].td = tables >> 4;
+    components[i].ta = tables & 15;
+    if (components[i].td > 3 || components[i].ta > 3) return false;
+    if (!dcTables[components[i].td].defined || !acTables[components[i].ta].defined) return false;
+    components[i].pred = 0;
+    components[i].outPred = 0;
+  }
+
+  const uint8_t* tail = seg + 1 + 2 * componentCount;
+  return tail[0] == 0 && tail[1] == 63 && tail[2] == 0;  // Ss, Se, Ah/Al
+}
+
+// ============================================================================
+// Header Writing
+// ============================================================================
+void JpegCropper::writeHeaders(uint16_t outWidth, uint16_t outHeight) {
+  putMarker(0xD8);  // SOI
+
+  // Quantization tables unchanged: coefficients are copied, not requantized
+  for (int i = 0; i < quantCount; i++) {
+    putMarker(0xDB);
+    put16(quantLengths[i] + 2);
+    for (int j = 0; j < quantLengths[i]; j++) putByte(quantSegments[i][j]);
+  }
+
+  putMarker(0xC0);
+  put16(8 + 3 * componentCount);
+  putByte(8);
+  put16(outHeight);
+  put16(outWidth);
+  putByte(componentCount);
+  for (int i = 0; i < componentCount; i++) {
+    putByte(components[i].id);
+    putByte((components[i].h << 4) | components[i].v);
+    putByte(components[i].tq);
+  }
+
+  for (int t = 0; t < (componentCount == 1 ? 2 : 4); t++) {
+    uint16_t symbols = 0;
+    for (int i = 0; i < 16; i++) symbols += STD_COUNTS[t][i];
+
+    putMarker(0xC4);
+    put16(2 + 1 + 16 + symbols);
+    putByte(STD_CLASS_ID[t]);
+    for (int i = 0; i < 16; i++) putByte(STD_COUNTS[t][i]);
+    for (int i = 0; i < symbols; i++) putByte(STD_SYMBOLS[t][i]);
+  }
+
+  putMarker(0xDA);
+  put16(6 + 2 * componentCount);
+  putByte(componentCount);
+  for (int i = 0; i < componentCount; i++) {
+    putByte(components[i].id);
+    putByte(i == 0 ? 0x00 : 0x11);  // Luma tables, then chroma tables
+  }
+  putByte(0);
+  putByte(63);
+  putByte(0);
+}
+
+void JpegCropper::putMarker(uint8_t marker) {
+  putByte(0xFF);
+  putByte(marker);
+}
+
+void JpegCropper::put16(uint16_t v) {
+  putByte(v >> 8);
+  putByte(v & 0xFF);
+}
+
+void JpegCropper::putByte(uint8_t b) {
+  if (outPos >= outMax) {
+    overflow = true;
+    return;
+  }
+  out[outPos++] = b;
+}
+
+// ============================================================================
+// Scan Transcoding
+// ============================================================================
+bool JpegCropper::transcodeScan(uint16_t mcuX0, uint16_t mcuY0, uint16_t mcuX1, uint16_t mcuY1) {
+  uint16_t mcusX = (width + 8 * maxH - 1) / (8 * maxH);
+  int16_t coef[64];
+
+  // Every MCU up to the bottom of the crop has to be decoded, since each
+  // depends on the bit position and DC prediction left by the one before
+  for (uint32_t m = 0; m < (uint32_t)mcuY1 * mcusX; m++) {
+    if (restartInterval && m > 0 && m % restartInterval == 0 && !restart()) return false;
+
+    uint16_t mx = m % mcusX;
+    uint16_t my = m / mcusX;
+    bool inside = mx >= mcuX0 && mx < mcuX1 && my >= mcuY0;
+
+    for (int c = 0; c < componentCount; c++) {
+      Component& comp = components[c];
+      for (int b = 0; b < comp.h * comp.v; b++) {
+        if (!decodeBlock(comp, coef)) return false;
+        if (inside) encodeBlock(comp, c == 0 ? 0 : 2, coef);
+      }
+    }
+
+    if (overflow) return false;
+  }
+
+  return true;
+}
+
+// ============================================================================
+// Entropy Decoding
+// ============================================================================
+void JpegCropper::fillBits() {
+  while (bitCount <= 24) {
+    uint8_t b = 0;
+
+    // At a marker (RSTn, EOI) the scan data has ended: feed zeros
+    if (!markerHit) {
+      if (inPos >= inLength) {
+        markerHit = true;
+      } else if (in[inPos] == 0xFF) {
+        if (inPos + 1 < inLength && in[inPos + 1] == 0x00) {
+          b = 0xFF;  // Stuffed byte
+          inPos += 2;
+        } else {
+          markerHit = true;
+        }
+      } else {
+        b = in[inPos++];
+      }
+    }
+
+    bitBuffer |= (uint32_t)b << (24 - bitCount);
+    bitCount += 8;
+  }
+}
+
+int32_t JpegCropper::getBits(uint8_t n) {
+  if (n == 0) return 0;
+  fillBits();
+  int32_t v = bitBuffer >> (32 - n);
+  bitBuffer <<= n;
+  bitCount -= n;
+  return v;
+}
+
+int JpegCropper::decodeHuffman(const HuffTable& table) {
+  int32_t code = getBits(1);
+  int len = 1;
+  while (code > table.maxCode[len]) {
+    if (++len > 16) return -1;  // Not a valid code
+    code = (code << 1) | getBits(1);
+  }
+  return table.values[table.valPtr[len] + code - table.minCode[len]];
+}
+
+bool JpegCropper::decodeBlock(Component& comp, int16_t* coef) {
+  // Coefficients stay in zigzag order; they are re-encoded in the same order
+  memset(coef, 0, 64 * sizeof(int16_t));
+
+  int t = decodeHuffman(dcTables[comp.td]);
+  if (t < 0 || t > 11) return false;
+  int32_t diff = getBits(t);
+  if (t && diff < (1 << (t - 1))) diff += 1 - (1 << t);  // EXTEND
+  comp.pred += diff;
+  coef[0] = comp.pred;
+
+  for (int k = 1; k < 64;) {
+    int rs = decodeHuffman(acTables[comp.ta]);
+    if (rs < 0) return false;
+
+    int r = rs >> 4;
+    int s = rs & 15;
+    if (s == 0) {
+      if (r != 15) break;  // EOB
+      k += 16;             // ZRL
+      continue;
+    }
+
+    k += r;
+    if (k > 63) return false;
+    int32_t v = getBits(s);
+    if (v < (1 << (s - 1))) v += 1 - (1 << s);
+    coef[k++] = v;
+  }
+
+  return true;
+}
+
+bool JpegCropper::restart() {
+  // Drop the partial byte, step over the RSTn marker, reset predictions
+  bitBuffer = 0;
+  bitCount = 0;
+  markerHit = false;
+
+  while (inPos < inLength && in[inPos] == 0xFF && inPos + 1 < inLength && in[inPos + 1] == 0xFF) {
+    inPos++;
+  }
+  if (inPos + 1 >= inLength || in[inPos] != 0xFF || (in[inPos + 1] & 0xF8) != 0xD0) return false;
+  inPos += 2;
+
+  for (int c = 0; c < componentCount; c++) components[c].pred = 0;
+  return true;
+}
+
+// ============================================================================
+// Entropy Encoding
+// ============================================================================
+void JpegCropper::putBits(uint32_t bits, uint8_t n) {
+  if (n == 0) return;
+  putBuffer = (putBuffer << n) | (bits & ((1u << n) - 1));
+  putCount += n;
+
+  while (putCount >= 8) {
+    uint8_t b = putBuffer >> (putCount - 8);
+    putByte(b);
+    if (b == 0xFF) putByte(0x00);  // Stuffing
+    putCount -= 8;
+  }
+  putBuffer &= (1u << putCount) - 1;
+}
+
+void JpegCropper::flushBits() {
+  // Pad the last byte with 1-bits
+  uint8_t pad = (8 - putCount % 8) % 8;
+  putBits((1u << pad) - 1, pad);
+}
+
+void JpegCropper::encodeBlock(Component& comp, uint8_t table, const int16_t* coef) {
+  const HuffCode* dc = stdCodes[table];
+  const HuffCode* ac = stdCodes[table + 1];
+
+  // DC relative to the previous block kept, not the previous block decoded
+  int32_t diff = coef[0] - comp.outPred;
+  comp.outPred = coef[0];
+
+  uint8_t s = bitLength(diff);
+  putBits(dc[s].code, dc[s].length);
+  putBits(diff < 0 ? diff - 1 : diff, s);
+
+  int run = 0;
+  for (int k = 1; k < 64; k++) {
+    if (coef[k] == 0) {
+      run++;
+      continue;
+    }
+
+    while (run > 15) {
+      putBits(ac[0xF0].code, ac[0xF0].length);  // ZRL
+      run -= 16;
+    }
+
+    s = bitLength(coef[k]);
+    uint8_t rs = (run << 4) | s;
+    putBits(ac[rs].code, ac[rs].length);
+    putBits(coef[k] < 0 ? coef[k] - 1 : coef[k], s);
+    run = 0;
+  }
+
+  if (run > 0) putBits(ac[0x00].code, ac[0x00].length);  // EOB
+}
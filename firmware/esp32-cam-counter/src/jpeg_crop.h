@@ -0,0 +1,141 @@
+/**
+ * SwanFlow - JPEG Crop
+ *
+ * Cuts a rectangle out of a baseline JPEG without decoding pixels. The
+ * entropy-coded scan is Huffman-decoded to quantized DCT coefficients,
+ * the MCUs inside the rectangle are re-encoded with their DC predictions
+ * rebased, and the result is wrapped in new headers. No IDCT, colour
+ * conversion or requantization, so the cropped blocks are bit-exact and
+ * the cost is one pass over the compressed frame.
+ *
+ * The rectangle is widened to whole MCUs (16x8 pixels for the camera's
+ * 4:2:2 output). The output always uses the standard Huffman tables
+ * (JPEG Annex K), which can code any baseline coefficient, and has no
+ * restart markers.
+ *
+ * Supported: baseline and extended sequential 8-bit Huffman JPEG, one or
+ * three components, sampling factors up to 2x2, with or without restart
+ * intervals. Anything else (progressive, arithmetic, 12-bit) is rejected.
+ */
+
+#ifndef JPEG_CROP_H
+#define JPEG_CROP_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+struct CropRect {
+  uint16_t x;       // Pixels from the left
+  uint16_t y;       // Pixels from the top
+  uint16_t width;   // 0 = no crop
+  uint16_t height;
+};
+
+// ============================================================================
+// JPEG Cropper Class
+// ============================================================================
+class JpegCropper {
+public:
+  JpegCropper();
+
+  // Crop jpeg to rect (widened to whole MCUs) into out. Returns the
+  // output length, or 0 if the input isn't supported, is corrupt, or the
+  // output doesn't fit in maxOut. On success getCropped() is the area
+  // actually kept.
+  size_t crop(const uint8_t* jpeg, size_t length, const CropRect& rect,
+              uint8_t* out, size_t maxOut);
+
+  const CropRect& getCropped() const { return cropped; }
+
+private:
+  static const uint8_t MAX_COMPONENTS = 3;
+
+  struct HuffTable {
+    bool defined;
+    int32_t maxCode[18];   // Largest code of each length (-1 = none)
+    int32_t valPtr[17];    // Index into values of each length's first code
+    int32_t minCode[17];
+    uint8_t values[256];
+  };
+
+  struct HuffCode {
+    uint16_t code;
+    uint8_t length;
+  };
+
+  struct Component {
+    uint8_t id;
+    uint8_t h;       // Sampling factors
+    uint8_t v;
+    uint8_t tq;      // Quantization table
+    uint8_t td;      // DC table (from SOS)
+    uint8_t ta;      // AC table
+    int16_t pred;    // Input DC prediction
+    int16_t outPred; // Output DC prediction
+  };
+
+  // Input
+  const uint8_t* in;
+  size_t inLength;
+  size_t inPos;
+  uint32_t bitBuffer;
+  uint8_t bitCount;
+  bool markerHit;  // Reached a marker inside the scan
+
+  // Output
+  uint8_t* out;
+  size_t outMax;
+  size_t outPos;
+  uint32_t putBuffer;
+  uint8_t putCount;
+  bool overflow;
+
+  // Frame
+  uint16_t width;
+  uint16_t height;
+  uint8_t componentCount;
+  Component components[MAX_COMPONENTS];
+  uint8_t maxH;
+  uint8_t maxV;
+  uint16_t restartInterval;
+  HuffTable dcTables[4];
+  HuffTable acTables[4];
+  const uint8_t* quantSegments[4];  // DQT segments to copy (incl. marker)
+  uint16_t quantLengths[4];
+  uint8_t quantCount;
+
+  CropRect cropped;
+
+  // Standard tables, built once
+  static HuffCode stdCodes[4][256];  // DC luma, AC luma, DC chroma, AC chroma
+  static bool stdReady;
+
+  bool parseHeaders();
+  bool parseSOF(const uint8_t* seg, uint16_t len);
+  bool parseDHT(const uint8_t* seg, uint16_t len);
+  bool parseSOS(const uint8_t* seg, uint16_t len);
+  void writeHeaders(uint16_t outWidth, uint16_t outHeight);
+  bool transcodeScan(uint16_t mcuX0, uint16_t mcuY0, uint16_t mcuX1, uint16_t mcuY1);
+
+  // Entropy decoding
+  void fillBits();
+  int32_t getBits(uint8_t n);
+  int decodeHuffman(const HuffTable& table);
+  bool decodeBlock(Component& comp, int16_t* coef);
+  bool restart();
+
+  // Entropy encoding
+  void putBits(uint32_t bits, uint8_t n);
+  void putByte(uint8_t b);
+  void putMarker(uint8_t marker);
+  void put16(uint16_t v);
+  void encodeBlock(Component& comp, uint8_t table, const int16_t* coef);
+  void flushBits();
+
+  static void buildTable(HuffTable& table, const uint8_t* counts, const uint8_t* symbols);
+  static void buildStandardCodes();
+};
+
+#endif // JPEG_CROP_H
@@ -0,0 +1,56 @@
+/**
+ * SwanFlow - Link Health Implementation
+ */
+
+#include "link_health.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+LinkHealth::LinkHealth() {
+  outcomes = 100;
+  failures = 0;
+  signalQuality = 99;
+}
+
+// ============================================================================
+// Outcomes
+// ============================================================================
+void LinkHealth::connected() {
+  failures = 0;
+  addOutcome(true);
+}
+
+void LinkHealth::connectFailed() {
+  if (failures < UINT8_MAX) failures++;
+  addOutcome(false);
+}
+
+void LinkHealth::uploadResult(bool success) {
+  addOutcome(success);
+}
+
+void LinkHealth::addOutcome(bool success) {
+  outcomes = (outcomes * 3 + (success ? 100 : 0) + 2) / 4;
+}
+
+// ============================================================================
+// Score and Backoff
+// ============================================================================
+uint8_t LinkHealth::score() const {
+  if (signalQuality == 99) return outcomes;
+
+  uint8_t signal = constrain(signalQuality, 0, 20) * 5;
+  return (outcomes * 3 + signal) / 4;
+}
+
+uint32_t LinkHealth::backoffMs() const {
+  uint32_t delayMs = MODEM_RETRY_DELAY_MS;
+  for (uint8_t i = 1; i < failures && delayMs < MODEM_BACKOFF_MAX_MS; i++) {
+    delayMs *= 2;
+  }
+  if (score() < 50) delayMs *= 2;
+  delayMs = min(delayMs, (uint32_t)MODEM_BACKOFF_MAX_MS);
+
+  return delayMs / 2 + random(delayMs / 2 + 1);
+}
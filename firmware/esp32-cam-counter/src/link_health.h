@@ -0,0 +1,55 @@
+/**
+ * SwanFlow - Link Health
+ *
+ * A 0-100 score for the modem link, and the wait before the next
+ * reconnect.
+ *
+ * The score blends recent outcomes (connects and uploads, an average
+ * that moves a quarter of the way to each new one) with signal strength
+ * (CSQ 20 and up counts as full). It starts at 100, so a fresh boot is
+ * trusted until it fails.
+ *
+ * Reconnects back off exponentially: MODEM_RETRY_DELAY_MS after the first
+ * failure, doubling with each one after to MODEM_BACKOFF_MAX_MS, and
+ * doubling once more while the score is below 50. The wait is then
+ * jittered to between half and all of that, so sites that lost the
+ * network together don't all retry together.
+ */
+
+#ifndef LINK_HEALTH_H
+#define LINK_HEALTH_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Link Health Class
+// ============================================================================
+class LinkHealth {
+public:
+  LinkHealth();
+
+  // The data session came up: failures reset
+  void connected();
+  // A connection attempt failed, or the session was lost
+  void connectFailed();
+  void uploadResult(bool success);
+  // CSQ (0-31, 99 = unknown)
+  void setSignal(int csq) { signalQuality = csq; }
+
+  uint8_t score() const;
+  // Consecutive failed connection attempts
+  uint8_t getFailures() const { return failures; }
+
+  // Wait before the next reconnect (jittered)
+  uint32_t backoffMs() const;
+
+private:
+  uint8_t outcomes;   // Recent outcomes, 0-100
+  uint8_t failures;
+  int signalQuality;
+
+  void addOutcome(bool success);
+};
+
+#endif // LINK_HEALTH_H
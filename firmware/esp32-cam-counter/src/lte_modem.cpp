@@ -7,6 +7,22 @@
 
 // Serial connection to modem
 HardwareSerial ModemSerial(1);  // Use Serial1
+static ModemStream modemStream;  // TinyGSM's view of it, shared with ModemAt
+
+// Binary telemetry, shared by live and replayed uploads
+static const size_t TELEMETRY_MAX_INTERVALS =
+    UPLOAD_BATCH_MAX > BACKLOG_BATCH_RECORDS ? UPLOAD_BATCH_MAX : BACKLOG_BATCH_RECORDS;
+static uint8_t telemetryRecord[TelemetryEncoder::maxSize(TELEMETRY_MAX_INTERVALS)];
+static uint8_t telemetryPacked[sizeof(telemetryRecord)];
+static LzCompressor telemetryLz;
+
+// Intervals are held through a PSM sleep; they must fit one batch
+static_assert(!MODEM_PSM || MODEM_PSM_TAU_S * 1000ULL <= (uint64_t)UPLOAD_BATCH_MAX * UPLOAD_INTERVAL_MS,
+              "MODEM_PSM_TAU_S is longer than an upload batch holds");
+
+// MQTT-SN short topic names (the gateway maps them to backend routes)
+static const char* MQTTSN_TOPIC_STATS = "st";    // SERVER_URL
+static const char* MQTTSN_TOPIC_BACKLOG = "sb";  // BACKLOG_URL
 
 // ============================================================================
 // Constructor
@@ -14,59 +30,253 @@ HardwareSerial ModemSerial(1);  // Use Serial1
 LTEModem::LTEModem() {
   modem = nullptr;
   client = nullptr;
+  state = MODEM_OFF;
+  stateSince = 0;
+  lastQuery = 0;
   modemInitialized = false;
-  gprsConnected = false;
-  lastConnectAttempt = 0;
+  signalQuality = 99;
+  backoffMs = MODEM_RETRY_DELAY_MS;
+  sleepMs = 0;
+  radioSending = false;
+  statsOmitted = 0;
+  active = UPLOAD_NONE;
+  finished = UPLOAD_NONE;
+  finishedOk = false;
+  finishedMqttSn = false;
+  viaMqttSn = false;
+  fallbackUrl = nullptr;
+  fallbackBody = nullptr;
+  fallbackLength = 0;
 }
 
 // ============================================================================
 // Initialization
 // ============================================================================
-bool LTEModem::begin() {
+void LTEModem::begin() {
   Serial.println("Initializing SIM7000A modem...");
+  if (MODEM_TLS && strlen(TLS_CA_CERT) == 0) {
+    Serial.println("*** ERROR: TLS_CA_CERT is not set in config.h - uploads are disabled ***");
+  }
 
   // Initialize serial connection to modem
   ModemSerial.begin(MODEM_BAUD, SERIAL_8N1, MODEM_RX, MODEM_TX);
-  delay(3000);
 
   // Create modem instance
-  modem = new TinyGsm(ModemSerial);
-  client = new TinyGsmClient(*modem);
+  modemStream.begin(ModemSerial);
+  modem = new TinyGsm(modemStream);
+  client = new ModemClient(*modem);
+  http.begin(*client);
+  http.setCaptureHeader("X-SwanFlow-Request");
+  power.begin(modemStream);
+
+  static char clientId[MqttSnClient::MAX_CLIENT_ID + 1];
+  snprintf(clientId, sizeof(clientId), "swanflow-%lu", (unsigned long)SITE_ID);
+  udp.begin(modemStream);
+  mqtt.begin(udp, MQTTSN_GATEWAY_HOST, MQTTSN_GATEWAY_PORT, clientId);
+
+  // The first poll() resets the modem
+  setState(MODEM_OFF);
+}
+
+// ============================================================================
+// Connection State Machine
+// ============================================================================
+void LTEModem::poll() {
+  if (!modem) return;
+
+  power.update(state >= MODEM_STARTING && state <= MODEM_ATTACHING, active != UPLOAD_NONE,
+               state == MODEM_SLEEPING);
+
+  switch (state) {
+    case MODEM_OFF: startModem(); break;
+    case MODEM_STARTING: pollStarting(); break;
+    case MODEM_REGISTERING: pollRegistering(); break;
+    case MODEM_ATTACHING: pollAttaching(); break;
+    case MODEM_READY: pollReady(); break;
+    case MODEM_SLEEPING: pollSleeping(); break;
+    case MODEM_BACKOFF:
+      // A modem that never came up (or lost the network) is reset;
+      // otherwise only the data session is brought up again
+      if (millis() - stateSince >= backoffMs) {
+        Serial.println("Attempting to reconnect...");
+        setState(modemInitialized ? MODEM_REGISTERING : MODEM_OFF);
+      }
+      break;
+  }
+}
+
+void LTEModem::setState(ModemState next) {
+  state = next;
+  stateSince = millis();
+  lastQuery = 0;
+}
+
+void LTEModem::fail(const char* reason) {
+  Serial.println(reason);
+  http.close();
+  mqtt.close();
+
+  health.connectFailed();
+  backoffMs = health.backoffMs();
+  Serial.printf("Reconnecting in %lu s (link health %d)\n", (unsigned long)(backoffMs / 1000),
+                health.score());
+  setState(MODEM_BACKOFF);
+}
+
+// Status queries while waiting in a state, one per interval
+bool LTEModem::queryDue(uint32_t interval) {
+  uint32_t now = millis();
+  if (lastQuery != 0 && now - lastQuery < interval) return false;
+  lastQuery = now ? now : 1;
+  return true;
+}
+
+// Reset the modem; it answers again after MODEM_BOOT_MS or so
+void LTEModem::startModem() {
+  Serial.println("Restarting modem...");
+  modemInitialized = false;
+  modem->sendAT(GF("+CFUN=1,1"));
+  modem->waitResponse(1000);
+  setState(MODEM_STARTING);
+}
+
+void LTEModem::pollStarting() {
+  uint32_t elapsed = millis() - stateSince;
+  if (elapsed < MODEM_BOOT_MS || !queryDue(MODEM_POLL_MS)) return;
+
+  if (!modem->testAT(100)) {
+    if (elapsed >= MODEM_START_TIMEOUT_MS) fail("Modem not responding");
+    return;
+  }
 
-  // Initialize modem
   if (!initModem()) {
-    Serial.println("Modem initialization failed");
-    return false;
+    fail("Modem initialization failed");
+    return;
   }
 
   modemInitialized = true;
+  Serial.print("Waiting for network...");
+  setState(MODEM_REGISTERING);
+}
+
+void LTEModem::pollRegistering() {
+  if (!queryDue(MODEM_POLL_MS)) return;
+
+  if (modem->isNetworkConnected()) {
+    Serial.println(" OK");
+    setState(MODEM_ATTACHING);
+    return;
+  }
 
-  // Connect to GPRS
+  // Not registering at all: reset the modem on the next attempt
+  if (millis() - stateSince >= MODEM_REGISTER_TIMEOUT_MS) {
+    Serial.println(" FAILED");
+    modemInitialized = false;
+    fail("No LTE network");
+  }
+}
+
+void LTEModem::pollAttaching() {
+  // Registered, so the attach inside gprsConnect() doesn't wait long
   if (!connectGPRS()) {
-    Serial.println("GPRS connection failed (will retry later)");
-    return false;
+    fail("GPRS connection failed (will retry later)");
+    return;
   }
 
-  gprsConnected = true;
+  // Retried before each upload until it works
+  if (MODEM_TLS && !tls.isConfigured() && !setupTls()) {
+    Serial.println("TLS setup failed (will retry later)");
+  }
+
+  signalQuality = modem->getSignalQuality();
+  power.readGranted();
+  power.activity();
+  health.connected();
+  health.setSignal(signalQuality);
   Serial.println("Modem ready");
+  setState(MODEM_READY);
+}
 
-  return true;
+void LTEModem::pollReady() {
+  if (active != UPLOAD_NONE) {
+    if (viaMqttSn) {
+      pollMqttSn();
+      return;
+    }
+    if (http.poll()) return;
+
+    if (http.getCapturedHeader()[0] != '\0') {
+      serverRequest = http.getCapturedHeader();
+      Serial.printf("Server requested: %s\n", serverRequest.c_str());
+    }
+
+    finishUpload(active, http.succeeded(), false);
+    jsonBody = String();  // Free it
+    return;
+  }
+
+  // PSM: the wake window is over. Sockets are closed while the modem is
+  // still awake; it keeps its registration and data session through sleep.
+  if (power.isAsleepDue() && finished == UPLOAD_NONE) {
+    http.close();
+    mqtt.close();
+    sleepMs = power.sleepMs();
+    Serial.printf("Modem asleep (PSM), next wake in %lu s\n", (unsigned long)(sleepMs / 1000));
+    setState(MODEM_SLEEPING);
+    return;
+  }
+
+  // Link check between uploads; the first query is due a full interval in
+  if (lastQuery == 0) lastQuery = stateSince ? stateSince : 1;
+  if (!queryDue(MODEM_LINK_CHECK_MS)) return;
+
+  signalQuality = modem->getSignalQuality();
+  health.setSignal(signalQuality);
+  if (!modem->isGprsConnected()) {
+    fail("Data session lost");
+  }
+}
+
+// Nothing is sent until the TAU wakes the modem; it answers AT then
+void LTEModem::pollSleeping() {
+  uint32_t elapsed = millis() - stateSince;
+  if (elapsed < sleepMs || !queryDue(MODEM_POLL_MS)) return;
+
+  if (!modem->testAT(100)) {
+    if (elapsed - sleepMs >= MODEM_START_TIMEOUT_MS) {
+      modemInitialized = false;
+      fail("Modem didn't wake from PSM");
+    }
+    return;
+  }
+
+  Serial.println("Modem awake");
+  power.activity();
+  setState(MODEM_READY);
+}
+
+void LTEModem::finishUpload(UploadKind kind, bool success, bool viaMqtt) {
+  finished = kind;
+  finishedOk = success;
+  finishedMqttSn = viaMqtt;
+  active = UPLOAD_NONE;
+
+  power.activity();
+  health.uploadResult(success);
+
+  // Radio time that reached the server isn't sent again
+  if (kind == UPLOAD_STATS && radioSending && success) power.reported(radioSent);
+  if (kind == UPLOAD_STATS) radioSending = false;
 }
 
 // ============================================================================
 // Modem Initialization
 // ============================================================================
 bool LTEModem::initModem() {
-  Serial.print("Waiting for modem response...");
-
-  // Restart modem
-  if (!modem->restart()) {
-    Serial.println(" FAILED");
-    return false;
-  }
-  Serial.println(" OK");
+  if (!modem->init()) return false;
 
   // Print modem info
+  signalQuality = modem->getSignalQuality();
   printModemInfo();
 
   // Set LTE bands for Australia
@@ -81,14 +291,25 @@ bool LTEModem::initModem() {
   modem->waitResponse();
   Serial.println(" OK");
 
-  // Wait for network
-  Serial.print("Waiting for network...");
-  if (!modem->waitForNetwork(60000)) {
-    Serial.println(" FAILED");
-    return false;
-  }
-  Serial.println(" OK");
+  // PSM and eDRX take effect from registration
+  power.configure();
+
+  return true;
+}
+
+// ============================================================================
+// TLS
+// ============================================================================
+bool LTEModem::setupTls() {
+  char host[HttpConnection::MAX_HOST];
+  uint16_t port;
+  const char* path;
+  if (!HttpConnection::parseUrl(SERVER_URL, host, port, path)) return false;
+
+  tls.begin(modemStream);
+  if (!tls.configure(host)) return false;
 
+  modem->setCertificate(TLS_CA_FILE);
   return true;
 }
 
@@ -115,80 +336,278 @@ bool LTEModem::connectGPRS() {
 // ============================================================================
 // Connection Management
 // ============================================================================
-bool LTEModem::isConnected() {
-  if (!modemInitialized) return false;
-  return modem->isNetworkConnected() && modem->isGprsConnected();
+bool LTEModem::disconnect() {
+  if (!modemInitialized) return true;
+
+  // An upload in flight is reported as failed
+  if (active != UPLOAD_NONE) {
+    finishUpload(active, false, viaMqttSn);
+    viaMqttSn = false;
+  }
+
+  http.close();
+  mqtt.close();
+  modem->gprsDisconnect();
+  backoffMs = MODEM_RETRY_DELAY_MS;
+  setState(MODEM_BACKOFF);
+  Serial.println("Disconnected from GPRS");
+
+  return true;
 }
 
-bool LTEModem::connect() {
-  if (isConnected()) return true;
+// ============================================================================
+// Data Upload
+// ============================================================================
+bool LTEModem::uploadStats(const CounterStats& stats, const IntervalRecord* intervals, size_t count,
+                           const MetricsSummary* metrics, const SdWriterStats* sd) {
+  if (!isIdle()) return false;
+  if (count == 0) return false;
+
+  // Previous upload, to compare connection reuse against reconnecting
+  const HttpStats& net = http.getStats();
+  const HttpStats* lastNet = net.requests > 0 ? &net : nullptr;
+
+  // Radio time so far; counted as sent once the upload succeeds
+  radioSent = getRadioStats();
+  radioSending = true;
+  statsOmitted = 0;
+
+#if TELEMETRY_BINARY
+  if (SITE_ID != 0) {
+    const uint8_t* payload;
+    size_t length = encodeTelemetry(intervals, count, metrics, sd, lastNet, &radioSent, payload);
+    if (length > 0) {
+      Serial.printf("Uploading %d intervals (%d bytes)\n", (int)count, (int)length);
+      return startTelemetry(UPLOAD_STATS, MQTTSN_TOPIC_STATS, SERVER_URL, payload, length);
+    }
+  }
+#endif
 
-  if (!modemInitialized) {
-    return begin();
+  // Build JSON payload (one interval: batching needs the binary format).
+  // Earlier intervals stay undelivered for the backlog replay.
+  statsOmitted = count - 1;
+  if (statsOmitted > 0) {
+    Serial.printf("JSON stats carry 1 of %d intervals; the rest go with the backlog\n", (int)count);
   }
+  jsonBody = buildStatsJSON(stats, intervals[count - 1], metrics, sd, lastNet, &radioSent);
+
+  DEBUG_PRINTLN("Uploading stats:");
+  DEBUG_PRINTLN(jsonBody);
 
-  return connectGPRS();
+  return startPOST(UPLOAD_STATS, SERVER_URL, "application/json",
+                   (const uint8_t*)jsonBody.c_str(), jsonBody.length());
 }
 
-bool LTEModem::disconnect() {
-  if (!modemInitialized) return true;
+// Each part is its own request, so a dropped link costs one part rather
+// than the image. The backend appends parts in order and checks the CRC
+// once it has them all (409 = it doesn't have the parts before offset).
+bool LTEModem::uploadImage(const ImageEntry& entry, const uint8_t* jpeg, uint32_t offset, size_t length) {
+  if (!isIdle()) return false;
+  if (offset + length > entry.size) return false;
+
+  // "SFIM", version, site name, image seq, size, part offset, CRC32,
+  // epoch, capture millis (LE32 each), min/max confidence, zone,
+  // vehicles, flags, crop X/Y (8 px), then the part's bytes
+  static uint8_t header[6 + 64 + 6 * 4 + 7];
+
+  size_t nameLen = strlen(SITE_NAME);
+  if (nameLen > 64) nameLen = 64;
+
+  uint8_t* p = header;
+  memcpy(p, "SFIM", 4);
+  p[4] = 1;
+  p[5] = nameLen;
+  memcpy(p + 6, SITE_NAME, nameLen);
+  p += 6 + nameLen;
+
+  uint32_t fields[] = { entry.seq, entry.size, offset, entry.dataCrc, entry.epoch, entry.timestamp };
+  for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+    for (int i = 0; i < 4; i++) {
+      *p++ = (fields[f] >> (i * 8)) & 0xFF;
+    }
+  }
+  *p++ = entry.minConfidence;
+  *p++ = entry.maxConfidence;
+  *p++ = entry.zone;
+  *p++ = entry.vehicles;
+  *p++ = entry.flags;
+  *p++ = entry.cropX8;
+  *p++ = entry.cropY8;
+
+  Serial.printf("Uploading image %lu: %lu-%lu of %lu bytes\n", (unsigned long)entry.seq,
+                (unsigned long)offset, (unsigned long)(offset + length), (unsigned long)entry.size);
+
+  return startPOST(UPLOAD_IMAGE, IMAGE_URL, "application/octet-stream", jpeg + offset, length,
+                   header, p - header);
+}
 
-  modem->gprsDisconnect();
-  gprsConnected = false;
-  Serial.println("Disconnected from GPRS");
+bool LTEModem::uploadIncident(const IncidentEvent& event, uint32_t stream) {
+  if (!isIdle()) return false;
 
-  return true;
+  jsonBody = buildIncidentJSON(event, stream);
+
+  DEBUG_PRINTLN("Uploading incident:");
+  DEBUG_PRINTLN(jsonBody);
+
+  return startPOST(UPLOAD_INCIDENT, INCIDENT_URL, "application/json",
+                   (const uint8_t*)jsonBody.c_str(), jsonBody.length());
 }
 
-void LTEModem::reconnect() {
-  unsigned long now = millis();
+bool LTEModem::uploadRollups(uint8_t tier, const RollupRecord* records, size_t count) {
+  if (!isIdle()) return false;
 
-  // Rate limit reconnection attempts
-  if (now - lastConnectAttempt < MODEM_RETRY_DELAY_MS) {
-    return;
+  // Binary batch: "SFRU", version, tier, count (LE16), site name, records
+  static uint8_t payload[9 + 64 + ROLLUP_BACKFILL_BATCH * sizeof(RollupRecord)];
+  if (count > ROLLUP_BACKFILL_BATCH) count = ROLLUP_BACKFILL_BATCH;
+
+  size_t nameLen = strlen(SITE_NAME);
+  if (nameLen > 64) nameLen = 64;
+
+  memcpy(payload, "SFRU", 4);
+  payload[4] = 1;
+  payload[5] = tier;
+  payload[6] = count & 0xFF;
+  payload[7] = count >> 8;
+  payload[8] = nameLen;
+  memcpy(payload + 9, SITE_NAME, nameLen);
+  memcpy(payload + 9 + nameLen, records, count * sizeof(RollupRecord));
+
+  Serial.printf("Uploading %d rollup records (tier %d)\n", (int)count, tier);
+
+  return startPOST(UPLOAD_ROLLUPS, ROLLUP_URL, "application/octet-stream", payload,
+                   9 + nameLen + count * sizeof(RollupRecord));
+}
+
+bool LTEModem::uploadBacklog(const IntervalRecord* records, size_t count) {
+  if (!isIdle()) return false;
+
+  if (count > BACKLOG_BATCH_RECORDS) count = BACKLOG_BATCH_RECORDS;
+
+  Serial.printf("Replaying %d intervals (%lu to %lu)\n", (int)count,
+                (unsigned long)records[0].interval, (unsigned long)records[count - 1].interval);
+
+#if TELEMETRY_BINARY
+  if (SITE_ID != 0) {
+    const uint8_t* telemetry;
+    size_t length = encodeTelemetry(records, count, nullptr, nullptr, nullptr, nullptr, telemetry);
+    if (length > 0) {
+      return startTelemetry(UPLOAD_BACKLOG, MQTTSN_TOPIC_BACKLOG, BACKLOG_URL, telemetry, length);
+    }
   }
+#endif
+
+  // Binary batch: "SFIB", version, count (LE16), site name, records
+  static uint8_t payload[8 + 64 + BACKLOG_BATCH_RECORDS * sizeof(IntervalRecord)];
 
-  lastConnectAttempt = now;
+  size_t nameLen = strlen(SITE_NAME);
+  if (nameLen > 64) nameLen = 64;
 
-  Serial.println("Attempting to reconnect...");
-  disconnect();
-  delay(1000);
-  connect();
+  memcpy(payload, "SFIB", 4);
+  payload[4] = 1;
+  payload[5] = count & 0xFF;
+  payload[6] = count >> 8;
+  payload[7] = nameLen;
+  memcpy(payload + 8, SITE_NAME, nameLen);
+  memcpy(payload + 8 + nameLen, records, count * sizeof(IntervalRecord));
+
+  return startPOST(UPLOAD_BACKLOG, BACKLOG_URL, "application/octet-stream", payload,
+                   8 + nameLen + count * sizeof(IntervalRecord));
 }
 
-// ============================================================================
-// Data Upload
-// ============================================================================
-bool LTEModem::uploadStats(const CounterStats& stats) {
-  if (!isConnected()) {
-    Serial.println("Not connected to network");
-    return false;
+bool LTEModem::uploadHeatmap(const uint8_t* cells, uint32_t seconds) {
+  if (!isIdle()) return false;
+
+  // Binary: "SFHM", version, cols, rows, site name, frame width/height,
+  // counting line Y (LE16 each), seconds accumulated (LE32), cells
+  static uint8_t payload[8 + 64 + 10 + Heatmap::SERIALIZED_SIZE];
+
+  size_t nameLen = strlen(SITE_NAME);
+  if (nameLen > 64) nameLen = 64;
+
+  uint16_t header[3] = { frameWidth(CAMERA_FRAME_SIZE), frameHeight(CAMERA_FRAME_SIZE), COUNTING_LINE_Y };
+
+  uint8_t* p = payload;
+  memcpy(p, "SFHM", 4);
+  p[4] = 1;
+  p[5] = Heatmap::COLS;
+  p[6] = Heatmap::ROWS;
+  p[7] = nameLen;
+  memcpy(p + 8, SITE_NAME, nameLen);
+  p += 8 + nameLen;
+  for (int i = 0; i < 3; i++) {
+    *p++ = header[i] & 0xFF;
+    *p++ = header[i] >> 8;
   }
+  for (int i = 0; i < 4; i++) {
+    *p++ = (seconds >> (i * 8)) & 0xFF;
+  }
+  memcpy(p, cells, Heatmap::SERIALIZED_SIZE);
+  p += Heatmap::SERIALIZED_SIZE;
 
-  // Build JSON payload
-  String json = buildStatsJSON(stats);
+  Serial.printf("Uploading heatmap (%d bytes)\n", (int)(p - payload));
 
-  DEBUG_PRINTLN("Uploading stats:");
-  DEBUG_PRINTLN(json);
+  return startPOST(UPLOAD_HEATMAP, HEATMAP_URL, "application/octet-stream", payload, p - payload);
+}
+
+// Binary telemetry record, LZ-compressed when that makes it smaller.
+// Returns the length and points payload at it; 0 if it didn't fit.
+size_t LTEModem::encodeTelemetry(const IntervalRecord* intervals, size_t count,
+                                 const MetricsSummary* metrics, const SdWriterStats* sd,
+                                 const HttpStats* net, const RadioStats* radio,
+                                 const uint8_t*& payload) {
+  TelemetryEncoder encoder(telemetryRecord, sizeof(telemetryRecord));
+  size_t length = encoder.encode(SITE_ID, intervals, count, metrics, sd, net, radio);
+  payload = telemetryRecord;
+
+  if (length > 0 && TELEMETRY_COMPRESS) {
+    size_t packed = encoder.compress(telemetryLz, telemetryPacked, sizeof(telemetryPacked));
+    if (packed > 0) {
+      DEBUG_PRINT("Telemetry compressed from ");
+      DEBUG_PRINTLN(length);
+      payload = telemetryPacked;
+      length = packed;
+    }
+  }
+
+  return length;
+}
 
-  // HTTP POST
-  bool success = httpPOST(SERVER_URL, "application/json", json);
+bool LTEModem::takeResult(UploadKind& kind, bool& success) {
+  if (finished == UPLOAD_NONE) return false;
 
-  return success;
+  kind = finished;
+  success = finishedOk;
+  finished = UPLOAD_NONE;
+  return true;
 }
 
-bool LTEModem::uploadImage(const uint8_t* imageData, size_t imageSize) {
-  // TODO: Implement image upload
-  // This will use multipart/form-data or base64 encoding
-  Serial.println("Image upload not yet implemented");
-  return false;
+bool LTEModem::takeServerRequest(const char* name) {
+  if (serverRequest != name) return false;
+  serverRequest = "";
+  return true;
 }
 
 // ============================================================================
 // JSON Builder
 // ============================================================================
-String LTEModem::buildStatsJSON(const CounterStats& stats) {
-  StaticJsonDocument<512> doc;
+// Sparse histogram: {"n": samples, "sum": total, "b": [bucket, count, ...]}
+static void addHistogram(JsonObject parent, const char* key, const LogHistogram& hist) {
+  JsonObject obj = parent.createNestedObject(key);
+  obj["n"] = hist.total;
+  obj["sum"] = hist.sum;
+
+  JsonArray buckets = obj.createNestedArray("b");
+  for (int i = 0; i < LogHistogram::BUCKETS; i++) {
+    if (hist.counts[i] == 0) continue;
+    buckets.add(i);
+    buckets.add(hist.counts[i]);
+  }
+}
+
+String LTEModem::buildStatsJSON(const CounterStats& stats, const IntervalRecord& interval,
+                                const MetricsSummary* metrics, const SdWriterStats* sd,
+                                const HttpStats* net, const RadioStats* radio) {
+  DynamicJsonDocument doc(metrics ? 3584 : 1024);
 
   doc["site"] = stats.siteName;
   doc["lat"] = stats.latitude;
@@ -199,6 +618,83 @@ String LTEModem::buildStatsJSON(const CounterStats& stats) {
   doc["hour_count"] = stats.lastHourCount;
   doc["minute_count"] = stats.lastMinuteCount;
   doc["avg_confidence"] = stats.avgConfidence;
+  doc["interval"] = interval.interval;
+  doc["stream"] = interval.stream;
+
+  if (metrics) {
+    JsonObject m = doc.createNestedObject("metrics");
+    m["seq"] = metrics->seq;
+    m["interval_ms"] = metrics->duration;
+    m["vehicles"] = metrics->vehicles;
+    addHistogram(m, "headway_ms", metrics->headwayMs);
+    addHistogram(m, "gap_ms", metrics->gapMs);
+    addHistogram(m, "speed_dkmh", metrics->speedDkmh);
+
+    JsonArray confidence = m.createNestedArray("confidence");
+    for (int i = 0; i < 20; i++) {
+      confidence.add(metrics->confidence[i]);
+    }
+  }
+
+  if (net) {
+    JsonObject n = doc.createNestedObject("net");
+    n["rtt_ms"] = net->lastRttMs;
+    n["connect_ms"] = net->lastConnectMs;
+    n["sent"] = net->lastBytesSent;
+    n["received"] = net->lastBytesReceived;
+    n["connects"] = net->connects;
+    n["reused"] = net->reused;
+    n["stale"] = net->stale;
+  }
+
+  if (sd) {
+    JsonObject s = doc.createNestedObject("sd");
+    s["written"] = sd->written;
+    s["failed"] = sd->failed;
+    s["dropped"] = sd->dropped;
+    s["queue"] = sd->queueDepth;
+    s["queue_max"] = sd->maxQueueDepth;
+    s["p50_us"] = sd->latencyP50Us;
+    s["p95_us"] = sd->latencyP95Us;
+    s["p99_us"] = sd->latencyP99Us;
+    s["stack_free"] = sd->stackFree;
+  }
+
+  if (radio) {
+    JsonObject r = doc.createNestedObject("radio");
+    r["period_ms"] = radio->periodMs;
+    r["active_ms"] = radio->activeMs;
+    r["awake_ms"] = radio->awakeMs;
+    r["wakes"] = radio->wakes;
+    r["health"] = radio->linkHealth;
+    r["tau_s"] = radio->tauS;
+    r["active_time_s"] = radio->activeTimeS;
+    r["edrx_ms"] = radio->edrxMs;
+  }
+
+  String output;
+  serializeJson(doc, output);
+
+  return output;
+}
+
+// (stream, seq) names the event, so a resend after a lost response is
+// recognised by the backend
+String LTEModem::buildIncidentJSON(const IncidentEvent& event, uint32_t stream) {
+  StaticJsonDocument<256> doc;
+
+  doc["site"] = SITE_NAME;
+  doc["stream"] = stream;
+  doc["seq"] = event.seq;
+  doc["type"] = incidentTypeName(event.type);
+  if (event.zone != INCIDENT_ZONE_SITE) {
+    doc["zone"] = event.zone;
+  }
+  doc["active"] = event.active;
+  doc["value"] = event.value;
+  doc["baseline"] = event.baseline;
+  doc["age_ms"] = millis() - event.timestamp;  // Server derives wall-clock time
+  doc["uptime"] = millis() / 1000;
 
   String output;
   serializeJson(doc, output);
@@ -207,53 +703,75 @@ String LTEModem::buildStatsJSON(const CounterStats& stats) {
 }
 
 // ============================================================================
-// HTTP POST
+// MQTT-SN
 // ============================================================================
-bool LTEModem::httpPOST(const String& url, const String& contentType, const String& body) {
-  // Parse URL
-  // Expected format: https://domain.com/path
-  int hostStart = url.indexOf("://") + 3;
-  int pathStart = url.indexOf("/", hostStart);
+// A binary telemetry record: published over MQTT-SN when that's enabled,
+// the gateway has been answering and it fits a datagram, otherwise
+// POSTed to url
+bool LTEModem::startTelemetry(UploadKind kind, const char* topic, const char* url,
+                              const uint8_t* body, size_t bodyLen) {
+  if (MQTTSN_ENABLED && bodyLen <= MqttSnClient::MAX_PAYLOAD && mqtt.isAvailable()) {
+    if (mqtt.publish(topic, body, bodyLen)) {
+      power.activity();
+      active = kind;
+      viaMqttSn = true;
+      fallbackUrl = url;
+      fallbackBody = body;
+      fallbackLength = bodyLen;
+      return true;
+    }
+  }
+
+  return startPOST(kind, url, "application/octet-stream", body, bodyLen);
+}
+
+// A publish the gateway answered is done, accepted or not (as with an
+// HTTP status); one it didn't answer goes again over HTTP
+void LTEModem::pollMqttSn() {
+  if (mqtt.poll()) return;
+  viaMqttSn = false;
+
+  char request[MqttSnClient::MAX_REQUEST];
+  if (mqtt.takeRequest(request, sizeof(request))) {
+    serverRequest = request;
+    Serial.printf("Server requested: %s\n", request);
+  }
 
-  String host = url.substring(hostStart, pathStart);
-  String path = url.substring(pathStart);
-  int port = 443;  // HTTPS
+  UploadKind kind = active;
+  active = UPLOAD_NONE;
 
-  Serial.printf("POST %s%s\n", host.c_str(), path.c_str());
+  if (mqtt.getReturnCode() != MQTTSN_NO_ANSWER) {
+    finishUpload(kind, mqtt.succeeded(), true);
+    return;
+  }
+
+  Serial.println("MQTT-SN gateway not answering, sending over HTTP");
+  if (!startPOST(kind, fallbackUrl, "application/octet-stream", fallbackBody, fallbackLength)) {
+    finishUpload(kind, false, false);
+  }
+}
 
-  // Connect to server
-  if (!client->connect(host.c_str(), port)) {
-    Serial.println("Connection to server failed");
+// ============================================================================
+// HTTP POST
+// ============================================================================
+// Start the request; pollReady() drives it to completion
+bool LTEModem::startPOST(UploadKind kind, const char* url, const char* contentType,
+                         const uint8_t* body, size_t bodyLen,
+                         const uint8_t* prefix, size_t prefixLen) {
+  if (MODEM_TLS && !tls.isConfigured() && !setupTls()) {
+    Serial.println("TLS not set up, upload skipped");
+    jsonBody = String();
     return false;
   }
 
-  // Send HTTP request
-  client->print(String("POST ") + path + " HTTP/1.1\r\n");
-  client->print(String("Host: ") + host + "\r\n");
-  client->print(String("Content-Type: ") + contentType + "\r\n");
-  client->print(String("Content-Length: ") + body.length() + "\r\n");
-  client->print(String("Authorization: Bearer ") + API_KEY + "\r\n");
-  client->print("Connection: close\r\n\r\n");
-  client->print(body);
-
-  // Wait for response
-  unsigned long timeout = millis();
-  while (client->connected() && millis() - timeout < 10000) {
-    if (client->available()) {
-      String line = client->readStringUntil('\n');
-      DEBUG_PRINTLN(line);
-
-      // Check for HTTP 200 OK
-      if (line.indexOf("200") >= 0 || line.indexOf("201") >= 0) {
-        client->stop();
-        return true;
-      }
-    }
+  if (!http.start(url, contentType, prefix, prefixLen, body, bodyLen)) {
+    jsonBody = String();
+    return false;
   }
 
-  client->stop();
-  Serial.println("Request timeout or non-200 response");
-  return false;
+  power.activity();
+  active = kind;
+  return true;
 }
 
 // ============================================================================
@@ -267,12 +785,34 @@ void LTEModem::printModemInfo() {
   Serial.printf("Name: %s\n", modemName.c_str());
   Serial.printf("Info: %s\n", modemInfo.c_str());
 
-  int signal = getSignalQuality();
-  Serial.printf("Signal: %d\n", signal);
+  Serial.printf("Signal: %d\n", signalQuality);
   Serial.println("------------------");
 }
 
-int LTEModem::getSignalQuality() {
+RadioStats LTEModem::getRadioStats() const {
+  RadioStats stats = power.getStats();
+  stats.linkHealth = health.score();
+  return stats;
+}
+
+uint32_t LTEModem::getUnixTime() {
   if (!modemInitialized) return 0;
-  return modem->getSignalQuality();
+
+  int year, month, day, hour, minute, second;
+  float timezone;
+  if (!modem->getNetworkTime(&year, &month, &day, &hour, &minute, &second, &timezone)) {
+    return 0;
+  }
+  if (year < 2024) return 0;  // Modem hasn't received network time yet
+
+  // Days since 1970-01-01 (civil calendar)
+  int y = month <= 2 ? year - 1 : year;
+  int era = y / 400;
+  int yoe = y - era * 400;
+  int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  int32_t days = era * 146097 + doe - 719468;
+
+  // Modem reports local time; timezone is in hours
+  return days * 86400UL + hour * 3600UL + minute * 60UL + second - (int32_t)(timezone * 3600);
 }
@@ -2,6 +2,25 @@
  * SwanFlow - LTE Modem Interface
  *
  * Handles SIM7000A LTE modem communication
+ *
+ * Everything runs from poll(), called every loop: bringing the modem up
+ * (reset, LTE registration, data session) and the upload in flight. Each
+ * call does a bounded amount of work, a few short AT exchanges or one
+ * HTTP step, so detection keeps its frame rate while the modem connects
+ * and uploads are sent. Waits (modem boot, registration, retry delays)
+ * are timestamps checked on the next poll, not delay() calls.
+ *
+ * One upload is in flight at a time. The upload calls start it and
+ * return at once; takeResult() reports how it went.
+ *
+ * Power saving (ModemPower): PSM and eDRX are requested as configured.
+ * Under PSM the modem is left to sleep once the wake window after the
+ * last traffic ends, and poll() looks for it again at its next TAU;
+ * nothing can be uploaded in between. Reconnects back off by LinkHealth.
+ *
+ * With MQTTSN_ENABLED, binary stats and backlog records are published
+ * over MQTT-SN (UDP) instead; a publish the gateway doesn't answer is
+ * sent again over HTTP, and HTTP alone is used for MQTTSN_FALLBACK_MS.
  */
 
 #ifndef LTE_MODEM_H
@@ -9,12 +28,70 @@
 
 #include <Arduino.h>
 #include "config.h"
+#include "http_connection.h"
+#include "image_store.h"
+#include "link_health.h"
+#include "modem_power.h"
+#include "modem_tls.h"
+#include "modem_udp.h"
+#include "mqtt_sn.h"
 #include "vehicle_counter.h"
+#include "rollup_store.h"
+#include "sd_writer.h"
+#include "stats_backlog.h"
+#include "telemetry.h"
 
-// TinyGSM library
+// TinyGSM library (the SSL variant uses the modem's CA* socket commands)
+#if MODEM_TLS
+#define TINY_GSM_MODEM_SIM7000SSL
+#else
 #define TINY_GSM_MODEM_SIM7000
+#endif
 #include <TinyGsmClient.h>
 
+#if MODEM_TLS
+typedef TinyGsmClientSecure ModemClientBase;
+#else
+typedef TinyGsmClient ModemClientBase;
+#endif
+
+// Opening a socket is one AT exchange that waits for the network; bound
+// it by HTTP_CONNECT_TIMEOUT_S rather than TinyGSM's 75 s
+class ModemClient : public ModemClientBase {
+public:
+  explicit ModemClient(TinyGsm& modem) : ModemClientBase(modem) {}
+
+  using ModemClientBase::connect;
+  int connect(const char* host, uint16_t port) override {
+    return ModemClientBase::connect(host, port, HTTP_CONNECT_TIMEOUT_S);
+  }
+};
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+// Connection progress (see poll())
+enum ModemState : uint8_t {
+  MODEM_OFF,          // Not started, or about to be reset
+  MODEM_STARTING,     // Reset sent, waiting for the modem to answer
+  MODEM_REGISTERING,  // Waiting for the LTE network
+  MODEM_ATTACHING,    // Bringing up the data session
+  MODEM_READY,        // Connected: uploads can be started
+  MODEM_SLEEPING,     // PSM: asleep until its next TAU (no AT)
+  MODEM_BACKOFF       // Waiting after a failure (LinkHealth backoff)
+};
+
+// What an upload was, reported back by takeResult()
+enum UploadKind : uint8_t {
+  UPLOAD_NONE,
+  UPLOAD_STATS,
+  UPLOAD_INCIDENT,
+  UPLOAD_ROLLUPS,
+  UPLOAD_HEATMAP,
+  UPLOAD_BACKLOG,
+  UPLOAD_IMAGE
+};
+
 // ============================================================================
 // LTE Modem Class
 // ============================================================================
@@ -22,36 +99,136 @@ class LTEModem {
 public:
   LTEModem();
 
-  // Initialization
-  bool begin();
+  // Set up the serial link; the modem is started by poll()
+  void begin();
+
+  // Advance connection setup and the upload in flight
+  void poll();
 
   // Connection management
-  bool isConnected();
-  bool connect();
+  ModemState getState() const { return state; }
+  bool isConnected() const { return state == MODEM_READY; }
+  // In PSM sleep: still registered, uploads wait for the next wake
+  bool isAsleep() const { return state == MODEM_SLEEPING; }
+  // The radio is up from recent traffic (always, without power saving):
+  // uploads that can wait are best started now
+  bool inWakeWindow() const { return power.inWakeWindow(); }
+  // Connected, nothing in flight and no result waiting to be taken
+  bool isIdle() const { return state == MODEM_READY && active == UPLOAD_NONE && finished == UPLOAD_NONE; }
+  // Drop the data session (poll() reconnects after MODEM_RETRY_DELAY_MS)
   bool disconnect();
-  void reconnect();
 
-  // Data upload
-  bool uploadStats(const CounterStats& stats);
-  bool uploadImage(const uint8_t* imageData, size_t imageSize);
+  // Data upload. Each starts an upload and returns at once: false if the
+  // modem isn't idle or the payload couldn't be built, otherwise the
+  // outcome comes from takeResult(). Payloads are copied or encoded into
+  // the modem's own buffers, so the arguments needn't outlive the call.
+  // Intervals oldest first. More than one needs the binary format: the
+  // JSON fallback carries only the newest (see getStatsOmitted()).
+  bool uploadStats(const CounterStats& stats, const IntervalRecord* intervals, size_t count,
+                   const MetricsSummary* metrics = nullptr, const SdWriterStats* sd = nullptr);
+  // Bytes [offset, offset + length) of a stored image, sent raw straight
+  // from jpeg (the whole image, entry.size bytes), which must stay as it
+  // is until the upload finishes
+  bool uploadImage(const ImageEntry& entry, const uint8_t* jpeg, uint32_t offset, size_t length);
+  bool uploadIncident(const IncidentEvent& event, uint32_t stream);
+  bool uploadRollups(uint8_t tier, const RollupRecord* records, size_t count);
+  bool uploadHeatmap(const uint8_t* cells, uint32_t seconds);
+  bool uploadBacklog(const IntervalRecord* records, size_t count);
+
+  // An upload finished: which kind, and whether the server took it (2xx).
+  // Returns true once per upload.
+  bool takeResult(UploadKind& kind, bool& success);
+
+  // Server requests (X-SwanFlow-Request response header, e.g. "heatmap").
+  // Returns true once per request, then forgets it.
+  bool takeServerRequest(const char* name);
+
+  // HTTP status of the last upload (0 if there was no response)
+  int getLastStatus() const { return http.getLastStatus(); }
+
+  // Round-trip time and bytes of recent uploads
+  const HttpStats& getHttpStats() const { return http.getStats(); }
+  const MqttSnStats& getMqttSnStats() const { return mqtt.getStats(); }
+  // The last upload taken went over MQTT-SN rather than HTTP
+  bool wasMqttSn() const { return finishedMqttSn; }
+  // Leading intervals the last stats upload left out (JSON fallback);
+  // they weren't delivered
+  size_t getStatsOmitted() const { return statsOmitted; }
+
+  // Radio-on time since the last stats upload, with the link health
+  // score and granted power-saving timers (sent with stats uploads)
+  RadioStats getRadioStats() const;
+  uint8_t getLinkHealth() const { return health.score(); }
 
   // Diagnostics
   void printModemInfo();
-  int getSignalQuality();
+  // CSQ from the last link check (0-31, 99 = unknown)
+  int getSignalQuality() const { return signalQuality; }
+
+  // Network (NITZ) time as Unix seconds, 0 if not available
+  uint32_t getUnixTime();
 
 private:
   TinyGsm* modem;
-  TinyGsmClient* client;
+  ModemClient* client;
+  HttpConnection http;  // Keep-alive connection over client
+  ModemTls tls;
+  ModemPower power;
+  LinkHealth health;
+  ModemUdp udp;
+  MqttSnClient mqtt;
 
+  ModemState state;
+  uint32_t stateSince;  // millis() when state was entered
+  uint32_t lastQuery;   // millis() of the last status query in this state
   bool modemInitialized;
-  bool gprsConnected;
-  unsigned long lastConnectAttempt;
+  int signalQuality;
+  uint32_t backoffMs;   // Wait in MODEM_BACKOFF
+  uint32_t sleepMs;     // Wait in MODEM_SLEEPING
+  RadioStats radioSent; // Radio figures in the stats upload in flight
+  bool radioSending;
+  size_t statsOmitted;  // Leading intervals not in the stats upload
+  String serverRequest;  // Last X-SwanFlow-Request value, "" if none
+
+  UploadKind active;    // In flight
+  UploadKind finished;  // Done, waiting for takeResult()
+  bool finishedOk;
+  bool finishedMqttSn;
+  String jsonBody;      // Body of a JSON upload while it is in flight
+
+  // MQTT-SN publish in flight, and its HTTP fallback
+  bool viaMqttSn;
+  const char* fallbackUrl;
+  const uint8_t* fallbackBody;
+  size_t fallbackLength;
 
-  // Helper functions
+  // Connection steps
+  void setState(ModemState next);
+  void fail(const char* reason);
+  bool queryDue(uint32_t interval);
+  void startModem();
+  void pollStarting();
+  void pollRegistering();
+  void pollAttaching();
+  void pollReady();
+  void pollSleeping();
+  void pollMqttSn();
+  void finishUpload(UploadKind kind, bool success, bool viaMqtt);
   bool initModem();
   bool connectGPRS();
-  String buildStatsJSON(const CounterStats& stats);
-  bool httpPOST(const String& url, const String& contentType, const String& body);
+  bool setupTls();
+  String buildStatsJSON(const CounterStats& stats, const IntervalRecord& interval,
+                        const MetricsSummary* metrics, const SdWriterStats* sd,
+                        const HttpStats* net, const RadioStats* radio);
+  String buildIncidentJSON(const IncidentEvent& event, uint32_t stream);
+  size_t encodeTelemetry(const IntervalRecord* intervals, size_t count, const MetricsSummary* metrics,
+                         const SdWriterStats* sd, const HttpStats* net, const RadioStats* radio,
+                         const uint8_t*& payload);
+  bool startTelemetry(UploadKind kind, const char* topic, const char* url,
+                      const uint8_t* body, size_t bodyLen);
+  bool startPOST(UploadKind kind, const char* url, const char* contentType,
+                 const uint8_t* body, size_t bodyLen,
+                 const uint8_t* prefix = nullptr, size_t prefixLen = 0);
 };
 
 #endif // LTE_MODEM_H
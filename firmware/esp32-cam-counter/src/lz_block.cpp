@@ -0,0 +1,98 @@
+/**
+ * SwanFlow - LZ Block Compression Implementation
+ */
+
+#include "lz_block.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+LzCompressor::LzCompressor() {
+  out = nullptr;
+  outCapacity = 0;
+  outLength = 0;
+}
+
+// ============================================================================
+// Compression
+// ============================================================================
+size_t LzCompressor::compress(const uint8_t* input, size_t length, uint8_t* output, size_t capacity) {
+  if (length > MAX_INPUT) return 0;
+
+  memset(table, 0, sizeof(table));
+  out = output;
+  outCapacity = capacity;
+  outLength = 0;
+
+  size_t pos = 0;
+  size_t anchor = 0;  // Start of the literals not yet emitted
+
+  if (length > MATCH_LIMIT) {
+    size_t matchLimit = length - MATCH_LIMIT;
+    size_t matchEnd = length - LAST_LITERALS;
+
+    while (pos <= matchLimit) {
+      uint32_t h = hash(input + pos);
+      size_t candidate = table[h];
+      table[h] = pos;
+
+      if (candidate >= pos || memcmp(input + candidate, input + pos, MIN_MATCH) != 0) {
+        pos++;
+        continue;
+      }
+
+      size_t matchLength = MIN_MATCH;
+      while (pos + matchLength < matchEnd && input[candidate + matchLength] == input[pos + matchLength]) {
+        matchLength++;
+      }
+
+      if (!emit(input + anchor, pos - anchor, pos - candidate, matchLength)) return 0;
+      pos += matchLength;
+      anchor = pos;
+    }
+  }
+
+  // Final sequence: literals only
+  if (!emit(input + anchor, length - anchor, 0, 0)) return 0;
+  return outLength;
+}
+
+// Token (literal length, match length - 4), literal length overflow,
+// literals, offset (LE16), match length overflow. A zero offset marks
+// the final, literals-only sequence.
+bool LzCompressor::emit(const uint8_t* literals, size_t literalLength, uint16_t offset, size_t matchLength) {
+  if (outLength >= outCapacity) return false;
+
+  size_t matchCode = offset ? matchLength - MIN_MATCH : 0;
+  out[outLength++] = (min(literalLength, (size_t)15) << 4) | min(matchCode, (size_t)15);
+
+  if (literalLength >= 15 && !putLength(literalLength - 15)) return false;
+  if (outLength + literalLength > outCapacity) return false;
+  memcpy(out + outLength, literals, literalLength);
+  outLength += literalLength;
+
+  if (!offset) return true;
+
+  if (outLength + 2 > outCapacity) return false;
+  out[outLength++] = offset & 0xFF;
+  out[outLength++] = offset >> 8;
+
+  return matchCode < 15 || putLength(matchCode - 15);
+}
+
+// Length overflow: 255s, then the remainder
+bool LzCompressor::putLength(size_t length) {
+  for (;;) {
+    if (outLength >= outCapacity) return false;
+    uint8_t b = length >= 255 ? 255 : length;
+    out[outLength++] = b;
+    if (b < 255) return true;
+    length -= 255;
+  }
+}
+
+uint32_t LzCompressor::hash(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
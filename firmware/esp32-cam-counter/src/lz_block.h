@@ -0,0 +1,48 @@
+/**
+ * SwanFlow - LZ Block Compression
+ *
+ * Greedy LZ77 compressor producing the LZ4 block format (sequences of
+ * literal run, 16-bit match offset, match length; no frame header), so
+ * any LZ4 block decoder can read it. Meant for upload payloads of a few
+ * KB: one hash probe per position, no allocation, and the 2 KB hash
+ * table lives in the compressor object.
+ *
+ * Decoded by lz4Decode() in the backend (backend/api/telemetry.js).
+ */
+
+#ifndef LZ_BLOCK_H
+#define LZ_BLOCK_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// LZ Compressor Class
+// ============================================================================
+class LzCompressor {
+public:
+  static const size_t MAX_INPUT = 65535;  // Offsets and table entries are 16-bit
+
+  LzCompressor();
+
+  // Compress length bytes of input into output. Returns the compressed
+  // length, or 0 if it didn't fit in capacity (or input is too large).
+  size_t compress(const uint8_t* input, size_t length, uint8_t* output, size_t capacity);
+
+private:
+  static const uint8_t HASH_BITS = 10;
+  static const uint8_t MIN_MATCH = 4;
+  static const uint8_t LAST_LITERALS = 5;  // Block must end with literals
+  static const uint8_t MATCH_LIMIT = 12;   // No match starts this close to the end
+
+  uint16_t table[1 << HASH_BITS];  // Last position seen per hash
+
+  uint8_t* out;
+  size_t outCapacity;
+  size_t outLength;
+
+  bool emit(const uint8_t* literals, size_t literalLength, uint16_t offset, size_t matchLength);
+  bool putLength(size_t length);
+  static uint32_t hash(const uint8_t* p);
+};
+
+#endif // LZ_BLOCK_H
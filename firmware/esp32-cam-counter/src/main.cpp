@@ -19,20 +19,111 @@
 #include <Arduino.h>
 #include "esp_camera.h"
 #include "SD_MMC.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
 #include "config.h"
 #include "vehicle_counter.h"
 #include "lte_modem.h"
+#include "rollup_store.h"
+#include "event_log.h"
+#include "image_store.h"
+#include "sd_writer.h"
+#include "stats_backlog.h"
+#include "training_capture.h"
+#include "upload_batch.h"
+#include "warm_state.h"
 
 // ============================================================================
 // Global Variables
 // ============================================================================
 VehicleCounter counter;
 LTEModem modem;
+RollupStore rollups;
+EventLog eventLog;
+ImageStore imageStore;
+SdWriter sdWriter;
+StatsBacklog backlog;
+TrainingCapture training;
+UploadBatch uploadBatch;
+WarmState warmState;
 
 unsigned long lastDetectionTime = 0;
 unsigned long lastUploadTime = 0;
+unsigned long lastIncidentFailure = 0;
+unsigned long lastWarmSave = 0;
+unsigned long lastBacklogReplay = 0;
+uint32_t lastIncidentSeq = 0;  // Last incident event pushed to the backend
+uint32_t sendingIncidentSeq = 0;  // Incident upload in flight
+uint32_t incidentStream = 0;      // Incident numbering restarts with a new one
+uint32_t lastMetricsSeq = 0;  // Last metrics interval added to an upload batch
+uint32_t lastLoggedCrossing = 0;  // Last crossing event appended to the event log
+
+// Wall-clock time (from the LTE network), needed to place rollup records
+uint32_t epochOffset = 0;        // Unix seconds at millis() == 0 (0 = unknown)
+uint32_t lastRollupMinute = 0;   // Next epoch minute to add to the rollups
+uint32_t lastUploadMinute = 0;   // Epoch minute of the last successful upload
 unsigned long bootTime = 0;
 
+// Stats batch waiting for the modem
+CounterStats batchStats;  // Counter stats when the last interval was added
+size_t batchTarget = 1;   // Intervals to collect before sending
+
+// Rollup backfill after an outage, one batch per upload
+bool backfillActive = false;
+uint8_t backfillTier = ROLLUP_MINUTE;
+uint32_t backfillNext = 0;        // Next period to send, in the tier's units
+uint32_t backfillSending = 0;     // End of the batch in flight
+uint32_t backfillMinuteFrom = 0;  // Where the 1-minute tier takes over
+uint32_t backfillTo = 0;          // Epoch minute the backfill runs up to
+
+// Stored detection images, sent oldest first a part at a time
+uint8_t* imageBuffer = nullptr;   // The image being sent (PSRAM, one slot)
+ImageEntry imageEntry;            // Its index entry
+bool imageActive = false;         // imageBuffer holds an image being sent
+uint32_t imageOffset = 0;         // Bytes the backend has
+uint32_t imagePartEnd = 0;        // End of the part in flight
+uint32_t lastImageSeq = 0;        // Last image fully sent
+unsigned long lastImageFailure = 0;
+
+// Uploader progress, saved with the counter for a warm restart
+UploadState uploadState() {
+  UploadState state = { lastIncidentSeq, lastRollupMinute, lastUploadMinute, backlog.getState(),
+                        lastImageSeq, incidentStream };
+  return state;
+}
+
+// Retention hints for a frame's image
+ImageMeta imageMeta(uint32_t captureTime, int vehicleCount) {
+  FrameSummary frame = counter.getLastFrame();
+
+  ImageMeta meta;
+  meta.timestamp = captureTime;
+  meta.epoch = epochOffset != 0 ? captureTime / 1000 + epochOffset : 0;
+  meta.minConfidence = frame.minConfidence * 255;
+  meta.maxConfidence = frame.maxConfidence * 255;
+  meta.zone = frame.zone;
+  meta.vehicles = max((int)frame.detections, vehicleCount);
+  meta.flags = 0;
+  if (frame.detections > 0 && frame.minConfidence < IMAGE_LOW_CONFIDENCE_BELOW) {
+    meta.flags |= IMAGE_LOW_CONFIDENCE;
+  }
+  if (meta.vehicles >= IMAGE_HIGH_VALUE_VEHICLES || frame.incidentActive) {
+    meta.flags |= IMAGE_HIGH_VALUE;
+  }
+
+  // Detection boxes plus some context; the SD writer does the cropping
+  memset(&meta.crop, 0, sizeof(meta.crop));
+  if (IMAGE_CROP && frame.boxWidth > 0) {
+    int x = max(0, frame.boxX - IMAGE_CROP_MARGIN_PX);
+    int y = max(0, frame.boxY - IMAGE_CROP_MARGIN_PX);
+    meta.crop.x = x;
+    meta.crop.y = y;
+    meta.crop.width = frame.boxX + frame.boxWidth + IMAGE_CROP_MARGIN_PX - x;
+    meta.crop.height = frame.boxY + frame.boxHeight + IMAGE_CROP_MARGIN_PX - y;
+  }
+  return meta;
+}
+
 // ============================================================================
 // Camera Initialization
 // ============================================================================
@@ -129,6 +220,268 @@ bool initSDCard() {
   return true;
 }
 
+// ============================================================================
+// Rollup Backfill
+// ============================================================================
+// Upload the count history for [fromMinute, toMinute) after an outage, a
+// batch at a time as the modem comes free. The last 24 hours go at 1-minute
+// resolution, anything older at 15 minutes.
+void advanceBackfill(uint32_t next);
+
+uint32_t backfillTierEnd() {
+  return backfillTier == ROLLUP_QUARTER ? backfillMinuteFrom / 15 : backfillTo;
+}
+
+void startBackfill(uint32_t fromMinute, uint32_t toMinute) {
+  rollups.flush();
+
+  backfillTo = toMinute;
+  backfillMinuteFrom = fromMinute;
+  backfillTier = ROLLUP_MINUTE;
+  uint32_t next = fromMinute;
+  if (toMinute - fromMinute > RollupStore::tierCapacity(ROLLUP_MINUTE)) {
+    // Older part of the outage from the 15-minute tier
+    backfillMinuteFrom = toMinute - RollupStore::tierCapacity(ROLLUP_MINUTE);
+    backfillTier = ROLLUP_QUARTER;
+    next = fromMinute / 15;
+  }
+
+  backfillActive = true;
+  advanceBackfill(next);
+}
+
+// Move past a delivered (or empty) batch, on to the next tier, and finish
+void advanceBackfill(uint32_t next) {
+  backfillNext = next;
+  if (backfillNext < backfillTierEnd()) return;
+
+  if (backfillTier == ROLLUP_QUARTER) {
+    backfillTier = ROLLUP_MINUTE;
+    backfillNext = backfillMinuteFrom;
+    if (backfillNext < backfillTo) return;
+  }
+
+  backfillActive = false;
+  lastUploadMinute = backfillTo;
+  Serial.println("Backfill complete");
+}
+
+// Read the next batch and start its upload. False if the upload couldn't
+// be started (the backfill is then dropped until the next stats upload).
+bool stepBackfill() {
+  static RollupRecord batch[ROLLUP_BACKFILL_BATCH];
+
+  uint32_t end = min(backfillNext + ROLLUP_BACKFILL_BATCH, backfillTierEnd());
+  size_t n = rollups.read(backfillTier, backfillNext, end, batch, ROLLUP_BACKFILL_BATCH);
+  if (n == 0) {
+    advanceBackfill(end);
+    return true;
+  }
+
+  if (!modem.uploadRollups(backfillTier, batch, n)) {
+    backfillActive = false;
+    return false;
+  }
+  backfillSending = end;
+  return true;
+}
+
+// ============================================================================
+// Uploads
+// ============================================================================
+// One upload is in flight at a time (LTEModem::poll() drives it). Each loop
+// with the modem idle starts the most urgent one; its outcome is handled
+// here when it finishes.
+void handleUploadResult(UploadKind kind, bool success, unsigned long currentTime) {
+  switch (kind) {
+    case UPLOAD_INCIDENT:
+      // Left queued and retried later if the upload failed
+      if (success) {
+        lastIncidentSeq = sendingIncidentSeq;
+      } else {
+        lastIncidentFailure = currentTime;
+      }
+      break;
+
+    case UPLOAD_STATS: {
+      backlog.release();
+
+      if (success && modem.wasMqttSn()) {
+        const MqttSnStats& mqtt = modem.getMqttSnStats();
+        Serial.printf("Upload successful (MQTT-SN): %lu ms, %lu bytes, %lu retransmits\n",
+                      (unsigned long)mqtt.lastRttMs, (unsigned long)mqtt.lastBytes,
+                      (unsigned long)mqtt.retransmits);
+      } else if (success) {
+        const HttpStats& net = modem.getHttpStats();
+        Serial.printf("Upload successful: %lu ms (connect %lu ms), %lu bytes out, %lu in, %lu/%lu reused, heap dip %lu\n",
+                      (unsigned long)net.lastRttMs, (unsigned long)net.lastConnectMs,
+                      (unsigned long)net.lastBytesSent, (unsigned long)net.lastBytesReceived,
+                      (unsigned long)net.reused, (unsigned long)net.requests,
+                      (unsigned long)net.lastHeapDip);
+      }
+
+      if (success) {
+        // Only what the upload carried: intervals the JSON format left out
+        // are replayed from the card
+        for (size_t i = modem.getStatsOmitted(); i < uploadBatch.sendingCount(); i++) {
+          backlog.delivered(uploadBatch.intervals()[i].interval);
+        }
+        uint32_t batchMinutes = uploadBatch.sendingCount() * UPLOAD_INTERVAL_MS / 60000;
+        uploadBatch.sent();
+
+        // Back after an outage: send the per-minute history we missed
+        // (a batch already covered the minutes it was collected over)
+        if (epochOffset != 0 && !backfillActive) {
+          uint32_t nowMinute = (currentTime / 1000 + epochOffset) / 60;
+          if (rollups.isReady() && lastUploadMinute != 0 &&
+              nowMinute - lastUploadMinute > 2 + batchMinutes) {
+            Serial.printf("Backfilling %lu minutes\n", (unsigned long)(nowMinute - lastUploadMinute));
+            startBackfill(lastUploadMinute, nowMinute);
+          } else {
+            lastUploadMinute = nowMinute;
+          }
+        }
+      } else {
+        // Intervals are on the card; the backlog replay sends them
+        Serial.println("Upload failed (will retry)");
+        uploadBatch.failed();
+      }
+
+      // Intervals added while the upload was in flight stay held
+      if (uploadBatch.count() > 0) backlog.hold(uploadBatch.firstInterval());
+      break;
+    }
+
+    case UPLOAD_ROLLUPS:
+      if (success) {
+        advanceBackfill(backfillSending);
+      } else {
+        // lastUploadMinute is unchanged: retried after the next stats upload
+        Serial.println("Backfill upload failed (will retry)");
+        backfillActive = false;
+      }
+      break;
+
+    case UPLOAD_BACKLOG:
+      if (success) {
+        backlog.acknowledge();
+      } else {
+        Serial.println("Backlog upload failed (will retry)");
+      }
+      break;
+
+    case UPLOAD_IMAGE:
+      if (success) {
+        imageOffset = imagePartEnd;
+        if (imageOffset >= imageEntry.size) {
+          Serial.printf("Image %lu sent\n", (unsigned long)imageEntry.seq);
+          lastImageSeq = imageEntry.seq;
+          imageActive = false;
+        }
+      } else if (modem.getLastStatus() == 409) {
+        // The backend lost the earlier parts: start the image again
+        imageOffset = 0;
+      } else if (modem.getLastStatus() >= 400 && modem.getLastStatus() < 500) {
+        // Rejected, and would be again: skip it
+        Serial.printf("Image %lu rejected\n", (unsigned long)imageEntry.seq);
+        lastImageSeq = imageEntry.seq;
+        imageActive = false;
+      } else {
+        // The same part is sent again later
+        lastImageFailure = currentTime;
+      }
+      break;
+
+    case UPLOAD_HEATMAP:
+    case UPLOAD_NONE:
+      break;
+  }
+}
+
+// Next part of the oldest image not yet sent. The image is copied from the
+// card once; its parts are then written to the modem straight from that
+// copy.
+void startImageUpload(unsigned long currentTime) {
+  if (!imageBuffer || currentTime - lastImageFailure < MODEM_RETRY_DELAY_MS) return;
+
+  if (!imageActive) {
+    // Never wait for the SD writer here: capture runs on this task
+    if (!imageStore.find(lastImageSeq, imageEntry, 0)) return;
+    ImageReadResult result = imageStore.read(imageEntry, imageBuffer, ImageStore::SLOT_SIZE, 0);
+    if (result == IMAGE_READ_BUSY) return;  // Next loop
+    if (result == IMAGE_READ_GONE) {
+      lastImageSeq = imageEntry.seq;  // Replaced since, or unreadable
+      return;
+    }
+    imageActive = true;
+    imageOffset = 0;
+  }
+
+  size_t length = min(imageEntry.size - imageOffset, (uint32_t)IMAGE_UPLOAD_PART);
+  if (modem.uploadImage(imageEntry, imageBuffer, imageOffset, length)) {
+    imagePartEnd = imageOffset + length;
+  } else {
+    lastImageFailure = currentTime;
+  }
+}
+
+void startNextUpload(unsigned long currentTime) {
+  if (!modem.isIdle()) return;
+
+  // Incidents first, one event per upload
+  IncidentEvent incident;
+  if (counter.getIncident(lastIncidentSeq, incident) &&
+      currentTime - lastIncidentFailure >= MODEM_RETRY_DELAY_MS) {
+    sendingIncidentSeq = incident.seq;
+    if (!modem.uploadIncident(incident, incidentStream)) handleUploadResult(UPLOAD_INCIDENT, false, currentTime);
+    return;
+  }
+
+  // The stats batch, once it has reached its target size
+  if (uploadBatch.count() > 0 && uploadBatch.count() >= batchTarget) {
+    SdWriterStats sd = sdWriter.getStats();
+    uploadBatch.sending();
+    if (!modem.uploadStats(batchStats, uploadBatch.intervals(), uploadBatch.count(),
+                           uploadBatch.metrics(), sdWriter.isReady() ? &sd : nullptr)) {
+      handleUploadResult(UPLOAD_STATS, false, currentTime);
+    }
+    return;
+  }
+
+  // The rest can wait for the radio to be up anyway (power saving)
+  if (!modem.inWakeWindow()) return;
+
+  // Backend asked for the calibration heatmap (re-asks until it arrives)
+  if (modem.takeServerRequest("heatmap")) {
+    static uint8_t cells[Heatmap::SERIALIZED_SIZE];
+    counter.getHeatmap(cells);
+    modem.uploadHeatmap(cells, (currentTime - bootTime) / 1000);
+    return;
+  }
+
+  if (backfillActive) {
+    if (!stepBackfill()) Serial.println("Backfill upload failed (will retry)");
+    return;
+  }
+
+  // Intervals whose live upload failed, oldest first, one batch at a time
+  // so live uploads and incidents keep their slots
+  if (backlog.pending() && currentTime - lastBacklogReplay >= BACKLOG_REPLAY_INTERVAL_MS) {
+    static IntervalRecord batch[BACKLOG_BATCH_RECORDS];
+    size_t n = backlog.readBatch(batch, BACKLOG_BATCH_RECORDS, epochOffset);
+
+    // Cut short by the SD writer: go on next loop
+    if (n > 0 || !backlog.wasBusy()) lastBacklogReplay = currentTime;
+    if (n > 0) {
+      if (!modem.uploadBacklog(batch, n)) Serial.println("Backlog upload failed (will retry)");
+      return;
+    }
+  }
+
+  // Images last: they are the largest and least urgent
+  startImageUpload(currentTime);
+}
+
 // ============================================================================
 // Setup
 // ============================================================================
@@ -153,17 +506,46 @@ void setup() {
   Serial.println("[2/4] Initializing SD card...");
   if (!initSDCard()) {
     Serial.println("WARNING: SD card not available (continuing without)");
+  } else {
+    if (!rollups.begin(SD_MMC)) {
+      Serial.println("WARNING: Rollup history not available");
+    }
+    // The log and image store share one lock: the SD writer task writes
+    // both, and the loop's reads skip a turn rather than wait for it
+    SemaphoreHandle_t cardLock = xSemaphoreCreateMutex();
+    if (UPLOAD_IMAGES && !imageStore.begin(SD_MMC, cardLock)) {
+      Serial.println("WARNING: Image store not available");
+    }
+    if (UPLOAD_IMAGES && !UPLOAD_STATS_ONLY && imageStore.isReady()) {
+      imageBuffer = (uint8_t*)heap_caps_malloc(ImageStore::SLOT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    if (!eventLog.begin(SD_MMC, cardLock) || !sdWriter.begin(eventLog, imageStore)) {
+      Serial.println("WARNING: Event log not available");
+    }
   }
+  backlog.begin(eventLog, sdWriter);
 
   // Initialize vehicle counter
   Serial.println("[3/4] Initializing vehicle counter...");
   counter.begin();
 
-  // Initialize LTE modem
-  Serial.println("[4/4] Initializing LTE modem...");
-  if (!modem.begin()) {
-    Serial.println("WARNING: LTE modem initialization failed (will retry)");
+  // Resume where the previous boot stopped (watchdog, ESP.restart(), power loss).
+  // Incident numbers carry on only when the counter's incidents come back
+  // from RTC memory; otherwise they restart from 1 under a new stream.
+  incidentStream = esp_random() | 1;
+  UploadState upload = uploadState();
+  if (warmState.restore(counter, upload) != WARM_NONE) {
+    lastIncidentSeq = upload.lastIncidentSeq;
+    incidentStream = upload.incidentStream;
+    lastRollupMinute = upload.lastRollupMinute;
+    lastUploadMinute = upload.lastUploadMinute;
+    lastImageSeq = upload.lastImageSeq;
   }
+  backlog.restore(upload.backlog);
+
+  // Initialize LTE modem (it connects in the background, from loop())
+  Serial.println("[4/4] Initializing LTE modem...");
+  modem.begin();
 
   Serial.println("\n=================================");
   Serial.println("System Ready");
@@ -197,17 +579,49 @@ void loop() {
     DEBUG_PRINT(fb->len);
     DEBUG_PRINTLN(" bytes");
 
+    // Capture time from the camera driver (same clock as millis()),
+    // so crossing interpolation isn't skewed by inference latency
+    uint32_t captureTime = fb->timestamp.tv_sec * 1000UL + fb->timestamp.tv_usec / 1000UL;
+
     // Run vehicle detection (FOMO inference)
     // TODO: Integrate Edge Impulse SDK after model training
     // For now, this is a placeholder
-    int vehicleCount = counter.detectVehicles(fb->buf, fb->len);
+    int vehicleCount = counter.detectVehicles(fb->buf, fb->len, captureTime);
 
     if (vehicleCount > 0) {
       Serial.printf("Detected %d vehicle(s)\n", vehicleCount);
 
-      // Optionally save image to SD card
-      if (SD_MMC.cardType() != CARD_NONE && UPLOAD_IMAGES) {
-        counter.saveImageToSD(fb, SD_MMC);
+      // Optionally keep the frame (copied, so the frame buffer can go
+      // straight back to the camera)
+      if (sdWriter.isReady() && UPLOAD_IMAGES) {
+        sdWriter.submitImage(imageMeta(captureTime, vehicleCount), fb->buf, fb->len);
+      }
+    }
+
+    // Training data: sampled frames with their labels, written by the SD
+    // writer like everything else
+    if (TRAINING_CAPTURE && sdWriter.isReady()) {
+      Detection detections[MAX_DETECTIONS_PER_FRAME];
+      size_t n = counter.getLastDetections(detections, MAX_DETECTIONS_PER_FRAME);
+      uint32_t epoch = epochOffset != 0 ? captureTime / 1000 + epochOffset : 0;
+      uint8_t reasons = training.sample(detections, n, captureTime, epoch);
+      if (reasons != 0) {
+        static TrainingSidecar sidecar;  // Kept off the loop task's stack
+        size_t length = training.buildSidecar(sidecar, reasons, detections, n,
+                                              captureTime, epoch, fb->len);
+        sdWriter.submit(LOG_TRAINING, captureTime, &sidecar, length, fb->buf, fb->len);
+      }
+    }
+
+    // Log new crossing events
+    if (sdWriter.isReady()) {
+      CrossingEvent events[8];
+      size_t n;
+      while ((n = counter.getCrossings(lastLoggedCrossing, events, 8)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+          sdWriter.submit(LOG_CROSSING, events[i].timestamp, &events[i], sizeof(CrossingEvent));
+        }
+        lastLoggedCrossing = events[n - 1].seq;
       }
     }
 
@@ -216,36 +630,123 @@ void loop() {
   }
 
   // -------------------------------------------------------------------------
-  // 2. Upload Stats to Backend
+  // 2. Count History
+  // -------------------------------------------------------------------------
+  // Close each completed minute into the SD rollups (needs network time)
+  if (rollups.isReady() && epochOffset != 0) {
+    uint32_t nowMinute = (currentTime / 1000 + epochOffset) / 60;
+    if (lastRollupMinute == 0) lastRollupMinute = nowMinute;
+
+    while (lastRollupMinute < nowMinute) {
+      uint32_t startMs = (lastRollupMinute * 60 - epochOffset) * 1000;
+      rollups.addMinute(lastRollupMinute, counter.getCountBetween(startMs, startMs + 60000));
+      lastRollupMinute++;
+    }
+  }
+
+  // -------------------------------------------------------------------------
+  // 3. Modem
+  // -------------------------------------------------------------------------
+  // Connection setup and the upload in flight advance one step per loop
+  modem.poll();
+
+  UploadKind finished;
+  bool success;
+  if (modem.takeResult(finished, success)) {
+    handleUploadResult(finished, success, currentTime);
+  }
+
+  // -------------------------------------------------------------------------
+  // 4. Collect Stats for Upload
   // -------------------------------------------------------------------------
   if (currentTime - lastUploadTime >= UPLOAD_INTERVAL_MS) {
     lastUploadTime = currentTime;
 
     // Get current stats
     CounterStats stats = counter.getStats();
+    batchStats = stats;
+
+    // Log the interval before trying to send it, so a failed upload can
+    // be replayed later
+    IntervalRecord interval = backlog.record(stats, epochOffset);
+
+    // Checkpoint totals first, so after a power cut the count can't fall
+    // below what the backend has already seen
+    warmState.saveNVS(counter, uploadState());
 
     Serial.println("\n--- Upload Stats ---");
     Serial.printf("Total count: %d\n", stats.totalCount);
     Serial.printf("Last hour: %d\n", stats.lastHourCount);
     Serial.printf("Uptime: %lu minutes\n", (currentTime - bootTime) / 60000);
 
-    // Upload via LTE
+    SdWriterStats sd = sdWriter.getStats();
+    if (sdWriter.isReady()) {
+      Serial.printf("SD: %lu written, %lu dropped, queue %u (max %u), p50/p99 %lu/%lu us, stack free %lu\n",
+                    (unsigned long)sd.written, (unsigned long)sd.dropped, sd.queueDepth,
+                    sd.maxQueueDepth, (unsigned long)sd.latencyP50Us, (unsigned long)sd.latencyP99Us,
+                    (unsigned long)sd.stackFree);
+    }
+    if (imageStore.isReady()) {
+      ImageStoreStats images = imageStore.getStats();
+      Serial.printf("Images: %lu/%lu slots, %lu KB, %lu evicted\n",
+                    (unsigned long)images.images, (unsigned long)images.slots,
+                    (unsigned long)(images.usedBytes / 1024), (unsigned long)images.evicted);
+    }
+    RadioStats radio = modem.getRadioStats();
+    Serial.printf("Radio: on %lu s, awake %lu s of %lu s, %lu wakes, link health %d\n",
+                  (unsigned long)(radio.activeMs / 1000), (unsigned long)(radio.awakeMs / 1000),
+                  (unsigned long)(radio.periodMs / 1000), (unsigned long)radio.wakes, radio.linkHealth);
+
+    // Add the interval, and the latest metrics interval if it is new, to
+    // the batch; the replay leaves held intervals alone
+    static MetricsSummary metrics;  // Too large for the loop task's stack
+    counter.getMetricsSummary(metrics);
+    if (metrics.seq != 0 && metrics.seq != lastMetricsSeq) {
+      uploadBatch.addMetrics(metrics);
+      lastMetricsSeq = metrics.seq;
+    }
+    if (uploadBatch.count() == 0) backlog.hold(interval.interval);
+    uploadBatch.add(interval);
+
     if (modem.isConnected()) {
-      bool success = modem.uploadStats(stats);
-      if (success) {
-        Serial.println("Upload successful");
-        counter.resetHourlyStats();
-      } else {
-        Serial.println("Upload failed (will retry)");
+      if (epochOffset == 0) {
+        uint32_t unixTime = modem.getUnixTime();
+        if (unixTime != 0) {
+          epochOffset = unixTime - currentTime / 1000;
+          Serial.printf("Network time: %lu\n", (unsigned long)unixTime);
+        }
       }
-    } else {
-      Serial.println("Modem not connected (attempting reconnect)");
-      modem.reconnect();
+
+      // Sent below once the batch is big enough and the modem is free
+      batchTarget = uploadBatch.target(modem.getSignalQuality(), modem.getHttpStats());
+      if (uploadBatch.count() < batchTarget) {
+        Serial.printf("Batching: %d/%d intervals\n", (int)uploadBatch.count(), (int)batchTarget);
+      }
+    } else if (modem.isAsleep()) {
+      // Held in the batch, and sent whole at the modem's next wake
+      Serial.printf("Modem asleep: %d intervals held\n", (int)uploadBatch.count());
+      batchTarget = 1;
+    } else if (!uploadBatch.isSending()) {
+      // Intervals are on the card; the backlog replay sends them
+      Serial.println("Modem not connected (reconnecting)");
+      backlog.release();
+      uploadBatch.failed();
     }
   }
 
   // -------------------------------------------------------------------------
-  // 3. Housekeeping
+  // 5. Start Next Upload
+  // -------------------------------------------------------------------------
+  startNextUpload(currentTime);
+
   // -------------------------------------------------------------------------
+  // 6. Housekeeping
+  // -------------------------------------------------------------------------
+  // Mirror state into RTC memory for a warm restart
+  if (currentTime - lastWarmSave >= WARM_RTC_INTERVAL_MS) {
+    lastWarmSave = currentTime;
+    warmState.saveRTC(counter, uploadState());
+  }
+
   delay(LOOP_DELAY_MS);
 }
@@ -0,0 +1,181 @@
+/**
+ * SwanFlow - Modem AT Implementation
+ */
+
+#include "modem_at.h"
+
+// ============================================================================
+// Modem Stream
+// ============================================================================
+ModemStream::ModemStream() {
+  serial = nullptr;
+  heldStart = 0;
+  heldLength = 0;
+  dropped = 0;
+}
+
+void ModemStream::begin(Stream& port) {
+  serial = &port;
+}
+
+bool ModemStream::hold(const char* line) {
+  size_t len = strlen(line);
+  if (heldLength + len + 2 > HOLD_SIZE) {
+    dropped++;
+    Serial.printf("Modem: no room to keep \"%s\" for TinyGSM\n", line);
+    return false;
+  }
+
+  for (size_t i = 0; i < len + 2; i++) {
+    char c = i < len ? line[i] : (i == len ? '\r' : '\n');
+    held[(heldStart + heldLength++) % HOLD_SIZE] = c;
+  }
+  return true;
+}
+
+int ModemStream::available() {
+  return (int)heldLength + serial->available();
+}
+
+int ModemStream::read() {
+  if (heldLength == 0) return serial->read();
+  int c = (uint8_t)held[heldStart];
+  heldStart = (heldStart + 1) % HOLD_SIZE;
+  heldLength--;
+  return c;
+}
+
+int ModemStream::peek() {
+  return heldLength > 0 ? (uint8_t)held[heldStart] : serial->peek();
+}
+
+// ============================================================================
+// Constructor
+// ============================================================================
+ModemAt::ModemAt() {
+  at = nullptr;
+  shared = nullptr;
+}
+
+void ModemAt::begin(ModemStream& stream) {
+  shared = &stream;
+  at = &stream.port();
+}
+
+// ============================================================================
+// Commands
+// ============================================================================
+void ModemAt::send(const char* cmd) {
+  // Nothing is in flight, so this is unsolicited (or a late reply, which
+  // passOn() drops). A line already arriving gets a moment to finish.
+  char line[96];
+  while (at->available() > 0) {
+    int len = readLine(line, sizeof(line), millis() + 20);
+    if (len >= 0) passOn(line);
+  }
+
+  at->print("AT");
+  at->print(cmd);
+  at->print("\r\n");
+  DEBUG_PRINT("AT >> AT");
+  DEBUG_PRINTLN(cmd);
+}
+
+bool ModemAt::command(const char* cmd, const char* expect, uint32_t timeout,
+                      char* reply, size_t replyLen) {
+  send(cmd);
+  return waitFor(expect, timeout, reply, replyLen);
+}
+
+// ============================================================================
+// Replies
+// ============================================================================
+bool ModemAt::waitFor(const char* expect, uint32_t timeout, char* reply, size_t replyLen) {
+  uint32_t deadline = millis() + timeout;
+  size_t expectLen = strlen(expect);
+  char line[96];
+
+  for (;;) {
+    int len = readLine(line, sizeof(line), deadline);
+    if (len < 0) return false;
+    if (len == 0 || strncmp(line, "AT", 2) == 0) continue;  // Blank or echo
+
+    DEBUG_PRINT("AT << ");
+    DEBUG_PRINTLN(line);
+
+    if (strncmp(line, expect, expectLen) == 0) {
+      if (reply) {
+        strncpy(reply, line, replyLen - 1);
+        reply[replyLen - 1] = '\0';
+      }
+      return true;
+    }
+    if (strstr(line, "ERROR")) return false;
+    passOn(line);
+  }
+}
+
+// The prompt is matched at the start of a line, as soon as it is complete
+bool ModemAt::waitForPrompt(const char* prompt, uint32_t timeout) {
+  uint32_t deadline = millis() + timeout;
+  size_t promptLen = strlen(prompt);
+  char line[64];
+  size_t len = 0;
+
+  for (;;) {
+    int c = readByte(deadline);
+    if (c < 0) return false;
+    if (c == '\r') continue;
+
+    if (c == '\n') {
+      line[len] = '\0';
+      if (strstr(line, "ERROR")) return false;
+      passOn(line);
+      len = 0;
+      continue;
+    }
+
+    if (len < sizeof(line) - 1) line[len++] = c;
+    if (len == promptLen && strncmp(line, prompt, promptLen) == 0) return true;
+  }
+}
+
+bool ModemAt::readBytes(uint8_t* data, size_t length, uint32_t timeout) {
+  uint32_t deadline = millis() + timeout;
+  for (size_t i = 0; i < length; i++) {
+    int c = readByte(deadline);
+    if (c < 0) return false;
+    data[i] = c;
+  }
+  return true;
+}
+
+// Hand a line that isn't ours to TinyGSM. Final result codes and echo are
+// left out: TinyGSM would take them for the answer to its next command.
+void ModemAt::passOn(const char* line) {
+  if (line[0] == '\0' || strncmp(line, "AT", 2) == 0 || strcmp(line, "OK") == 0) return;
+  if (strstr(line, "ERROR")) return;
+  shared->hold(line);
+}
+
+// One line without its CRLF; -1 on timeout
+int ModemAt::readLine(char* line, size_t maxLen, uint32_t deadline) {
+  size_t len = 0;
+  for (;;) {
+    int c = readByte(deadline);
+    if (c < 0) return -1;
+    if (c == '\r') continue;
+    if (c == '\n') break;
+    if (len < maxLen - 1) line[len++] = c;
+  }
+  line[len] = '\0';
+  return len;
+}
+
+int ModemAt::readByte(uint32_t deadline) {
+  while (at->available() <= 0) {
+    if ((int32_t)(millis() - deadline) >= 0) return -1;
+    delay(1);
+  }
+  return at->read();
+}
@@ -0,0 +1,99 @@
+/**
+ * SwanFlow - Modem AT
+ *
+ * Raw AT exchanges with the SIM7000 for the features TinyGSM doesn't
+ * cover (the modem's file system and SSL contexts, the UDP socket):
+ * send a command, wait for its reply line, read binary data that follows
+ * a reply.
+ *
+ * Talks directly over the modem's serial stream; use it while no other
+ * AT command is in flight.
+ *
+ * TinyGSM shares the serial port and learns from unsolicited result codes
+ * that its socket has data (+CADATAIND) or was closed (+CASTATE). Lines
+ * that aren't part of an exchange here are handed back to it through
+ * ModemStream, which TinyGSM reads instead of the serial port: it sees
+ * them, in order, before anything newer.
+ */
+
+#ifndef MODEM_AT_H
+#define MODEM_AT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Modem Stream Class
+// ============================================================================
+// The modem's serial port as TinyGSM sees it: lines held for it by
+// ModemAt first, then the port
+class ModemStream : public Stream {
+public:
+  static const size_t HOLD_SIZE = 256;
+
+  ModemStream();
+
+  void begin(Stream& port);
+  Stream& port() { return *serial; }
+
+  // Queue line (without its CRLF) for TinyGSM; false if it didn't fit
+  bool hold(const char* line);
+  size_t getDropped() const { return dropped; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override { return serial->write(c); }
+  size_t write(const uint8_t* buffer, size_t size) override { return serial->write(buffer, size); }
+  using Print::write;
+  void flush() override { serial->flush(); }
+
+private:
+  Stream* serial;
+  char held[HOLD_SIZE];  // Ring of held bytes
+  size_t heldStart;
+  size_t heldLength;
+  size_t dropped;        // Lines that didn't fit
+};
+
+// ============================================================================
+// Modem AT Class
+// ============================================================================
+class ModemAt {
+public:
+  ModemAt();
+
+  void begin(ModemStream& stream);
+  bool isReady() const { return at != nullptr; }
+  Stream& stream() { return *at; }
+
+  // Send "AT<command>". Lines that arrived since the last exchange are
+  // handed to TinyGSM first.
+  void send(const char* command);
+
+  // send(), then waitFor()
+  bool command(const char* command, const char* expect = "OK", uint32_t timeout = 2000,
+               char* reply = nullptr, size_t replyLen = 0);
+
+  // Wait for a line starting with expect (false on ERROR or timeout). The
+  // matching line is copied to reply if given; other lines are handed to
+  // TinyGSM.
+  bool waitFor(const char* expect, uint32_t timeout, char* reply = nullptr, size_t replyLen = 0);
+
+  // Wait for text that isn't followed by a line ending: a prompt
+  // ("DOWNLOAD", "> ") or the start of a reply carrying binary data
+  bool waitForPrompt(const char* prompt, uint32_t timeout);
+
+  // Read exactly length bytes; false on timeout
+  bool readBytes(uint8_t* data, size_t length, uint32_t timeout);
+
+private:
+  Stream* at;           // The serial port itself
+  ModemStream* shared;  // TinyGSM's view of it
+
+  void passOn(const char* line);
+  int readLine(char* line, size_t maxLen, uint32_t deadline);
+  int readByte(uint32_t deadline);
+};
+
+#endif // MODEM_AT_H
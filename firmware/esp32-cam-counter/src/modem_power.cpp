@@ -0,0 +1,265 @@
+/**
+ * SwanFlow - Modem Power Implementation
+ */
+
+#include "modem_power.h"
+
+// Timer units (3GPP TS 24.008 10.5.7.4a GPRS timer 3, 10.5.7.3 GPRS
+// timer 2): the top three bits of the code, in seconds per step
+struct TimerUnit {
+  uint8_t bits;
+  uint32_t seconds;
+};
+
+static const TimerUnit TAU_UNITS[] = {
+  { 0x3, 2 }, { 0x4, 30 }, { 0x5, 60 }, { 0x0, 600 }, { 0x1, 3600 }, { 0x2, 36000 }, { 0x6, 1152000 }
+};
+static const TimerUnit ACTIVE_UNITS[] = {
+  { 0x0, 2 }, { 0x1, 60 }, { 0x2, 360 }
+};
+
+// LTE-M eDRX cycles (TS 24.008 10.5.5.32), by code
+static const uint32_t EDRX_CYCLES_MS[16] = {
+  5120, 10240, 20480, 40960, 61440, 81920, 102400, 122880,
+  143360, 163840, 327680, 655360, 1310720, 2621440, 5242880, 10485760
+};
+
+// ============================================================================
+// Constructor
+// ============================================================================
+ModemPower::ModemPower() {
+  tauS = 0;
+  activeTimeS = 0;
+  edrxMs = 0;
+  hasActivity = false;
+  lastActivity = 0;
+  lastUpdate = 0;
+  periodMs = 0;
+  activeMs = 0;
+  awakeMs = 0;
+  wakes = 0;
+}
+
+void ModemPower::begin(ModemStream& stream) {
+  at.begin(stream);
+}
+
+// ============================================================================
+// Timer Codes
+// ============================================================================
+static void writeBits(uint8_t value, int count, char* bits) {
+  for (int i = 0; i < count; i++) {
+    bits[i] = (value >> (count - 1 - i)) & 1 ? '1' : '0';
+  }
+  bits[count] = '\0';
+}
+
+static uint8_t readBits(const char* bits, int count) {
+  uint8_t value = 0;
+  for (int i = 0; i < count && bits[i]; i++) {
+    value = (value << 1) | (bits[i] == '1');
+  }
+  return value;
+}
+
+// The finest unit that reaches the time, rounded up to a whole step
+static void encodeTimer(uint32_t seconds, const TimerUnit* units, size_t unitCount, char* bits) {
+  if (seconds == 0) {
+    writeBits(0xE0, 8, bits);  // Deactivated
+    return;
+  }
+  for (size_t i = 0; i < unitCount; i++) {
+    uint32_t steps = (seconds + units[i].seconds - 1) / units[i].seconds;
+    if (steps <= 31 || i == unitCount - 1) {
+      writeBits((units[i].bits << 5) | min(steps, (uint32_t)31), 8, bits);
+      return;
+    }
+  }
+}
+
+static uint32_t decodeTimer(const char* bits, const TimerUnit* units, size_t unitCount) {
+  uint8_t code = readBits(bits, 8);
+  for (size_t i = 0; i < unitCount; i++) {
+    if (units[i].bits == code >> 5) return (code & 0x1F) * units[i].seconds;
+  }
+  return 0;  // Deactivated
+}
+
+void ModemPower::encodeTau(uint32_t seconds, char* bits) {
+  encodeTimer(seconds, TAU_UNITS, sizeof(TAU_UNITS) / sizeof(TAU_UNITS[0]), bits);
+}
+
+void ModemPower::encodeActiveTime(uint32_t seconds, char* bits) {
+  encodeTimer(seconds, ACTIVE_UNITS, sizeof(ACTIVE_UNITS) / sizeof(ACTIVE_UNITS[0]), bits);
+}
+
+uint32_t ModemPower::decodeTau(const char* bits) {
+  return decodeTimer(bits, TAU_UNITS, sizeof(TAU_UNITS) / sizeof(TAU_UNITS[0]));
+}
+
+// Units 011 to 110 aren't defined for timer 2 and are read as minutes
+uint32_t ModemPower::decodeActiveTime(const char* bits) {
+  uint8_t unit = readBits(bits, 8) >> 5;
+  if (unit >= 0x3 && unit <= 0x6) return (readBits(bits, 8) & 0x1F) * 60;
+  return decodeTimer(bits, ACTIVE_UNITS, sizeof(ACTIVE_UNITS) / sizeof(ACTIVE_UNITS[0]));
+}
+
+// The longest cycle no longer than asked for
+uint8_t ModemPower::encodeEdrx(uint32_t cycleMs) {
+  uint8_t code = 0;
+  while (code < 15 && EDRX_CYCLES_MS[code + 1] <= cycleMs) code++;
+  return code;
+}
+
+uint32_t ModemPower::decodeEdrx(uint8_t code) {
+  return EDRX_CYCLES_MS[code & 0x0F];
+}
+
+// ============================================================================
+// Configuration
+// ============================================================================
+bool ModemPower::configure() {
+  if (!at.isReady()) return false;
+
+  char cmd[48];
+  char tau[9];
+  char active[9];
+  char cycle[5];
+
+  // Registration replies then carry the granted PSM timers
+  bool ok = at.command("+CEREG=4");
+
+  if (MODEM_PSM) {
+    encodeTau(MODEM_PSM_TAU_S, tau);
+    encodeActiveTime(MODEM_PSM_ACTIVE_S, active);
+    snprintf(cmd, sizeof(cmd), "+CPSMS=1,,,\"%s\",\"%s\"", tau, active);
+    ok = at.command(cmd) && ok;
+  } else {
+    ok = at.command("+CPSMS=0") && ok;
+  }
+
+  if (MODEM_EDRX) {
+    writeBits(encodeEdrx(MODEM_EDRX_CYCLE_MS), 4, cycle);
+    snprintf(cmd, sizeof(cmd), "+CEDRXS=1,4,\"%s\"", cycle);  // 4 = LTE-M
+    ok = at.command(cmd) && ok;
+  } else {
+    ok = at.command("+CEDRXS=0") && ok;
+  }
+
+  if (!ok) Serial.println("Power saving: modem refused the settings");
+  return ok;
+}
+
+// Quoted fields of a reply line, in order; the line is cut up in place
+static int quotedFields(char* line, const char** fields, int maxFields) {
+  int count = 0;
+  char* p = line;
+  while (count < maxFields && (p = strchr(p, '"')) != nullptr) {
+    char* end = strchr(p + 1, '"');
+    if (!end) break;
+    *end = '\0';
+    fields[count++] = p + 1;
+    p = end + 1;
+  }
+  return count;
+}
+
+void ModemPower::readGranted() {
+  char reply[96];
+  const char* fields[4];
+
+  tauS = 0;
+  activeTimeS = 0;
+  edrxMs = 0;
+
+  // +CEREG: 4,<stat>,"<tac>","<ci>",<AcT>,,,"<active time>","<periodic TAU>"
+  if (MODEM_PSM && at.command("+CEREG?", "+CEREG:", 2000, reply, sizeof(reply))) {
+    at.waitFor("OK", 2000);
+    if (quotedFields(reply, fields, 4) == 4 && strncmp(fields[2], "111", 3) != 0) {
+      activeTimeS = decodeActiveTime(fields[2]);
+      tauS = decodeTau(fields[3]);
+    }
+  }
+
+  // A longer sleep would hold more intervals than a batch takes: stay
+  // out of PSM instead
+  if (tauS * 1000ULL > (uint64_t)UPLOAD_BATCH_MAX * UPLOAD_INTERVAL_MS) {
+    Serial.printf("Power saving: granted TAU %lu s is too long, PSM off\n", (unsigned long)tauS);
+    at.command("+CPSMS=0");
+    tauS = 0;
+    activeTimeS = 0;
+  }
+
+  // +CEDRXRDP: <AcT>,"<requested>","<granted>","<paging time window>"
+  if (MODEM_EDRX && at.command("+CEDRXRDP", "+CEDRXRDP:", 2000, reply, sizeof(reply))) {
+    at.waitFor("OK", 2000);
+    if (atoi(reply + 10) != 0 && quotedFields(reply, fields, 2) == 2) {
+      edrxMs = decodeEdrx(readBits(fields[1], 4));
+    }
+  }
+
+  Serial.printf("Power saving: PSM %s (TAU %lu s, active %lu s), eDRX %lu ms\n",
+                tauS ? "on" : "off", (unsigned long)tauS, (unsigned long)activeTimeS,
+                (unsigned long)edrxMs);
+}
+
+// ============================================================================
+// Wake Windows
+// ============================================================================
+void ModemPower::activity() {
+  if (!radioTail()) wakes++;
+  hasActivity = true;
+  lastActivity = millis();
+}
+
+bool ModemPower::radioTail() const {
+  return hasActivity && millis() - lastActivity < MODEM_RRC_TAIL_MS;
+}
+
+bool ModemPower::inWakeWindow() const {
+  if (!MODEM_PSM && !MODEM_EDRX) return true;
+  return radioTail();
+}
+
+bool ModemPower::isAsleepDue() const {
+  return isPsmGranted() && hasActivity && !radioTail();
+}
+
+uint32_t ModemPower::sleepMs() const {
+  uint32_t elapsed = millis() - lastActivity;
+  uint32_t tau = MODEM_RRC_TAIL_MS + tauS * 1000UL;
+  return tau > elapsed ? tau - elapsed : 0;
+}
+
+// ============================================================================
+// Radio Time
+// ============================================================================
+void ModemPower::update(bool connecting, bool uploading, bool asleep) {
+  uint32_t now = millis();
+  uint32_t elapsed = lastUpdate != 0 ? now - lastUpdate : 0;
+  lastUpdate = now ? now : 1;
+
+  periodMs += elapsed;
+  if (!asleep) awakeMs += elapsed;
+  if (connecting || uploading || radioTail()) activeMs += elapsed;
+}
+
+RadioStats ModemPower::getStats() const {
+  RadioStats stats;
+  stats.periodMs = periodMs;
+  stats.activeMs = activeMs;
+  stats.awakeMs = awakeMs;
+  stats.wakes = wakes;
+  stats.linkHealth = 0;
+  stats.tauS = tauS;
+  stats.activeTimeS = activeTimeS;
+  stats.edrxMs = edrxMs;
+  return stats;
+}
+
+void ModemPower::reported(const RadioStats& sent) {
+  periodMs -= sent.periodMs;
+  activeMs -= sent.activeMs;
+  awakeMs -= sent.awakeMs;
+  wakes -= sent.wakes;
+}
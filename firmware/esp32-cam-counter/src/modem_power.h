@@ -0,0 +1,114 @@
+/**
+ * SwanFlow - Modem Power
+ *
+ * LTE-M power saving for the SIM7000, and an account of how long the
+ * radio is on.
+ *
+ * configure() requests the PSM timers (AT+CPSMS: periodic TAU and active
+ * time) and the eDRX cycle (AT+CEDRXS) before the modem registers.
+ * readGranted() reads back what the network allowed after it has (the
+ * timers in AT+CEREG's extended reply, AT+CEDRXRDP), which may differ or
+ * be refused; only granted values are acted on.
+ *
+ * Wake windows: the radio stays connected for MODEM_RRC_TAIL_MS after
+ * traffic, and each new connection pays that tail again, so uploads that
+ * can wait are sent while the radio is already up (inWakeWindow()).
+ * Under PSM the modem goes idle after the tail and sleeps once the
+ * active time runs out, until its next TAU (the TAU timer starts when it
+ * goes idle). LTEModem leaves it alone from the end of the window, while
+ * it is certainly still awake, to sleepMs() later.
+ *
+ * Radio-on time is estimated, sampled from update(): connecting, an
+ * upload in flight, and the tail after traffic count as on; anything but
+ * PSM sleep counts as awake.
+ */
+
+#ifndef MODEM_POWER_H
+#define MODEM_POWER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "modem_at.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+// Radio use since the last report, with the settings behind it
+struct RadioStats {
+  uint32_t periodMs;     // Time these figures cover
+  uint32_t activeMs;     // Radio connected (estimated)
+  uint32_t awakeMs;      // Modem out of PSM sleep
+  uint32_t wakes;        // Times the radio came up from idle
+  uint8_t linkHealth;    // LinkHealth score, 0-100
+  uint32_t tauS;         // Granted periodic TAU (0 = no PSM)
+  uint32_t activeTimeS;  // Granted active time
+  uint32_t edrxMs;       // Granted eDRX cycle (0 = no eDRX)
+};
+
+// ============================================================================
+// Modem Power Class
+// ============================================================================
+class ModemPower {
+public:
+  ModemPower();
+
+  void begin(ModemStream& at);
+
+  // Request PSM and eDRX (or turn them off) as configured; call before
+  // the modem registers
+  bool configure();
+
+  // Read the granted timers; call once registered
+  void readGranted();
+
+  bool isPsmGranted() const { return tauS > 0; }
+  uint32_t getTauS() const { return tauS; }
+  uint32_t getActiveTimeS() const { return activeTimeS; }
+  uint32_t getEdrxMs() const { return edrxMs; }
+
+  // Traffic now (an upload started or finished, the modem woke)
+  void activity();
+  // The radio is up from recent traffic, or power saving is off
+  bool inWakeWindow() const;
+
+  // PSM: the wake window is over, so the modem is about to sleep;
+  // sleepMs() is how long from now until its next TAU
+  bool isAsleepDue() const;
+  uint32_t sleepMs() const;
+
+  // Sample radio use (call every poll)
+  void update(bool connecting, bool uploading, bool asleep);
+
+  // Figures since the last report; reported() subtracts what was sent
+  RadioStats getStats() const;
+  void reported(const RadioStats& sent);
+
+  // 3GPP timer codes as AT+CPSMS / AT+CEREG write them (8-character
+  // bit strings) and the eDRX cycle code (4 bits); 0 means deactivated
+  static void encodeTau(uint32_t seconds, char* bits);
+  static void encodeActiveTime(uint32_t seconds, char* bits);
+  static uint32_t decodeTau(const char* bits);
+  static uint32_t decodeActiveTime(const char* bits);
+  static uint8_t encodeEdrx(uint32_t cycleMs);
+  static uint32_t decodeEdrx(uint8_t code);
+
+private:
+  ModemAt at;
+
+  uint32_t tauS;
+  uint32_t activeTimeS;
+  uint32_t edrxMs;
+
+  bool hasActivity;
+  uint32_t lastActivity;  // millis()
+  uint32_t lastUpdate;
+
+  uint32_t periodMs;
+  uint32_t activeMs;
+  uint32_t awakeMs;
+  uint32_t wakes;
+
+  bool radioTail() const;
+};
+
+#endif // MODEM_POWER_H
@@ -0,0 +1,95 @@
+/**
+ * SwanFlow - Modem TLS Implementation
+ */
+
+#include "modem_tls.h"
+
+#define TLS_CERT_MAX_BYTES 10240  // AT+CFSWFILE limit
+#define TLS_CERT_DIRECTORY 3      // /customer/ (where the SSL stack looks)
+
+// ============================================================================
+// Constructor
+// ============================================================================
+ModemTls::ModemTls() {
+  configured = false;
+  uploads = 0;
+}
+
+void ModemTls::begin(ModemStream& stream) {
+  at.begin(stream);
+}
+
+// ============================================================================
+// Configuration
+// ============================================================================
+bool ModemTls::configure(const char* host) {
+  if (!at.isReady()) return false;
+  configured = false;
+
+  // Without a CA anyone on the path could pose as the server and collect
+  // the API key, so there is no unverified mode
+  size_t certLength = strlen(TLS_CA_CERT);
+  if (certLength == 0) {
+    Serial.println("TLS: ERROR - TLS_CA_CERT is empty in config.h; nothing will be uploaded");
+    return false;
+  }
+  if (certLength > TLS_CERT_MAX_BYTES) {
+    Serial.println("TLS: CA certificate too large for the modem");
+    return false;
+  }
+  if (!certificateInstalled(certLength)) {
+    Serial.printf("TLS: uploading %s (%d bytes)\n", TLS_CA_FILE, (int)certLength);
+    if (!uploadCertificate(TLS_CA_CERT, certLength)) {
+      Serial.println("TLS: certificate upload failed");
+      return false;
+    }
+    uploads++;
+  }
+
+  char cmd[96];
+  snprintf(cmd, sizeof(cmd), "+CSSLCFG=\"sni\",0,\"%s\"", host);
+
+  if (!at.command("+CSSLCFG=\"sslversion\",0,3") ||     // TLS 1.2
+      !at.command("+CSSLCFG=\"ignorertctime\",0,1") ||  // Modem clock may not be set yet
+      !at.command(cmd)) {
+    Serial.println("TLS: SSL context setup failed");
+    return false;
+  }
+
+  configured = true;
+  Serial.println("TLS: modem SSL ready");
+  return true;
+}
+
+bool ModemTls::certificateInstalled(size_t length) {
+  char cmd[64];
+  char reply[48];
+  snprintf(cmd, sizeof(cmd), "+CFSGFIS=%d,\"%s\"", TLS_CERT_DIRECTORY, TLS_CA_FILE);
+
+  if (!at.command("+CFSINIT")) return false;
+
+  // "+CFSGFIS: <size>", or ERROR if there's no such file
+  bool found = at.command(cmd, "+CFSGFIS:", 2000, reply, sizeof(reply));
+  if (found) at.waitFor("OK", 2000);
+  at.command("+CFSTERM");
+
+  return found && (size_t)atol(reply + 9) == length;
+}
+
+bool ModemTls::uploadCertificate(const char* pem, size_t length) {
+  char cmd[80];
+  snprintf(cmd, sizeof(cmd), "+CFSWFILE=%d,\"%s\",0,%u,10000",
+           TLS_CERT_DIRECTORY, TLS_CA_FILE, (unsigned)length);
+
+  if (!at.command("+CFSINIT")) return false;
+
+  at.send(cmd);
+  bool ok = at.waitForPrompt("DOWNLOAD", 5000);
+  if (ok) {
+    at.stream().write((const uint8_t*)pem, length);
+    ok = at.waitFor("OK", 12000);
+  }
+
+  at.command("+CFSTERM");
+  return ok;
+}
@@ -0,0 +1,57 @@
+/**
+ * SwanFlow - Modem TLS
+ *
+ * Sets up the SIM7000's own SSL stack, so uploads are encrypted by the
+ * modem rather than the ESP32 (no mbedTLS heap or handshake CPU here).
+ *
+ * configure() runs once per modem start, and refuses (false) while
+ * TLS_CA_CERT is empty; there is no unverified mode:
+ * - the CA certificate (TLS_CA_CERT) goes to the modem's file system,
+ *   only if a file of that name and size isn't there already, so the
+ *   upload happens once per modem rather than once per boot
+ * - SSL context 0 gets TLS 1.2, SNI for the backend host, and skips the
+ *   certificate validity-period check while the modem clock is unset
+ *
+ * The client (TinyGsmClientSecure) then converts the certificate and
+ * binds it to the socket at each connect. The SIM7000 has no TLS session
+ * cache that outlives a socket, so handshakes are saved by keeping the
+ * connection open (HttpConnection): one handshake per connection rather
+ * than per upload.
+ *
+ * Talks AT directly over the modem's serial stream (ModemAt); call it
+ * while no other AT command is in flight.
+ */
+
+#ifndef MODEM_TLS_H
+#define MODEM_TLS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "modem_at.h"
+
+// ============================================================================
+// Modem TLS Class
+// ============================================================================
+class ModemTls {
+public:
+  ModemTls();
+
+  void begin(ModemStream& at);
+
+  // Install the certificate (if needed) and set up the SSL context for host
+  bool configure(const char* host);
+  bool isConfigured() const { return configured; }
+
+  // Certificate uploads since boot (0 once the modem has it)
+  uint16_t getUploads() const { return uploads; }
+
+private:
+  ModemAt at;
+  bool configured;
+  uint16_t uploads;
+
+  bool certificateInstalled(size_t length);
+  bool uploadCertificate(const char* pem, size_t length);
+};
+
+#endif // MODEM_TLS_H
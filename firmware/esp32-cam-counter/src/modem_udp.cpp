@@ -0,0 +1,157 @@
+/**
+ * SwanFlow - Modem UDP Implementation
+ */
+
+#include "modem_udp.h"
+
+#define UDP_SOCKET 3              // CA socket ID, above TinyGSM's (0-1)
+#define UDP_OPEN_TIMEOUT_MS 10000 // Includes resolving the host name
+#define UDP_AT_TIMEOUT_MS 2000
+
+// ============================================================================
+// Constructor
+// ============================================================================
+ModemUdp::ModemUdp() {
+  opened = false;
+  host[0] = '\0';
+  port = 0;
+  txLength = 0;
+  txOverflow = false;
+  rxLength = 0;
+  rxPos = 0;
+}
+
+void ModemUdp::begin(ModemStream& stream) {
+  at.begin(stream);
+}
+
+// ============================================================================
+// Socket
+// ============================================================================
+// "+CAOPEN: <id>,<result>", result 0 when the socket is open
+bool ModemUdp::open(const char* toHost, uint16_t toPort) {
+  if (!at.isReady()) return false;
+  if (opened) stop();
+
+  char cmd[32 + MAX_HOST];
+  char reply[32];
+  snprintf(cmd, sizeof(cmd), "+CAOPEN=%d,0,\"UDP\",\"%s\",%u", UDP_SOCKET, toHost, toPort);
+
+  if (!at.command(cmd, "+CAOPEN:", UDP_OPEN_TIMEOUT_MS, reply, sizeof(reply))) return false;
+  at.waitFor("OK", UDP_AT_TIMEOUT_MS);
+
+  const char* result = strchr(reply, ',');
+  if (!result || atoi(result + 1) != 0) {
+    Serial.printf("UDP: open failed (%s)\n", reply);
+    return false;
+  }
+
+  strncpy(host, toHost, MAX_HOST - 1);
+  host[MAX_HOST - 1] = '\0';
+  port = toPort;
+  opened = true;
+  return true;
+}
+
+void ModemUdp::stop() {
+  rxLength = rxPos = 0;
+  if (!opened) return;
+  opened = false;
+
+  char cmd[20];
+  snprintf(cmd, sizeof(cmd), "+CACLOSE=%d", UDP_SOCKET);
+  at.command(cmd, "OK", UDP_AT_TIMEOUT_MS);
+}
+
+// ============================================================================
+// Sending
+// ============================================================================
+int ModemUdp::beginPacket(const char* toHost, uint16_t toPort) {
+  txLength = 0;
+  txOverflow = false;
+
+  if (opened && toPort == port && strcmp(toHost, host) == 0) return 1;
+  return open(toHost, toPort) ? 1 : 0;
+}
+
+size_t ModemUdp::write(uint8_t data) {
+  return write(&data, 1);
+}
+
+size_t ModemUdp::write(const uint8_t* buffer, size_t size) {
+  if (txLength + size > sizeof(tx)) {
+    txOverflow = true;
+    return 0;
+  }
+  memcpy(tx + txLength, buffer, size);
+  txLength += size;
+  return size;
+}
+
+// "AT+CASEND=<id>,<length>", the "> " prompt, then the datagram. A
+// failure means the socket is gone (the data session dropped), so the
+// next beginPacket() opens another.
+int ModemUdp::endPacket() {
+  if (!opened || txOverflow || txLength == 0) return 0;
+
+  char cmd[32];
+  snprintf(cmd, sizeof(cmd), "+CASEND=%d,%u", UDP_SOCKET, (unsigned)txLength);
+
+  at.send(cmd);
+  bool ok = at.waitForPrompt(">", UDP_AT_TIMEOUT_MS);
+  if (ok) {
+    at.stream().write(tx, txLength);
+    ok = at.waitFor("OK", UDP_AT_TIMEOUT_MS);
+  }
+
+  txLength = 0;
+  if (!ok) stop();
+  return ok ? 1 : 0;
+}
+
+// ============================================================================
+// Receiving
+// ============================================================================
+// "+CARECV: <length>,<data>", or "+CARECV: 0" if nothing has arrived
+int ModemUdp::parsePacket() {
+  rxLength = rxPos = 0;
+  if (!opened) return 0;
+
+  char cmd[32];
+  snprintf(cmd, sizeof(cmd), "+CARECV=%d,%u", UDP_SOCKET, (unsigned)sizeof(rx));
+
+  at.send(cmd);
+  if (!at.waitForPrompt("+CARECV: ", UDP_AT_TIMEOUT_MS)) return 0;
+
+  size_t length = 0;
+  uint8_t c;
+  for (;;) {
+    if (!at.readBytes(&c, 1, UDP_AT_TIMEOUT_MS)) return 0;
+    if (c < '0' || c > '9') break;
+    length = length * 10 + (c - '0');
+  }
+
+  if (length > 0) {
+    if (c != ',' || length > sizeof(rx)) return 0;
+    if (!at.readBytes(rx, length, UDP_AT_TIMEOUT_MS)) return 0;
+  }
+  at.waitFor("OK", UDP_AT_TIMEOUT_MS);
+
+  rxLength = length;
+  return length;
+}
+
+int ModemUdp::read() {
+  return rxPos < rxLength ? rx[rxPos++] : -1;
+}
+
+int ModemUdp::read(unsigned char* buffer, size_t len) {
+  size_t n = min(len, rxLength - rxPos);
+  memcpy(buffer, rx + rxPos, n);
+  rxPos += n;
+  return n;
+}
+
+int ModemUdp::peek() {
+  return rxPos < rxLength ? rx[rxPos] : -1;
+}
@@ -0,0 +1,76 @@
+/**
+ * SwanFlow - Modem UDP
+ *
+ * Arduino UDP over one of the SIM7000's own sockets (the CA* commands),
+ * so the MQTT-SN client can run on the modem or, unchanged, on any other
+ * UDP (a host test, WiFiUDP).
+ *
+ * The socket is opened by the first beginPacket() to a host (the modem
+ * resolves the name) and kept for later datagrams to the same host and
+ * port. endPacket() sends the datagram with AT+CASEND; parsePacket()
+ * reads whatever has arrived with AT+CARECV, which can be more than one
+ * datagram (MQTT-SN messages carry their own length). Each is a short
+ * AT exchange, so call it while no other AT command is in flight.
+ *
+ * The CA commands need the application network TinyGSM's SSL variant
+ * brings up (MODEM_TLS true); otherwise the socket doesn't open and
+ * beginPacket() fails.
+ */
+
+#ifndef MODEM_UDP_H
+#define MODEM_UDP_H
+
+#include <Arduino.h>
+#include <Udp.h>
+#include "config.h"
+#include "modem_at.h"
+
+// ============================================================================
+// Modem UDP Class
+// ============================================================================
+class ModemUdp : public UDP {
+public:
+  static const uint8_t MAX_HOST = 64;
+
+  ModemUdp();
+
+  void begin(ModemStream& at);
+  bool isOpen() const { return opened; }
+
+  // UDP. The local port is the modem's choice, and datagrams go to a host
+  // by name only.
+  uint8_t begin(uint16_t port) override { return 1; }
+  void stop() override;
+  int beginPacket(IPAddress ip, uint16_t port) override { return 0; }
+  int beginPacket(const char* host, uint16_t port) override;
+  int endPacket() override;
+  size_t write(uint8_t data) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  int parsePacket() override;
+  int available() override { return rxLength - rxPos; }
+  int read() override;
+  int read(unsigned char* buffer, size_t len) override;
+  int read(char* buffer, size_t len) override { return read((unsigned char*)buffer, len); }
+  int peek() override;
+  void flush() override {}
+  IPAddress remoteIP() override { return IPAddress(); }
+  uint16_t remotePort() override { return port; }
+
+private:
+  ModemAt at;
+  bool opened;
+  char host[MAX_HOST];
+  uint16_t port;
+
+  uint8_t tx[MQTTSN_MAX_PACKET];
+  size_t txLength;
+  bool txOverflow;  // Datagram didn't fit: endPacket() fails
+
+  uint8_t rx[MQTTSN_MAX_PACKET];
+  size_t rxLength;
+  size_t rxPos;
+
+  bool open(const char* host, uint16_t port);
+};
+
+#endif // MODEM_UDP_H
@@ -0,0 +1,296 @@
+/**
+ * SwanFlow - MQTT-SN Client Implementation
+ */
+
+#include "mqtt_sn.h"
+
+// Message types (MQTT-SN v1.2, section 5.2.2)
+#define MQTTSN_CONNECT 0x04
+#define MQTTSN_CONNACK 0x05
+#define MQTTSN_PUBLISH 0x0C
+#define MQTTSN_PUBACK 0x0D
+#define MQTTSN_DISCONNECT 0x18
+
+// PUBLISH flags
+#define MQTTSN_FLAG_DUP 0x80
+#define MQTTSN_FLAG_QOS1 0x20
+#define MQTTSN_FLAG_CLEAN 0x04
+#define MQTTSN_TOPIC_SHORT 0x02
+#define MQTTSN_TOPIC_TYPE 0x03
+
+#define MQTTSN_REQUEST_TOPIC "rq"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+MqttSnClient::MqttSnClient() {
+  udp = nullptr;
+  host = nullptr;
+  port = 0;
+  clientId[0] = '\0';
+  state = STATE_IDLE;
+  connected = false;
+  lastHeard = 0;
+  down = false;
+  downSince = 0;
+  returnCode = MQTTSN_NO_ANSWER;
+  payload = nullptr;
+  payloadLength = 0;
+  msgId = 0;
+  retries = 0;
+  startedAt = 0;
+  sentAt = 0;
+  lastReceive = 0;
+  bytesAtStart = 0;
+  request[0] = '\0';
+  memset(&stats, 0, sizeof(stats));
+}
+
+void MqttSnClient::begin(UDP& socket, const char* gatewayHost, uint16_t gatewayPort, const char* id) {
+  udp = &socket;
+  host = gatewayHost;
+  port = gatewayPort;
+  strncpy(clientId, id, MAX_CLIENT_ID);
+  clientId[MAX_CLIENT_ID] = '\0';
+}
+
+// ============================================================================
+// Publishing
+// ============================================================================
+bool MqttSnClient::publish(const char* topicName, const uint8_t* data, size_t length) {
+  if (!udp || state != STATE_IDLE) return false;
+  if (strlen(topicName) != 2 || length > MAX_PAYLOAD) return false;
+
+  memcpy(topic, topicName, 2);
+  payload = data;
+  payloadLength = length;
+  if (++msgId == 0) msgId = 1;
+  retries = 0;
+  startedAt = millis();
+  lastReceive = startedAt;
+  bytesAtStart = stats.bytesSent + stats.bytesReceived;
+  returnCode = MQTTSN_NO_ANSWER;
+  stats.publishes++;
+
+  // The gateway forgets a session after its keep-alive
+  if (connected && startedAt - lastHeard >= MQTTSN_KEEPALIVE_S * 1000UL) {
+    connected = false;
+  }
+  state = connected ? STATE_PUBLISHING : STATE_CONNECTING;
+
+  if (!send()) {
+    finish(MQTTSN_NO_ANSWER);
+    return false;
+  }
+  return true;
+}
+
+bool MqttSnClient::poll() {
+  if (state == STATE_IDLE) return false;
+
+  uint32_t now = millis();
+  if (now - lastReceive >= MQTTSN_RECEIVE_POLL_MS) {
+    lastReceive = now;
+    int size = udp->parsePacket();
+    if (size > 0) {
+      int length = udp->read(packet, min((size_t)size, sizeof(packet)));
+      if (length > 0) receive(packet, length);
+    }
+    if (state == STATE_IDLE) return false;
+  }
+
+  if (now - sentAt < MQTTSN_RETRY_MS) return true;
+
+  if (retries >= MQTTSN_RETRIES) {
+    Serial.println("MQTT-SN: no answer from gateway");
+    connected = false;
+    finish(MQTTSN_NO_ANSWER);
+    return false;
+  }
+
+  retries++;
+  stats.retransmits++;
+  if (!send()) {
+    finish(MQTTSN_NO_ANSWER);
+    return false;
+  }
+  return true;
+}
+
+void MqttSnClient::close() {
+  if (state != STATE_IDLE) finish(MQTTSN_NO_ANSWER);
+  connected = false;
+  if (udp) udp->stop();
+}
+
+bool MqttSnClient::isAvailable() const {
+  return !down || millis() - downSince >= MQTTSN_FALLBACK_MS;
+}
+
+bool MqttSnClient::takeRequest(char* out, size_t outLen) {
+  if (request[0] == '\0') return false;
+  strncpy(out, request, outLen - 1);
+  out[outLen - 1] = '\0';
+  request[0] = '\0';
+  return true;
+}
+
+void MqttSnClient::finish(MqttSnReturnCode code) {
+  returnCode = code;
+  state = STATE_IDLE;
+  payload = nullptr;
+
+  if (code == MQTTSN_ACCEPTED) {
+    stats.acked++;
+    stats.lastRttMs = millis() - startedAt;
+  } else {
+    stats.failed++;
+  }
+  if (code == MQTTSN_NO_ANSWER) {
+    down = true;
+    downSince = millis();
+  }
+  stats.lastBytes = stats.bytesSent + stats.bytesReceived - bytesAtStart;
+}
+
+// ============================================================================
+// Sending
+// ============================================================================
+// The message the current state is waiting on an answer to
+bool MqttSnClient::send() {
+  sentAt = millis();
+  if (state == STATE_CONNECTING) return sendConnect();
+  return sendPublish(retries > 0);
+}
+
+// Length, CONNECT, flags, protocol ID, keep-alive (BE16), client ID
+bool MqttSnClient::sendConnect() {
+  uint8_t header[6];
+  size_t idLength = strlen(clientId);
+  header[0] = sizeof(header) + idLength;
+  header[1] = MQTTSN_CONNECT;
+  header[2] = MQTTSN_FLAG_CLEAN;
+  header[3] = 0x01;
+  header[4] = MQTTSN_KEEPALIVE_S >> 8;
+  header[5] = MQTTSN_KEEPALIVE_S & 0xFF;
+  return sendDatagram(header, sizeof(header), (const uint8_t*)clientId, idLength);
+}
+
+// Length (one byte, or 0x01 and BE16 past 255), PUBLISH, flags, topic,
+// message ID (BE16), data
+bool MqttSnClient::sendPublish(bool duplicate) {
+  uint8_t header[9];
+  size_t total = 7 + payloadLength;
+  size_t n = 0;
+
+  if (total <= 255) {
+    header[n++] = total;
+  } else {
+    total += 2;
+    header[n++] = 0x01;
+    header[n++] = total >> 8;
+    header[n++] = total & 0xFF;
+  }
+  header[n++] = MQTTSN_PUBLISH;
+  header[n++] = (duplicate ? MQTTSN_FLAG_DUP : 0) | MQTTSN_FLAG_QOS1 | MQTTSN_TOPIC_SHORT;
+  header[n++] = topic[0];
+  header[n++] = topic[1];
+  header[n++] = msgId >> 8;
+  header[n++] = msgId & 0xFF;
+
+  return sendDatagram(header, n, payload, payloadLength);
+}
+
+bool MqttSnClient::sendDatagram(const uint8_t* header, size_t headerLength,
+                                const uint8_t* data, size_t dataLength) {
+  if (!udp->beginPacket(host, port)) {
+    Serial.println("MQTT-SN: can't open socket");
+    return false;
+  }
+  udp->write(header, headerLength);
+  if (dataLength > 0) udp->write(data, dataLength);
+  if (!udp->endPacket()) {
+    Serial.println("MQTT-SN: send failed");
+    return false;
+  }
+
+  stats.bytesSent += headerLength + dataLength;
+  return true;
+}
+
+// ============================================================================
+// Receiving
+// ============================================================================
+// A modem read can hold more than one datagram; each starts with its length
+void MqttSnClient::receive(const uint8_t* data, size_t length) {
+  stats.bytesReceived += length;
+
+  while (length >= 2) {
+    size_t total = data[0];
+    size_t headerLength = 1;
+    if (total == 0x01) {
+      if (length < 4) return;
+      total = (data[1] << 8) | data[2];
+      headerLength = 3;
+    }
+    if (total < headerLength + 1 || total > length) return;
+
+    lastHeard = millis();
+    down = false;
+    handlePacket(data[headerLength], data + headerLength + 1, total - headerLength - 1);
+
+    data += total;
+    length -= total;
+  }
+}
+
+void MqttSnClient::handlePacket(uint8_t type, const uint8_t* body, size_t length) {
+  switch (type) {
+    case MQTTSN_CONNACK:
+      if (state != STATE_CONNECTING || length < 1) return;
+      if (body[0] != MQTTSN_ACCEPTED) {
+        Serial.printf("MQTT-SN: connection refused (%d)\n", body[0]);
+        finish((MqttSnReturnCode)body[0]);
+        return;
+      }
+      connected = true;
+      stats.connects++;
+      state = STATE_PUBLISHING;
+      retries = 0;
+      if (!send()) finish(MQTTSN_NO_ANSWER);
+      return;
+
+    case MQTTSN_PUBACK: {
+      // Topic (2), message ID (2), return code
+      if (state != STATE_PUBLISHING || length < 5) return;
+      if (((body[2] << 8) | body[3]) != msgId) return;  // Late answer to an earlier publish
+      if (body[4] != MQTTSN_ACCEPTED) {
+        Serial.printf("MQTT-SN: publish rejected (%d)\n", body[4]);
+      }
+      finish((MqttSnReturnCode)body[4]);
+      return;
+    }
+
+    case MQTTSN_PUBLISH: {
+      // Flags, topic (2), message ID (2), data; only QoS 0 requests
+      if (length < 5 || (body[0] & MQTTSN_TOPIC_TYPE) != MQTTSN_TOPIC_SHORT) return;
+      if (memcmp(body + 1, MQTTSN_REQUEST_TOPIC, 2) != 0) return;
+      size_t n = min(length - 5, (size_t)MAX_REQUEST - 1);
+      memcpy(request, body + 5, n);
+      request[n] = '\0';
+      return;
+    }
+
+    case MQTTSN_DISCONNECT:
+      // The gateway lost the session: open another and publish again
+      connected = false;
+      if (state == STATE_PUBLISHING) {
+        state = STATE_CONNECTING;
+        if (!send()) finish(MQTTSN_NO_ANSWER);
+      }
+      return;
+
+    default:
+      return;
+  }
+}
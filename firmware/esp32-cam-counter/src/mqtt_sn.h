@@ -0,0 +1,141 @@
+/**
+ * SwanFlow - MQTT-SN Client
+ *
+ * Publishes telemetry records as MQTT-SN v1.2 datagrams over any Arduino
+ * UDP (the modem's socket, ModemUdp). A publish costs one datagram with
+ * 7 bytes of header and one 7-byte PUBACK, against a few hundred bytes of
+ * HTTP headers plus TCP and TLS setup.
+ *
+ * Only what uploads need is implemented:
+ * - CONNECT / CONNACK with a clean session, repeated when the session has
+ *   been idle for MQTTSN_KEEPALIVE_S (the gateway will have dropped it)
+ * - PUBLISH at QoS 1 to two-character short topic names, so there is no
+ *   REGISTER round trip; resent with DUP every MQTTSN_RETRY_MS until the
+ *   PUBACK with its message ID, MQTTSN_RETRIES times
+ * - PUBLISH from the gateway on the request topic ("rq"), the
+ *   equivalent of the X-SwanFlow-Request header
+ *
+ * Like HttpConnection, one publish is in flight at a time and poll()
+ * drives it without blocking; replies are checked every
+ * MQTTSN_RECEIVE_POLL_MS. A gateway that left a publish unanswered is
+ * passed over (isAvailable()) for MQTTSN_FALLBACK_MS, so uploads go over
+ * HTTP meanwhile rather than each waiting out the retries.
+ */
+
+#ifndef MQTT_SN_H
+#define MQTT_SN_H
+
+#include <Arduino.h>
+#include <Udp.h>
+#include "config.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+// PUBACK / CONNACK return codes
+enum MqttSnReturnCode : uint8_t {
+  MQTTSN_ACCEPTED = 0x00,
+  MQTTSN_CONGESTION = 0x01,      // Gateway couldn't pass it on, try later
+  MQTTSN_INVALID_TOPIC = 0x02,
+  MQTTSN_NOT_SUPPORTED = 0x03,   // The backend refused the record
+  MQTTSN_NO_ANSWER = 0xFF        // Not part of the protocol: retries ran out
+};
+
+// Counters since boot, and the last publish
+struct MqttSnStats {
+  uint32_t publishes;
+  uint32_t acked;
+  uint32_t failed;        // Rejected or unanswered
+  uint32_t retransmits;   // CONNECT and PUBLISH resends
+  uint32_t connects;      // Sessions opened (CONNACKs)
+  uint32_t bytesSent;     // Datagrams, headers included
+  uint32_t bytesReceived;
+  uint32_t lastRttMs;     // publish() to PUBACK
+  uint32_t lastBytes;     // Sent and received by the last publish
+};
+
+// ============================================================================
+// MQTT-SN Client Class
+// ============================================================================
+class MqttSnClient {
+public:
+  static const uint8_t MAX_CLIENT_ID = 23;
+  static const uint8_t MAX_REQUEST = 32;
+  static const size_t MAX_PAYLOAD = MQTTSN_MAX_PACKET - 9;  // Less the longest PUBLISH header
+
+  MqttSnClient();
+
+  // Gateway address; clientId is up to MAX_CLIENT_ID characters
+  void begin(UDP& udp, const char* host, uint16_t port, const char* clientId);
+
+  // Start publishing length bytes to a two-character topic name. False if
+  // a publish is in flight or the datagram couldn't be sent; payload must
+  // stay as it is until poll() returns false.
+  bool publish(const char* topic, const uint8_t* payload, size_t length);
+
+  // Advance the publish in flight; true while it is still running
+  bool poll();
+
+  bool isBusy() const { return state != STATE_IDLE; }
+  // The last publish was acknowledged
+  bool succeeded() const { return returnCode == MQTTSN_ACCEPTED; }
+  MqttSnReturnCode getReturnCode() const { return returnCode; }
+  // The gateway answered the last publish, or it didn't but
+  // MQTTSN_FALLBACK_MS have passed since
+  bool isAvailable() const;
+
+  // Forget the session and close the socket (after the link was lost);
+  // a publish in flight fails
+  void close();
+
+  // Gateway request (e.g. "heatmap"), copied to request. Returns true
+  // once per request.
+  bool takeRequest(char* request, size_t requestLen);
+
+  const MqttSnStats& getStats() const { return stats; }
+
+private:
+  enum State : uint8_t {
+    STATE_IDLE,
+    STATE_CONNECTING,   // CONNECT sent, waiting for CONNACK
+    STATE_PUBLISHING    // PUBLISH sent, waiting for PUBACK
+  };
+
+  UDP* udp;
+  const char* host;
+  uint16_t port;
+  char clientId[MAX_CLIENT_ID + 1];
+
+  State state;
+  bool connected;       // Session open at the gateway
+  uint32_t lastHeard;   // millis() of the last datagram from the gateway
+  bool down;            // A publish went unanswered...
+  uint32_t downSince;   // ...at this millis()
+  MqttSnReturnCode returnCode;
+
+  // Publish in flight
+  char topic[2];
+  const uint8_t* payload;
+  size_t payloadLength;
+  uint16_t msgId;
+  uint8_t retries;
+  uint32_t startedAt;
+  uint32_t sentAt;       // Of the last CONNECT or PUBLISH
+  uint32_t lastReceive;  // Of the last check for replies
+  uint32_t bytesAtStart;
+
+  char request[MAX_REQUEST];
+  uint8_t packet[MQTTSN_MAX_PACKET];
+  MqttSnStats stats;
+
+  bool send();
+  bool sendConnect();
+  bool sendPublish(bool duplicate);
+  bool sendDatagram(const uint8_t* header, size_t headerLength,
+                    const uint8_t* data, size_t dataLength);
+  void receive(const uint8_t* data, size_t length);
+  void handlePacket(uint8_t type, const uint8_t* body, size_t length);
+  void finish(MqttSnReturnCode code);
+};
+
+#endif // MQTT_SN_H
@@ -0,0 +1,260 @@
+/**
+ * SwanFlow - Rollup Store Implementation
+ */
+
+#include "rollup_store.h"
+
+#define ROLLUP_VERSION 1
+
+// ============================================================================
+// Tier Geometry
+// ============================================================================
+uint16_t RollupStore::tierMinutes(uint8_t tier) {
+  switch (tier) {
+    case ROLLUP_MINUTE: return 1;
+    case ROLLUP_QUARTER: return 15;
+    default: return 60;
+  }
+}
+
+uint32_t RollupStore::tierCapacity(uint8_t tier) {
+  switch (tier) {
+    case ROLLUP_MINUTE: return 24 * 60;       // 24 hours
+    case ROLLUP_QUARTER: return 30 * 24 * 4;  // 30 days
+    default: return 365 * 24;                 // 1 year
+  }
+}
+
+const char* RollupStore::tierPath(uint8_t tier) {
+  switch (tier) {
+    case ROLLUP_MINUTE: return "/rollup/m1.bin";
+    case ROLLUP_QUARTER: return "/rollup/m15.bin";
+    default: return "/rollup/h1.bin";
+  }
+}
+
+// ============================================================================
+// Constructor
+// ============================================================================
+RollupStore::RollupStore() {
+  fs = nullptr;
+  ready = false;
+  minutesSinceFlush = 0;
+
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    memset(&tiers[t].current, 0, sizeof(RollupRecord));
+    tiers[t].sectorIndex = -1;
+    tiers[t].dirty = false;
+  }
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+bool RollupStore::begin(fs::FS &filesystem) {
+  fs = &filesystem;
+
+  if (!fs->exists("/rollup")) {
+    fs->mkdir("/rollup");
+  }
+
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    if (!preallocate(t)) {
+      Serial.printf("Rollup: failed to prepare %s\n", tierPath(t));
+      return false;
+    }
+  }
+
+  ready = true;
+  Serial.println("Rollup store ready");
+  return true;
+}
+
+bool RollupStore::preallocate(uint8_t tier) {
+  uint32_t sectors = (tierCapacity(tier) + RECORDS_PER_SECTOR - 1) / RECORDS_PER_SECTOR;
+  uint32_t expected = sectors * SECTOR_SIZE;
+
+  File file = fs->open(tierPath(tier), FILE_READ);
+  if (file && file.size() == expected) {
+    file.close();
+    return true;
+  }
+  if (file) file.close();
+
+  // First use (or a size change): zero-fill once so later writes are in place
+  Serial.printf("Rollup: allocating %s (%lu bytes)\n", tierPath(tier), (unsigned long)expected);
+  file = fs->open(tierPath(tier), FILE_WRITE);
+  if (!file) return false;
+
+  uint8_t* zero = tiers[tier].sector;
+  memset(zero, 0, SECTOR_SIZE);
+  for (uint32_t i = 0; i < sectors; i++) {
+    if (file.write(zero, SECTOR_SIZE) != SECTOR_SIZE) {
+      file.close();
+      return false;
+    }
+  }
+
+  file.close();
+  return true;
+}
+
+// ============================================================================
+// Accumulation
+// ============================================================================
+void RollupStore::addMinute(uint32_t epochMinute, uint16_t vehicles) {
+  if (!ready) return;
+
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    accumulate(t, epochMinute, vehicles);
+  }
+
+  // Batch sector writes: partial records reach the card every few minutes
+  if (++minutesSinceFlush >= ROLLUP_FLUSH_MINUTES) {
+    flush();
+  }
+}
+
+void RollupStore::accumulate(uint8_t tier, uint32_t epochMinute, uint16_t vehicles) {
+  RollupRecord& current = tiers[tier].current;
+  uint32_t period = epochMinute / tierMinutes(tier);
+
+  if (current.period != period) {
+    // Close out the previous period
+    if (current.period != 0) {
+      storeRecord(tier, current);
+    }
+
+    // Resume a partial period written before a restart, if there is one
+    if (!loadRecord(tier, period, current)) {
+      memset(&current, 0, sizeof(current));
+      current.period = period;
+      current.version = ROLLUP_VERSION;
+    }
+  }
+
+  current.vehicles = current.vehicles + vehicles < UINT16_MAX ? current.vehicles + vehicles : UINT16_MAX;
+  if (vehicles > current.peakMinute) current.peakMinute = vehicles;
+  current.coverage++;
+}
+
+void RollupStore::flush() {
+  if (!ready) return;
+
+  for (int t = 0; t < ROLLUP_TIERS; t++) {
+    if (tiers[t].current.period != 0) {
+      storeRecord(t, tiers[t].current);
+    }
+    if (tiers[t].dirty) {
+      writeSector(t);
+    }
+  }
+
+  minutesSinceFlush = 0;
+}
+
+// ============================================================================
+// Sector I/O
+// ============================================================================
+void RollupStore::storeRecord(uint8_t tier, const RollupRecord& record) {
+  uint32_t slot = record.period % tierCapacity(tier);
+  int32_t sectorIndex = slot / RECORDS_PER_SECTOR;
+
+  if (!loadSector(tier, sectorIndex)) return;
+
+  RollupRecord stored = record;
+  stored.crc = crc16((const uint8_t*)&stored, offsetof(RollupRecord, crc));
+  memcpy(tiers[tier].sector + (slot % RECORDS_PER_SECTOR) * sizeof(RollupRecord),
+         &stored, sizeof(RollupRecord));
+  tiers[tier].dirty = true;
+}
+
+bool RollupStore::loadRecord(uint8_t tier, uint32_t period, RollupRecord& record) {
+  uint32_t slot = period % tierCapacity(tier);
+  if (!loadSector(tier, slot / RECORDS_PER_SECTOR)) return false;
+
+  memcpy(&record, tiers[tier].sector + (slot % RECORDS_PER_SECTOR) * sizeof(RollupRecord),
+         sizeof(RollupRecord));
+  return recordValid(record, period);
+}
+
+bool RollupStore::loadSector(uint8_t tier, int32_t sectorIndex) {
+  TierState& state = tiers[tier];
+  if (state.sectorIndex == sectorIndex) return true;
+
+  // Moving to another sector: write back the one we hold
+  if (state.dirty && !writeSector(tier)) return false;
+
+  File file = fs->open(tierPath(tier), FILE_READ);
+  if (!file) return false;
+
+  bool ok = file.seek(sectorIndex * SECTOR_SIZE) &&
+            file.read(state.sector, SECTOR_SIZE) == SECTOR_SIZE;
+  file.close();
+
+  state.sectorIndex = ok ? sectorIndex : -1;
+  return ok;
+}
+
+bool RollupStore::writeSector(uint8_t tier) {
+  TierState& state = tiers[tier];
+  if (state.sectorIndex < 0) return false;
+
+  // "r+" writes in place without truncating the preallocated file
+  File file = fs->open(tierPath(tier), "r+");
+  if (!file) return false;
+
+  bool ok = file.seek(state.sectorIndex * SECTOR_SIZE) &&
+            file.write(state.sector, SECTOR_SIZE) == SECTOR_SIZE;
+  file.close();
+
+  if (ok) state.dirty = false;
+  return ok;
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+size_t RollupStore::read(uint8_t tier, uint32_t fromPeriod, uint32_t toPeriod,
+                         RollupRecord* out, size_t maxRecords) {
+  if (!ready || tier >= ROLLUP_TIERS) return 0;
+
+  // Make sure the in-progress period is visible to the reader
+  if (tiers[tier].current.period != 0) {
+    storeRecord(tier, tiers[tier].current);
+  }
+
+  // Never look back further than the ring holds
+  if (toPeriod - fromPeriod > tierCapacity(tier)) {
+    fromPeriod = toPeriod - tierCapacity(tier);
+  }
+
+  size_t count = 0;
+  for (uint32_t period = fromPeriod; period < toPeriod && count < maxRecords; period++) {
+    if (loadRecord(tier, period, out[count])) {
+      count++;
+    }
+  }
+
+  return count;
+}
+
+// ============================================================================
+// Helpers
+// ============================================================================
+bool RollupStore::recordValid(const RollupRecord& record, uint32_t period) {
+  return record.period == period && record.version == ROLLUP_VERSION &&
+         record.crc == crc16((const uint8_t*)&record, offsetof(RollupRecord, crc));
+}
+
+uint16_t RollupStore::crc16(const uint8_t* data, size_t len) {
+  // CRC-16/CCITT-FALSE
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) {
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
@@ -0,0 +1,97 @@
+/**
+ * SwanFlow - Rollup Store
+ *
+ * Cascading count history on the SD card: 1-minute records for a day,
+ * 15-minute records for a month and hourly records for a year. Survives
+ * modem outages and reboots so the backend can be backfilled afterwards.
+ *
+ * Layout: one preallocated file per tier holding fixed 16-byte records.
+ * A period lives in slot (period % capacity), so a record's position is
+ * known without an index. Records carry their period and a CRC; stale or
+ * torn slots are ignored. Writes are whole 512-byte sectors at sector-
+ * aligned offsets, batched every ROLLUP_FLUSH_MINUTES.
+ */
+
+#ifndef ROLLUP_STORE_H
+#define ROLLUP_STORE_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "config.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+enum RollupTier : uint8_t {
+  ROLLUP_MINUTE = 0,   // 1 minute, 24 hours
+  ROLLUP_QUARTER = 1,  // 15 minutes, 30 days
+  ROLLUP_HOUR = 2,     // 1 hour, 1 year
+  ROLLUP_TIERS = 3
+};
+
+struct RollupRecord {
+  uint32_t period;       // Epoch minutes / tier minutes (0 = empty slot)
+  uint16_t vehicles;     // Vehicles counted in the period
+  uint16_t peakMinute;   // Busiest minute in the period
+  uint16_t coverage;     // Minutes of the period actually observed
+  uint8_t version;       // Record format version
+  uint8_t reserved[3];
+  uint16_t crc;          // CRC-16/CCITT of the preceding 14 bytes
+};
+
+static_assert(sizeof(RollupRecord) == 16, "RollupRecord must be 16 bytes");
+
+// ============================================================================
+// Rollup Store Class
+// ============================================================================
+class RollupStore {
+public:
+  static const uint16_t SECTOR_SIZE = 512;
+  static const uint8_t RECORDS_PER_SECTOR = SECTOR_SIZE / sizeof(RollupRecord);
+
+  RollupStore();
+
+  // Open (and on first use, preallocate) the tier files
+  bool begin(fs::FS &fs);
+  bool isReady() const { return ready; }
+
+  // Add one observed minute; cascades into the 15-minute and hourly tiers
+  void addMinute(uint32_t epochMinute, uint16_t vehicles);
+
+  // Write any pending sectors now (e.g. before a planned restart)
+  void flush();
+
+  // Copy valid records of a tier with period in [fromPeriod, toPeriod)
+  size_t read(uint8_t tier, uint32_t fromPeriod, uint32_t toPeriod,
+              RollupRecord* out, size_t maxRecords);
+
+  static uint16_t tierMinutes(uint8_t tier);
+  static uint32_t tierCapacity(uint8_t tier);
+
+private:
+  fs::FS* fs;
+  bool ready;
+
+  // One cached sector per tier
+  struct TierState {
+    RollupRecord current;     // Record being accumulated
+    uint8_t sector[SECTOR_SIZE];
+    int32_t sectorIndex;      // Sector held in the buffer (-1 = none)
+    bool dirty;
+  };
+  TierState tiers[ROLLUP_TIERS];
+  uint8_t minutesSinceFlush;
+
+  void accumulate(uint8_t tier, uint32_t epochMinute, uint16_t vehicles);
+  bool loadSector(uint8_t tier, int32_t sectorIndex);
+  bool writeSector(uint8_t tier);
+  void storeRecord(uint8_t tier, const RollupRecord& record);
+  bool loadRecord(uint8_t tier, uint32_t period, RollupRecord& record);
+  bool preallocate(uint8_t tier);
+
+  static const char* tierPath(uint8_t tier);
+  static bool recordValid(const RollupRecord& record, uint32_t period);
+  static uint16_t crc16(const uint8_t* data, size_t len);
+};
+
+#endif // ROLLUP_STORE_H
@@ -0,0 +1,249 @@
+/**
+ * SwanFlow - SD Writer Implementation
+ */
+
+#include "sd_writer.h"
+#include "esp_heap_caps.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+SdWriter::SdWriter() : pendingBytes(0), dropped(0), maxQueueDepth(0) {
+  log = nullptr;
+  images = nullptr;
+  cropBuffer = nullptr;
+  queue = nullptr;
+  ready = false;
+  written = 0;
+  failed = 0;
+  latencyP50Us = 0;
+  latencyP95Us = 0;
+  latencyP99Us = 0;
+  stackFree = 0;
+  latency.clear();
+  previousLatency.clear();
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+bool SdWriter::begin(EventLog& eventLog, ImageStore& imageStore) {
+  if (!eventLog.isReady()) return false;
+  log = &eventLog;
+  images = &imageStore;
+
+  // Without it images are stored uncropped
+  if (IMAGE_CROP && images->isReady()) {
+    cropBuffer = (uint8_t*)heap_caps_malloc(ImageStore::SLOT_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  }
+
+  queue = xQueueCreate(SD_WRITER_QUEUE_DEPTH, sizeof(SdWriteRequest));
+  if (!queue) {
+    Serial.println("SD writer: queue allocation failed");
+    return false;
+  }
+
+  // Same priority as loop(), but on the core that capture doesn't use
+  if (xTaskCreatePinnedToCore(taskEntry, "sd_writer", SD_WRITER_STACK, this, 1, nullptr,
+                              SD_WRITER_CORE) != pdPASS) {
+    Serial.println("SD writer: task creation failed");
+    return false;
+  }
+
+  ready = true;
+  Serial.println("SD writer ready");
+  return true;
+}
+
+// ============================================================================
+// Producer Side
+// ============================================================================
+bool SdWriter::submit(uint8_t type, uint32_t timestamp, const void* payload, size_t length) {
+  if (!ready) return false;
+
+  SdWriteRequest request;
+  request.timestamp = timestamp;
+  request.queuedAt = micros();
+  request.length = length;
+  request.type = type;
+  request.data = nullptr;
+  return enqueue(request, payload, length, nullptr);
+}
+
+bool SdWriter::submit(uint8_t type, uint32_t timestamp, const void* head, size_t headLength,
+                      const void* body, size_t bodyLength) {
+  if (!ready) return false;
+
+  SdWriteRequest request;
+  request.timestamp = timestamp;
+  request.queuedAt = micros();
+  request.length = headLength + bodyLength;
+  request.type = type;
+  request.data = nullptr;
+  return enqueue(request, head, headLength, body);
+}
+
+bool SdWriter::submitImage(const ImageMeta& meta, const uint8_t* jpeg, size_t length) {
+  if (!ready || !images->isReady()) return false;
+
+  SdWriteRequest request;
+  request.timestamp = meta.timestamp;
+  request.queuedAt = micros();
+  request.length = length;
+  request.type = LOG_IMAGE;
+  request.data = nullptr;
+  request.image = meta;
+  return enqueue(request, jpeg, length, nullptr);
+}
+
+// The payload is head followed by body (request.length - headLength bytes)
+bool SdWriter::enqueue(SdWriteRequest& request, const void* head, size_t headLength, const void* body) {
+  size_t length = request.length;
+  uint8_t* dest;
+
+  if (length <= sizeof(request.inlineData)) {
+    dest = request.inlineData;
+  } else {
+    // Bound what the card can fall behind by, so a stalled card can't
+    // take the heap with it
+    if (pendingBytes.load() + length > SD_WRITER_MAX_PENDING_BYTES) {
+      dropped++;
+      return false;
+    }
+
+    // Frames go to PSRAM to leave internal RAM for the camera and modem
+    request.data = (uint8_t*)heap_caps_malloc(length, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!request.data) request.data = (uint8_t*)malloc(length);
+    if (!request.data) {
+      dropped++;
+      return false;
+    }
+    dest = request.data;
+    pendingBytes += length;
+  }
+
+  memcpy(dest, head, headLength);
+  if (length > headLength) memcpy(dest + headLength, body, length - headLength);
+
+  if (xQueueSend(queue, &request, 0) != pdTRUE) {
+    release(request);
+    dropped++;
+    return false;
+  }
+
+  uint16_t depth = uxQueueMessagesWaiting(queue);
+  uint16_t seen = maxQueueDepth.load();
+  while (depth > seen && !maxQueueDepth.compare_exchange_weak(seen, depth)) {
+  }
+
+  return true;
+}
+
+void SdWriter::release(SdWriteRequest& request) {
+  if (request.data) {
+    pendingBytes -= request.length;
+    free(request.data);
+    request.data = nullptr;
+  }
+}
+
+// ============================================================================
+// Writer Task
+// ============================================================================
+void SdWriter::taskEntry(void* arg) {
+  static_cast<SdWriter*>(arg)->run();
+}
+
+void SdWriter::run() {
+  uint32_t lastFlush = millis();
+
+  for (;;) {
+    SdWriteRequest request;
+    if (xQueueReceive(queue, &request, pdMS_TO_TICKS(SD_WRITER_FLUSH_MS)) == pdTRUE) {
+      process(request);
+    }
+
+    // Nothing waiting: advance the image retention sweep
+    if (uxQueueMessagesWaiting(queue) == 0) {
+      images->maintain();
+    }
+
+    // Staged records reach the card (and readers) within SD_WRITER_FLUSH_MS
+    if (millis() - lastFlush >= SD_WRITER_FLUSH_MS) {
+      log->flush();
+      lastFlush = millis();
+
+      // High-water mark of this task's stack, for sizing SD_WRITER_STACK
+      uint32_t free = uxTaskGetStackHighWaterMark(nullptr);
+      statsLock.writeBegin();
+      stackFree = free;
+      statsLock.writeEnd();
+    }
+  }
+}
+
+void SdWriter::process(SdWriteRequest& request) {
+  const uint8_t* payload = request.data ? request.data : request.inlineData;
+  bool ok = request.type == LOG_IMAGE
+                ? storeImage(request, payload)
+                : log->append(request.type, request.timestamp, payload, request.length);
+  uint32_t elapsed = micros() - request.queuedAt;
+  release(request);
+
+  // Percentiles cover the current window plus the last full one, so they
+  // follow the card's recent behaviour without jumping at each rollover
+  if (latency.total >= LATENCY_WINDOW) {
+    previousLatency = latency;
+    latency.clear();
+  }
+  latency.add(elapsed);
+
+  LogHistogram recent = previousLatency;
+  recent.merge(latency);
+
+  statsLock.writeBegin();
+  if (ok) written++;
+  else failed++;
+  latencyP50Us = recent.percentile(0.50f);
+  latencyP95Us = recent.percentile(0.95f);
+  latencyP99Us = recent.percentile(0.99f);
+  statsLock.writeEnd();
+}
+
+bool SdWriter::storeImage(SdWriteRequest& request, const uint8_t* jpeg) {
+  ImageMeta& meta = request.image;
+
+  if (meta.crop.width > 0 && cropBuffer) {
+    size_t length = cropper.crop(jpeg, request.length, meta.crop, cropBuffer, ImageStore::SLOT_SIZE);
+    if (length > 0) {
+      meta.crop = cropper.getCropped();
+      return images->store(meta, cropBuffer, length);
+    }
+  }
+
+  // Not cropped (or the frame couldn't be): keep all of it
+  memset(&meta.crop, 0, sizeof(meta.crop));
+  return images->store(meta, jpeg, request.length);
+}
+
+// ============================================================================
+// Statistics
+// ============================================================================
+SdWriterStats SdWriter::getStats() const {
+  SdWriterStats stats;
+  uint32_t seq;
+  do {
+    seq = statsLock.readBegin();
+    stats.written = written;
+    stats.failed = failed;
+    stats.latencyP50Us = latencyP50Us;
+    stats.latencyP95Us = latencyP95Us;
+    stats.latencyP99Us = latencyP99Us;
+    stats.stackFree = stackFree;
+  } while (statsLock.readRetry(seq));
+
+  stats.queueDepth = queue ? uxQueueMessagesWaiting(queue) : 0;
+  stats.maxQueueDepth = maxQueueDepth.load();
+  stats.dropped = dropped.load();
+  return stats;
+}
@@ -0,0 +1,114 @@
+/**
+ * SwanFlow - SD Writer
+ *
+ * Moves SD card writes off the capture path. The loop queues records
+ * with submit() and images with submitImage(), which never wait on the
+ * card, and a task on the other core appends records to the EventLog
+ * (flushing it every SD_WRITER_FLUSH_MS) and stores images in the
+ * ImageStore, cropping them to the detections first. Idle time goes to
+ * the image store's retention sweep. When
+ * the card falls behind, new requests are dropped (and counted) rather
+ * than stalling capture.
+ */
+
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+#include "event_log.h"
+#include "image_store.h"
+#include "jpeg_crop.h"
+#include "seqlock.h"
+#include "traffic_metrics.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+struct SdWriteRequest {
+  uint32_t timestamp;  // Event time (millis)
+  uint32_t queuedAt;   // micros() when submitted, for latency
+  uint32_t length;
+  uint8_t type;        // EventLogType
+  uint8_t* data;       // Heap copy, or nullptr if the payload is inline
+  uint8_t inlineData[40];  // Payloads up to an IntervalRecord travel here
+  ImageMeta image;     // LOG_IMAGE only
+};
+
+struct SdWriterStats {
+  uint16_t queueDepth;     // Requests waiting now
+  uint16_t maxQueueDepth;  // Most ever waiting
+  uint32_t written;        // Records appended
+  uint32_t failed;         // Appends the log rejected
+  uint32_t dropped;        // Records never queued (queue full, no memory)
+  uint32_t latencyP50Us;   // Submit to append, over recent writes
+  uint32_t latencyP95Us;
+  uint32_t latencyP99Us;
+  uint32_t stackFree;      // Least free stack the writer task has had (bytes)
+};
+
+// ============================================================================
+// SD Writer Class
+// ============================================================================
+class SdWriter {
+public:
+  static const uint16_t LATENCY_WINDOW = 1024;  // Writes per latency window
+
+  SdWriter();
+
+  // Start the writer task for an open log (the image store may not be ready)
+  bool begin(EventLog& log, ImageStore& images);
+  bool isReady() const { return ready; }
+
+  // Queue a record. Copies the payload and returns at once; false if the
+  // record was dropped.
+  bool submit(uint8_t type, uint32_t timestamp, const void* payload, size_t length);
+
+  // Same, for a payload in two parts (e.g. a header and a frame)
+  bool submit(uint8_t type, uint32_t timestamp, const void* head, size_t headLength,
+              const void* body, size_t bodyLength);
+
+  // Queue a JPEG for the image store, the same way
+  bool submitImage(const ImageMeta& meta, const uint8_t* jpeg, size_t length);
+
+  // Safe from any task
+  SdWriterStats getStats() const;
+
+private:
+  EventLog* log;
+  ImageStore* images;
+  QueueHandle_t queue;
+  bool ready;
+
+  std::atomic<uint32_t> pendingBytes;  // Heap bytes held by queued requests
+  std::atomic<uint32_t> dropped;
+  std::atomic<uint16_t> maxQueueDepth;
+
+  // Written only by the writer task
+  SeqLock statsLock;
+  uint32_t written;
+  uint32_t failed;
+  uint32_t latencyP50Us;
+  uint32_t latencyP95Us;
+  uint32_t latencyP99Us;
+  uint32_t stackFree;
+  LogHistogram latency;          // Current window
+  LogHistogram previousLatency;  // Last full window
+
+  // Image cropping, on this task rather than the capture path
+  JpegCropper cropper;
+  uint8_t* cropBuffer;  // ImageStore::SLOT_SIZE bytes, in PSRAM
+
+  bool enqueue(SdWriteRequest& request, const void* head, size_t headLength, const void* body);
+  static void taskEntry(void* arg);
+  void run();
+  void process(SdWriteRequest& request);
+  bool storeImage(SdWriteRequest& request, const uint8_t* jpeg);
+  void release(SdWriteRequest& request);
+};
+
+#endif // SD_WRITER_H
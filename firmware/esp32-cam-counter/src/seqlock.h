@@ -0,0 +1,104 @@
+/**
+ * SwanFlow - Sequence Lock
+ *
+ * Single-writer lock for state that is written by one task and read from
+ * others. The writer never waits; readers copy what they need and retry
+ * if a write overlapped the copy.
+ *
+ * In use today: SdWriter's stats (written by the SD writer task, read by
+ * the loop task). VehicleCounter's readers all run on the loop task that
+ * also writes, so its lock is never contended yet; it is there so the
+ * uploads can move to another task or core without a data race.
+ */
+
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// ThreadSanitizer (host tests): a reader's copy races with the writer by
+// design and is thrown away if it did, so its reads are not reported.
+// Writes are still checked.
+#if defined(__SANITIZE_THREAD__)
+#define SEQLOCK_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SEQLOCK_TSAN 1
+#endif
+#endif
+
+#ifdef SEQLOCK_TSAN
+extern "C" void AnnotateIgnoreReadsBegin(const char* file, int line);
+extern "C" void AnnotateIgnoreReadsEnd(const char* file, int line);
+#endif
+
+// ============================================================================
+// SeqLock Class
+// ============================================================================
+// Writer:
+//   lock.writeBegin(); ...modify state...; lock.writeEnd();
+//
+// Reader:
+//   uint32_t seq;
+//   do {
+//     seq = lock.readBegin();
+//     ...copy state into locals...
+//   } while (lock.readRetry(seq));
+//
+// Readers may see torn values inside the loop, so they must only copy,
+// and anything used as an index must be bounds-safe for any value.
+//
+// A reader that finds a write in progress spins, yielding every
+// SPIN_LIMIT tries; it never sleeps. taskYIELD() only hands the core to
+// tasks of the same or higher priority, so a reader must not run above
+// the writer's priority on the writer's core.
+class SeqLock {
+public:
+  static const uint32_t SPIN_LIMIT = 64;
+
+  SeqLock() : sequence(0) {}
+
+  // Only one task may write
+  void writeBegin() {
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+  }
+
+  void writeEnd() {
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  uint32_t readBegin() const {
+    uint32_t seq;
+    uint32_t spins = 0;
+    while ((seq = sequence.load(std::memory_order_acquire)) & 1) {
+      // Write in progress: a few microseconds if the writer is on the
+      // other core; yield now and then in case it is on this one
+      if (++spins >= SPIN_LIMIT) {
+        taskYIELD();
+        spins = 0;
+      }
+    }
+#ifdef SEQLOCK_TSAN
+    AnnotateIgnoreReadsBegin(__FILE__, __LINE__);
+#endif
+    return seq;
+  }
+
+  // true if a write overlapped the read and it must be repeated
+  bool readRetry(uint32_t seq) const {
+#ifdef SEQLOCK_TSAN
+    AnnotateIgnoreReadsEnd(__FILE__, __LINE__);
+#endif
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return sequence.load(std::memory_order_relaxed) != seq;
+  }
+
+private:
+  std::atomic<uint32_t> sequence;  // Odd while a write is in progress
+};
+
+#endif // SEQLOCK_H
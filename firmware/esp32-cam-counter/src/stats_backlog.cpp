@@ -0,0 +1,209 @@
+/**
+ * SwanFlow - Stats Backlog Implementation
+ */
+
+#include "stats_backlog.h"
+#include "esp_system.h"
+
+static_assert(sizeof(IntervalRecord) <= sizeof(SdWriteRequest::inlineData),
+              "IntervalRecord must fit inline in an SdWriteRequest");
+
+// ============================================================================
+// Constructor
+// ============================================================================
+StatsBacklog::StatsBacklog() {
+  log = nullptr;
+  writer = nullptr;
+  memset(&state, 0, sizeof(state));
+  bootId = 0;
+  lastRecordAt = 0;
+  heldFrom = 0;
+  busy = false;
+  memset(&scanCursor, 0, sizeof(scanCursor));
+  scanCursorValid = false;
+  batchLastInterval = 0;
+  memset(&batchEnd, 0, sizeof(batchEnd));
+}
+
+// ============================================================================
+// Initialization
+// ============================================================================
+void StatsBacklog::begin(EventLog& eventLog, SdWriter& sdWriter) {
+  log = &eventLog;
+  writer = &sdWriter;
+  bootId = esp_random();
+}
+
+void StatsBacklog::restore(const BacklogState& saved) {
+  state = saved;
+
+  if (state.stream == 0) {
+    // Cold start: numbering restarts, so start a new stream for the backend
+    state.stream = esp_random() | 1;
+    state.nextInterval = 1;
+    state.deliveredInterval = 0;
+    state.scanSeq = log && log->isReady() ? log->getNextSeq() : 0;
+  } else if (pending()) {
+    Serial.printf("Backlog: %lu intervals to replay\n", (unsigned long)pendingCount());
+  }
+}
+
+// ============================================================================
+// Recording
+// ============================================================================
+IntervalRecord StatsBacklog::record(const CounterStats& stats, uint32_t epochOffset) {
+  IntervalRecord rec;
+  rec.interval = state.nextInterval++;
+  rec.stream = state.stream;
+  rec.bootId = bootId;
+  rec.timestamp = millis();
+  rec.epoch = epochOffset != 0 ? rec.timestamp / 1000 + epochOffset : 0;
+  rec.totalCount = stats.totalCount;
+  rec.lastHourCount = stats.lastHourCount;
+  rec.lastMinuteCount = stats.lastMinuteCount;
+  rec.avgConfidence = stats.avgConfidence;
+  rec.uptime = stats.uptime;
+
+  // Small enough to travel inline in the queue (no heap copy, not held to
+  // SD_WRITER_MAX_PENDING_BYTES), so it is only dropped if the writer
+  // queue itself is full
+  if (writer) writer->submit(LOG_STATS, rec.timestamp, &rec, sizeof(rec));
+  lastRecordAt = rec.timestamp;
+
+  return rec;
+}
+
+void StatsBacklog::delivered(uint32_t interval) {
+  // Only in-order delivery moves the mark; a live upload made while a
+  // backlog is waiting is sent again by the replay and deduplicated
+  if (interval != state.deliveredInterval + 1) return;
+
+  state.deliveredInterval = interval;
+  if (log && log->isReady()) {
+    state.scanSeq = log->getNextSeq();
+    scanCursorValid = false;
+  }
+}
+
+// ============================================================================
+// Replay
+// ============================================================================
+size_t StatsBacklog::readBatch(IntervalRecord* out, size_t maxRecords, uint32_t epochOffset) {
+  batchLastInterval = 0;
+  busy = false;
+
+  // No log (yet): keep the intervals pending. A card that failed may be
+  // readable again after a restart.
+  if (!log || !log->isReady()) return 0;
+
+  // Called from the loop task, so never wait for the SD writer: if it
+  // has the card, stop here and carry on from this point next time
+  LogCursor cursor = scanCursor;
+  if (!scanCursorValid || scanCursor.seq != state.scanSeq) {
+    if (!log->seek(state.scanSeq, cursor, 0)) {
+      busy = true;
+      return 0;
+    }
+  }
+
+  // Crossings and images sit between stats records; walk their headers
+  // only, and bound the walk so one pass can't stall the loop
+  size_t count = 0;
+  uint32_t scanned = 0;
+  uint32_t skipped = 0;
+  bool reachedEnd = false;
+  bool held = false;
+  LogCursor heldAt;
+  LogEntry entry;
+
+  while (count < maxRecords && scanned < BACKLOG_SCAN_RECORDS) {
+    LogCursor at = cursor;
+    LogReadResult result = log->read(cursor, entry, nullptr, 0, 0);
+    if (result == LOG_READ_BUSY) {
+      busy = true;
+      break;
+    }
+    if (result == LOG_READ_END) {
+      reachedEnd = true;
+      break;
+    }
+    scanned++;
+
+    if (result == LOG_READ_INVALID) {
+      // Torn or corrupt (or a failed card read): step past it rather
+      // than give up on the records after it
+      if (!log->skip(cursor, 0)) {
+        busy = true;
+        break;
+      }
+      skipped++;
+      continue;
+    }
+
+    if (entry.type != LOG_STATS || entry.length != sizeof(IntervalRecord)) continue;
+
+    IntervalRecord& rec = out[count];
+    result = log->read(at, entry, (uint8_t*)&rec, sizeof(rec), 0);
+    if (result == LOG_READ_BUSY) {
+      cursor = at;  // Read it again next time
+      busy = true;
+      break;
+    }
+    if (result != LOG_READ_OK || !entry.intact) continue;
+    if (rec.stream != state.stream || rec.interval <= state.deliveredInterval) continue;
+    if (rec.interval >= replayEnd()) {
+      // Held for the live batch; resume at it next time
+      held = true;
+      heldAt = at;
+      break;
+    }
+
+    if (rec.epoch == 0 && rec.bootId == bootId && epochOffset != 0) {
+      rec.epoch = rec.timestamp / 1000 + epochOffset;
+    }
+
+    batchLastInterval = rec.interval;
+    count++;
+  }
+
+  batchEnd = held ? heldAt : cursor;
+
+  if (skipped > 0) {
+    Serial.printf("Backlog: skipped unreadable event log data before record #%lu\n",
+                  (unsigned long)cursor.seq);
+  }
+
+  if (count == 0) {
+    if (!reachedEnd && !held) {
+      // Nothing in this stretch; resume after it next time
+      setScan(batchEnd);
+    } else if (held || millis() - lastRecordAt > 2 * SD_WRITER_FLUSH_MS) {
+      // Everything recorded has had time to reach the card, so the
+      // intervals still missing were dropped or overwritten
+      skipLost(batchEnd);
+    }
+  }
+
+  return count;
+}
+
+void StatsBacklog::acknowledge() {
+  if (batchLastInterval == 0) return;
+
+  state.deliveredInterval = batchLastInterval;
+  setScan(batchEnd);
+  batchLastInterval = 0;
+}
+
+void StatsBacklog::setScan(const LogCursor& at) {
+  state.scanSeq = at.seq;
+  scanCursor = at;
+  scanCursorValid = true;
+}
+
+void StatsBacklog::skipLost(const LogCursor& end) {
+  Serial.printf("Backlog: %lu intervals not found in the event log\n",
+                (unsigned long)pendingCount());
+  state.deliveredInterval = replayEnd() - 1;
+  setScan(end);
+}
@@ -0,0 +1,116 @@
+/**
+ * SwanFlow - Stats Backlog
+ *
+ * Store-and-forward for upload intervals. Every interval is numbered and
+ * written to the event log before the live upload is tried, so a failed
+ * upload leaves the record on the card rather than losing it. Once the
+ * modem is back, undelivered intervals are read back from the log oldest
+ * first and sent in batches, at most one batch per
+ * BACKLOG_REPLAY_INTERVAL_MS, while live uploads carry on.
+ *
+ * Progress (next interval, last in-order delivery, where to resume the log
+ * scan) is saved with the warm restart state. Intervals are numbered per
+ * stream, a random ID picked at cold start, so the backend can key on
+ * (site, stream, interval) and drop anything it has already seen.
+ */
+
+#ifndef STATS_BACKLOG_H
+#define STATS_BACKLOG_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "event_log.h"
+#include "sd_writer.h"
+#include "vehicle_counter.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+// One upload interval, as logged (LOG_STATS) and as sent in a batch
+struct IntervalRecord {
+  uint32_t interval;        // Interval number within the stream
+  uint32_t stream;          // Random ID from the last cold start
+  uint32_t bootId;          // Random ID of the boot that recorded it
+  uint32_t timestamp;       // millis() when recorded
+  uint32_t epoch;           // Unix seconds when recorded (0 = unknown)
+  uint32_t totalCount;
+  uint32_t lastHourCount;
+  uint32_t lastMinuteCount;
+  float avgConfidence;
+  uint32_t uptime;          // Seconds since boot
+};
+
+static_assert(sizeof(IntervalRecord) == 40, "IntervalRecord must be 40 bytes");
+
+// Progress kept in UploadState
+struct BacklogState {
+  uint32_t stream;
+  uint32_t nextInterval;       // Number the next interval will get
+  uint32_t deliveredInterval;  // Everything up to here has been delivered
+  uint32_t scanSeq;            // Event log seq to resume scanning from
+};
+
+// ============================================================================
+// Stats Backlog Class
+// ============================================================================
+class StatsBacklog {
+public:
+  StatsBacklog();
+
+  // log may not be ready (no SD card): undelivered intervals then stay
+  // pending, and are replayed if a later boot finds them on the card
+  void begin(EventLog& log, SdWriter& writer);
+
+  // Progress from a previous boot; a zero stream starts a new one
+  void restore(const BacklogState& state);
+  BacklogState getState() const { return state; }
+
+  // Number and log the interval just ended; call before uploading it
+  IntervalRecord record(const CounterStats& stats, uint32_t epochOffset);
+
+  // The live upload of interval succeeded
+  void delivered(uint32_t interval);
+
+  // Intervals from this one on are held for a live upload (UploadBatch);
+  // the replay leaves them alone until release()
+  void hold(uint32_t interval) { heldFrom = interval; }
+  void release() { heldFrom = 0; }
+
+  // Intervals are waiting to be replayed
+  bool pending() const { return state.deliveredInterval + 1 < replayEnd(); }
+  uint32_t pendingCount() const { return replayEnd() - 1 - state.deliveredInterval; }
+
+  // Read the next batch of undelivered intervals, oldest first. Fills in
+  // epoch where it is known now but wasn't when the interval was recorded.
+  // Returns 0 if none were found in this pass. Doesn't wait for the SD
+  // writer: if it had the card the pass stops early (wasBusy()).
+  size_t readBatch(IntervalRecord* out, size_t maxRecords, uint32_t epochOffset);
+  bool wasBusy() const { return busy; }
+
+  // The batch from readBatch() was delivered
+  void acknowledge();
+
+private:
+  EventLog* log;
+  SdWriter* writer;
+  BacklogState state;
+  uint32_t bootId;
+  uint32_t lastRecordAt;  // millis() of the last record()
+  uint32_t heldFrom;      // First interval held for a live upload (0 = none)
+  bool busy;              // The last readBatch() found the card in use
+
+  // Where state.scanSeq is in the log, if known: the log's index is
+  // sparse, so seeking there can mean walking many headers
+  LogCursor scanCursor;
+  bool scanCursorValid;
+
+  // Set by readBatch(), applied by acknowledge()
+  uint32_t batchLastInterval;
+  LogCursor batchEnd;
+
+  uint32_t replayEnd() const { return heldFrom ? heldFrom : state.nextInterval; }
+  void setScan(const LogCursor& at);
+  void skipLost(const LogCursor& end);
+};
+
+#endif // STATS_BACKLOG_H
@@ -0,0 +1,198 @@
+/**
+ * SwanFlow - Binary Telemetry Implementation
+ */
+
+#include "telemetry.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+TelemetryEncoder::TelemetryEncoder(uint8_t* buf, size_t cap) {
+  buffer = buf;
+  capacity = cap;
+  length = 0;
+  overflow = false;
+}
+
+// ============================================================================
+// Encoding
+// ============================================================================
+static uint32_t confidenceMille(float confidence) {
+  return (uint32_t)(constrain(confidence, 0.0f, 1.0f) * 1000 + 0.5f);
+}
+
+size_t TelemetryEncoder::encode(uint32_t siteId, const IntervalRecord* intervals, size_t count,
+                                const MetricsSummary* metrics, const SdWriterStats* sd,
+                                const HttpStats* net, const RadioStats* radio) {
+  length = 0;
+  overflow = count == 0;
+
+  uint8_t flags = 0;
+  if (metrics) flags |= TELEMETRY_METRICS;
+  if (sd) flags |= TELEMETRY_SD;
+  if (net) flags |= TELEMETRY_NET;
+  if (radio) flags |= TELEMETRY_RADIO;
+  for (size_t i = 0; i < count; i++) {
+    if (intervals[i].epoch != 0) flags |= TELEMETRY_EPOCH;
+  }
+
+  putByte('S');
+  putByte('F');
+  putByte('T');
+  putByte('M');
+  putByte(VERSION);
+  putByte(flags);
+  putVarint(siteId);
+  put32(count ? intervals[0].stream : 0);
+  putVarint(count);
+
+  // Clocks are predicted to advance by the same step as last time
+  uint32_t timestampStep = 0;
+  uint32_t uptimeStep = 0;
+  uint32_t epochStep = 0;
+
+  for (size_t i = 0; i < count && !overflow; i++) {
+    const IntervalRecord& r = intervals[i];
+
+    if (i == 0) {
+      putVarint(r.interval);
+      putVarint(r.timestamp);
+      putVarint(r.uptime);
+      putVarint(r.totalCount);
+      putVarint(r.lastHourCount);
+      putVarint(r.lastMinuteCount);
+      putVarint(confidenceMille(r.avgConfidence));
+      if (flags & TELEMETRY_EPOCH) putVarint(r.epoch);
+      continue;
+    }
+
+    const IntervalRecord& p = intervals[i - 1];
+    putDelta(r.interval - p.interval, 1);
+    putDelta(r.timestamp - p.timestamp, timestampStep);
+    putDelta(r.uptime - p.uptime, uptimeStep);
+    putDelta(r.totalCount, p.totalCount);
+    putDelta(r.lastHourCount, p.lastHourCount);
+    putDelta(r.lastMinuteCount, p.lastMinuteCount);
+    putDelta(confidenceMille(r.avgConfidence), confidenceMille(p.avgConfidence));
+    if (flags & TELEMETRY_EPOCH) putDelta(r.epoch - p.epoch, epochStep);
+
+    timestampStep = r.timestamp - p.timestamp;
+    uptimeStep = r.uptime - p.uptime;
+    epochStep = r.epoch - p.epoch;
+  }
+
+  if (metrics) {
+    putVarint(metrics->seq);
+    putVarint(metrics->duration);
+    putVarint(metrics->vehicles);
+    putHistogram(metrics->headwayMs);
+    putHistogram(metrics->gapMs);
+    putHistogram(metrics->speedDkmh);
+    for (int i = 0; i < 20; i++) {
+      putVarint(metrics->confidence[i]);
+    }
+  }
+
+  if (sd) {
+    putVarint(sd->written);
+    putVarint(sd->failed);
+    putVarint(sd->dropped);
+    putVarint(sd->queueDepth);
+    putVarint(sd->maxQueueDepth);
+    putVarint(sd->latencyP50Us);
+    putVarint(sd->latencyP95Us);
+    putVarint(sd->latencyP99Us);
+  }
+
+  if (net) {
+    putVarint(net->lastRttMs);
+    putVarint(net->lastConnectMs);
+    putVarint(net->lastBytesSent);
+    putVarint(net->lastBytesReceived);
+    putVarint(net->connects);
+    putVarint(net->reused);
+    putVarint(net->stale);
+  }
+
+  if (radio) {
+    putVarint(radio->periodMs);
+    putVarint(radio->activeMs);
+    putVarint(radio->awakeMs);
+    putVarint(radio->wakes);
+    putVarint(radio->linkHealth);
+    putVarint(radio->tauS);
+    putVarint(radio->activeTimeS);
+    putVarint(radio->edrxMs);
+  }
+
+  return overflow ? 0 : length;
+}
+
+size_t TelemetryEncoder::compress(LzCompressor& lz, uint8_t* output, size_t outputCapacity) {
+  if (overflow || length <= HEADER_SIZE || outputCapacity <= HEADER_SIZE + 5) return 0;
+
+  size_t bodyLength = length - HEADER_SIZE;
+  memcpy(output, buffer, HEADER_SIZE);
+  output[5] |= TELEMETRY_LZ;
+
+  size_t pos = HEADER_SIZE;
+  for (uint32_t v = bodyLength; ; v >>= 7) {
+    output[pos++] = v >= 0x80 ? (v & 0x7F) | 0x80 : v;
+    if (v < 0x80) break;
+  }
+
+  size_t packed = lz.compress(buffer + HEADER_SIZE, bodyLength, output + pos, outputCapacity - pos);
+  if (packed == 0 || pos + packed >= length) return 0;
+  return pos + packed;
+}
+
+// Sparse: only non-empty buckets, each as the gap from the previous one
+void TelemetryEncoder::putHistogram(const LogHistogram& hist) {
+  putVarint(hist.total);
+  putVarint(hist.sum);
+
+  uint8_t used = 0;
+  for (int i = 0; i < LogHistogram::BUCKETS; i++) {
+    if (hist.counts[i] != 0) used++;
+  }
+  putVarint(used);
+
+  int previous = -1;
+  for (int i = 0; i < LogHistogram::BUCKETS; i++) {
+    if (hist.counts[i] == 0) continue;
+    putVarint(i - previous - 1);
+    putVarint(hist.counts[i]);
+    previous = i;
+  }
+}
+
+// ============================================================================
+// Primitives
+// ============================================================================
+void TelemetryEncoder::putByte(uint8_t b) {
+  if (length >= capacity) {
+    overflow = true;
+    return;
+  }
+  buffer[length++] = b;
+}
+
+void TelemetryEncoder::putVarint(uint32_t v) {
+  while (v >= 0x80) {
+    putByte((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  putByte(v);
+}
+
+// Difference from a prediction, as a zigzag varint
+void TelemetryEncoder::putDelta(uint32_t value, uint32_t predicted) {
+  int32_t delta = (int32_t)(value - predicted);
+  putVarint(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+}
+
+void TelemetryEncoder::put32(uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    putByte(v >> (i * 8));
+  }
+}
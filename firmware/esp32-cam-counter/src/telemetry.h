@@ -0,0 +1,99 @@
+/**
+ * SwanFlow - Binary Telemetry
+ *
+ * Compact encoding of a stats upload, in place of the JSON document.
+ * The site is a numeric ID (the backend's sites.id) instead of its name
+ * and position, integers are varints (7 bits a byte, low first), and
+ * fractions are fixed point. Encoding builds no document or String.
+ *
+ * One record carries a batch of intervals. The first is sent in full;
+ * each later one as the change from the one before: counts as signed
+ * deltas, and clocks (device millis, uptime, Unix time) as the change in
+ * their step, which is 0 when intervals are evenly spaced.
+ *
+ * Layout ("SFTM", version 2):
+ *   magic, version, flags (TELEMETRY_*), then the body, or with
+ *   TELEMETRY_LZ the body's length (varint) and the body as an LZ4 block
+ * body: varint site ID, stream (LE32), varint interval count, intervals,
+ *   [metrics], [SD writer], [network], [radio]
+ * interval: number, device millis, uptime (s), total, hour and minute
+ *   counts, avg confidence (0.1%), [Unix seconds]; deltas are zigzag
+ *   varints (0, -1, 1, -2 ... as 0, 1, 2, 3 ...)
+ * metrics: varint seq, duration (ms), vehicles, three histograms
+ *   (headway, gap, speed) as varint samples, sum, bucket count and
+ *   (bucket gap, count) pairs, then 20 varint confidence bins
+ * SD writer / network / radio: the SdWriterStats / HttpStats /
+ *   RadioStats fields as varints
+ *
+ * Version 1 (one interval, no deltas) is still accepted by the backend.
+ * Decoded by decodeTelemetry() in the backend (backend/api/telemetry.js).
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "http_connection.h"
+#include "lz_block.h"
+#include "modem_power.h"
+#include "sd_writer.h"
+#include "stats_backlog.h"
+#include "traffic_metrics.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+enum TelemetryFlags : uint8_t {
+  TELEMETRY_METRICS = 0x01,
+  TELEMETRY_SD = 0x02,
+  TELEMETRY_NET = 0x04,
+  TELEMETRY_EPOCH = 0x08,  // Intervals carry Unix time
+  TELEMETRY_LZ = 0x10,     // Body is LZ-compressed
+  TELEMETRY_RADIO = 0x20
+};
+
+// ============================================================================
+// Telemetry Encoder Class
+// ============================================================================
+class TelemetryEncoder {
+public:
+  static const uint8_t VERSION = 2;
+  static const size_t HEADER_SIZE = 6;
+
+  // Worst cases (every field at 32 bits, every histogram bucket set)
+  static const size_t MAX_INTERVAL_SIZE = 8 * 5;
+  static const size_t MAX_EXTRA_SIZE = 3 * 5 + 3 * (15 + LogHistogram::BUCKETS * 5) + 20 * 3 + 8 * 5 + 7 * 5 + 8 * 5;
+
+  // Buffer size that always holds a record of this many intervals
+  static constexpr size_t maxSize(size_t intervals) {
+    return HEADER_SIZE + 5 + 4 + 5 + intervals * MAX_INTERVAL_SIZE + MAX_EXTRA_SIZE;
+  }
+
+  TelemetryEncoder(uint8_t* buffer, size_t capacity);
+
+  // Encode a batch of consecutive intervals (oldest first, one stream);
+  // metrics, sd, net and radio are optional. Returns the length, or 0 if
+  // it didn't fit.
+  size_t encode(uint32_t siteId, const IntervalRecord* intervals, size_t count,
+                const MetricsSummary* metrics, const SdWriterStats* sd, const HttpStats* net,
+                const RadioStats* radio);
+
+  // Compress the body of the record just encoded into output (header
+  // included). Returns the new length, or 0 if it came out no smaller.
+  size_t compress(LzCompressor& lz, uint8_t* output, size_t capacity);
+
+private:
+  uint8_t* buffer;
+  size_t capacity;
+  size_t length;
+  bool overflow;
+
+  void putByte(uint8_t b);
+  void putVarint(uint32_t v);
+  void putDelta(uint32_t value, uint32_t previous);
+  void put32(uint32_t v);
+  void putHistogram(const LogHistogram& hist);
+};
+
+#endif // TELEMETRY_H
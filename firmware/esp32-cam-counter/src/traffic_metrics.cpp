@@ -0,0 +1,120 @@
+/**
+ * SwanFlow - Traffic Metrics Implementation
+ */
+
+#include "traffic_metrics.h"
+
+// ============================================================================
+// Log-Bucket Histogram
+// ============================================================================
+void LogHistogram::clear() {
+  memset(counts, 0, sizeof(counts));
+  total = 0;
+  sum = 0;
+}
+
+uint8_t LogHistogram::bucketOf(uint32_t value) {
+  if (value < 8) return value;
+
+  int msb = 31 - __builtin_clz(value);
+  uint32_t bucket = 8 * (msb - 2) + ((value >> (msb - 3)) & 7);
+  return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+uint32_t LogHistogram::bucketLowerBound(uint8_t bucket) {
+  if (bucket < 8) return bucket;
+
+  int msb = bucket / 8 + 2;
+  return (8 + bucket % 8) << (msb - 3);
+}
+
+void LogHistogram::add(uint32_t value) {
+  uint16_t& count = counts[bucketOf(value)];
+  if (count < UINT16_MAX) count++;
+  total++;
+  sum += value;
+}
+
+void LogHistogram::merge(const LogHistogram& other) {
+  for (int i = 0; i < BUCKETS; i++) {
+    uint32_t merged = counts[i] + other.counts[i];
+    counts[i] = merged < UINT16_MAX ? merged : UINT16_MAX;
+  }
+  total += other.total;
+  sum += other.sum;
+}
+
+uint32_t LogHistogram::percentile(float q) const {
+  if (total == 0) return 0;
+
+  uint32_t target = (uint32_t)(q * total);
+  uint32_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += counts[i];
+    if (seen > target) return bucketLowerBound(i);
+  }
+  return bucketLowerBound(BUCKETS - 1);
+}
+
+// ============================================================================
+// Constructor
+// ============================================================================
+TrafficMetrics::TrafficMetrics() {
+  memset(&current, 0, sizeof(current));
+  memset(&completed, 0, sizeof(completed));
+  memset(lanes, 0, sizeof(lanes));
+}
+
+void TrafficMetrics::begin(uint32_t now) {
+  current.start = now;
+}
+
+// ============================================================================
+// Streaming Updates
+// ============================================================================
+void TrafficMetrics::addCrossing(uint32_t timestamp, uint8_t zone, float confidence,
+                                 float speed, float length) {
+  current.vehicles++;
+
+  // 0 = unknown (the placeholder detector), left out like speed
+  if (confidence > 0) {
+    int bin = (int)(confidence * 20);
+    current.confidence[bin > 19 ? 19 : bin]++;
+  }
+
+  if (speed > 0) {
+    current.speedDkmh.add((uint32_t)(speed * 10 + 0.5f));
+  }
+
+  if (zone < COUNTING_ZONES) {
+    LaneState& lane = lanes[zone];
+
+    if (lane.lastTime != 0) {
+      uint32_t headway = timestamp - lane.lastTime;
+      current.headwayMs.add(headway);
+
+      // Gap = headway minus the time the previous vehicle took to pass
+      if (lane.lastSpeed > 0 && lane.lastLength > 0) {
+        uint32_t occupancy = (uint32_t)(lane.lastLength / (lane.lastSpeed / 3.6f) * 1000);
+        current.gapMs.add(headway > occupancy ? headway - occupancy : 0);
+      }
+    }
+
+    lane.lastTime = timestamp;
+    lane.lastSpeed = speed;
+    lane.lastLength = length;
+  }
+}
+
+bool TrafficMetrics::update(uint32_t now) {
+  if (now - current.start < METRICS_INTERVAL_MS) return false;
+
+  current.duration = now - current.start;
+  current.seq = completed.seq + 1;
+  completed = current;
+
+  memset(&current, 0, sizeof(current));
+  current.start = now;
+
+  return true;
+}
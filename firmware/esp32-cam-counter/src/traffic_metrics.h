@@ -0,0 +1,87 @@
+/**
+ * SwanFlow - Traffic Metrics
+ *
+ * Fixed-memory streaming distributions of headway, gap, speed and
+ * detection confidence, fed from crossing events
+ */
+
+#ifndef TRAFFIC_METRICS_H
+#define TRAFFIC_METRICS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// Log-Bucket Histogram
+// ============================================================================
+// Values below 8 get their own bucket; above that each power of two is split
+// into 8 buckets (<= 12.5% relative error). Counters are plain sums, so
+// histograms from different intervals or sites merge by adding buckets.
+struct LogHistogram {
+  static const uint8_t BUCKETS = 168;  // Covers values up to 2^22
+
+  uint16_t counts[BUCKETS];
+  uint32_t total;  // Samples
+  uint32_t sum;    // Sum of samples (for the mean)
+
+  void clear();
+  void add(uint32_t value);
+  void merge(const LogHistogram& other);
+
+  // Approximate value at quantile q (0-1), from bucket lower bounds
+  uint32_t percentile(float q) const;
+
+  static uint8_t bucketOf(uint32_t value);
+  static uint32_t bucketLowerBound(uint8_t bucket);
+};
+
+// ============================================================================
+// Interval Summary
+// ============================================================================
+struct MetricsSummary {
+  uint32_t seq;            // Interval number (0 = none completed yet)
+  uint32_t start;          // Interval start (millis)
+  uint32_t duration;       // Interval length (ms)
+  uint32_t vehicles;       // Crossings in the interval
+  LogHistogram headwayMs;  // Front-to-front time to previous vehicle in lane
+  LogHistogram gapMs;      // Rear-to-front time to previous vehicle in lane
+  LogHistogram speedDkmh;  // Speed in 0.1 km/h
+  uint16_t confidence[20]; // Detection confidence in 5% bins (known only)
+};
+
+// ============================================================================
+// Traffic Metrics Class
+// ============================================================================
+class TrafficMetrics {
+public:
+  TrafficMetrics();
+
+  // Start the first interval
+  void begin(uint32_t now);
+
+  // Per-crossing update: O(1), no allocation.
+  // speed in km/h and length in m (0 = unknown).
+  void addCrossing(uint32_t timestamp, uint8_t zone, float confidence,
+                   float speed, float length);
+
+  // Close the current interval once METRICS_INTERVAL_MS has passed.
+  // Returns true if a new summary was completed.
+  bool update(uint32_t now);
+
+  // Most recently completed interval
+  const MetricsSummary& lastSummary() const { return completed; }
+
+private:
+  MetricsSummary current;
+  MetricsSummary completed;
+
+  // Previous vehicle per lane, for headway and gap
+  struct LaneState {
+    uint32_t lastTime;   // 0 = no previous vehicle
+    float lastSpeed;     // km/h
+    float lastLength;    // m
+  };
+  LaneState lanes[COUNTING_ZONES];
+};
+
+#endif // TRAFFIC_METRICS_H
@@ -0,0 +1,129 @@
+/**
+ * SwanFlow - Training Capture Implementation
+ */
+
+#include "training_capture.h"
+
+#define TRAINING_FRAME_WIDTH frameWidth(CAMERA_FRAME_SIZE)
+#define TRAINING_FRAME_HEIGHT frameHeight(CAMERA_FRAME_SIZE)
+#define TRAINING_HOUR_MS 3600000UL
+
+// ============================================================================
+// Constructor
+// ============================================================================
+TrainingCapture::TrainingCapture() {
+  lastUniform = 0;
+  lastTriggered = 0;
+  lastNight = 0;
+  lastRefill = 0;
+  budgetMs = 0;
+  sampled = 0;
+  started = false;
+}
+
+// ============================================================================
+// Sampling
+// ============================================================================
+uint8_t TrainingCapture::sample(const Detection* detections, size_t count,
+                                uint32_t captureTime, uint32_t epoch) {
+  // First frame: the uniform interval starts now, the others are open
+  if (!started) {
+    started = true;
+    lastRefill = captureTime;
+    budgetMs = FRAME_COST_MS * TRAINING_BURST;
+    lastUniform = captureTime;
+    lastTriggered = captureTime - TRAINING_MIN_GAP_MS;
+    lastNight = captureTime - TRAINING_HOUR_MS;
+  }
+
+  budgetMs += captureTime - lastRefill;
+  if (budgetMs > FRAME_COST_MS * TRAINING_BURST) budgetMs = FRAME_COST_MS * TRAINING_BURST;
+  lastRefill = captureTime;
+
+  uint8_t reasons = 0;
+
+  if (TRAINING_SAMPLE_NIGHT && TRAINING_NIGHT_PER_HOUR > 0 && isNight(epoch) &&
+      captureTime - lastNight >= TRAINING_HOUR_MS / TRAINING_NIGHT_PER_HOUR) {
+    reasons |= TRAIN_NIGHT;
+  }
+
+  bool budget = budgetMs >= FRAME_COST_MS;
+
+  if (TRAINING_SAMPLE_UNIFORM && budget && captureTime - lastUniform >= TRAINING_UNIFORM_INTERVAL_MS) {
+    reasons |= TRAIN_UNIFORM;
+  }
+
+  if (budget && captureTime - lastTriggered >= TRAINING_MIN_GAP_MS) {
+    for (size_t i = 0; i < count; i++) {
+      const Detection& det = detections[i];
+      if (TRAINING_SAMPLE_LOW_CONFIDENCE && det.confidence < IMAGE_LOW_CONFIDENCE_BELOW) {
+        reasons |= TRAIN_LOW_CONFIDENCE;
+      }
+      float distance = det.y * TRAINING_FRAME_HEIGHT - COUNTING_LINE_Y;
+      if (TRAINING_SAMPLE_NEAR_CROSSING && fabsf(distance) <= TRAINING_NEAR_LINE_PX) {
+        reasons |= TRAIN_NEAR_CROSSING;
+      }
+    }
+  }
+
+  if (reasons == 0) return 0;
+
+  // A night frame that also met another policy counts as both
+  if (reasons & TRAIN_UNIFORM) lastUniform = captureTime;
+  if (reasons & (TRAIN_LOW_CONFIDENCE | TRAIN_NEAR_CROSSING)) lastTriggered = captureTime;
+  if (reasons & TRAIN_NIGHT) lastNight = captureTime;
+  if (reasons & ~TRAIN_NIGHT) budgetMs -= FRAME_COST_MS;
+  sampled++;
+  return reasons;
+}
+
+bool TrainingCapture::isNight(uint32_t epoch) {
+  if (epoch == 0) return false;  // No network time yet
+
+  uint32_t hour = ((epoch + TRAINING_UTC_OFFSET_HOURS * 3600L) / 3600) % 24;
+  if (TRAINING_NIGHT_START_HOUR <= TRAINING_NIGHT_END_HOUR) {
+    return hour >= TRAINING_NIGHT_START_HOUR && hour < TRAINING_NIGHT_END_HOUR;
+  }
+  return hour >= TRAINING_NIGHT_START_HOUR || hour < TRAINING_NIGHT_END_HOUR;
+}
+
+// ============================================================================
+// Sidecar
+// ============================================================================
+size_t TrainingCapture::buildSidecar(TrainingSidecar& sidecar, uint8_t reasons,
+                                     const Detection* detections, size_t count,
+                                     uint32_t captureTime, uint32_t epoch,
+                                     size_t jpegLength) const {
+  if (count > MAX_DETECTIONS_PER_FRAME) count = MAX_DETECTIONS_PER_FRAME;
+
+  TrainingHeader& header = sidecar.header;
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.reasons = reasons;
+  header.boxCount = count;
+  header.reserved = 0;
+  header.timestamp = captureTime;
+  header.epoch = epoch;
+  header.frameWidth = TRAINING_FRAME_WIDTH;
+  header.frameHeight = TRAINING_FRAME_HEIGHT;
+  header.jpegLength = jpegLength;
+
+  for (size_t i = 0; i < count; i++) {
+    const Detection& det = detections[i];
+    float left = constrain(det.x - det.width / 2, 0.0f, 1.0f);
+    float top = constrain(det.y - det.height / 2, 0.0f, 1.0f);
+    float right = constrain(det.x + det.width / 2, left, 1.0f);
+    float bottom = constrain(det.y + det.height / 2, top, 1.0f);
+
+    TrainingBox& box = sidecar.boxes[i];
+    box.x = left * TRAINING_FRAME_WIDTH;
+    box.y = top * TRAINING_FRAME_HEIGHT;
+    box.width = (right - left) * TRAINING_FRAME_WIDTH;
+    box.height = (bottom - top) * TRAINING_FRAME_HEIGHT;
+    box.trackId = det.trackId;
+    box.confidence = constrain(det.confidence, 0.0f, 1.0f) * 255;
+    box.reserved = 0;
+  }
+
+  return sizeof(TrainingHeader) + count * sizeof(TrainingBox);
+}
@@ -0,0 +1,110 @@
+/**
+ * SwanFlow - Training Capture
+ *
+ * Samples frames for model training while the counter runs. Each frame
+ * is checked against the enabled policies:
+ *
+ * - Uniform: one frame every TRAINING_UNIFORM_INTERVAL_MS
+ * - Low confidence: a detection below IMAGE_LOW_CONFIDENCE_BELOW
+ * - Near crossing: a detection within TRAINING_NEAR_LINE_PX of the line
+ * - Night: TRAINING_NIGHT_PER_HOUR frames an hour during the night hours
+ *   (needs network time), with or without detections
+ *
+ * Triggered policies (low confidence, near crossing) are spaced by
+ * TRAINING_MIN_GAP_MS. Uniform and triggered frames share a budget of
+ * TRAINING_MAX_PER_HOUR that refills steadily (bursts of up to
+ * TRAINING_BURST), so a busy spell can't use up the hour in its first
+ * minutes. Night frames have their own quota outside the budget.
+ *
+ * A sampled frame is logged as one LOG_TRAINING record: a TrainingHeader,
+ * one TrainingBox per detection, then the JPEG. The record goes through
+ * the SdWriter like any other, so the capture path only pays for the
+ * policy check and a copy of the frame. tools/export_training.py turns
+ * the records on a card into images and an Edge Impulse label file.
+ */
+
+#ifndef TRAINING_CAPTURE_H
+#define TRAINING_CAPTURE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "vehicle_counter.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+enum TrainingReason : uint8_t {
+  TRAIN_UNIFORM = 0x01,
+  TRAIN_LOW_CONFIDENCE = 0x02,
+  TRAIN_NEAR_CROSSING = 0x04,
+  TRAIN_NIGHT = 0x08
+};
+
+// Sidecar layout (little-endian, read by tools/export_training.py)
+struct TrainingHeader {
+  uint32_t magic;        // TrainingCapture::MAGIC
+  uint8_t version;
+  uint8_t reasons;       // TrainingReason bits that selected the frame
+  uint8_t boxCount;      // TrainingBox entries that follow
+  uint8_t reserved;
+  uint32_t timestamp;    // Capture time (millis)
+  uint32_t epoch;        // Unix seconds (0 = unknown)
+  uint16_t frameWidth;   // Pixels
+  uint16_t frameHeight;
+  uint32_t jpegLength;   // JPEG bytes after the boxes
+};
+
+struct TrainingBox {
+  uint16_t x;            // Top-left corner (pixels)
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+  uint16_t trackId;      // 0 = not matched to a track
+  uint8_t confidence;    // 0-255
+  uint8_t reserved;
+};
+
+static_assert(sizeof(TrainingHeader) == 24, "TrainingHeader must be 24 bytes");
+static_assert(sizeof(TrainingBox) == 12, "TrainingBox must be 12 bytes");
+
+struct TrainingSidecar {
+  TrainingHeader header;
+  TrainingBox boxes[MAX_DETECTIONS_PER_FRAME];
+};
+
+// ============================================================================
+// Training Capture Class
+// ============================================================================
+class TrainingCapture {
+public:
+  static const uint32_t MAGIC = 0x4C545346;  // "SFTL"
+  static const uint8_t VERSION = 1;
+  static const uint32_t FRAME_COST_MS = 3600000UL / TRAINING_MAX_PER_HOUR;
+
+  TrainingCapture();
+
+  // Policies that select this frame (0 = skip it). Counts the frame
+  // against the quotas if it is selected.
+  uint8_t sample(const Detection* detections, size_t count, uint32_t captureTime, uint32_t epoch);
+
+  // Fill sidecar for a selected frame; returns the bytes to log before
+  // the JPEG
+  size_t buildSidecar(TrainingSidecar& sidecar, uint8_t reasons,
+                      const Detection* detections, size_t count,
+                      uint32_t captureTime, uint32_t epoch, size_t jpegLength) const;
+
+  uint32_t getSampled() const { return sampled; }
+
+private:
+  uint32_t lastUniform;
+  uint32_t lastTriggered;
+  uint32_t lastNight;
+  uint32_t lastRefill;
+  uint32_t budgetMs;  // Frames available = budgetMs / FRAME_COST_MS
+  uint32_t sampled;
+  bool started;
+
+  static bool isNight(uint32_t epoch);
+};
+
+#endif // TRAINING_CAPTURE_H
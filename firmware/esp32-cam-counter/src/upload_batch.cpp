@@ -0,0 +1,100 @@
+/**
+ * SwanFlow - Upload Batch Implementation
+ */
+
+#include "upload_batch.h"
+
+// ============================================================================
+// Constructor
+// ============================================================================
+UploadBatch::UploadBatch() {
+  intervalCount = 0;
+  inFlight = 0;
+  hasMetrics = false;
+  hasLater = false;
+  lastFailed = false;
+}
+
+// ============================================================================
+// Batch Size
+// ============================================================================
+size_t UploadBatch::target(int signalQuality, const HttpStats& net) const {
+  if (!TELEMETRY_BINARY || SITE_ID == 0) return 1;
+
+  size_t size = UPLOAD_BATCH_INTERVALS;
+  if (UPLOAD_BATCH_ADAPTIVE) {
+    bool known = signalQuality > 0 && signalQuality != 99;
+    if (lastFailed || (known && signalQuality < 10) ||
+        (net.requests > 0 && net.lastRttMs >= UPLOAD_BATCH_SLOW_RTT_MS)) {
+      size *= 3;  // Poor: fewer, larger requests
+    } else if (known && signalQuality < 15) {
+      size *= 2;  // Fair
+    }
+  }
+
+  return constrain(size, (size_t)1, (size_t)UPLOAD_BATCH_MAX);
+}
+
+// ============================================================================
+// Collecting
+// ============================================================================
+void UploadBatch::add(const IntervalRecord& interval) {
+  if (full()) return;
+  records[intervalCount++] = interval;
+}
+
+void UploadBatch::addMetrics(const MetricsSummary& summary) {
+  // The merged summary is in flight: collect into the next one
+  MetricsSummary& into = inFlight > 0 ? later : merged;
+  bool& has = inFlight > 0 ? hasLater : hasMetrics;
+
+  if (!has) {
+    into = summary;
+    has = true;
+    return;
+  }
+  merge(into, summary);
+}
+
+void UploadBatch::merge(MetricsSummary& into, const MetricsSummary& summary) {
+  into.seq = summary.seq;
+  into.duration += summary.duration;
+  into.vehicles += summary.vehicles;
+  into.headwayMs.merge(summary.headwayMs);
+  into.gapMs.merge(summary.gapMs);
+  into.speedDkmh.merge(summary.speedDkmh);
+  for (int i = 0; i < 20; i++) {
+    uint32_t bin = into.confidence[i] + summary.confidence[i];
+    into.confidence[i] = bin < UINT16_MAX ? bin : UINT16_MAX;
+  }
+}
+
+// ============================================================================
+// Outcome
+// ============================================================================
+void UploadBatch::sent() {
+  intervalCount -= inFlight;
+  memmove(records, records + inFlight, intervalCount * sizeof(IntervalRecord));
+  inFlight = 0;
+
+  hasMetrics = hasLater;
+  if (hasLater) merged = later;
+  hasLater = false;
+  lastFailed = false;
+}
+
+void UploadBatch::failed() {
+  intervalCount = 0;
+  inFlight = 0;
+
+  if (hasLater) {
+    if (hasMetrics) {
+      merge(merged, later);
+    } else {
+      merged = later;
+      hasMetrics = true;
+    }
+    hasLater = false;
+  }
+  lastFailed = true;
+}
@@ -0,0 +1,78 @@
+/**
+ * SwanFlow - Upload Batch
+ *
+ * Holds upload intervals until there are enough to send together, so one
+ * request (and one wake of the modem) carries several minutes of counts
+ * rather than each minute paying its own HTTP, TCP and TLS overhead.
+ *
+ * The batch size is UPLOAD_BATCH_INTERVALS, raised on a poor link (weak
+ * signal, slow or failed uploads) where each request costs the most, up
+ * to UPLOAD_BATCH_MAX. Metrics intervals completed while the batch fills
+ * are merged into one summary (histograms merge by adding buckets).
+ *
+ * Held intervals are also in the event log: if the batch can't be sent
+ * it is dropped and the stats backlog replays them from the card.
+ * Uploads are asynchronous: intervals and metrics that arrive while a
+ * batch is in flight are kept for the next one.
+ * Batching needs the binary format (TELEMETRY_BINARY with a SITE_ID);
+ * otherwise every interval is sent on its own as before.
+ */
+
+#ifndef UPLOAD_BATCH_H
+#define UPLOAD_BATCH_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "http_connection.h"
+#include "stats_backlog.h"
+#include "traffic_metrics.h"
+
+// ============================================================================
+// Upload Batch Class
+// ============================================================================
+class UploadBatch {
+public:
+  UploadBatch();
+
+  // Intervals to collect before uploading. signalQuality is the modem's
+  // CSQ (0-31, 99 = unknown); net has the last upload's round trip.
+  size_t target(int signalQuality, const HttpStats& net) const;
+
+  void add(const IntervalRecord& interval);
+  void addMetrics(const MetricsSummary& summary);
+
+  size_t count() const { return intervalCount; }
+  bool full() const { return intervalCount >= UPLOAD_BATCH_MAX; }
+  const IntervalRecord* intervals() const { return records; }
+  uint32_t firstInterval() const { return intervalCount ? records[0].interval : 0; }
+
+  // Merged metrics since the last successful upload, null if none
+  const MetricsSummary* metrics() const { return hasMetrics ? &merged : nullptr; }
+
+  // The intervals and metrics collected so far are being uploaded
+  void sending() { inFlight = intervalCount; }
+  bool isSending() const { return inFlight > 0; }
+  size_t sendingCount() const { return inFlight; }
+
+  // The batch in flight was delivered: anything added since starts the
+  // next one
+  void sent();
+
+  // The batch wasn't delivered: all intervals are left to the backlog
+  // replay, metrics stay for the next batch
+  void failed();
+
+private:
+  IntervalRecord records[UPLOAD_BATCH_MAX];
+  size_t intervalCount;
+  size_t inFlight;        // Leading intervals being uploaded
+  MetricsSummary merged;
+  bool hasMetrics;
+  MetricsSummary later;   // Merged while a batch is in flight
+  bool hasLater;
+  bool lastFailed;
+
+  static void merge(MetricsSummary& into, const MetricsSummary& summary);
+};
+
+#endif // UPLOAD_BATCH_H
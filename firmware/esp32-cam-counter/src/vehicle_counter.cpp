@@ -7,45 +7,85 @@
 // TODO: Include Edge Impulse SDK after model export
 // #include <your-project-name_inferencing.h>
 
+#define COUNTER_TEMPLATE template <uint16_t FrameWidth, uint16_t FrameHeight, uint8_t MaxTracks, uint8_t ZoneCount>
+#define COUNTER_CLASS BasicVehicleCounter<FrameWidth, FrameHeight, MaxTracks, ZoneCount>
+
 // ============================================================================
 // Constructor
 // ============================================================================
-VehicleCounter::VehicleCounter() {
+COUNTER_TEMPLATE
+COUNTER_CLASS::BasicVehicleCounter() {
   detectionCount = 0;
   totalCount = 0;
-  hourlyCount = 0;
-  minuteCount = 0;
-  lastHourReset = 0;
-  lastMinuteReset = 0;
   totalConfidence = 0;
   totalDetections = 0;
 
+  for (int z = 0; z < ZoneCount; z++) {
+    zoneCounts[z] = 0;
+  }
+
   // Initialize tracking
-  for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
-    tracked[i].lastY = 0;
-    tracked[i].counted = false;
-    tracked[i].lastSeen = 0;
+  for (int i = 0; i < MaxTracks; i++) {
+    trackX[i] = 0;
+    trackY[i] = 0;
+    trackSeen[i] = 0;
+    trackId[i] = 0;
+    trackCounted[i] = false;
+    trackAppearance[i] = 0;
+    trackAnchorX[i] = 0;
+    trackAnchorY[i] = 0;
+    trackStillSince[i] = 0;
+  }
+  nextTrackId = 1;
+
+  // Initialize re-identification
+  memset(lostTracks, 0, sizeof(lostTracks));
+  reidCount = 0;
+
+  // Initialize incident detection
+  for (int z = 0; z < ZoneCount; z++) {
+    queueActive[z] = false;
+    blockageActive[z] = false;
   }
+  flowDropActive = false;
+  flowWindowStart = 0;
+  flowWindowCount = 0;
+  flowBaseline = 0;
+
+  // Initialize incident log
+  memset(incidentLog, 0, sizeof(incidentLog));
+  incidentSeq = 0;
+
+  // Initialize crossing log
+  memset(crossingLog, 0, sizeof(crossingLog));
+  crossingSeq = 0;
 }
 
 // ============================================================================
 // Initialization
 // ============================================================================
-void VehicleCounter::begin() {
-  lastHourReset = millis();
-  lastMinuteReset = millis();
+COUNTER_TEMPLATE
+void COUNTER_CLASS::begin() {
+  countWindow.advance(millis());
+  metrics.begin(millis());
 
   Serial.println("Vehicle counter initialized");
   Serial.printf("Detection threshold: %.2f\n", DETECTION_CONFIDENCE_THRESHOLD);
+  Serial.printf("Frame: %dx%d, %d zones, %d tracks\n", FrameWidth, FrameHeight, ZoneCount, MaxTracks);
   Serial.printf("Counting line Y: %d pixels\n", COUNTING_LINE_Y);
 }
 
 // ============================================================================
 // Main Detection Function
 // ============================================================================
-int VehicleCounter::detectVehicles(const uint8_t* imageBuffer, size_t imageSize) {
+COUNTER_TEMPLATE
+int COUNTER_CLASS::detectVehicles(const uint8_t* imageBuffer, size_t imageSize, uint32_t captureTime) {
   // TODO: This is a placeholder until Edge Impulse model is integrated
   //
+  // Until then the tracking path (trackDetections(): matching, crossing
+  // interpolation, re-identification, heatmap) is dormant: only the
+  // example below and the host benchmark call it.
+  //
   // After training your FOMO model in Edge Impulse:
   // 1. Export as Arduino library
   // 2. Add to lib_deps in platformio.ini
@@ -69,94 +109,135 @@ int VehicleCounter::detectVehicles(const uint8_t* imageBuffer, size_t imageSize)
     return 0;
   }
 
-  // Process FOMO detections
-  detectionCount = 0;
-  int newVehicles = 0;
-
+  // Convert FOMO detections
+  Detection frame[EI_CLASSIFIER_OBJECT_DETECTION_COUNT];
   for (size_t ix = 0; ix < EI_CLASSIFIER_OBJECT_DETECTION_COUNT; ix++) {
     auto bb = result.bounding_boxes[ix];
+    Detection& det = frame[ix];
+    det.x = bb.x / (float)EI_CLASSIFIER_INPUT_WIDTH;
+    det.y = bb.y / (float)EI_CLASSIFIER_INPUT_HEIGHT;
+    det.width = bb.width / (float)EI_CLASSIFIER_INPUT_WIDTH;
+    det.height = bb.height / (float)EI_CLASSIFIER_INPUT_HEIGHT;
+    det.confidence = bb.value;
+    det.timestamp = captureTime;
+    det.appearance = computeAppearance(snapshot_buf,
+        EI_CLASSIFIER_INPUT_WIDTH, EI_CLASSIFIER_INPUT_HEIGHT, det);
+    det.trackId = 0;
+  }
+
+  return trackDetections(frame, EI_CLASSIFIER_OBJECT_DETECTION_COUNT, captureTime);
+  */
+
+  // PLACEHOLDER: Random detection for testing (REMOVE AFTER MODEL INTEGRATION).
+  // It bypasses tracking and records a bare crossing with no confidence,
+  // speed or length (0 = unknown), which the metrics leave out.
+  Serial.println("WARNING: Using placeholder detection (integrate Edge Impulse model)");
 
-    if (bb.value < DETECTION_CONFIDENCE_THRESHOLD) continue;
+  // Serial output waits until the write section is over
+  uint32_t lastCrossing = crossingSeq;
+  uint32_t lastIncident = incidentSeq;
+
+  int newVehicles = 0;
+  stateLock.writeBegin();
+  countWindow.advance(captureTime);
+  metrics.update(captureTime);
+  if (random(100) < 5) {  // 5% chance of "detection"
+    recordCrossing(captureTime, FrameWidth * FIXED_ONE / 2, 0, 0, 0, 0, 1);
+    newVehicles = 1;
+  }
+
+  updateIncidents(captureTime);
+  stateLock.writeEnd();
+
+  logEvents(lastCrossing, lastIncident);
+  return newVehicles;
+}
+
+COUNTER_TEMPLATE
+int COUNTER_CLASS::trackDetections(const Detection* frame, size_t count, uint32_t captureTime) {
+  // Serial output waits until the write section is over
+  uint32_t lastCrossing = crossingSeq;
+  uint32_t lastIncident = incidentSeq;
+
+  // State changes from here on are published as one update
+  stateLock.writeBegin();
+
+  // Roll the minute/hour windows and metrics interval forward even if
+  // nothing is counted
+  countWindow.advance(captureTime);
+  metrics.update(captureTime);
+
+  detectionCount = 0;
+  int newVehicles = 0;
+
+  for (size_t ix = 0; ix < count; ix++) {
+    if (frame[ix].confidence < DETECTION_CONFIDENCE_THRESHOLD) continue;
     if (detectionCount >= MAX_DETECTIONS_PER_FRAME) break;
 
     // Store detection
-    detections[detectionCount].x = bb.x / (float)EI_CLASSIFIER_INPUT_WIDTH;
-    detections[detectionCount].y = bb.y / (float)EI_CLASSIFIER_INPUT_HEIGHT;
-    detections[detectionCount].width = bb.width / (float)EI_CLASSIFIER_INPUT_WIDTH;
-    detections[detectionCount].height = bb.height / (float)EI_CLASSIFIER_INPUT_HEIGHT;
-    detections[detectionCount].confidence = bb.value;
-    detections[detectionCount].timestamp = millis();
+    detections[detectionCount] = frame[ix];
+    detections[detectionCount].trackId = 0;
 
     // Update statistics
-    totalConfidence += bb.value;
+    totalConfidence += frame[ix].confidence;
     totalDetections++;
 
     // Track vehicle (check if it crosses counting line)
-    int trackIdx = findClosestTrack(detections[detectionCount].x, detections[detectionCount].y);
-
-    if (trackIdx >= 0) {
-      float currentY = detections[detectionCount].y * 240;  // QVGA height
-      float previousY = tracked[trackIdx].lastY;
-
-      if (!tracked[trackIdx].counted && hasCrossedLine(currentY, previousY)) {
-        // Vehicle crossed the line!
-        totalCount++;
-        hourlyCount++;
-        minuteCount++;
-        newVehicles++;
-        tracked[trackIdx].counted = true;
-
-        Serial.printf("VEHICLE #%d (confidence: %.2f)\n", totalCount, bb.value);
-      }
-
-      tracked[trackIdx].lastY = currentY;
-      tracked[trackIdx].lastSeen = millis();
+    if (processDetection(detections[detectionCount])) {
+      newVehicles++;
     }
 
     detectionCount++;
   }
 
   // Prune old tracks
-  pruneOldTracks();
+  pruneOldTracks(captureTime);
 
+  // Check for queues, flow drops and blocked lanes
+  updateIncidents(captureTime);
+  stateLock.writeEnd();
+
+  logEvents(lastCrossing, lastIncident);
   return newVehicles;
-  */
+}
 
-  // PLACEHOLDER: Random detection for testing (REMOVE AFTER MODEL INTEGRATION)
-  Serial.println("WARNING: Using placeholder detection (integrate Edge Impulse model)");
-  if (random(100) < 5) {  // 5% chance of "detection"
-    totalCount++;
-    hourlyCount++;
-    minuteCount++;
-    return 1;
+// Crossings and incidents recorded since the given sequence numbers.
+// Only called by the writer, outside the write section.
+COUNTER_TEMPLATE
+void COUNTER_CLASS::logEvents(uint32_t afterCrossing, uint32_t afterIncident) {
+  uint32_t oldest = crossingSeq >= CROSSING_LOG_SIZE ? crossingSeq - CROSSING_LOG_SIZE + 1 : 1;
+  for (uint32_t seq = afterCrossing + 1 > oldest ? afterCrossing + 1 : oldest; seq <= crossingSeq; seq++) {
+    const CrossingEvent& event = crossingLog[seq % CROSSING_LOG_SIZE];
+    Serial.printf("VEHICLE #%lu (confidence: %.2f)\n",
+                  (unsigned long)(totalCount - (crossingSeq - seq)), event.confidence);
   }
 
-  return 0;
+  oldest = incidentSeq >= INCIDENT_QUEUE_SIZE ? incidentSeq - INCIDENT_QUEUE_SIZE + 1 : 1;
+  for (uint32_t seq = afterIncident + 1 > oldest ? afterIncident + 1 : oldest; seq <= incidentSeq; seq++) {
+    const IncidentEvent& event = incidentLog[seq % INCIDENT_QUEUE_SIZE];
+    Serial.printf("INCIDENT %s %s (zone %d, value %d)\n", incidentTypeName(event.type),
+                  event.active ? "raised" : "cleared", event.zone, event.value);
+  }
 }
 
 // ============================================================================
 // Statistics
 // ============================================================================
-CounterStats VehicleCounter::getStats() {
-  CounterStats stats;
-
-  // Update minute/hour counters
-  unsigned long now = millis();
-  if (now - lastMinuteReset >= 60000) {
-    minuteCount = 0;
-    lastMinuteReset = now;
-  }
-  if (now - lastHourReset >= 3600000) {
-    hourlyCount = 0;
-    lastHourReset = now;
-  }
-
-  // Fill stats
-  stats.totalCount = totalCount;
-  stats.lastHourCount = hourlyCount;
-  stats.lastMinuteCount = minuteCount;
-  stats.avgConfidence = totalDetections > 0 ? totalConfidence / totalDetections : 0;
-  stats.uptime = now / 1000;
+COUNTER_TEMPLATE
+CounterStats COUNTER_CLASS::getStats() const {
+  CounterStats stats = {};
+
+  // Fill stats (window sums are kept current by detectVehicles)
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    stats.totalCount = totalCount;
+    stats.lastHourCount = countWindow.lastHour();
+    stats.lastMinuteCount = countWindow.lastMinute();
+    stats.avgConfidence = totalDetections > 0 ? totalConfidence / totalDetections : 0;
+  } while (stateLock.readRetry(seq));
+
+  stats.uptime = millis() / 1000;
   strncpy(stats.siteName, SITE_NAME, sizeof(stats.siteName) - 1);
   stats.latitude = SITE_LAT;
   stats.longitude = SITE_LON;
@@ -164,100 +245,633 @@ CounterStats VehicleCounter::getStats() {
   return stats;
 }
 
-void VehicleCounter::resetHourlyStats() {
-  hourlyCount = 0;
-  lastHourReset = millis();
+COUNTER_TEMPLATE
+uint32_t COUNTER_CLASS::getCountBetween(uint32_t fromMs, uint32_t toMs) const {
+  uint32_t count, seq;
+  do {
+    seq = stateLock.readBegin();
+    count = countWindow.countBetween(fromMs, toMs);
+  } while (stateLock.readRetry(seq));
+  return count;
+}
+
+COUNTER_TEMPLATE
+uint32_t COUNTER_CLASS::getZoneCount(uint8_t zone) const {
+  if (zone >= ZoneCount) return 0;
+
+  uint32_t count, seq;
+  do {
+    seq = stateLock.readBegin();
+    count = zoneCounts[zone];
+  } while (stateLock.readRetry(seq));
+  return count;
+}
+
+COUNTER_TEMPLATE
+uint32_t COUNTER_CLASS::getReidCount() const {
+  uint32_t count, seq;
+  do {
+    seq = stateLock.readBegin();
+    count = reidCount;
+  } while (stateLock.readRetry(seq));
+  return count;
+}
+
+COUNTER_TEMPLATE
+void COUNTER_CLASS::getMetricsSummary(MetricsSummary& out) const {
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    out = metrics.lastSummary();
+  } while (stateLock.readRetry(seq));
+}
+
+// ============================================================================
+// Crossing Event Log
+// ============================================================================
+COUNTER_TEMPLATE
+void COUNTER_CLASS::recordCrossing(uint32_t timestamp, int16_t fixedX, float confidence,
+                                   float speed, float length, uint16_t trackId, int8_t direction) {
+  uint8_t zone = zoneOf(fixedX);
+  crossingSeq++;
+
+  CrossingEvent& event = crossingLog[crossingSeq % CROSSING_LOG_SIZE];
+  event.seq = crossingSeq;
+  event.timestamp = timestamp;
+  event.x = fixedX / (float)(FrameWidth * FIXED_ONE);
+  event.confidence = confidence;
+  event.speed = speed;
+  event.length = length;
+  event.trackId = trackId;
+  event.direction = direction;
+  event.zone = zone;
+
+  totalCount++;
+  countWindow.add(timestamp);
+  metrics.addCrossing(timestamp, zone, confidence, speed, length);
+  zoneCounts[zone]++;
+  flowWindowCount++;
+}
+
+COUNTER_TEMPLATE
+size_t COUNTER_CLASS::getCrossings(uint32_t afterSeq, CrossingEvent* out, size_t maxEvents) const {
+  size_t copied;
+  uint32_t lockSeq;
+  do {
+    lockSeq = stateLock.readBegin();
+    uint32_t last = crossingSeq;
+
+    // Oldest event still held by the ring
+    uint32_t oldest = last >= CROSSING_LOG_SIZE ? last - CROSSING_LOG_SIZE + 1 : 1;
+    uint32_t seq = afterSeq + 1 > oldest ? afterSeq + 1 : oldest;
+
+    copied = 0;
+    while (seq <= last && copied < maxEvents) {
+      out[copied++] = crossingLog[seq % CROSSING_LOG_SIZE];
+      seq++;
+    }
+  } while (stateLock.readRetry(lockSeq));
+
+  return copied;
+}
+
+COUNTER_TEMPLATE
+uint32_t COUNTER_CLASS::getLastCrossingSeq() const {
+  uint32_t last, seq;
+  do {
+    seq = stateLock.readBegin();
+    last = crossingSeq;
+  } while (stateLock.readRetry(seq));
+  return last;
 }
 
 // ============================================================================
 // Tracking Helpers
 // ============================================================================
-bool VehicleCounter::hasCrossedLine(float currentY, float previousY) {
+COUNTER_TEMPLATE
+bool COUNTER_CLASS::processDetection(Detection& det) {
+  // Single float->fixed conversion per detection; everything below is integer
+  int16_t currentX = toFixedX(det.x);
+  int16_t currentY = toFixedY(det.y);
+
+  det.trackId = 0;
+  int trackIdx = findClosestTrack(currentX, currentY, det.appearance, det.timestamp);
+  if (trackIdx < 0) return false;
+  det.trackId = trackId[trackIdx];
+
+  int16_t previousX = trackX[trackIdx];
+  int16_t previousY = trackY[trackIdx];
+  uint32_t previousSeen = trackSeen[trackIdx];
+  bool counted = false;
+
+  int8_t direction = trackCounted[trackIdx] ? 0 : crossingDirection(currentY, previousY);
+  if (direction != 0) {
+    // Vehicle crossed the line between the previous and current frame.
+    // Interpolate where along that step it was exactly on the line.
+    int32_t num = LINE_Y - previousY;
+    int32_t den = currentY - previousY;  // Non-zero: the line lies between the two
+    int32_t dt = det.timestamp - previousSeen;
+    uint32_t crossTime = previousSeen + (uint32_t)((num * dt + den / 2) / den);
+    int16_t crossX = previousX + (int16_t)(num * (currentX - previousX) / den);
+
+    // Speed from the vertical step across the line; length from box height
+    float metersPerFixed = METERS_PER_PIXEL / FIXED_ONE;
+    float speed = dt > 0 ? abs(den) * metersPerFixed / (dt / 1000.0f) * 3.6f : 0;
+    float length = det.height * FrameHeight * METERS_PER_PIXEL;
+
+    recordCrossing(crossTime, crossX, det.confidence, speed, length, trackId[trackIdx], direction);
+    trackCounted[trackIdx] = true;
+    counted = true;
+  }
+
+  // Heatmap: where vehicles are seen and which way they move (px/s).
+  // A new track has no previous frame, so it adds a hit but no motion.
+  int32_t dtSeen = det.timestamp - previousSeen;
+  int32_t vx = dtSeen > 0 ? (currentX - previousX) * 1000 / (dtSeen * FIXED_ONE) : 0;
+  int32_t vy = dtSeen > 0 ? (currentY - previousY) * 1000 / (dtSeen * FIXED_ONE) : 0;
+  heatmap.add(cellOf(currentX, FrameWidth * FIXED_ONE, Heatmap::COLS),
+              cellOf(currentY, FrameHeight * FIXED_ONE, Heatmap::ROWS),
+              constrain(vx, INT16_MIN, INT16_MAX), constrain(vy, INT16_MIN, INT16_MAX),
+              (uint8_t)(det.confidence * 255), dtSeen > 0);
+
+  // Restart the stationary timer whenever the vehicle moves noticeably
+  int32_t moved = abs(currentX - trackAnchorX[trackIdx]) + abs(currentY - trackAnchorY[trackIdx]);
+  if (moved > STATIONARY_MOVE) {
+    trackAnchorX[trackIdx] = currentX;
+    trackAnchorY[trackIdx] = currentY;
+    trackStillSince[trackIdx] = det.timestamp;
+  }
+
+  trackX[trackIdx] = currentX;
+  trackY[trackIdx] = currentY;
+  trackSeen[trackIdx] = det.timestamp;
+  if (det.appearance != 0) trackAppearance[trackIdx] = det.appearance;
+
+  return counted;
+}
+
+COUNTER_TEMPLATE
+int8_t COUNTER_CLASS::crossingDirection(int16_t currentY, int16_t previousY) {
   // Check if vehicle crossed the counting line
-  float lineY = COUNTING_LINE_Y;
-  float margin = COUNTING_ZONE_MARGIN;
 
   // Crossed from above to below
-  if (previousY < lineY - margin && currentY > lineY + margin) {
-    return true;
+  if (previousY < LINE_Y - LINE_MARGIN && currentY > LINE_Y + LINE_MARGIN) {
+    return 1;
   }
 
   // Optionally: count reverse direction too
-  // if (previousY > lineY + margin && currentY < lineY - margin) {
-  //   return true;
-  // }
+  if (ENABLE_DIRECTION_TRACKING && previousY > LINE_Y + LINE_MARGIN && currentY < LINE_Y - LINE_MARGIN) {
+    return -1;
+  }
 
-  return false;
+  return 0;
 }
 
-int VehicleCounter::findClosestTrack(float x, float y) {
+COUNTER_TEMPLATE
+int COUNTER_CLASS::findClosestTrack(int16_t x, int16_t y, uint32_t appearance, uint32_t now) {
   // Find existing track near this detection, or create new one
-  const float MAX_DISTANCE = 0.1;  // Max distance to match (normalized)
   int closestIdx = -1;
-  float closestDist = MAX_DISTANCE;
-
-  for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
-    if (tracked[i].lastSeen == 0) continue;  // Unused slot
+  int32_t closestDist = MATCH_DISTANCE;
+  int freeIdx = -1;
+
+  // Fixed trip count, integer only (see test/bench_counter.cpp for timings)
+  for (int i = 0; i < MaxTracks; i++) {
+    if (trackSeen[i] == 0) {  // Unused slot
+      if (freeIdx < 0) freeIdx = i;
+      continue;
+    }
 
     // Simple distance check (could use more sophisticated tracking)
-    float dist = abs(y * 240 - tracked[i].lastY);
-    if (dist < closestDist * 240) {
-      closestDist = dist / 240;
+    int32_t dist = y - trackY[i];
+    if (dist < 0) dist = -dist;
+    if (dist < closestDist) {
+      closestDist = dist;
       closestIdx = i;
     }
   }
 
-  // If no close match, create new track
-  if (closestIdx == -1) {
-    for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
-      if (tracked[i].lastSeen == 0) {
-        tracked[i].lastY = y * 240;
-        tracked[i].counted = false;
-        tracked[i].lastSeen = millis();
-        return i;
-      }
+  if (closestIdx != -1 || freeIdx < 0) {
+    return closestIdx;
+  }
+
+  // No close match: revive a track lost to occlusion if one looks the same.
+  // It resumes from its pre-occlusion position so a crossing made while
+  // hidden is still counted once, with the right direction.
+  int lostIdx = findLostTrack(x, appearance, now);
+  if (lostIdx >= 0) {
+    LostTrack& lost = lostTracks[lostIdx];
+    trackX[freeIdx] = lost.x;
+    trackY[freeIdx] = lost.y;
+    trackCounted[freeIdx] = lost.counted;
+    trackId[freeIdx] = lost.id;
+    trackSeen[freeIdx] = lost.lastSeen;
+    trackAppearance[freeIdx] = lost.appearance;
+    trackAnchorX[freeIdx] = x;
+    trackAnchorY[freeIdx] = y;
+    trackStillSince[freeIdx] = now;
+    lost.lastSeen = 0;
+    reidCount++;
+
+    DEBUG_PRINT("Re-identified track ");
+    DEBUG_PRINTLN(lost.id);
+    return freeIdx;
+  }
+
+  // Otherwise create new track
+  trackX[freeIdx] = x;
+  trackY[freeIdx] = y;
+  trackCounted[freeIdx] = false;
+  trackId[freeIdx] = nextTrackId++;
+  if (nextTrackId == 0) nextTrackId = 1;  // 0 = no track
+  trackSeen[freeIdx] = now;
+  trackAppearance[freeIdx] = appearance;
+  trackAnchorX[freeIdx] = x;
+  trackAnchorY[freeIdx] = y;
+  trackStillSince[freeIdx] = now;
+  return freeIdx;
+}
+
+COUNTER_TEMPLATE
+int COUNTER_CLASS::findLostTrack(int16_t x, uint32_t appearance, uint32_t now) {
+  if (!ENABLE_REID || appearance == 0) return -1;
+
+  int bestIdx = -1;
+  uint8_t bestDist = REID_MAX_DISTANCE + 1;
+  uint8_t zone = zoneOf(x);
+
+  for (int i = 0; i < REID_LOST_TRACKS; i++) {
+    const LostTrack& lost = lostTracks[i];
+    if (lost.lastSeen == 0) continue;
+
+    if (now - lost.expiredAt > REID_WINDOW_MS) {
+      lostTracks[i].lastSeen = 0;  // Too old to revive
+      continue;
+    }
+
+    // Vehicles don't change lanes behind a bus often enough to matter
+    if (zoneOf(lost.x) != zone) continue;
+
+    uint8_t dist = appearanceDistance(appearance, lost.appearance);
+    if (dist < bestDist) {
+      bestDist = dist;
+      bestIdx = i;
     }
   }
 
-  return closestIdx;
+  return bestIdx;
 }
 
-void VehicleCounter::pruneOldTracks() {
+COUNTER_TEMPLATE
+void COUNTER_CLASS::pruneOldTracks(uint32_t now) {
   // Remove tracks not seen in 2 seconds
-  unsigned long now = millis();
-  for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
-    if (tracked[i].lastSeen > 0 && now - tracked[i].lastSeen > 2000) {
-      tracked[i].lastSeen = 0;
-      tracked[i].counted = false;
+  for (int i = 0; i < MaxTracks; i++) {
+    if (trackSeen[i] > 0 && now - trackSeen[i] > 2000) {
+      // Remember it for re-identification, replacing the oldest entry
+      if (ENABLE_REID && trackAppearance[i] != 0) {
+        int slot = 0;
+        for (int j = 0; j < REID_LOST_TRACKS; j++) {
+          if (lostTracks[j].lastSeen == 0) { slot = j; break; }
+          if (lostTracks[j].expiredAt < lostTracks[slot].expiredAt) slot = j;
+        }
+
+        LostTrack& lost = lostTracks[slot];
+        lost.x = trackX[i];
+        lost.y = trackY[i];
+        lost.lastSeen = trackSeen[i];
+        lost.expiredAt = now;
+        lost.appearance = trackAppearance[i];
+        lost.id = trackId[i];
+        lost.counted = trackCounted[i];
+      }
+
+      trackSeen[i] = 0;
+      trackCounted[i] = false;
+      trackAppearance[i] = 0;
     }
   }
 }
 
 // ============================================================================
-// SD Card Storage
+// Incident Detection
 // ============================================================================
-bool VehicleCounter::saveImageToSD(camera_fb_t* fb, fs::FS &fs) {
-  // Generate filename with timestamp
-  char filename[64];
-  snprintf(filename, sizeof(filename), "/detections/%lu.jpg", millis());
-
-  // Ensure directory exists
-  if (!fs.exists("/detections")) {
-    fs.mkdir("/detections");
+COUNTER_TEMPLATE
+void COUNTER_CLASS::updateIncidents(uint32_t now) {
+  if (!ENABLE_INCIDENT_DETECTION) return;
+
+  // Queues and blockages: stationary tracks per zone
+  uint8_t queued[ZoneCount] = {0};
+  uint32_t longestStill[ZoneCount] = {0};
+
+  for (int i = 0; i < MaxTracks; i++) {
+    if (trackSeen[i] == 0) continue;
+
+    uint32_t still = now - trackStillSince[i];
+    if (still < STATIONARY_TIME_MS) continue;
+
+    uint8_t zone = zoneOf(trackX[i]);
+    queued[zone]++;
+    if (still > longestStill[zone]) longestStill[zone] = still;
   }
 
-  // Write file
-  File file = fs.open(filename, FILE_WRITE);
-  if (!file) {
-    Serial.println("Failed to open file for writing");
-    return false;
+  for (int z = 0; z < ZoneCount; z++) {
+    updateIncident(queueActive[z], queued[z] >= QUEUE_MIN_VEHICLES,
+                   INCIDENT_QUEUE, z, queued[z], 0, now);
+    updateIncident(blockageActive[z], longestStill[z] >= BLOCKAGE_TIME_MS,
+                   INCIDENT_BLOCKAGE, z, longestStill[z] / 1000, 0, now);
   }
 
-  file.write(fb->buf, fb->len);
-  file.close();
+  // Flow drop: compare each window against a slow moving baseline
+  if (flowWindowStart == 0) flowWindowStart = now;
+  if (now - flowWindowStart < FLOW_WINDOW_MS) return;
+
+  uint16_t flow = flowWindowCount;
+  flowWindowCount = 0;
+  flowWindowStart = now;
+
+  bool enoughTraffic = flowBaseline >= FLOW_DROP_MIN_BASELINE;
+  bool dropped = enoughTraffic && flow < flowBaseline * FLOW_DROP_RATIO;
+  // Clear with hysteresis so a borderline flow doesn't flap
+  bool recovered = !enoughTraffic || flow >= flowBaseline * FLOW_DROP_RATIO * 2;
+
+  updateIncident(flowDropActive, flowDropActive ? !recovered : dropped,
+                 INCIDENT_FLOW_DROP, INCIDENT_ZONE_SITE, flow, (uint16_t)(flowBaseline + 0.5f), now);
+
+  // Don't let the incident itself drag the baseline down
+  if (!flowDropActive) {
+    flowBaseline = flowBaseline == 0 ? flow : flowBaseline * 0.875f + flow * 0.125f;
+  }
+}
+
+COUNTER_TEMPLATE
+void COUNTER_CLASS::updateIncident(bool& active, bool condition, uint8_t type, uint8_t zone,
+                                   uint16_t value, uint16_t baseline, uint32_t now) {
+  if (condition == active) return;
+  active = condition;
+
+  // The ring overwrites the oldest event if the uploader falls behind
+  incidentSeq++;
+
+  IncidentEvent& event = incidentLog[incidentSeq % INCIDENT_QUEUE_SIZE];
+  event.seq = incidentSeq;
+  event.timestamp = now;
+  event.value = value;
+  event.baseline = baseline;
+  event.type = type;
+  event.zone = zone;
+  event.active = active;
+}
+
+COUNTER_TEMPLATE
+bool COUNTER_CLASS::getIncident(uint32_t afterSeq, IncidentEvent& event) const {
+  bool found;
+  uint32_t lockSeq;
+  do {
+    lockSeq = stateLock.readBegin();
+    uint32_t last = incidentSeq;
+
+    // Oldest event still held by the ring
+    uint32_t oldest = last >= INCIDENT_QUEUE_SIZE ? last - INCIDENT_QUEUE_SIZE + 1 : 1;
+    uint32_t seq = afterSeq + 1 > oldest ? afterSeq + 1 : oldest;
 
-  DEBUG_PRINT("Saved image: ");
-  DEBUG_PRINTLN(filename);
+    found = seq <= last;
+    if (found) event = incidentLog[seq % INCIDENT_QUEUE_SIZE];
+  } while (stateLock.readRetry(lockSeq));
 
-  return true;
+  return found;
 }
+
+const char* incidentTypeName(uint8_t type) {
+  switch (type) {
+    case INCIDENT_QUEUE: return "queue";
+    case INCIDENT_FLOW_DROP: return "flow_drop";
+    case INCIDENT_BLOCKAGE: return "blockage";
+    default: return "unknown";
+  }
+}
+
+// ============================================================================
+// Detection Heatmap
+// ============================================================================
+COUNTER_TEMPLATE
+void COUNTER_CLASS::getHeatmap(uint8_t* out) const {
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    heatmap.serialize(out);
+  } while (stateLock.readRetry(seq));
+}
+
+COUNTER_TEMPLATE
+FrameSummary COUNTER_CLASS::getLastFrame() const {
+  FrameSummary frame;
+  float left, top, right, bottom;
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    frame.detections = 0;
+    frame.zone = 0;
+    frame.minConfidence = 0;
+    frame.maxConfidence = 0;
+    frame.incidentActive = flowDropActive;
+    left = 1;
+    top = 1;
+    right = 0;
+    bottom = 0;
+
+    for (uint8_t z = 0; z < ZoneCount; z++) {
+      if (queueActive[z] || blockageActive[z]) frame.incidentActive = true;
+    }
+
+    int count = detectionCount < MAX_DETECTIONS_PER_FRAME ? detectionCount : MAX_DETECTIONS_PER_FRAME;
+    for (int i = 0; i < count; i++) {
+      const Detection& det = detections[i];
+      if (frame.detections == 0 || det.confidence < frame.minConfidence) {
+        frame.minConfidence = det.confidence;
+      }
+      if (frame.detections == 0 || det.confidence > frame.maxConfidence) {
+        frame.maxConfidence = det.confidence;
+        frame.zone = zoneOf(toFixedX(det.x));
+      }
+      left = min(left, det.x - det.width / 2);
+      top = min(top, det.y - det.height / 2);
+      right = max(right, det.x + det.width / 2);
+      bottom = max(bottom, det.y + det.height / 2);
+      frame.detections++;
+    }
+  } while (stateLock.readRetry(seq));
+
+  frame.boxX = frame.boxY = frame.boxWidth = frame.boxHeight = 0;
+  if (frame.detections > 0) {
+    left = constrain(left, 0.0f, 1.0f);
+    top = constrain(top, 0.0f, 1.0f);
+    right = constrain(right, left, 1.0f);
+    bottom = constrain(bottom, top, 1.0f);
+    frame.boxX = left * FrameWidth;
+    frame.boxY = top * FrameHeight;
+    frame.boxWidth = (right - left) * FrameWidth;
+    frame.boxHeight = (bottom - top) * FrameHeight;
+  }
+
+  return frame;
+}
+
+COUNTER_TEMPLATE
+size_t COUNTER_CLASS::getLastDetections(Detection* out, size_t maxDetections) const {
+  size_t n;
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    n = detectionCount < MAX_DETECTIONS_PER_FRAME ? detectionCount : MAX_DETECTIONS_PER_FRAME;
+    if (n > maxDetections) n = maxDetections;
+    memcpy(out, detections, n * sizeof(Detection));
+  } while (stateLock.readRetry(seq));
+  return n;
+}
+
+// ============================================================================
+// Warm Restart
+// ============================================================================
+COUNTER_TEMPLATE
+void COUNTER_CLASS::getTotals(Totals& out) const {
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    out.totalCount = totalCount;
+    memcpy(out.zoneCounts, zoneCounts, sizeof(zoneCounts));
+    out.totalConfidence = totalConfidence;
+    out.totalDetections = totalDetections;
+  } while (stateLock.readRetry(seq));
+}
+
+COUNTER_TEMPLATE
+void COUNTER_CLASS::getCheckpoint(Checkpoint& out) const {
+  uint32_t seq;
+  do {
+    seq = stateLock.readBegin();
+    out.savedAt = millis();
+    out.totals.totalCount = totalCount;
+    memcpy(out.totals.zoneCounts, zoneCounts, sizeof(zoneCounts));
+    out.totals.totalConfidence = totalConfidence;
+    out.totals.totalDetections = totalDetections;
+    out.countWindow = countWindow;
+    memcpy(out.trackX, trackX, sizeof(trackX));
+    memcpy(out.trackY, trackY, sizeof(trackY));
+    memcpy(out.trackSeen, trackSeen, sizeof(trackSeen));
+    memcpy(out.trackId, trackId, sizeof(trackId));
+    memcpy(out.trackCounted, trackCounted, sizeof(trackCounted));
+    memcpy(out.trackAppearance, trackAppearance, sizeof(trackAppearance));
+    memcpy(out.trackAnchorX, trackAnchorX, sizeof(trackAnchorX));
+    memcpy(out.trackAnchorY, trackAnchorY, sizeof(trackAnchorY));
+    memcpy(out.trackStillSince, trackStillSince, sizeof(trackStillSince));
+    out.nextTrackId = nextTrackId;
+    out.reidCount = reidCount;
+    memcpy(out.queueActive, queueActive, sizeof(queueActive));
+    memcpy(out.blockageActive, blockageActive, sizeof(blockageActive));
+    out.flowDropActive = flowDropActive;
+    out.flowWindowStart = flowWindowStart;
+    out.flowWindowCount = flowWindowCount;
+    out.flowBaseline = flowBaseline;
+    memcpy(out.incidentLog, incidentLog, sizeof(incidentLog));
+    out.incidentSeq = incidentSeq;
+  } while (stateLock.readRetry(seq));
+}
+
+COUNTER_TEMPLATE
+void COUNTER_CLASS::restoreTotals(const Totals& in) {
+  stateLock.writeBegin();
+  totalCount = in.totalCount;
+  memcpy(zoneCounts, in.zoneCounts, sizeof(zoneCounts));
+  totalConfidence = in.totalConfidence;
+  totalDetections = in.totalDetections;
+  stateLock.writeEnd();
+}
+
+COUNTER_TEMPLATE
+void COUNTER_CLASS::restoreCheckpoint(const Checkpoint& in) {
+  restoreTotals(in.totals);
+
+  // Move saved timestamps onto this boot's clock (0 = unused stays 0)
+  uint32_t delta = millis() - in.savedAt;
+
+  stateLock.writeBegin();
+  countWindow = in.countWindow;
+  countWindow.rebase(delta);
+  memcpy(trackX, in.trackX, sizeof(trackX));
+  memcpy(trackY, in.trackY, sizeof(trackY));
+  memcpy(trackId, in.trackId, sizeof(trackId));
+  memcpy(trackCounted, in.trackCounted, sizeof(trackCounted));
+  memcpy(trackAppearance, in.trackAppearance, sizeof(trackAppearance));
+  memcpy(trackAnchorX, in.trackAnchorX, sizeof(trackAnchorX));
+  memcpy(trackAnchorY, in.trackAnchorY, sizeof(trackAnchorY));
+  for (int i = 0; i < MaxTracks; i++) {
+    trackSeen[i] = in.trackSeen[i] ? in.trackSeen[i] + delta : 0;
+    trackStillSince[i] = in.trackSeen[i] ? in.trackStillSince[i] + delta : 0;
+  }
+  nextTrackId = in.nextTrackId;
+  reidCount = in.reidCount;
+  memcpy(queueActive, in.queueActive, sizeof(queueActive));
+  memcpy(blockageActive, in.blockageActive, sizeof(blockageActive));
+  flowDropActive = in.flowDropActive;
+  flowWindowStart = in.flowWindowStart ? in.flowWindowStart + delta : 0;
+  flowWindowCount = in.flowWindowCount;
+  flowBaseline = in.flowBaseline;
+  memcpy(incidentLog, in.incidentLog, sizeof(incidentLog));
+  incidentSeq = in.incidentSeq;
+  stateLock.writeEnd();
+}
+
+// ============================================================================
+// Appearance Descriptors
+// ============================================================================
+uint32_t computeAppearance(const uint8_t* rgb888, uint16_t width, uint16_t height,
+                           const Detection& det) {
+  // Crop bounds in pixels, clamped to the frame
+  int x0 = (int)((det.x - det.width / 2) * width);
+  int y0 = (int)((det.y - det.height / 2) * height);
+  int x1 = (int)((det.x + det.width / 2) * width);
+  int y1 = (int)((det.y + det.height / 2) * height);
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > width) x1 = width;
+  if (y1 > height) y1 = height;
+  if (x1 <= x0 || y1 <= y0) return 0;
+
+  // Sample at most 16x16 points
+  int stepX = (x1 - x0 + 15) / 16;
+  int stepY = (y1 - y0 + 15) / 16;
+
+  uint16_t bins[8] = {0};
+  uint16_t samples = 0;
+  for (int y = y0; y < y1; y += stepY) {
+    const uint8_t* row = rgb888 + (y * width) * 3;
+    for (int x = x0; x < x1; x += stepX) {
+      const uint8_t* px = row + x * 3;
+      uint8_t luma = (px[0] + 2 * px[1] + px[2]) >> 2;
+      bins[luma >> 5]++;
+      samples++;
+    }
+  }
+
+  // Pack each bin's share as a nibble
+  uint32_t descriptor = 0;
+  for (int i = 0; i < 8; i++) {
+    uint32_t share = (bins[i] * 15 + samples / 2) / samples;
+    descriptor |= share << (i * 4);
+  }
+
+  return descriptor;
+}
+
+uint8_t appearanceDistance(uint32_t a, uint32_t b) {
+  uint8_t dist = 0;
+  for (int i = 0; i < 8; i++) {
+    int na = (a >> (i * 4)) & 0xF;
+    int nb = (b >> (i * 4)) & 0xF;
+    dist += na > nb ? na - nb : nb - na;
+  }
+  return dist;
+}
+
+// Instantiate the configured counter
+template class BasicVehicleCounter<frameWidth(CAMERA_FRAME_SIZE), frameHeight(CAMERA_FRAME_SIZE),
+                                   MAX_DETECTIONS_PER_FRAME, COUNTING_ZONES>;
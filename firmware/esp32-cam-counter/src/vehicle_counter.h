@@ -9,9 +9,33 @@
 
 #include <Arduino.h>
 #include "esp_camera.h"
-#include "FS.h"
-#include "SD_MMC.h"
 #include "config.h"
+#include "count_window.h"
+#include "heatmap.h"
+#include "seqlock.h"
+#include "traffic_metrics.h"
+
+// ============================================================================
+// Frame Geometry
+// ============================================================================
+// Pixel dimensions of the esp32-camera frame sizes we can run at
+constexpr uint16_t frameWidth(framesize_t size) {
+  return size == FRAMESIZE_96X96   ? 96  :
+         size == FRAMESIZE_QQVGA   ? 160 :
+         size == FRAMESIZE_240X240 ? 240 :
+         size == FRAMESIZE_QVGA    ? 320 :
+         size == FRAMESIZE_CIF     ? 400 :
+         size == FRAMESIZE_VGA     ? 640 : 0;
+}
+
+constexpr uint16_t frameHeight(framesize_t size) {
+  return size == FRAMESIZE_96X96   ? 96  :
+         size == FRAMESIZE_QQVGA   ? 120 :
+         size == FRAMESIZE_240X240 ? 240 :
+         size == FRAMESIZE_QVGA    ? 240 :
+         size == FRAMESIZE_CIF     ? 296 :
+         size == FRAMESIZE_VGA     ? 480 : 0;
+}
 
 // ============================================================================
 // Data Structures
@@ -23,6 +47,53 @@ struct Detection {
   float height;      // Bounding box height (normalized 0-1)
   float confidence;  // Detection confidence (0-1)
   uint32_t timestamp; // Detection timestamp (millis)
+  uint32_t appearance; // Appearance descriptor (0 = unknown)
+  uint16_t trackId;    // Track it was matched to (0 = none)
+};
+
+struct CrossingEvent {
+  uint32_t seq;        // Monotonic event number (1 = first crossing since boot)
+  uint32_t timestamp;  // Interpolated crossing time (millis)
+  float x;             // Interpolated crossing X (normalized 0-1)
+  float confidence;    // Detection confidence at crossing
+  float speed;         // Estimated speed (km/h, 0 = unknown)
+  float length;        // Apparent vehicle length (m, 0 = unknown)
+  uint16_t trackId;    // Track that produced the crossing
+  int8_t direction;    // +1 = top to bottom, -1 = bottom to top
+  uint8_t zone;        // Counting zone (lane) the crossing happened in
+};
+
+enum IncidentType : uint8_t {
+  INCIDENT_QUEUE = 1,      // Stationary vehicles queued in a zone
+  INCIDENT_FLOW_DROP = 2,  // Site flow fell well below its baseline
+  INCIDENT_BLOCKAGE = 3    // A vehicle has been stopped in a zone for a long time
+};
+
+#define INCIDENT_ZONE_SITE 0xFF  // Incident applies to the whole site
+
+struct IncidentEvent {
+  uint32_t seq;        // Monotonic event number (1 = first incident since boot)
+  uint32_t timestamp;  // When the incident was raised or cleared (millis)
+  uint16_t value;      // QUEUE: vehicles, FLOW_DROP: vehicles/window, BLOCKAGE: seconds
+  uint16_t baseline;   // FLOW_DROP: expected vehicles/window, otherwise 0
+  uint8_t type;        // IncidentType
+  uint8_t zone;        // Counting zone, or INCIDENT_ZONE_SITE
+  bool active;         // true = raised, false = cleared
+};
+
+const char* incidentTypeName(uint8_t type);
+
+// The most recent frame, for deciding how long to keep its image
+struct FrameSummary {
+  uint8_t detections;    // Detections above the threshold
+  uint8_t zone;          // Zone of the most confident detection
+  float minConfidence;   // 0 if there were no detections
+  float maxConfidence;
+  bool incidentActive;   // Any queue, blockage or flow drop raised
+  uint16_t boxX;         // Union of the detection boxes (pixels)
+  uint16_t boxY;
+  uint16_t boxWidth;     // 0 if there were no detections
+  uint16_t boxHeight;
 };
 
 struct CounterStats {
@@ -36,58 +107,253 @@ struct CounterStats {
   float longitude;          // Site longitude
 };
 
+// ============================================================================
+// Appearance Descriptors
+// ============================================================================
+// 32-bit luma histogram of a detection crop: 8 brightness bins, each holding
+// that bin's share of the crop quantized to 4 bits. Sampled on a grid of at
+// most 16x16 pixels, so cost is independent of box size.
+uint32_t computeAppearance(const uint8_t* rgb888, uint16_t width, uint16_t height,
+                           const Detection& det);
+
+// L1 distance between two descriptors (0 = identical, 120 = disjoint)
+uint8_t appearanceDistance(uint32_t a, uint32_t b);
+
 // ============================================================================
 // Vehicle Counter Class
 // ============================================================================
-class VehicleCounter {
+// Geometry and capacity are compile-time parameters so pixel conversions
+// fold to constants and the per-frame track loops have a static trip count.
+//
+// FrameWidth/FrameHeight: camera frame size in pixels
+// MaxTracks:              simultaneous vehicle tracks
+// ZoneCount:              counting zones (equal-width lanes across the frame)
+template <uint16_t FrameWidth, uint16_t FrameHeight, uint8_t MaxTracks, uint8_t ZoneCount>
+class BasicVehicleCounter {
 public:
-  VehicleCounter();
+  // Track positions are stored as fixed-point pixels (1/16 px)
+  static constexpr int FIXED_SHIFT = 4;
+  static constexpr int32_t FIXED_ONE = 1 << FIXED_SHIFT;
+
+  static constexpr int16_t LINE_Y = COUNTING_LINE_Y * FIXED_ONE;
+  static constexpr int16_t LINE_MARGIN = COUNTING_ZONE_MARGIN * FIXED_ONE;
+  static constexpr int16_t MATCH_DISTANCE = FrameHeight * FIXED_ONE / 10;  // 10% of frame
+  static constexpr int16_t STATIONARY_MOVE = STATIONARY_MOVE_PX * FIXED_ONE;
+
+  static_assert(FrameWidth > 0 && FrameHeight > 0, "Unsupported camera frame size");
+  static_assert((int32_t)FrameWidth * FIXED_ONE <= INT16_MAX &&
+                (int32_t)FrameHeight * FIXED_ONE <= INT16_MAX,
+                "Frame too large for fixed-point track positions");
+  static_assert(COUNTING_LINE_Y + COUNTING_ZONE_MARGIN < FrameHeight &&
+                COUNTING_LINE_Y >= COUNTING_ZONE_MARGIN,
+                "Counting line and margin must lie inside the frame");
+  static_assert(MATCH_DISTANCE >= 2 * LINE_MARGIN + FIXED_ONE,
+                "COUNTING_ZONE_MARGIN too wide: no matched step can cross both margins");
+  static_assert(MaxTracks > 0 && ZoneCount > 0, "Need at least one track and zone");
+
+  BasicVehicleCounter();
 
   // Initialization
   void begin();
 
   // Main detection function
+  // captureTime is the frame capture timestamp (millis), used to
+  // interpolate crossing times between frames
   // Returns number of vehicles detected in this frame
-  int detectVehicles(const uint8_t* imageBuffer, size_t imageSize);
+  // Only one task may call this
+  int detectVehicles(const uint8_t* imageBuffer, size_t imageSize, uint32_t captureTime);
+
+  // Track one frame of detections (normalized boxes, appearance filled
+  // in) and count line crossings. Detections below the confidence
+  // threshold are skipped. detectVehicles() calls it with the model
+  // output; the host benchmark feeds it directly.
+  // Returns number of vehicles counted in this frame
+  // Only one task may call this
+  int trackDetections(const Detection* frame, size_t count, uint32_t captureTime);
+
+  // ---------------------------------------------------------------------
+  // Readers
+  // ---------------------------------------------------------------------
+  // Safe to call from any task while detectVehicles() runs. Each returns a
+  // consistent copy taken under a seqlock and never blocks inference.
+  // (For now main.cpp calls them all from the loop task that also runs
+  // inference, so no read ever overlaps a write.)
 
   // Get current statistics
-  CounterStats getStats();
+  CounterStats getStats() const;
+
+  // Vehicles counted in [fromMs, toMs), for any sub-window of the last hour
+  uint32_t getCountBetween(uint32_t fromMs, uint32_t toMs) const;
+
+  // Per-zone totals since boot
+  uint32_t getZoneCount(uint8_t zone) const;
+
+  // Crossing event log
+  // Copies up to maxEvents events with seq > afterSeq (oldest first).
+  // Events overwritten by the ring are skipped.
+  size_t getCrossings(uint32_t afterSeq, CrossingEvent* out, size_t maxEvents) const;
+  uint32_t getLastCrossingSeq() const;
+
+  // Headway/gap/speed/confidence distributions for the last completed
+  // METRICS_INTERVAL_MS interval (seq = 0 until one completes)
+  void getMetricsSummary(MetricsSummary& out) const;
+
+  // Tracks revived by re-identification since boot
+  uint32_t getReidCount() const;
 
-  // Reset hourly counters
-  void resetHourlyStats();
+  // Incident events (oldest first)
+  // Copies the first event with seq > afterSeq. Upload it, then move
+  // afterSeq to its seq so a failed upload is retried. Events overwritten
+  // by the ring are skipped.
+  bool getIncident(uint32_t afterSeq, IncidentEvent& event) const;
 
-  // Save detection image to SD card
-  bool saveImageToSD(camera_fb_t* fb, fs::FS &fs);
+  // Detection heatmap since boot (Heatmap::SERIALIZED_SIZE bytes)
+  void getHeatmap(uint8_t* out) const;
+
+  // Detections in the last frame processed
+  FrameSummary getLastFrame() const;
+
+  // Copies up to maxDetections of the last frame's detections (with the
+  // tracks they were matched to) and returns how many were copied
+  size_t getLastDetections(Detection* out, size_t maxDetections) const;
+
+  // ---------------------------------------------------------------------
+  // Warm Restart
+  // ---------------------------------------------------------------------
+  // Cumulative totals, small enough to checkpoint to flash often
+  struct Totals {
+    uint32_t totalCount;
+    uint32_t zoneCounts[ZoneCount];
+    float totalConfidence;
+    uint32_t totalDetections;
+  };
+
+  // Everything needed to resume counting after a reset. Timestamps are
+  // millis() of the boot that saved it. Metrics and the heatmap restart.
+  struct Checkpoint {
+    uint32_t savedAt;
+    Totals totals;
+    CountWindow countWindow;
+    int16_t trackX[MaxTracks];
+    int16_t trackY[MaxTracks];
+    uint32_t trackSeen[MaxTracks];
+    uint16_t trackId[MaxTracks];
+    bool trackCounted[MaxTracks];
+    uint32_t trackAppearance[MaxTracks];
+    int16_t trackAnchorX[MaxTracks];
+    int16_t trackAnchorY[MaxTracks];
+    uint32_t trackStillSince[MaxTracks];
+    uint16_t nextTrackId;
+    uint32_t reidCount;
+    bool queueActive[ZoneCount];
+    bool blockageActive[ZoneCount];
+    bool flowDropActive;
+    uint32_t flowWindowStart;
+    uint16_t flowWindowCount;
+    float flowBaseline;
+    IncidentEvent incidentLog[INCIDENT_QUEUE_SIZE];
+    uint32_t incidentSeq;
+  };
+
+  void getTotals(Totals& out) const;
+  void getCheckpoint(Checkpoint& out) const;
+
+  // Call after begin() and before the first detectVehicles(). The time
+  // between saving and restoring is treated as zero, so tracks and the
+  // count window carry on where they stopped.
+  void restoreTotals(const Totals& in);
+  void restoreCheckpoint(const Checkpoint& in);
 
 private:
+  // Guards everything below that readers copy
+  SeqLock stateLock;
+
   // Detection state
   Detection detections[MAX_DETECTIONS_PER_FRAME];
   int detectionCount;
 
   // Counting state
   uint32_t totalCount;
-  uint32_t hourlyCount;
-  uint32_t minuteCount;
-  uint32_t lastHourReset;
-  uint32_t lastMinuteReset;
+  CountWindow countWindow;  // Exact sliding minute/hour counts
+  uint32_t zoneCounts[ZoneCount];
 
   // Statistics
   float totalConfidence;
   uint32_t totalDetections;
+  TrafficMetrics metrics;
+  Heatmap heatmap;
 
   // Tracking (for counting line crossings)
-  struct TrackedVehicle {
-    float lastY;
+  // Structure-of-arrays so the matching loop touches only what it compares.
+  // A track slot is free when trackSeen == 0.
+  int16_t trackX[MaxTracks];      // Fixed-point pixels
+  int16_t trackY[MaxTracks];      // Fixed-point pixels
+  uint32_t trackSeen[MaxTracks];  // Capture time of last matched frame (millis)
+  uint16_t trackId[MaxTracks];
+  bool trackCounted[MaxTracks];
+  uint32_t trackAppearance[MaxTracks];
+  int16_t trackAnchorX[MaxTracks];     // Where the track last started moving
+  int16_t trackAnchorY[MaxTracks];
+  uint32_t trackStillSince[MaxTracks]; // Time it last moved more than STATIONARY_MOVE_PX
+  uint16_t nextTrackId;
+
+  // Recently expired tracks, kept for re-identification
+  struct LostTrack {
+    int16_t x;
+    int16_t y;
+    uint32_t lastSeen;    // 0 = empty slot
+    uint32_t expiredAt;
+    uint32_t appearance;
+    uint16_t id;
     bool counted;
-    uint32_t lastSeen;
   };
-  TrackedVehicle tracked[MAX_DETECTIONS_PER_FRAME];
+  LostTrack lostTracks[REID_LOST_TRACKS];
+  uint32_t reidCount;
+
+  // Incident detection
+  bool queueActive[ZoneCount];
+  bool blockageActive[ZoneCount];
+  bool flowDropActive;
+  uint32_t flowWindowStart;
+  uint16_t flowWindowCount;
+  float flowBaseline;
+
+  // Incident event ring buffer
+  IncidentEvent incidentLog[INCIDENT_QUEUE_SIZE];
+  uint32_t incidentSeq;
+
+  // Crossing event ring buffer
+  CrossingEvent crossingLog[CROSSING_LOG_SIZE];
+  uint32_t crossingSeq;
+
+  // Fixed-point conversions
+  static constexpr int16_t toFixedX(float x) { return (int16_t)(x * (FrameWidth * FIXED_ONE)); }
+  static constexpr int16_t toFixedY(float y) { return (int16_t)(y * (FrameHeight * FIXED_ONE)); }
+  static constexpr uint8_t cellOf(int16_t fixed, int32_t extent, uint8_t cells) {
+    return fixed <= 0 ? 0 :
+           fixed >= extent ? cells - 1 :
+           (uint8_t)((int32_t)fixed * cells / extent);
+  }
+  static constexpr uint8_t zoneOf(int16_t fixedX) {
+    return cellOf(fixedX, FrameWidth * FIXED_ONE, ZoneCount);
+  }
 
   // Helper functions
-  bool hasCrossedLine(float currentY, float previousY);
-  void updateTracking();
-  void pruneOldTracks();
-  int findClosestTrack(float x, float y);
+  int8_t crossingDirection(int16_t currentY, int16_t previousY);
+  bool processDetection(Detection& det);
+  void recordCrossing(uint32_t timestamp, int16_t fixedX, float confidence,
+                      float speed, float length, uint16_t trackId, int8_t direction);
+  void pruneOldTracks(uint32_t now);
+  void updateIncidents(uint32_t now);
+  void updateIncident(bool& active, bool condition, uint8_t type, uint8_t zone,
+                      uint16_t value, uint16_t baseline, uint32_t now);
+  void logEvents(uint32_t afterCrossing, uint32_t afterIncident);
+  int findClosestTrack(int16_t x, int16_t y, uint32_t appearance, uint32_t now);
+  int findLostTrack(int16_t x, uint32_t appearance, uint32_t now);
 };
 
+// Counter for the configured camera and site
+typedef BasicVehicleCounter<frameWidth(CAMERA_FRAME_SIZE), frameHeight(CAMERA_FRAME_SIZE),
+                            MAX_DETECTIONS_PER_FRAME, COUNTING_ZONES> VehicleCounter;
+
 #endif // VEHICLE_COUNTER_H
@@ -0,0 +1,148 @@
+/**
+ * SwanFlow - Warm Restart State Implementation
+ */
+
+#include "warm_state.h"
+#include <Preferences.h>
+#include "esp_system.h"
+#include "esp32/rom/crc.h"
+
+// ============================================================================
+// RTC Memory Record
+// ============================================================================
+// RTC_NOINIT_ATTR: not cleared at boot, so the previous boot's copy is
+// still there after a software or watchdog reset. Garbage after power-on,
+// which the magic, size and CRC reject.
+struct RtcRecord {
+  uint32_t magic;
+  uint32_t size;       // sizeof(RtcRecord) of the writing firmware
+  uint32_t build;      // WARM_BUILD_ID of the writing firmware
+  uint32_t warmBoots;
+  VehicleCounter::Checkpoint counter;
+  UploadState upload;
+  uint32_t crc;        // CRC32 of everything above
+};
+
+static_assert(sizeof(RtcRecord) <= 6 * 1024, "Warm state too large for RTC slow memory");
+
+static const uint32_t RTC_MAGIC = 0x53465753;  // "SFWS"
+
+RTC_NOINIT_ATTR static RtcRecord rtcRecord;
+
+// ============================================================================
+// Constructor
+// ============================================================================
+WarmState::WarmState() {
+  memset(&lastWritten, 0, sizeof(lastWritten));
+  warmBoots = 0;
+}
+
+// ============================================================================
+// Restore
+// ============================================================================
+WarmSource WarmState::restore(VehicleCounter& counter, UploadState& upload) {
+  // Power-on leaves RTC memory undefined; anything else kept it
+  bool rtcValid = esp_reset_reason() != ESP_RST_POWERON &&
+                  rtcRecord.magic == RTC_MAGIC &&
+                  rtcRecord.size == sizeof(RtcRecord) &&
+                  rtcRecord.build == WARM_BUILD_ID &&
+                  rtcRecord.crc == crc32(&rtcRecord, offsetof(RtcRecord, crc));
+
+  if (rtcValid) {
+    counter.restoreCheckpoint(rtcRecord.counter);
+    upload = rtcRecord.upload;
+    warmBoots = rtcRecord.warmBoots + 1;
+
+    Serial.printf("Warm restart #%lu: resumed at %lu vehicles\n",
+                  (unsigned long)warmBoots, (unsigned long)rtcRecord.counter.totals.totalCount);
+    return WARM_RTC;
+  }
+
+  if (!WARM_NVS_CHECKPOINT) return WARM_NONE;
+
+  // Power loss: only the totals and the backlog and image positions survive. Pending
+  // incidents, tracks and the count window are gone, so the incident and
+  // rollup cursors stay fresh.
+  Preferences prefs;
+  if (!prefs.begin("swanflow", true)) return WARM_NONE;
+
+  NvsRecord record;
+  size_t len = prefs.getBytes("totals", &record, sizeof(record));
+  prefs.end();
+
+  if (len != sizeof(record) || record.size != sizeof(record) ||
+      record.crc != crc32(&record, offsetof(NvsRecord, crc))) {
+    Serial.println("Cold start (no saved state)");
+    return WARM_NONE;
+  }
+  if (record.version != NVS_VERSION || record.build != WARM_BUILD_ID) {
+    Serial.printf("Cold start (saved state is from format %u, build %u)\n",
+                  record.version, record.build);
+    return WARM_NONE;
+  }
+
+  counter.restoreTotals(record.totals);
+  upload.lastUploadMinute = record.lastUploadMinute;
+  upload.backlog = record.backlog;
+  upload.lastImageSeq = record.lastImageSeq;
+  lastWritten = record;
+
+  Serial.printf("Restored totals from flash: %lu vehicles\n",
+                (unsigned long)record.totals.totalCount);
+  return WARM_NVS;
+}
+
+// ============================================================================
+// Save
+// ============================================================================
+void WarmState::saveRTC(const VehicleCounter& counter, const UploadState& upload) {
+  // Written in place: a reset mid-write fails the CRC and falls back to NVS
+  rtcRecord.magic = RTC_MAGIC;
+  rtcRecord.size = sizeof(RtcRecord);
+  rtcRecord.build = WARM_BUILD_ID;
+  rtcRecord.warmBoots = warmBoots;
+  counter.getCheckpoint(rtcRecord.counter);
+  rtcRecord.upload = upload;
+  rtcRecord.crc = crc32(&rtcRecord, offsetof(RtcRecord, crc));
+}
+
+bool WarmState::saveNVS(const VehicleCounter& counter, const UploadState& upload) {
+  if (!WARM_NVS_CHECKPOINT) return false;
+
+  NvsRecord record;
+  memset(&record, 0, sizeof(record));
+  record.size = sizeof(record);
+  record.version = NVS_VERSION;
+  record.build = WARM_BUILD_ID;
+  counter.getTotals(record.totals);
+  record.lastUploadMinute = upload.lastUploadMinute;
+  record.backlog = upload.backlog;
+  record.lastImageSeq = upload.lastImageSeq;
+  record.crc = crc32(&record, offsetof(NvsRecord, crc));
+
+  // Every write costs flash wear; skip it if nothing changed
+  if (memcmp(&record, &lastWritten, sizeof(record)) == 0) return true;
+
+  Preferences prefs;
+  if (!prefs.begin("swanflow", false)) {
+    Serial.println("NVS checkpoint failed (open)");
+    return false;
+  }
+
+  bool ok = prefs.putBytes("totals", &record, sizeof(record)) == sizeof(record);
+  prefs.end();
+
+  if (ok) {
+    lastWritten = record;
+  } else {
+    Serial.println("NVS checkpoint failed (write)");
+  }
+  return ok;
+}
+
+// ============================================================================
+// Checksum
+// ============================================================================
+uint32_t WarmState::crc32(const void* data, size_t len) {
+  return crc32_le(0, (const uint8_t*)data, len);  // ROM implementation
+}
@@ -0,0 +1,80 @@
+/**
+ * SwanFlow - Warm Restart State
+ *
+ * Keeps counter and uploader state across resets. A full checkpoint is
+ * mirrored into RTC slow memory (kept through software, watchdog and panic
+ * resets); cumulative totals go to NVS (kept through power loss). Both
+ * carry a checksum, a layout size and WARM_BUILD_ID, so a torn write or a
+ * firmware with a different layout or build falls back to the next source
+ * instead of restoring junk; an NVS record in an older format is dropped.
+ */
+
+#ifndef WARM_STATE_H
+#define WARM_STATE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "vehicle_counter.h"
+#include "stats_backlog.h"
+
+// ============================================================================
+// Data Structures
+// ============================================================================
+// Uploader progress kept alongside the counter
+struct UploadState {
+  uint32_t lastIncidentSeq;   // Last incident event pushed
+  uint32_t lastRollupMinute;  // Next epoch minute to add to the rollups
+  uint32_t lastUploadMinute;  // Epoch minute of the last successful upload
+  BacklogState backlog;       // Store-and-forward progress
+  uint32_t lastImageSeq;      // Last stored image fully uploaded
+  uint32_t incidentStream;    // Random ID for the counter's incident numbering
+};
+
+enum WarmSource : uint8_t {
+  WARM_NONE = 0,  // Cold start
+  WARM_RTC = 1,   // Full state from RTC memory
+  WARM_NVS = 2    // Totals only, from flash
+};
+
+// ============================================================================
+// Warm State Class
+// ============================================================================
+class WarmState {
+public:
+  WarmState();
+
+  // Restore state saved by a previous boot; call after counter.begin().
+  // Fields of upload that can't be restored are left untouched.
+  WarmSource restore(VehicleCounter& counter, UploadState& upload);
+
+  // Mirror the full state into RTC memory (fixed cost, every WARM_RTC_INTERVAL_MS)
+  void saveRTC(const VehicleCounter& counter, const UploadState& upload);
+
+  // Checkpoint totals to NVS; skipped if nothing changed since the last write
+  bool saveNVS(const VehicleCounter& counter, const UploadState& upload);
+
+  // Boots since the last cold start
+  uint32_t getWarmBoots() const { return warmBoots; }
+
+private:
+  // Format of NvsRecord; records of older formats are not restored
+  static const uint16_t NVS_VERSION = 2;
+
+  struct NvsRecord {
+    uint32_t size;              // sizeof(NvsRecord) of the writing firmware
+    uint16_t version;           // NVS_VERSION of the writing firmware
+    uint16_t build;             // WARM_BUILD_ID of the writing firmware
+    VehicleCounter::Totals totals;
+    uint32_t lastUploadMinute;
+    BacklogState backlog;
+    uint32_t lastImageSeq;
+    uint32_t crc;
+  };
+
+  NvsRecord lastWritten;  // Last record in NVS, to skip no-op writes
+  uint32_t warmBoots;
+
+  static uint32_t crc32(const void* data, size_t len);
+};
+
+#endif // WARM_STATE_H
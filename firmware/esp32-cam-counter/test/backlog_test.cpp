@@ -0,0 +1,273 @@
+/**
+ * SwanFlow - Stats Backlog Test
+ *
+ * Multi-day outages against a stand-in for the backend: intervals are
+ * recorded through the SD writer into the event log (with crossings
+ * between them, as in the field) while the server is unreachable, then
+ * replayed in batches alongside live uploads once it is back. The server
+ * keys intervals on (stream, interval) like backend/api, so resends are
+ * counted rather than stored twice.
+ */
+
+#include "stats_backlog.h"
+#include <stdio.h>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static const char* ROOT = "/tmp/swanflow-test-backlog";
+static const uint32_t CROSSINGS_PER_INTERVAL = 30;
+static const uint32_t INTERVALS_PER_DAY = 86400000UL / UPLOAD_INTERVAL_MS;
+
+static fs::FS sd(ROOT);
+
+// ============================================================================
+// Stand-in Server
+// ============================================================================
+struct StandInServer {
+  bool online;
+  std::set<std::pair<uint32_t, uint32_t> > stored;
+  uint32_t duplicates;
+  uint32_t batches;
+
+  StandInServer() : online(true), duplicates(0), batches(0) {}
+
+  // One POST; false if it never arrived
+  bool post(const IntervalRecord* records, size_t count) {
+    if (!online) return false;
+    for (size_t i = 0; i < count; i++) {
+      if (!stored.insert(std::make_pair(records[i].stream, records[i].interval)).second) duplicates++;
+    }
+    if (count > 1) batches++;
+    return true;
+  }
+
+  bool has(uint32_t stream, uint32_t interval) const {
+    return stored.count(std::make_pair(stream, interval)) > 0;
+  }
+};
+
+// ============================================================================
+// Simulated Device
+// ============================================================================
+struct Device {
+  EventLog log;
+  ImageStore images;  // Not started: no images in this test
+  SdWriter writer;
+  StatsBacklog backlog;
+  uint32_t submitted;
+  uint32_t lastReplay;
+
+  Device() : submitted(0), lastReplay(0) {}
+
+  bool begin(const BacklogState& saved) {
+    if (!log.begin(sd) || !writer.begin(log, images)) return false;
+    backlog.begin(log, writer);
+    backlog.restore(saved);
+    return true;
+  }
+
+  // Wait until the writer task has appended everything queued, then make
+  // it readable (the task would flush within SD_WRITER_FLUSH_MS)
+  void settle() {
+    for (;;) {
+      SdWriterStats stats = writer.getStats();
+      if (stats.written + stats.failed >= submitted) break;
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    log.flush();
+  }
+
+  // One upload interval: crossings spread over it with replay slots in
+  // between, then the interval record and its live upload
+  IntervalRecord interval(StandInServer& server) {
+    uint8_t crossing[28];
+    for (uint32_t i = 0; i < CROSSINGS_PER_INTERVAL; i++) {
+      memset(crossing, (int)i, sizeof(crossing));
+      if (writer.submit(LOG_CROSSING, millis(), crossing, sizeof(crossing))) submitted++;
+      if (i % 8 == 7) settle();  // The card keeps up with real traffic
+      replay(server);
+      hostAdvance(UPLOAD_INTERVAL_MS / CROSSINGS_PER_INTERVAL);
+    }
+
+    CounterStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.totalCount = submitted;
+    IntervalRecord rec = backlog.record(stats, 1700000000);
+    submitted++;
+    settle();
+
+    if (server.post(&rec, 1)) backlog.delivered(rec.interval);
+    return rec;
+  }
+
+  // As startNextUpload(): only with the modem connected
+  void replay(StandInServer& server) {
+    if (!server.online || !backlog.pending()) return;
+    if (millis() - lastReplay < BACKLOG_REPLAY_INTERVAL_MS) return;
+
+    IntervalRecord batch[BACKLOG_BATCH_RECORDS];
+    size_t n = backlog.readBatch(batch, BACKLOG_BATCH_RECORDS, 1700000000);
+    if (n > 0 || !backlog.wasBusy()) lastReplay = millis();
+    if (n > 0 && server.post(batch, n)) backlog.acknowledge();
+  }
+};
+
+// Bytes from a logged interval's header to the next record's
+static const uint32_t STATS_RECORD_SIZE = (sizeof(LogRecordHeader) + sizeof(IntervalRecord) + 31) & ~31u;
+
+// Spoil the header CRC of the record headerOffset bytes on from the
+// logged interval (its stream and number lead the payload), as a torn
+// write would
+static bool corruptRecord(uint32_t interval, uint32_t stream, uint32_t headerOffset) {
+  std::string path = std::string(ROOT) + "/log/events.bin";
+  FILE* f = fopen(path.c_str(), "r+b");
+  if (!f) return false;
+
+  // Records are 32-byte aligned after the two checkpoint sectors; the
+  // outage fits well inside the first few MB of the ring
+  const uint32_t base = 2 * EventLog::SECTOR_SIZE;
+  static uint8_t data[16 * 1024 * 1024];
+  size_t n = fread(data, 1, sizeof(data), f);
+
+  bool found = false;
+  for (size_t at = base; at + 64 <= n; at += 32) {
+    uint32_t words[2];
+    memcpy(words, data + at + sizeof(LogRecordHeader), sizeof(words));
+    if (words[0] != interval || words[1] != stream) continue;
+
+    size_t target = at + headerOffset + offsetof(LogRecordHeader, headerCrc);
+    uint8_t bad = data[target] ^ 0x5A;
+    found = fseek(f, (long)target, SEEK_SET) == 0 && fwrite(&bad, 1, 1, f) == 1;
+    break;
+  }
+
+  fclose(f);
+  return found;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// Three days offline, one bad stats record and one bad crossing in the
+// middle: everything else reaches the server, oldest first, while live
+// uploads carry on
+static void testMultiDayOutage() {
+  sd.clear();
+  hostSetMillis(1000);
+
+  BacklogState fresh;
+  memset(&fresh, 0, sizeof(fresh));
+  Device& device = *new Device();  // Its writer task never ends
+  CHECK(device.begin(fresh));
+  uint32_t stream = device.backlog.getState().stream;
+
+  StandInServer server;
+  for (int i = 0; i < 30; i++) device.interval(server);
+  CHECK(!device.backlog.pending());
+
+  server.online = false;
+  uint32_t firstOffline = 0, lastOffline = 0;
+  for (uint32_t i = 0; i < 3 * INTERVALS_PER_DAY; i++) {
+    IntervalRecord rec = device.interval(server);
+    if (i == 0) firstOffline = rec.interval;
+    lastOffline = rec.interval;
+  }
+  CHECK(device.backlog.pendingCount() == lastOffline - firstOffline + 1);
+  CHECK(device.writer.getStats().dropped == 0);
+
+  // A torn stats record, and a torn crossing just after another one
+  uint32_t lostInterval = firstOffline + INTERVALS_PER_DAY;
+  CHECK(corruptRecord(lostInterval, stream, 0));
+  CHECK(corruptRecord(lostInterval + INTERVALS_PER_DAY / 2, stream, STATS_RECORD_SIZE));
+
+  // Back online: drain with live uploads interleaved
+  server.online = true;
+  uint32_t minutes = 0;
+  while (device.backlog.pending() && minutes < INTERVALS_PER_DAY) {
+    device.interval(server);
+    minutes++;
+  }
+  CHECK(!device.backlog.pending());
+
+  uint32_t missing = 0;
+  for (uint32_t i = 1; i < device.backlog.getState().nextInterval; i++) {
+    if (!server.has(stream, i)) missing++;
+  }
+  CHECK(missing == 1 && !server.has(stream, lostInterval));
+
+  // Replay is rate limited: one batch per BACKLOG_REPLAY_INTERVAL_MS
+  uint32_t expectedBatches = (lastOffline - firstOffline) / BACKLOG_BATCH_RECORDS;
+  CHECK(server.batches >= expectedBatches);
+  CHECK((uint64_t)minutes * UPLOAD_INTERVAL_MS >= (uint64_t)expectedBatches * BACKLOG_REPLAY_INTERVAL_MS);
+
+  printf("3-day outage: %lu intervals replayed in %lu batches over %lu minutes, %lu resent\n",
+         (unsigned long)(lastOffline - firstOffline + 1), (unsigned long)server.batches,
+         (unsigned long)minutes, (unsigned long)server.duplicates);
+}
+
+// A restart in the middle of an outage replays from the saved progress
+static void testOutageAcrossRestart() {
+  sd.clear();
+  hostSetMillis(1000);
+
+  BacklogState saved;
+  memset(&saved, 0, sizeof(saved));
+  StandInServer server;
+  server.online = false;
+  Device& before = *new Device();
+  CHECK(before.begin(saved));
+  uint32_t stream = before.backlog.getState().stream;
+  for (uint32_t i = 0; i < INTERVALS_PER_DAY; i++) before.interval(server);
+  saved = before.backlog.getState();
+
+  // The old writer task idles on; the new device reopens the log
+  server.online = true;
+  Device& device = *new Device();
+  CHECK(device.begin(saved));
+  CHECK(device.backlog.pendingCount() == INTERVALS_PER_DAY);
+  for (int i = 0; i < 60 && device.backlog.pending(); i++) device.interval(server);
+  CHECK(!device.backlog.pending());
+  for (uint32_t i = 1; i <= INTERVALS_PER_DAY; i++) CHECK(server.has(stream, i));
+}
+
+// Without a readable log nothing is given up: the intervals stay pending
+static void testLogNotReady() {
+  EventLog log;
+  SdWriter writer;
+  StatsBacklog backlog;
+  backlog.begin(log, writer);
+
+  BacklogState saved = { 0x1234, 50, 20, 7 };
+  backlog.restore(saved);
+  IntervalRecord batch[BACKLOG_BATCH_RECORDS];
+  CHECK(backlog.readBatch(batch, BACKLOG_BATCH_RECORDS, 0) == 0);
+  CHECK(backlog.pendingCount() == 29 && backlog.getState().deliveredInterval == 20);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testMultiDayOutage();
+  testOutageAcrossRestart();
+  testLogNotReady();
+  sd.clear();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
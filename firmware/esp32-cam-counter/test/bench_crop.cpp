@@ -0,0 +1,224 @@
+/**
+ * SwanFlow - JPEG Crop Benchmark
+ *
+ * Three ways to store the area around a detection: the whole frame as
+ * captured, JpegCropper's compressed-domain crop, and decode, crop and
+ * encode again (libjpeg, standing in for the esp32-camera converters).
+ * Reports output bytes and host time per frame, and checks that the
+ * cropped blocks decode to exactly the pixels of the same area of the
+ * frame.
+ *
+ * Frames are synthetic road scenes encoded like the camera's: 4:2:2,
+ * baseline, libjpeg quality 80 (about CAMERA_JPEG_QUALITY 12).
+ *
+ * The host's libjpeg is usually libjpeg-turbo, with SIMD colour
+ * conversion, DCT and Huffman coding. The ESP32 has none of that, so on
+ * the device the recode column is far slower relative to the crop, which
+ * only Huffman-decodes the frame and re-encodes the kept blocks.
+ */
+
+#include "jpeg_crop.h"
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+#include <jpeglib.h>
+
+static const int QUALITY = 80;
+static const int ITERATIONS = 200;
+
+static double nowUs() {
+  return std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================================
+// libjpeg
+// ============================================================================
+static std::vector<uint8_t> encode(const uint8_t* rgb, int width, int height) {
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+
+  unsigned char* mem = nullptr;
+  unsigned long memSize = 0;
+  jpeg_mem_dest(&cinfo, &mem, &memSize);
+
+  cinfo.image_width = width;
+  cinfo.image_height = height;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo);
+  jpeg_set_quality(&cinfo, QUALITY, TRUE);
+  cinfo.comp_info[0].h_samp_factor = 2;  // 4:2:2, as the camera sends
+  cinfo.comp_info[0].v_samp_factor = 1;
+
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height) {
+    JSAMPROW row = (JSAMPROW)(rgb + cinfo.next_scanline * width * 3);
+    jpeg_write_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+
+  std::vector<uint8_t> out(mem, mem + memSize);
+  free(mem);
+  jpeg_destroy_compress(&cinfo);
+  return out;
+}
+
+// Plain upsampling, so each MCU decodes on its own and a crop's pixels
+// can be compared with the frame's
+static std::vector<uint8_t> decode(const uint8_t* jpeg, size_t length, int& width, int& height,
+                                   bool fancy) {
+  jpeg_decompress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_decompress(&cinfo);
+  jpeg_mem_src(&cinfo, (unsigned char*)jpeg, length);
+  jpeg_read_header(&cinfo, TRUE);
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.do_fancy_upsampling = fancy ? TRUE : FALSE;
+  jpeg_start_decompress(&cinfo);
+
+  width = cinfo.output_width;
+  height = cinfo.output_height;
+  std::vector<uint8_t> rgb((size_t)width * height * 3);
+  while (cinfo.output_scanline < cinfo.output_height) {
+    JSAMPROW row = (JSAMPROW)(rgb.data() + cinfo.output_scanline * width * 3);
+    jpeg_read_scanlines(&cinfo, &row, 1);
+  }
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  return rgb;
+}
+
+// ============================================================================
+// Frames
+// ============================================================================
+// Sky, a textured road with lane marks, and a few boxy vehicles
+static std::vector<uint8_t> roadScene(int width, int height) {
+  std::vector<uint8_t> rgb((size_t)width * height * 3);
+  uint32_t seed = 12345;
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      seed = seed * 1103515245 + 12345;
+      int noise = (int)(seed >> 27) - 16;
+      uint8_t* p = &rgb[((size_t)y * width + x) * 3];
+
+      if (y < height / 3) {
+        p[0] = 120 + y / 4;
+        p[1] = 160 + y / 4;
+        p[2] = 220;
+      } else {
+        int grey = 90 + noise;
+        bool lane = (x % (width / 4)) < 3 && (y / 12) % 2 == 0;
+        p[0] = p[1] = p[2] = (uint8_t)(lane ? 230 : grey);
+      }
+    }
+  }
+
+  static const uint8_t colours[3][3] = { { 200, 30, 30 }, { 30, 60, 160 }, { 230, 230, 230 } };
+  for (int v = 0; v < 3; v++) {
+    int vx = width * (1 + 3 * v) / 10;
+    int vy = height / 2 + v * height / 10;
+    int vw = width / 6;
+    int vh = height / 8;
+    for (int y = vy; y < vy + vh && y < height; y++) {
+      for (int x = vx; x < vx + vw && x < width; x++) {
+        uint8_t* p = &rgb[((size_t)y * width + x) * 3];
+        bool window = y < vy + vh / 3 && x > vx + 4 && x < vx + vw - 4;
+        for (int c = 0; c < 3; c++) p[c] = window ? 40 : colours[v][c];
+      }
+    }
+  }
+  return rgb;
+}
+
+// ============================================================================
+// Runs
+// ============================================================================
+static bool run(const char* name, int width, int height, const CropRect& rect) {
+  std::vector<uint8_t> scene = roadScene(width, height);
+  std::vector<uint8_t> frame = encode(scene.data(), width, height);
+  std::vector<uint8_t> out(frame.size() + 4096);
+  std::vector<uint8_t> copy(frame.size());
+  JpegCropper cropper;
+
+  // One untimed pass each, so no method pays for the first touch
+  cropper.crop(frame.data(), frame.size(), rect, out.data(), out.size());
+  encode(scene.data(), width, height);
+
+  // Whole frame: the bytes as captured
+  double start = nowUs();
+  for (int i = 0; i < ITERATIONS; i++) memcpy(copy.data(), frame.data(), frame.size());
+  double fullUs = (nowUs() - start) / ITERATIONS;
+
+  // Compressed-domain crop
+  size_t cropLength = 0;
+  start = nowUs();
+  for (int i = 0; i < ITERATIONS; i++) {
+    cropLength = cropper.crop(frame.data(), frame.size(), rect, out.data(), out.size());
+  }
+  double cropUs = (nowUs() - start) / ITERATIONS;
+  if (cropLength == 0) {
+    printf("%s: crop failed\n", name);
+    return false;
+  }
+  CropRect kept = cropper.getCropped();
+
+  // Decode, crop the pixels, encode again
+  size_t recodedLength = 0;
+  start = nowUs();
+  for (int i = 0; i < ITERATIONS; i++) {
+    int w, h;
+    std::vector<uint8_t> rgb = decode(frame.data(), frame.size(), w, h, true);
+    std::vector<uint8_t> region((size_t)rect.width * rect.height * 3);
+    for (int y = 0; y < rect.height; y++) {
+      memcpy(&region[(size_t)y * rect.width * 3], &rgb[((size_t)(rect.y + y) * w + rect.x) * 3],
+             (size_t)rect.width * 3);
+    }
+    recodedLength = encode(region.data(), rect.width, rect.height).size();
+  }
+  double recodeUs = (nowUs() - start) / ITERATIONS;
+
+  // The cropped blocks are the frame's, so they decode to its pixels
+  int fw, fh, cw, ch;
+  std::vector<uint8_t> full = decode(frame.data(), frame.size(), fw, fh, false);
+  std::vector<uint8_t> cropped = decode(out.data(), cropLength, cw, ch, false);
+  bool exact = cw == kept.width && ch == kept.height;
+  for (int y = 0; exact && y < ch; y++) {
+    exact = memcmp(&cropped[(size_t)y * cw * 3], &full[((size_t)(kept.y + y) * fw + kept.x) * 3],
+                   (size_t)cw * 3) == 0;
+  }
+
+  printf("%-18s %4dx%-4d box %3ux%-3u | full %6zu B %7.1f us | crop %6zu B %7.1f us (%ux%u) | "
+         "recode %6zu B %7.1f us | %s\n",
+         name, width, height, rect.width, rect.height, frame.size(), fullUs, cropLength, cropUs,
+         kept.width, kept.height, recodedLength, recodeUs, exact ? "bit-exact" : "MISMATCH");
+  return exact;
+}
+
+int main() {
+  hostSerialOutput(false);
+
+  // Boxes as main.cpp sends them: the detection plus IMAGE_CROP_MARGIN_PX
+  struct Case {
+    const char* name;
+    int width, height;
+    CropRect rect;
+  };
+  const Case cases[] = {
+    { "QVGA small car", 320, 240, { 90, 110, 72, 56 } },
+    { "QVGA near car", 320, 240, { 20, 100, 140, 100 } },
+    { "QVGA two cars", 320, 240, { 20, 100, 260, 120 } },
+    { "VGA small car", 640, 480, { 180, 220, 144, 112 } },
+    { "VGA near car", 640, 480, { 40, 200, 280, 200 } },
+  };
+
+  bool ok = true;
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    ok = run(cases[i].name, cases[i].width, cases[i].height, cases[i].rect) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/**
+ * SwanFlow - Event Log Benchmark
+ *
+ * Stores the same records two ways: one file each in /detections (as
+ * saveImageToSD() did before the event log) and appended to the event
+ * log. Reports host time per record, file system calls per record, and
+ * a FAT model of the card I/O each costs.
+ *
+ * Host times come from the host file system, which indexes directories;
+ * FAT doesn't. On FAT, creating a file scans the directory for the name
+ * and a free entry (32 bytes per 8.3 entry, so one 512-byte sector per
+ * 16 files already there), then writes the directory entry and the FAT.
+ * The model counts those sectors; the log's are what it actually wrote.
+ */
+
+#include "event_log.h"
+#include <chrono>
+#include <stdio.h>
+#include <vector>
+
+static fs::FS sd("/tmp/swanflow-bench-eventlog");
+
+static double nowUs() {
+  return std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================================
+// Runs
+// ============================================================================
+struct Result {
+  double usPerRecord;
+  double callsPerRecord;    // open/exists/mkdir
+  double sectorsPerRecord;  // Card sectors read or written (FAT model for files)
+};
+
+static Result filePerRecord(const uint8_t* payload, size_t length, uint32_t records) {
+  sd.clear();
+  sd.stats = HostFsStats();
+  double fatSectors = 0;
+
+  double start = nowUs();
+  for (uint32_t i = 0; i < records; i++) {
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/detections/%lu.jpg", (unsigned long)i);
+    if (!sd.exists("/detections")) sd.mkdir("/detections");
+
+    File file = sd.open(filename, FILE_WRITE);
+    file.write(payload, length);
+    file.close();
+
+    // FAT: scan i existing entries, write the entry and the FAT sector,
+    // then the data
+    fatSectors += (i * 32 + 511) / 512 + 2 + (length + 511) / 512;
+  }
+  double elapsed = nowUs() - start;
+
+  Result result;
+  result.usPerRecord = elapsed / records;
+  result.callsPerRecord = (double)(sd.stats.opens + sd.stats.lookups) / records;
+  result.sectorsPerRecord = fatSectors / records;
+  return result;
+}
+
+static Result eventLog(const uint8_t* payload, size_t length, uint32_t records) {
+  sd.clear();
+  EventLog log;
+  log.begin(sd);
+  sd.stats = HostFsStats();
+
+  double start = nowUs();
+  for (uint32_t i = 0; i < records; i++) {
+    log.append(LOG_CROSSING, i, payload, length);
+  }
+  log.flush();
+  double elapsed = nowUs() - start;
+
+  Result result;
+  result.usPerRecord = elapsed / records;
+  result.callsPerRecord = (double)(sd.stats.opens + sd.stats.lookups) / records;
+  result.sectorsPerRecord = (double)(sd.stats.bytesWritten + sd.stats.bytesRead) / 512 / records;
+  return result;
+}
+
+int main() {
+  hostSerialOutput(false);
+
+  const size_t sizes[] = {28, 8192};
+  const uint32_t counts[] = {1000, 5000, 20000};
+  std::vector<uint8_t> payload(8192);
+  for (size_t i = 0; i < payload.size(); i++) payload[i] = (uint8_t)(i * 7);
+
+  printf("%6s %7s | %-34s | %-34s\n", "bytes", "records", "file per record", "event log");
+  printf("%6s %7s | %9s %8s %15s | %9s %8s %15s\n", "", "", "us/rec", "calls", "sectors (FAT)",
+         "us/rec", "calls", "sectors");
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+      Result file = filePerRecord(payload.data(), sizes[s], counts[c]);
+      Result log = eventLog(payload.data(), sizes[s], counts[c]);
+      printf("%6zu %7u | %9.2f %8.2f %15.1f | %9.2f %8.3f %15.2f\n", sizes[s], counts[c],
+             file.usPerRecord, file.callsPerRecord, file.sectorsPerRecord,
+             log.usPerRecord, log.callsPerRecord, log.sectorsPerRecord);
+    }
+  }
+
+  sd.clear();
+  return 0;
+}
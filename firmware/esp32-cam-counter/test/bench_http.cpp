@@ -0,0 +1,70 @@
+/**
+ * SwanFlow - HTTP Keep-Alive Benchmark
+ *
+ * The same stats uploads sent to stand_in_server.js two ways: a new
+ * connection per request (close() after each, as before keep-alive) and
+ * one kept-alive connection. Round trips are emulated by HostTcpClient
+ * (two to open a connection, one per response) at a few Cat-M1-like
+ * latencies. Reports time and bytes per upload. Skipped without Node.js.
+ *
+ * TLS (MODEM_TLS) would add two more round trips to each new connection,
+ * which widens the gap; the stand-in is plain HTTP.
+ */
+
+#include "http_connection.h"
+#include "tcp_client.h"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+static const uint16_t PORT = 18432;
+static const int UPLOADS = 10;
+
+static HostTcpClient client;
+static uint8_t body[260];  // About a JSON stats upload
+
+// ============================================================================
+// Runs
+// ============================================================================
+static void run(uint32_t rttMs, bool keepAlive) {
+  HttpConnection http;
+  http.begin(client);
+  client.setLatency(rttMs);
+
+  unsigned long start = millis();
+  int ok = 0;
+  for (int i = 0; i < UPLOADS; i++) {
+    if (http.start("http://127.0.0.1:18432/api/detections", "application/json", body, sizeof(body))) {
+      while (http.poll()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+      if (http.succeeded()) ok++;
+    }
+    if (!keepAlive) http.close();
+  }
+  unsigned long elapsed = millis() - start;
+
+  const HttpStats& stats = http.getStats();
+  printf("RTT %3lu ms  %-12s %2d/%d ok  %6.1f ms/upload  %2lu connects  %5.0f B sent  %5.0f B received\n",
+         (unsigned long)rttMs, keepAlive ? "keep-alive" : "per-request", ok, UPLOADS,
+         elapsed / (double)UPLOADS, (unsigned long)stats.connects, stats.bytesSent / (double)UPLOADS,
+         stats.bytesReceived / (double)UPLOADS);
+}
+
+int main() {
+  hostSerialOutput(false);
+  hostRealClock(true);
+
+  if (!hostStandInStart(PORT, 120000)) {
+    printf("skipped: Node.js not found\n");
+    return 0;
+  }
+
+  memset(body, 'x', sizeof(body));
+  const uint32_t latencies[] = { 0, 100, 300 };
+  for (size_t i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++) {
+    run(latencies[i], false);
+    run(latencies[i], true);
+  }
+
+  hostStandInStop();
+  return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * SwanFlow - HTTP Response Parser Benchmark
+ *
+ * Time to parse backend responses as HttpConnection sees them: whole,
+ * in the HTTP_READ_CHUNK reads it makes from the modem, and a byte at a
+ * time. The responses are what backend/api (Express) sends for an upload, a
+ * chunked one, and one behind a 100 Continue.
+ */
+
+#include "http_response_parser.h"
+#include <stdio.h>
+#include <chrono>
+#include <string>
+
+static const int ITERATIONS = 200000;
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ============================================================================
+// Runs
+// ============================================================================
+static bool run(const char* name, const std::string& response, size_t piece) {
+  HttpResponseParser parser;
+  const uint8_t* data = (const uint8_t*)response.data();
+  bool ok = true;
+
+  double start = nowNs();
+  for (int i = 0; i < ITERATIONS; i++) {
+    parser.begin("X-SwanFlow-Request");
+    size_t used = 0;
+    HttpParseResult result = HTTP_PARSE_MORE;
+    while (used < response.size() && result == HTTP_PARSE_MORE) {
+      size_t n = piece && piece < response.size() - used ? piece : response.size() - used;
+      size_t consumed;
+      result = parser.feed(data + used, n, consumed);
+      used += consumed;
+    }
+    ok = ok && result == HTTP_PARSE_DONE && used == response.size();
+  }
+  double ns = (nowNs() - start) / ITERATIONS;
+
+  char split[32];
+  if (piece) {
+    snprintf(split, sizeof(split), "%zu B reads", piece);
+  } else {
+    snprintf(split, sizeof(split), "whole");
+  }
+  printf("%-14s %4zu B  %-11s %7.0f ns  %5.2f ns/B  %s\n", name, response.size(), split, ns,
+         ns / response.size(), ok ? "ok" : "PARSE FAILED");
+  return ok;
+}
+
+int main() {
+  hostSerialOutput(false);
+
+  const std::string json = "{\"success\":true,\"id\":12345,\"message\":\"Stats saved\"}";
+  const std::string express =
+      "HTTP/1.1 201 Created\r\n"
+      "X-Powered-By: Express\r\n"
+      "Access-Control-Allow-Origin: *\r\n"
+      "Content-Type: application/json; charset=utf-8\r\n"
+      "Content-Length: " + std::to_string(json.size()) + "\r\n"
+      "ETag: W/\"34-bXh0dHBzOi8vZXhhbXBsZS5jb20\"\r\n"
+      "Date: Mon, 19 Oct 2026 10:00:00 GMT\r\n"
+      "Connection: keep-alive\r\n"
+      "Keep-Alive: timeout=5\r\n"
+      "\r\n" + json;
+  const std::string chunked =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/json; charset=utf-8\r\n"
+      "Transfer-Encoding: chunked\r\n"
+      "X-SwanFlow-Request: heatmap\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n"
+      "1a\r\n{\"success\":true,\"id\":123}\r\n"
+      "10\r\n,\"duplicate\":tr\r\n"
+      "3\r\nue}\r\n"
+      "0\r\n\r\n";
+  const std::string interim = "HTTP/1.1 100 Continue\r\n\r\n" + express;
+
+  bool ok = true;
+  const size_t pieces[] = { 0, HTTP_READ_CHUNK, 1 };
+  for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+    ok = run("express", express, pieces[p]) && ok;
+    ok = run("chunked", chunked, pieces[p]) && ok;
+    ok = run("100-continue", interim, pieces[p]) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+/**
+ * SwanFlow - Telemetry Benchmark
+ *
+ * Bytes and host time to send a batch of stats intervals as JSON, as an
+ * SFTM record (TelemetryEncoder) and as an LZ-compressed one. A JSON body
+ * carries one interval, so a batch costs a document per interval; the
+ * metrics, SD writer, network and radio sections go in the last one, as
+ * they go once in a record.
+ *
+ * The JSON is written with snprintf in the layout of
+ * LTEModem::buildStatsJSON() (ArduinoJson isn't built on the host): sizes
+ * match what the device sends, times only show the order of magnitude.
+ */
+
+#include "telemetry.h"
+#include <chrono>
+#include <stdio.h>
+#include <string>
+
+static const int ITERATIONS = 2000;
+
+static double nowNs() {
+  return std::chrono::duration<double, std::nano>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t seed = 7;
+static uint32_t random32() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// ============================================================================
+// JSON (buildStatsJSON layout)
+// ============================================================================
+static size_t appendHistogram(char* out, size_t capacity, const char* key, const LogHistogram& hist) {
+  size_t n = snprintf(out, capacity, "\"%s\":{\"n\":%lu,\"sum\":%lu,\"b\":[", key,
+                      (unsigned long)hist.total, (unsigned long)hist.sum);
+  bool first = true;
+  for (int i = 0; i < LogHistogram::BUCKETS && n < capacity; i++) {
+    if (hist.counts[i] == 0) continue;
+    n += snprintf(out + n, capacity - n, "%s%d,%u", first ? "" : ",", i, hist.counts[i]);
+    first = false;
+  }
+  if (n < capacity) n += snprintf(out + n, capacity - n, "]}");
+  return n;
+}
+
+static size_t statsJSON(char* out, size_t capacity, const IntervalRecord& r,
+                        const MetricsSummary* metrics, const SdWriterStats* sd,
+                        const HttpStats* net, const RadioStats* radio) {
+  size_t n = snprintf(out, capacity,
+                      "{\"site\":\"%s\",\"lat\":%.4f,\"lon\":%.4f,\"timestamp\":%lu,\"uptime\":%lu,"
+                      "\"total_count\":%lu,\"hour_count\":%lu,\"minute_count\":%lu,"
+                      "\"avg_confidence\":%.7g,\"interval\":%lu,\"stream\":%lu",
+                      SITE_NAME, SITE_LAT, SITE_LON, (unsigned long)r.timestamp,
+                      (unsigned long)r.uptime, (unsigned long)r.totalCount,
+                      (unsigned long)r.lastHourCount, (unsigned long)r.lastMinuteCount,
+                      r.avgConfidence, (unsigned long)r.interval, (unsigned long)r.stream);
+  if (metrics) {
+    n += snprintf(out + n, capacity - n, ",\"metrics\":{\"seq\":%lu,\"interval_ms\":%lu,\"vehicles\":%lu,",
+                  (unsigned long)metrics->seq, (unsigned long)metrics->duration,
+                  (unsigned long)metrics->vehicles);
+    n += appendHistogram(out + n, capacity - n, "headway_ms", metrics->headwayMs);
+    n += snprintf(out + n, capacity - n, ",");
+    n += appendHistogram(out + n, capacity - n, "gap_ms", metrics->gapMs);
+    n += snprintf(out + n, capacity - n, ",");
+    n += appendHistogram(out + n, capacity - n, "speed_dkmh", metrics->speedDkmh);
+    n += snprintf(out + n, capacity - n, ",\"confidence\":[");
+    for (int i = 0; i < 20; i++) {
+      n += snprintf(out + n, capacity - n, "%s%u", i ? "," : "", metrics->confidence[i]);
+    }
+    n += snprintf(out + n, capacity - n, "]}");
+  }
+  if (net) {
+    n += snprintf(out + n, capacity - n,
+                  ",\"net\":{\"rtt_ms\":%lu,\"connect_ms\":%lu,\"sent\":%lu,\"received\":%lu,"
+                  "\"connects\":%lu,\"reused\":%lu,\"stale\":%lu}",
+                  (unsigned long)net->lastRttMs, (unsigned long)net->lastConnectMs,
+                  (unsigned long)net->lastBytesSent, (unsigned long)net->lastBytesReceived,
+                  (unsigned long)net->connects, (unsigned long)net->reused, (unsigned long)net->stale);
+  }
+  if (sd) {
+    n += snprintf(out + n, capacity - n,
+                  ",\"sd\":{\"written\":%lu,\"failed\":%lu,\"dropped\":%lu,\"queue\":%u,"
+                  "\"queue_max\":%u,\"p50_us\":%lu,\"p95_us\":%lu,\"p99_us\":%lu,\"stack_free\":%lu}",
+                  (unsigned long)sd->written, (unsigned long)sd->failed, (unsigned long)sd->dropped,
+                  sd->queueDepth, sd->maxQueueDepth, (unsigned long)sd->latencyP50Us,
+                  (unsigned long)sd->latencyP95Us, (unsigned long)sd->latencyP99Us,
+                  (unsigned long)sd->stackFree);
+  }
+  if (radio) {
+    n += snprintf(out + n, capacity - n,
+                  ",\"radio\":{\"period_ms\":%lu,\"active_ms\":%lu,\"awake_ms\":%lu,\"wakes\":%lu,"
+                  "\"health\":%u,\"tau_s\":%lu,\"active_time_s\":%lu,\"edrx_ms\":%lu}",
+                  (unsigned long)radio->periodMs, (unsigned long)radio->activeMs,
+                  (unsigned long)radio->awakeMs, (unsigned long)radio->wakes, radio->linkHealth,
+                  (unsigned long)radio->tauS, (unsigned long)radio->activeTimeS,
+                  (unsigned long)radio->edrxMs);
+  }
+  n += snprintf(out + n, capacity - n, "}");
+  return n;
+}
+
+// ============================================================================
+// Runs
+// ============================================================================
+static IntervalRecord intervals[60];
+static MetricsSummary metrics;
+static SdWriterStats sd = { 0, 6, 48211, 0, 0, 910, 3900, 17500, 2300 };
+static HttpStats net;
+static RadioStats radio = { 3600000, 190000, 240000, 58, 92, 3240, 60, 81920 };
+
+static void makeIntervals() {
+  uint32_t total = 15000;
+  for (int i = 0; i < 60; i++) {
+    uint32_t vehicles = 15 + random32() % 40;
+    total += vehicles;
+    IntervalRecord& r = intervals[i];
+    memset(&r, 0, sizeof(r));
+    r.interval = 4100 + i;
+    r.stream = 0x9E3779B1;
+    r.timestamp = 18000000 + i * 60000 + random32() % 40;
+    r.epoch = 1791000000 + i * 60;
+    r.uptime = 18000 + i * 60;
+    r.totalCount = total;
+    r.lastMinuteCount = vehicles;
+    r.lastHourCount = 1700 + random32() % 600;
+    r.avgConfidence = 0.6f + (random32() % 350) / 1000.0f;
+  }
+
+  memset(&metrics, 0, sizeof(metrics));
+  metrics.seq = 301;
+  metrics.duration = 60000;
+  metrics.vehicles = 38;
+  for (int i = 0; i < 38; i++) {
+    metrics.headwayMs.add(900 + random32() % 6000);
+    metrics.gapMs.add(200 + random32() % 5000);
+    metrics.speedDkmh.add(350 + random32() % 400);
+    metrics.confidence[12 + random32() % 8]++;
+  }
+  net.lastRttMs = 610;
+  net.lastConnectMs = 0;
+  net.lastBytesSent = 395;
+  net.lastBytesReceived = 225;
+  net.connects = 9;
+  net.reused = 280;
+  net.stale = 1;
+}
+
+static void run(size_t count, bool sections) {
+  const MetricsSummary* m = sections ? &metrics : nullptr;
+  const SdWriterStats* s = sections ? &sd : nullptr;
+  const HttpStats* n = sections ? &net : nullptr;
+  const RadioStats* r = sections ? &radio : nullptr;
+
+  static char json[4096];
+  static uint8_t record[TelemetryEncoder::maxSize(60)];
+  static uint8_t packed[sizeof(record)];
+  static LzCompressor lz;
+
+  size_t jsonBytes = 0;
+  double start = nowNs();
+  for (int it = 0; it < ITERATIONS; it++) {
+    jsonBytes = 0;
+    for (size_t i = 0; i < count; i++) {
+      bool last = i + 1 == count;
+      jsonBytes += statsJSON(json, sizeof(json), intervals[i], last ? m : nullptr,
+                             last ? s : nullptr, last ? n : nullptr, last ? r : nullptr);
+    }
+  }
+  double jsonNs = (nowNs() - start) / ITERATIONS;
+
+  TelemetryEncoder encoder(record, sizeof(record));
+  size_t recordBytes = 0;
+  start = nowNs();
+  for (int it = 0; it < ITERATIONS; it++) {
+    recordBytes = encoder.encode(1, intervals, count, m, s, n, r);
+  }
+  double recordNs = (nowNs() - start) / ITERATIONS;
+
+  size_t packedBytes = 0;
+  start = nowNs();
+  for (int it = 0; it < ITERATIONS; it++) {
+    packedBytes = encoder.compress(lz, packed, sizeof(packed));
+  }
+  double packedNs = (nowNs() - start) / ITERATIONS;
+
+  printf("%3zu intervals %-8s | JSON %6zu B %8.0f ns | SFTM %5zu B %7.0f ns (%4.1fx) | ",
+         count, sections ? "+extras" : "", jsonBytes, jsonNs, recordBytes, recordNs,
+         (double)jsonBytes / recordBytes);
+  if (packedBytes) {
+    printf("LZ %5zu B +%7.0f ns (%4.1fx)\n", packedBytes, packedNs, (double)jsonBytes / packedBytes);
+  } else {
+    printf("LZ  no gain +%7.0f ns\n", packedNs);
+  }
+}
+
+int main() {
+  hostSerialOutput(false);
+  makeIntervals();
+
+  const size_t counts[] = { 1, 5, 15, 60 };
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    run(counts[c], false);
+    run(counts[c], true);
+  }
+  return 0;
+}
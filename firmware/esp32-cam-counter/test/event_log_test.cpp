@@ -0,0 +1,167 @@
+/**
+ * SwanFlow - Event Log Test
+ *
+ * Appends, reads back, reopens and wraps the configured (EVENT_LOG_SIZE_MB)
+ * log in a file on the host.
+ */
+
+#include "event_log.h"
+#include <stdio.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static fs::FS sd("/tmp/swanflow-test-eventlog");
+static std::vector<uint8_t> payload;
+
+static void fillPayload(uint32_t seed, size_t length) {
+  if (payload.size() < length) payload.resize(length);
+  for (size_t i = 0; i < length; i++) payload[i] = (uint8_t)(seed * 31 + i * 7);
+}
+
+static bool payloadMatches(uint32_t seed, const uint8_t* buf, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (buf[i] != (uint8_t)(seed * 31 + i * 7)) return false;
+  }
+  return true;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+static void testRoundTrip() {
+  sd.clear();
+  EventLog log;
+  CHECK(log.begin(sd));
+
+  // Crossings with an image-sized record every tenth
+  for (uint32_t i = 0; i < 500; i++) {
+    size_t length = i % 10 == 0 ? 5000 + i * 13 : 28;
+    fillPayload(i, length);
+    CHECK(log.append(i % 10 == 0 ? LOG_TRAINING : LOG_CROSSING, i, payload.data(), length));
+  }
+
+  log.flush();
+  LogCursor cursor;
+  LogEntry entry;
+  CHECK(log.seek(1, cursor));
+  std::vector<uint8_t> buf(16384);
+  uint32_t read = 0;
+  while (log.next(cursor, entry, buf.data(), buf.size())) {
+    CHECK(entry.seq == read + 1 && entry.timestamp == read && entry.intact);
+    CHECK(payloadMatches(read, buf.data(), entry.length));
+    read++;
+  }
+  CHECK(read == 500);
+
+  // A record is readable only once flushed
+  fillPayload(500, 28);
+  CHECK(log.append(LOG_CROSSING, 500, payload.data(), 28));
+  CHECK(!log.next(cursor, entry, nullptr, 0));
+  log.flush();
+  CHECK(log.next(cursor, entry, nullptr, 0) && entry.seq == 501);
+
+  // Seek lands on the record asked for
+  CHECK(log.seek(321, cursor) && log.next(cursor, entry, nullptr, 0) && entry.seq == 321);
+}
+
+static void testReopen() {
+  // Continues from testRoundTrip's log: the checkpoint plus the scan
+  // after it find every flushed record
+  {
+    EventLog log;
+    CHECK(log.begin(sd));
+    CHECK(log.getNextSeq() == 502);
+    fillPayload(502, 28);
+    CHECK(log.append(LOG_CROSSING, 502, payload.data(), 28));
+    log.flush();
+  }
+
+  EventLog log;
+  CHECK(log.begin(sd));
+  CHECK(log.getNextSeq() == 503);
+  LogCursor cursor;
+  LogEntry entry;
+  uint8_t buf[64];
+  CHECK(log.seek(502, cursor) && log.next(cursor, entry, buf, sizeof(buf)));
+  CHECK(entry.seq == 502 && entry.intact && payloadMatches(502, buf, 28));
+}
+
+// After a wrap the zero fill of a partly used sector lands on the oldest
+// records. They must read as overwritten, not as the end of the log.
+static void testWrapZeroFill() {
+  sd.clear();
+  EventLog log;
+  CHECK(log.begin(sd));
+
+  const uint32_t capacity = (uint32_t)EVENT_LOG_SIZE_MB * 1024 * 1024 - 2 * EventLog::SECTOR_SIZE;
+  const uint32_t maxRecord = capacity / 4;
+  const uint32_t smallRecord = 64;  // Header + 28-byte payload, aligned
+
+  // Lap 1: small records at the start of the ring...
+  fillPayload(0, 28);
+  for (uint32_t i = 0; i < 10; i++) CHECK(log.append(LOG_CROSSING, i, payload.data(), 28));
+  uint32_t left = capacity - 10 * smallRecord;
+
+  // ...then large ones (records 11-14) until exactly a pad header's
+  // worth is left, so the pad fills the lap with no payload
+  fillPayload(0, maxRecord);
+  while (left > 32) {
+    uint32_t size = left - 32 < maxRecord ? left - 32 : maxRecord;
+    CHECK(log.append(LOG_TRAINING, 0, payload.data(), size - 32));
+    left -= size;
+  }
+  log.flush();
+
+  // A reader positioned on the second record
+  LogCursor cursor;
+  LogEntry entry;
+  CHECK(log.seek(2, cursor) && cursor.seq == 2);
+
+  // Lap 2: one small record (15) wraps; flushing zero fills the rest of
+  // the first sector, over lap 1's records 2-8
+  fillPayload(0, 28);
+  CHECK(log.append(LOG_CROSSING, 99, payload.data(), 28));
+  log.flush();
+
+  // The reader skips ahead to what is left instead of stopping
+  std::vector<uint8_t> buf(maxRecord);
+  CHECK(log.next(cursor, entry, buf.data(), buf.size()));
+  CHECK(entry.seq > 8 && entry.intact);
+  uint32_t last = entry.seq;
+  while (log.next(cursor, entry, nullptr, 0)) last = entry.seq;
+  CHECK(last == log.getNextSeq() - 1);
+
+  // Seeking to an overwritten record lands on an intact one
+  CHECK(log.seek(3, cursor) && log.next(cursor, entry, buf.data(), buf.size()));
+  CHECK(entry.seq > 8 && entry.intact);
+
+  // Lap 1's large records are untouched, and lap 2 follows them
+  CHECK(log.seek(12, cursor) && log.next(cursor, entry, buf.data(), buf.size()));
+  CHECK(entry.seq == 12 && entry.intact);
+  CHECK(log.seek(15, cursor) && log.next(cursor, entry, buf.data(), buf.size()));
+  CHECK(entry.seq == 15 && entry.timestamp == 99 && entry.intact);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testRoundTrip();
+  testReopen();
+  testWrapZeroFill();
+  sd.clear();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
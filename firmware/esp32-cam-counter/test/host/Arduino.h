@@ -0,0 +1,141 @@
+/**
+ * SwanFlow - Host Arduino Shim
+ *
+ * The parts of the Arduino core the firmware modules use, so they build
+ * and run on the host for tests and benchmarks.
+ *
+ * millis() runs on a simulated clock that delay() advances, so timeouts
+ * cost no real time. Tests that talk to real sockets switch to the wall
+ * clock with hostRealClock(true). Serial output is dropped unless a test
+ * turns it on with hostSerialOutput(true).
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+typedef uint8_t byte;
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+// Kept together so a test can reach RTC memory (hostRtcMemory())
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_noinit")))
+#define PROGMEM
+
+#ifndef constrain
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#endif
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+long random(long howBig);
+long random(long howSmall, long howBig);
+
+// ============================================================================
+// Host Controls
+// ============================================================================
+void hostSetMillis(unsigned long ms);
+void hostAdvance(unsigned long ms);
+void hostRealClock(bool real);
+void hostSerialOutput(bool on);
+// Variables declared RTC_NOINIT_ATTR, as one block of length bytes
+uint8_t* hostRtcMemory(size_t* length);
+
+// ============================================================================
+// Streams
+// ============================================================================
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+  }
+  size_t write(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  virtual void flush() {}
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return printf("%d", v); }
+  size_t print(unsigned v) { return printf("%u", v); }
+  size_t print(long v) { return printf("%ld", v); }
+  size_t print(unsigned long v) { return printf("%lu", v); }
+  size_t print(double v) { return printf("%.2f", v); }
+
+  template <typename T>
+  size_t println(T v) { return print(v) + println(); }
+  size_t println() { return write("\r\n"); }
+
+  __attribute__((format(printf, 2, 3)))
+  size_t printf(const char* format, ...) {
+    char buf[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    return write((const uint8_t*)buf, min((size_t)len, sizeof(buf) - 1));
+  }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  void setTimeout(unsigned long) {}
+};
+
+class Client : public Stream {
+public:
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+  using Print::write;
+  virtual int read(uint8_t* buffer, size_t size) = 0;
+  virtual int read() = 0;
+  virtual void stop() = 0;
+  virtual uint8_t connected() = 0;
+  virtual operator bool() = 0;
+};
+
+// Console; writes to stdout when enabled
+class HardwareSerial : public Stream {
+public:
+  explicit HardwareSerial(int port) {}
+  void begin(unsigned long baud, int config = 0, int rx = -1, int tx = -1) {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+};
+
+#define SERIAL_8N1 0
+
+extern HardwareSerial Serial;
+
+struct EspClass {
+  uint32_t getFreeHeap() { return 200000; }
+  void restart() { abort(); }
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
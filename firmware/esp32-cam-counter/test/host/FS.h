@@ -0,0 +1,91 @@
+/**
+ * SwanFlow - Host File System Shim
+ *
+ * fs::FS over a directory on the host, for modules that take an SD_MMC
+ * file system. Paths are relative to the root given to HostFS. Calls are
+ * counted (HostFsStats) so benchmarks can compare access patterns.
+ */
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct HostFsStats {
+  uint32_t opens;
+  uint32_t creates;
+  uint32_t lookups;  // exists() and mkdir()
+  uint32_t writes;
+  uint64_t bytesWritten;
+  uint32_t reads;
+  uint64_t bytesRead;
+  uint32_t seeks;
+  uint32_t flushes;
+};
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+class File : public Stream {
+public:
+  File() {}
+  File(FILE* handle, const std::string& path, HostFsStats* stats);
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void flush() override;
+  void close();
+  const char* name() const { return handle ? handle->path.c_str() : ""; }
+  operator bool() const { return handle && handle->file; }
+
+private:
+  struct Handle {
+    FILE* file;
+    std::string path;
+    HostFsStats* stats;
+    ~Handle() { if (file) fclose(file); }
+  };
+  std::shared_ptr<Handle> handle;
+};
+
+class FS {
+public:
+  explicit FS(const char* root = "/tmp/swanflow-fs");
+
+  File open(const char* path, const char* mode = FILE_READ, bool create = false);
+  bool exists(const char* path);
+  bool mkdir(const char* path);
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+
+  // Host only
+  void setRoot(const char* path);
+  const char* getRoot() const { return root.c_str(); }
+  // Remove everything under the root
+  void clear();
+  HostFsStats stats;
+
+private:
+  std::string root;
+};
+
+} // namespace fs
+
+using fs::File;
+
+#endif // HOST_FS_H
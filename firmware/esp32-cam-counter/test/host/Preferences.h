@@ -0,0 +1,38 @@
+/**
+ * SwanFlow - Host Preferences Shim
+ *
+ * NVS key-value storage in memory, kept for the life of the process so it
+ * outlasts the objects a test "reboots". As on the device, a namespace
+ * that was never written can't be opened read-only.
+ */
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include <Arduino.h>
+#include <string>
+
+class Preferences {
+public:
+  Preferences() : readOnly(true), opened(false) {}
+
+  bool begin(const char* name, bool readOnly = false);
+  void end() { opened = false; }
+
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t putBytes(const char* key, const void* value, size_t len);
+  bool remove(const char* key);
+
+private:
+  std::string name;
+  bool readOnly;
+  bool opened;
+};
+
+// ============================================================================
+// Host Controls
+// ============================================================================
+// Erase all of NVS
+void hostNvsErase();
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,83 @@
+/**
+ * SwanFlow - Host Arduino Shim Implementation
+ */
+
+#include <Arduino.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+HardwareSerial Serial(0);
+EspClass ESP;
+
+static std::atomic<unsigned long> simulatedMs(0);
+static std::atomic<bool> realClock(false);
+static std::atomic<bool> serialOutput(false);
+static const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+// ============================================================================
+// Time
+// ============================================================================
+static unsigned long realMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started).count();
+}
+
+unsigned long millis() {
+  return realClock ? realMicros() / 1000 : simulatedMs.load();
+}
+
+unsigned long micros() {
+  return realClock ? realMicros() : simulatedMs.load() * 1000;
+}
+
+void delay(unsigned long ms) {
+  if (realClock) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  } else {
+    simulatedMs += ms;
+    std::this_thread::yield();
+  }
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+void hostSetMillis(unsigned long ms) { simulatedMs = ms; }
+void hostAdvance(unsigned long ms) { simulatedMs += ms; }
+void hostRealClock(bool real) { realClock = real; }
+void hostSerialOutput(bool on) { serialOutput = on; }
+
+// Section bounds from the linker; null when no RTC_NOINIT_ATTR variable
+// is linked in
+extern "C" uint8_t __start_rtc_noinit[] __attribute__((weak));
+extern "C" uint8_t __stop_rtc_noinit[] __attribute__((weak));
+
+uint8_t* hostRtcMemory(size_t* length) {
+  *length = __start_rtc_noinit ? __stop_rtc_noinit - __start_rtc_noinit : 0;
+  return __start_rtc_noinit;
+}
+
+// ============================================================================
+// Random
+// ============================================================================
+long random(long howBig) {
+  return howBig > 0 ? rand() % howBig : 0;
+}
+
+long random(long howSmall, long howBig) {
+  return howBig > howSmall ? howSmall + random(howBig - howSmall) : howSmall;
+}
+
+// ============================================================================
+// Serial
+// ============================================================================
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (serialOutput) fwrite(buffer, 1, size, stdout);
+  return size;
+}
@@ -0,0 +1,58 @@
+/**
+ * SwanFlow - Backend Decoder for Host Tests Implementation
+ */
+
+#include "backend_decode.h"
+#include <unistd.h>
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+bool hostBackendDecode(const std::vector<std::string>& requests, std::vector<std::string>& answers) {
+  answers.clear();
+
+  // Requests go through a file: popen() only pipes one way
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/swanflow-decode-%ld.txt", (long)getpid());
+  FILE* file = fopen(path, "w");
+  if (!file) return false;
+  for (size_t i = 0; i < requests.size(); i++) {
+    fprintf(file, "%s\n", requests[i].c_str());
+  }
+  fclose(file);
+
+  char command[256];
+  snprintf(command, sizeof(command), "node %s/telemetry_decode.js < %s", TEST_DIR, path);
+  FILE* node = popen(command, "r");
+  if (!node) {
+    unlink(path);
+    return false;
+  }
+
+  // Answers are lines ended by "end"
+  std::string answer;
+  char line[4096];
+  while (fgets(line, sizeof(line), node)) {
+    if (strcmp(line, "end\n") == 0) {
+      answers.push_back(answer);
+      answer.clear();
+    } else {
+      answer += line;
+    }
+  }
+  pclose(node);
+  unlink(path);
+  return answers.size() == requests.size();
+}
+
+std::string hostHex(const uint8_t* data, size_t length) {
+  static const char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(length * 2);
+  for (size_t i = 0; i < length; i++) {
+    hex += digits[data[i] >> 4];
+    hex += digits[data[i] & 15];
+  }
+  return hex;
+}
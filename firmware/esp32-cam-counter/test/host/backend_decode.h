@@ -0,0 +1,22 @@
+/**
+ * SwanFlow - Backend Decoder for Host Tests
+ *
+ * Passes records the firmware encoded to the backend's decoder, through
+ * test/telemetry_decode.js (needs Node.js), and returns its answers.
+ */
+
+#ifndef HOST_BACKEND_DECODE_H
+#define HOST_BACKEND_DECODE_H
+
+#include <Arduino.h>
+#include <string>
+#include <vector>
+
+// One request per entry ("<kind> [args]", binary data as hex; see
+// telemetry_decode.js), one answer per request, in order. False if Node
+// couldn't be run or answered fewer.
+bool hostBackendDecode(const std::vector<std::string>& requests, std::vector<std::string>& answers);
+
+std::string hostHex(const uint8_t* data, size_t length);
+
+#endif // HOST_BACKEND_DECODE_H
@@ -0,0 +1,22 @@
+/**
+ * SwanFlow - Host ROM CRC Shim
+ *
+ * CRC-32 (IEEE, reflected) with the ROM's conventions: crc32_le(0, ...)
+ * is the standard CRC of the data, and a previous result continues it.
+ */
+
+#ifndef HOST_ROM_CRC_H
+#define HOST_ROM_CRC_H
+
+#include <stdint.h>
+
+inline uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int k = 0; k < 8; k++) crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+  }
+  return ~crc;
+}
+
+#endif // HOST_ROM_CRC_H
@@ -0,0 +1,30 @@
+/**
+ * SwanFlow - Host Camera Shim
+ *
+ * Frame sizes and the frame buffer type, as in esp32-camera.
+ */
+
+#ifndef HOST_ESP_CAMERA_H
+#define HOST_ESP_CAMERA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+
+typedef enum {
+  FRAMESIZE_96X96, FRAMESIZE_QQVGA, FRAMESIZE_QCIF, FRAMESIZE_HQVGA, FRAMESIZE_240X240,
+  FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_HVGA, FRAMESIZE_VGA, FRAMESIZE_SVGA
+} framesize_t;
+
+typedef enum { PIXFORMAT_RGB565, PIXFORMAT_YUV422, PIXFORMAT_GRAYSCALE, PIXFORMAT_JPEG } pixformat_t;
+
+typedef struct {
+  uint8_t* buf;
+  size_t len;
+  size_t width;
+  size_t height;
+  pixformat_t format;
+  struct timeval timestamp;
+} camera_fb_t;
+
+#endif // HOST_ESP_CAMERA_H
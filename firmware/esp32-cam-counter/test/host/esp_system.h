@@ -0,0 +1,22 @@
+/**
+ * SwanFlow - Host System Shim
+ */
+
+#ifndef HOST_ESP_SYSTEM_H
+#define HOST_ESP_SYSTEM_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef enum { ESP_RST_UNKNOWN, ESP_RST_POWERON, ESP_RST_SW, ESP_RST_PANIC } esp_reset_reason_t;
+
+// The reason the last "boot" reports (ESP_RST_SW until a test sets it)
+inline esp_reset_reason_t& hostResetReason() {
+  static esp_reset_reason_t reason = ESP_RST_SW;
+  return reason;
+}
+
+inline esp_reset_reason_t esp_reset_reason() { return hostResetReason(); }
+inline uint32_t esp_random() { return ((uint32_t)rand() << 16) ^ (uint32_t)rand(); }
+
+#endif // HOST_ESP_SYSTEM_H
@@ -0,0 +1,28 @@
+/**
+ * SwanFlow - Host FreeRTOS Shim
+ *
+ * Tasks, queues and mutexes on std::thread, for host builds of the
+ * modules that use them. A tick is a millisecond; waits are real time.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+typedef void* SemaphoreHandle_t;
+typedef void* QueueHandle_t;
+typedef void* TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFFu
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,10 @@
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
+
+#endif // HOST_FREERTOS_SEMPHR_H
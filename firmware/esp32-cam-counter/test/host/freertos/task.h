@@ -0,0 +1,18 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+
+// The task runs on its own thread; core and priority are ignored
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackDepth,
+                                   void* parameter, UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core);
+void vTaskDelay(TickType_t ticks);
+void taskYieldHost();
+#define taskYIELD() taskYieldHost()
+// Stack use isn't measured on the host: reports the whole stack as free
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+#endif // HOST_FREERTOS_TASK_H
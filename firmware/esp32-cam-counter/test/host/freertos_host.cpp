@@ -0,0 +1,130 @@
+/**
+ * SwanFlow - Host FreeRTOS Shim Implementation
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+// Wait on cv until ready() or the ticks run out
+template <typename Ready>
+static bool waitFor(std::condition_variable& cv, std::unique_lock<std::mutex>& lock,
+                    TickType_t wait, Ready ready) {
+  if (wait == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(wait), ready);
+}
+
+// ============================================================================
+// Tasks
+// ============================================================================
+static const uint32_t HOST_STACK_DEPTH_UNKNOWN = 0;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stackDepth,
+                                   void* parameter, UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core) {
+  std::thread(task, parameter).detach();
+  if (created) *created = nullptr;
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+void taskYieldHost() {
+  std::this_thread::yield();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  return HOST_STACK_DEPTH_UNKNOWN;
+}
+
+// ============================================================================
+// Queues
+// ============================================================================
+struct HostQueue {
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<std::vector<uint8_t>> items;
+  size_t length;
+  size_t itemSize;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostQueue* queue = new HostQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t wait) {
+  HostQueue* queue = (HostQueue*)handle;
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue->changed, lock, wait, [&] { return queue->items.size() < queue->length; })) {
+    return pdFAIL;
+  }
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* item, TickType_t wait) {
+  HostQueue* queue = (HostQueue*)handle;
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue->changed, lock, wait, [&] { return !queue->items.empty(); })) {
+    return pdFAIL;
+  }
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+  HostQueue* queue = (HostQueue*)handle;
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+// ============================================================================
+// Mutexes
+// ============================================================================
+struct HostMutex {
+  std::mutex mutex;
+  std::condition_variable released;
+  bool held;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  HostMutex* mutex = new HostMutex();
+  mutex->held = false;
+  return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t wait) {
+  HostMutex* mutex = (HostMutex*)handle;
+  std::unique_lock<std::mutex> lock(mutex->mutex);
+  if (!waitFor(mutex->released, lock, wait, [&] { return !mutex->held; })) return pdFALSE;
+  mutex->held = true;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+  HostMutex* mutex = (HostMutex*)handle;
+  std::lock_guard<std::mutex> lock(mutex->mutex);
+  mutex->held = false;
+  mutex->released.notify_one();
+  return pdTRUE;
+}
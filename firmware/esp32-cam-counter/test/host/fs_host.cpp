@@ -0,0 +1,134 @@
+/**
+ * SwanFlow - Host File System Shim Implementation
+ */
+
+#include "FS.h"
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <string.h>
+
+namespace fs {
+
+// ============================================================================
+// File
+// ============================================================================
+File::File(FILE* file, const std::string& path, HostFsStats* stats) {
+  if (!file) return;
+  handle = std::make_shared<Handle>();
+  handle->file = file;
+  handle->path = path;
+  handle->stats = stats;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!*this) return 0;
+  size_t n = fwrite(buffer, 1, size, handle->file);
+  handle->stats->writes++;
+  handle->stats->bytesWritten += n;
+  return n;
+}
+
+int File::available() {
+  if (!*this) return 0;
+  size_t pos = position();
+  size_t end = size();
+  return end > pos ? (int)(end - pos) : 0;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  if (!*this) return -1;
+  int c = fgetc(handle->file);
+  if (c != EOF) ungetc(c, handle->file);
+  return c == EOF ? -1 : c;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!*this) return 0;
+  size_t n = fread(buffer, 1, size, handle->file);
+  handle->stats->reads++;
+  handle->stats->bytesRead += n;
+  return n;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!*this) return false;
+  handle->stats->seeks++;
+  int whence = mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END;
+  return fseek(handle->file, pos, whence) == 0;
+}
+
+size_t File::position() const {
+  return *this ? ftell(handle->file) : 0;
+}
+
+size_t File::size() const {
+  if (!*this) return 0;
+  fflush(handle->file);
+  struct stat st;
+  return fstat(fileno(handle->file), &st) == 0 ? st.st_size : 0;
+}
+
+void File::flush() {
+  if (!*this) return;
+  handle->stats->flushes++;
+  fflush(handle->file);
+}
+
+void File::close() {
+  handle.reset();
+}
+
+// ============================================================================
+// FS
+// ============================================================================
+FS::FS(const char* path) {
+  memset(&stats, 0, sizeof(stats));
+  setRoot(path);
+}
+
+void FS::setRoot(const char* path) {
+  root = path;
+  ::mkdir(root.c_str(), 0755);
+}
+
+void FS::clear() {
+  std::string cmd = "rm -rf '" + root + "'/*";
+  if (system(cmd.c_str()) != 0) return;
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  std::string full = root + path;
+  stats.opens++;
+  bool existed = access(full.c_str(), F_OK) == 0;
+  // "r+" on a missing file fails, as on the card
+  FILE* file = fopen(full.c_str(), strcmp(mode, "a") == 0 ? "a+" : mode);
+  if (file && !existed) stats.creates++;
+  return File(file, full, &stats);
+}
+
+bool FS::exists(const char* path) {
+  stats.lookups++;
+  struct stat st;
+  return stat((root + path).c_str(), &st) == 0;
+}
+
+bool FS::mkdir(const char* path) {
+  stats.lookups++;
+  return ::mkdir((root + path).c_str(), 0755) == 0;
+}
+
+bool FS::remove(const char* path) {
+  return ::remove((root + path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+  return ::rename((root + from).c_str(), (root + to).c_str()) == 0;
+}
+
+} // namespace fs
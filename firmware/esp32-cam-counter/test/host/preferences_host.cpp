@@ -0,0 +1,46 @@
+/**
+ * SwanFlow - Host Preferences Shim Implementation
+ */
+
+#include <Preferences.h>
+#include <map>
+#include <vector>
+
+// "namespace/key" -> value
+static std::map<std::string, std::vector<uint8_t> > nvs;
+
+static bool hasNamespace(const std::string& name) {
+  std::map<std::string, std::vector<uint8_t> >::const_iterator it = nvs.lower_bound(name + "/");
+  return it != nvs.end() && it->first.compare(0, name.size() + 1, name + "/") == 0;
+}
+
+bool Preferences::begin(const char* ns, bool ro) {
+  name = ns;
+  readOnly = ro;
+  opened = !readOnly || hasNamespace(name);
+  return opened;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  if (!opened) return 0;
+  std::map<std::string, std::vector<uint8_t> >::const_iterator it = nvs.find(name + "/" + key);
+  if (it == nvs.end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (!opened || readOnly) return 0;
+  const uint8_t* bytes = (const uint8_t*)value;
+  nvs[name + "/" + key].assign(bytes, bytes + len);
+  return len;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!opened || readOnly) return false;
+  return nvs.erase(name + "/" + key) > 0;
+}
+
+void hostNvsErase() {
+  nvs.clear();
+}
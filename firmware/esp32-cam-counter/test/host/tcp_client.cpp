@@ -0,0 +1,127 @@
+/**
+ * SwanFlow - Host TCP Client Implementation
+ */
+
+#include "tcp_client.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+static void sleepMs(uint32_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// ============================================================================
+// Connection
+// ============================================================================
+int HostTcpClient::connect(const char* host, uint16_t port) {
+  stop();
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return 0;
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+  sleepMs(2 * latencyMs);
+  if (::connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void HostTcpClient::stop() {
+  if (fd >= 0) ::close(fd);
+  fd = -1;
+  bufferPos = bufferEnd = 0;
+}
+
+// ============================================================================
+// Data
+// ============================================================================
+size_t HostTcpClient::write(const uint8_t* data, size_t size) {
+  if (fd < 0) return 0;
+  lastWrite = millis();
+  ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+  return n < 0 ? 0 : n;
+}
+
+int HostTcpClient::available() {
+  if (fd < 0) return 0;
+  if (bufferEnd > bufferPos) return bufferEnd - bufferPos;
+  if (millis() - lastWrite < latencyMs) return 0;
+
+  ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+  if (n > 0) {
+    bufferPos = 0;
+    bufferEnd = n;
+    return n;
+  }
+
+  // Closed by the server (or reset): noticed only now, as with the modem
+  if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) stop();
+  return 0;
+}
+
+int HostTcpClient::read() {
+  if (available() <= 0) return -1;
+  return buffer[bufferPos++];
+}
+
+int HostTcpClient::read(uint8_t* data, size_t size) {
+  size_t n = 0;
+  while (n < size && available() > 0) {
+    size_t chunk = min(size - n, bufferEnd - bufferPos);
+    memcpy(data + n, buffer + bufferPos, chunk);
+    bufferPos += chunk;
+    n += chunk;
+  }
+  return n;
+}
+
+// ============================================================================
+// Stand-in Server
+// ============================================================================
+static FILE* standIn = nullptr;
+static pid_t standInPid = 0;
+
+bool hostStandInStart(uint16_t port, uint32_t keepAliveMs) {
+  char command[256];
+  snprintf(command, sizeof(command), "exec node %s/stand_in_server.js %u %lu 2>/dev/null", TEST_DIR,
+           port, (unsigned long)keepAliveMs);
+  standIn = popen(command, "r");
+  if (!standIn) return false;
+
+  char line[64];
+  long pid = 0;
+  if (!fgets(line, sizeof(line), standIn) || sscanf(line, "ready %ld", &pid) != 1) {
+    pclose(standIn);
+    standIn = nullptr;
+    return false;
+  }
+  standInPid = pid;
+  return true;
+}
+
+void hostStandInStop() {
+  if (!standIn) return;
+  kill(standInPid, SIGTERM);
+  pclose(standIn);
+  standIn = nullptr;
+}
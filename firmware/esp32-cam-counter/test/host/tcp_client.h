@@ -0,0 +1,56 @@
+/**
+ * SwanFlow - Host TCP Client
+ *
+ * Arduino Client over a host socket to 127.0.0.1, standing in for the
+ * modem's TinyGsmClient. Like the modem, it only learns the server has
+ * closed the connection when it next reads.
+ *
+ * Latency can be emulated: opening a connection takes two round trips
+ * (handshake, then the modem reporting it open) and a response is held
+ * back one round trip after the last write.
+ *
+ * Also starts test/stand_in_server.js (needs Node.js) for tests that talk
+ * to a server.
+ */
+
+#ifndef HOST_TCP_CLIENT_H
+#define HOST_TCP_CLIENT_H
+
+#include <Arduino.h>
+
+class HostTcpClient : public Client {
+public:
+  HostTcpClient() : fd(-1), bufferPos(0), bufferEnd(0), latencyMs(0), lastWrite(0) {}
+  ~HostTcpClient() { stop(); }
+
+  void setLatency(uint32_t roundTripMs) { latencyMs = roundTripMs; }
+
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buffer, size_t size) override;
+  int peek() override { return available() > 0 ? buffer[bufferPos] : -1; }
+  void stop() override;
+  uint8_t connected() override { return fd >= 0; }
+  operator bool() override { return fd >= 0; }
+
+private:
+  int fd;
+  uint8_t buffer[1460];  // Received, not yet read
+  size_t bufferPos;
+  size_t bufferEnd;
+  uint32_t latencyMs;
+  unsigned long lastWrite;
+};
+
+// ============================================================================
+// Stand-in Server
+// ============================================================================
+// Start stand_in_server.js on port; false if Node.js isn't available
+bool hostStandInStart(uint16_t port, uint32_t keepAliveMs);
+void hostStandInStop();
+
+#endif // HOST_TCP_CLIENT_H
@@ -0,0 +1,145 @@
+/**
+ * SwanFlow - Host UDP Client Implementation
+ */
+
+#include "udp_client.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+// ============================================================================
+// Socket
+// ============================================================================
+uint8_t HostUdp::begin(uint16_t localPort) {
+  stop();
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) return 0;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(localPort);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void HostUdp::stop() {
+  if (fd >= 0) ::close(fd);
+  fd = -1;
+  rxLength = rxPos = 0;
+  awaitingReply = false;
+}
+
+// ============================================================================
+// Sending
+// ============================================================================
+// Opened on first use, on a port of the system's choice, as the modem does
+int HostUdp::beginPacket(const char* host, uint16_t toPort) {
+  if (fd < 0 && !begin(0)) return 0;
+  port = toPort;
+  tx.clear();
+  return 1;
+}
+
+size_t HostUdp::write(const uint8_t* data, size_t size) {
+  tx.insert(tx.end(), data, data + size);
+  return size;
+}
+
+// Unconnected, so a peer that has gone away is just silence
+int HostUdp::endPacket() {
+  if (fd < 0) return 0;
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  if (sendto(fd, tx.data(), tx.size(), 0, (sockaddr*)&addr, sizeof(addr)) != (ssize_t)tx.size()) {
+    return 0;
+  }
+
+  sentDatagrams.push_back(tx);
+  awaitingReply = true;
+  return 1;
+}
+
+// ============================================================================
+// Receiving
+// ============================================================================
+int HostUdp::parsePacket() {
+  rxLength = rxPos = 0;
+  if (!injected.empty()) {
+    rxLength = injected.front().size();
+    memcpy(rx, injected.front().data(), rxLength);
+    injected.erase(injected.begin());
+    return rxLength;
+  }
+  if (fd < 0) return 0;
+
+  if (awaitingReply && replyWaitMs > 0) {
+    pollfd ready = { fd, POLLIN, 0 };
+    ::poll(&ready, 1, replyWaitMs);
+  }
+
+  ssize_t n = recv(fd, rx, sizeof(rx), MSG_DONTWAIT);
+  if (n <= 0) return 0;
+  awaitingReply = false;
+
+  if (drop > 0) {
+    drop--;
+    return 0;
+  }
+  rxLength = n;
+  return n;
+}
+
+int HostUdp::read(unsigned char* buffer, size_t len) {
+  size_t n = min(len, rxLength - rxPos);
+  memcpy(buffer, rx + rxPos, n);
+  rxPos += n;
+  return n;
+}
+
+// ============================================================================
+// Stand-in Gateway
+// ============================================================================
+static FILE* gateway = nullptr;
+static pid_t gatewayPid = 0;
+
+bool hostGatewayStart(uint16_t udpPort, uint16_t httpPort) {
+  char command[256];
+  snprintf(command, sizeof(command), "exec node %s/stand_in_gateway.js %u %u 2>/dev/null", TEST_DIR,
+           udpPort, httpPort);
+  gateway = popen(command, "r");
+  if (!gateway) return false;
+
+  char line[64];
+  long pid = 0;
+  if (!fgets(line, sizeof(line), gateway) || sscanf(line, "ready %ld", &pid) != 1) {
+    pclose(gateway);
+    gateway = nullptr;
+    return false;
+  }
+  gatewayPid = pid;
+  return true;
+}
+
+void hostGatewayStop() {
+  if (!gateway) return;
+  kill(gatewayPid, SIGTERM);
+  pclose(gateway);
+  gateway = nullptr;
+}
@@ -0,0 +1,78 @@
+/**
+ * SwanFlow - Host UDP Client
+ *
+ * Arduino UDP over a host socket to 127.0.0.1, standing in for the
+ * modem's socket (ModemUdp). Datagrams go to a host by name, which is
+ * ignored, as the TCP client does.
+ *
+ * For tests: every datagram sent is kept, received ones can be dropped
+ * (a lost answer) or injected (one that never came from the peer), and
+ * parsePacket() can wait a little for the answer to what was just sent,
+ * so a test on the simulated clock doesn't outrun a real peer.
+ *
+ * Also starts test/stand_in_gateway.js (needs Node.js), the backend's
+ * MQTT-SN gateway forwarding to the stand-in server.
+ */
+
+#ifndef HOST_UDP_CLIENT_H
+#define HOST_UDP_CLIENT_H
+
+#include <Arduino.h>
+#include <Udp.h>
+#include <vector>
+
+class HostUdp : public UDP {
+public:
+  HostUdp() : fd(-1), port(0), rxLength(0), rxPos(0), drop(0), replyWaitMs(0), awaitingReply(false) {}
+  ~HostUdp() { stop(); }
+
+  // Lose the next count datagrams received
+  void dropIncoming(uint32_t count) { drop = count; }
+  // Have parsePacket() return this datagram before anything received
+  void inject(const std::vector<uint8_t>& datagram) { injected.push_back(datagram); }
+  // Wait up to ms (real time) for a datagram after sending one
+  void setReplyWait(uint32_t ms) { replyWaitMs = ms; }
+  const std::vector<std::vector<uint8_t> >& sent() const { return sentDatagrams; }
+
+  uint8_t begin(uint16_t localPort) override;
+  void stop() override;
+  int beginPacket(IPAddress ip, uint16_t port) override { return 0; }
+  int beginPacket(const char* host, uint16_t port) override;
+  int endPacket() override;
+  size_t write(uint8_t data) override { return write(&data, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int parsePacket() override;
+  int available() override { return rxLength - rxPos; }
+  int read() override { return rxPos < rxLength ? rx[rxPos++] : -1; }
+  int read(unsigned char* buffer, size_t len) override;
+  int read(char* buffer, size_t len) override { return read((unsigned char*)buffer, len); }
+  int peek() override { return rxPos < rxLength ? rx[rxPos] : -1; }
+  void flush() override {}
+  IPAddress remoteIP() override { return IPAddress(127, 0, 0, 1); }
+  uint16_t remotePort() override { return port; }
+
+private:
+  int fd;
+  uint16_t port;
+  std::vector<uint8_t> tx;
+  uint8_t rx[65536];
+  size_t rxLength;
+  size_t rxPos;
+
+  uint32_t drop;
+  std::vector<std::vector<uint8_t> > injected;
+  uint32_t replyWaitMs;
+  bool awaitingReply;  // Sent since the last datagram received
+  std::vector<std::vector<uint8_t> > sentDatagrams;
+};
+
+// ============================================================================
+// Stand-in Gateway
+// ============================================================================
+// Start stand_in_gateway.js on udpPort, forwarding to the stand-in server
+// on httpPort; false if Node.js isn't available
+bool hostGatewayStart(uint16_t udpPort, uint16_t httpPort);
+void hostGatewayStop();
+
+#endif // HOST_UDP_CLIENT_H
@@ -0,0 +1,251 @@
+/**
+ * SwanFlow - HTTP Response Parser Test
+ *
+ * Known responses fed in random splits, then a fuzz run over generated
+ * input: a response must parse the same however its bytes arrive, never
+ * take a byte past its end (the next response on the connection starts
+ * there), and never allocate.
+ */
+
+#include "http_response_parser.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+// Heap allocations, to check the parser makes none
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  allocations++;
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+static const char* CAPTURE = "X-SwanFlow-Request";
+
+// ============================================================================
+// Feeding
+// ============================================================================
+struct Outcome {
+  HttpParseResult result;
+  size_t used;  // Bytes taken
+  int status;
+  bool keepAlive;
+  std::string captured;
+
+  bool operator==(const Outcome& o) const {
+    return result == o.result && used == o.used && status == o.status &&
+           keepAlive == o.keepAlive && captured == o.captured;
+  }
+};
+
+// Feed s in pieces of 1 to maxPiece bytes (all at once if 0), as reads
+// from the modem would split it. A piece is only cut short by the end
+// of the response.
+static Outcome feedSplit(HttpResponseParser& parser, const std::string& s, uint32_t seed,
+                         size_t maxPiece, bool& shortRead) {
+  Outcome out;
+  out.result = HTTP_PARSE_MORE;
+  out.used = 0;
+  shortRead = false;
+
+  while (out.used < s.size() && out.result == HTTP_PARSE_MORE) {
+    seed = seed * 1103515245 + 12345;
+    size_t n = maxPiece ? 1 + (seed >> 16) % maxPiece : s.size();
+    if (n > s.size() - out.used) n = s.size() - out.used;
+
+    size_t consumed = 0;
+    out.result = parser.feed((const uint8_t*)s.data() + out.used, n, consumed);
+    out.used += consumed;
+    if (consumed > n || (consumed < n && out.result == HTTP_PARSE_MORE)) shortRead = true;
+  }
+
+  out.status = parser.getStatus();
+  out.keepAlive = parser.isKeepAlive();
+  out.captured = parser.getCaptured();
+  return out;
+}
+
+// ============================================================================
+// Known Responses
+// ============================================================================
+struct Case {
+  const char* response;
+  HttpParseResult result;
+  int status;
+  bool keepAlive;
+  const char* captured;
+};
+
+static const Case CASES[] = {
+  { "HTTP/1.1 200 OK\r\nContent-Length: 5\r\nX-SwanFlow-Request: heatmap\r\n\r\nhello",
+    HTTP_PARSE_DONE, 200, true, "heatmap" },
+  { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhe200\r\na;x=1\r\n0123456789\r\n"
+    "0\r\nTrailer: x\r\n\r\n",
+    HTTP_PARSE_DONE, 200, true, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: 10\r\nTransfer-Encoding: gzip, chunked\r\n\r\n3\r\nabc\r\n0\r\n\r\n",
+    HTTP_PARSE_DONE, 200, true, "" },
+  { "HTTP/1.1 404 Not Found\r\nContent-Length: 3\r\nConnection: close\r\n\r\n200",
+    HTTP_PARSE_DONE, 404, false, "" },
+  { "HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n", HTTP_PARSE_DONE, 200, false, "" },
+  { "HTTP/1.1 204 No Content\r\n\r\n", HTTP_PARSE_DONE, 204, false, "" },
+  { "HTTP/1.1 201 Created\nContent-Length: 2\n\nok", HTTP_PARSE_DONE, 201, true, "" },
+
+  // Interim responses are skipped; the final one decides
+  { "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 201 Created\r\nContent-Length: 2\r\n\r\nok",
+    HTTP_PARSE_DONE, 201, true, "" },
+  { "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 102 Processing\r\n\r\n"
+    "HTTP/1.1 103 Early Hints\r\nX-SwanFlow-Request: early\r\n\r\n"
+    "HTTP/1.1 500 Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n",
+    HTTP_PARSE_DONE, 500, false, "" },
+  { "HTTP/1.1 100 Continue\r\nContent-Length: 5\r\n\r\nHTTP/1.1 200 OK\r\nX-SwanFlow-Request: heatmap\r\n"
+    "Transfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+    HTTP_PARSE_DONE, 200, true, "heatmap" },
+
+  { "garbage 200\r\n", HTTP_PARSE_ERROR, 0, false, "" },
+  { "HTTP/1.1 2x0 OK\r\n", HTTP_PARSE_ERROR, 0, false, "" },
+  { "HTTP/1.1 2000 OK\r\nContent-Length: 0\r\n\r\n", HTTP_PARSE_ERROR, 0, false, "" },
+  { "HTTP/1.1 20\r\n", HTTP_PARSE_ERROR, 0, false, "" },
+  { "HTTP/1.1 200\r\nContent-Length: 2\r\n\r\nok", HTTP_PARSE_DONE, 200, true, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: 2 \r\n\r\nok", HTTP_PARSE_DONE, 200, true, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: abc\r\n\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: 12x\r\n\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: \r\n\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: 4294967296\r\n\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nContent-Length: 99999999999999999999999\r\n\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n\r\n", HTTP_PARSE_ERROR, 101, false, "" },
+  { "HTTP/1.1 100 Continue\r\n\r\nnot a status line\r\n", HTTP_PARSE_ERROR, 0, false, "" },
+  { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nFFFFFFFFF\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+  { "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nabX\r\n", HTTP_PARSE_ERROR, 200, false, "" },
+};
+
+// Each in 200 different splits, with the next response's bytes after
+// it: the same outcome every time, and nothing of the next one taken
+static void testKnownResponses() {
+  const std::string next = "HTTP/1.1 200 OK\r\n";
+
+  for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); c++) {
+    const Case& expected = CASES[c];
+    std::string input = std::string(expected.response) + next;
+    size_t length = strlen(expected.response);
+    int wrong = 0;
+
+    for (uint32_t seed = 0; seed < 200; seed++) {
+      HttpResponseParser parser;
+      parser.begin(CAPTURE);
+      bool shortRead;
+      Outcome out = feedSplit(parser, input, seed, seed == 0 ? 0 : 1 + seed % 23, shortRead);
+
+      bool ok = !shortRead && out.result == expected.result;
+      if (expected.result == HTTP_PARSE_DONE) {
+        ok = ok && out.used == length && out.status == expected.status &&
+             out.keepAlive == expected.keepAlive && out.captured == expected.captured;
+      }
+      if (!ok) wrong++;
+    }
+
+    if (wrong) printf("FAIL case %d: %d of 200 splits\n", (int)c, wrong);
+    CHECK(wrong == 0);
+  }
+}
+
+// Stats count what was skipped and seen
+static void testStats() {
+  HttpResponseParser parser;
+  std::string s = CASES[8].response;
+  bool shortRead;
+  feedSplit(parser, s, 1, 5, shortRead);
+  CHECK(parser.getStats().interim == 3 && parser.getStats().responses == 1);
+
+  parser.begin();
+  feedSplit(parser, CASES[1].response, 2, 7, shortRead);
+  CHECK(parser.getStats().chunkedBodies == 1 && parser.getStats().chunks == 2);
+  CHECK(parser.getStats().responses == 2 && parser.getStats().errors == 0);
+}
+
+// ============================================================================
+// Fuzz
+// ============================================================================
+static const char* FRAGMENTS[] = {
+  "HTTP/1.1 200 OK\r\n", "HTTP/1.1 100 Continue\r\n", "HTTP/1.0 503 Busy\r\n", "Content-Length: ",
+  "Transfer-Encoding: chunked\r\n", "Connection: close\r\n", "X-SwanFlow-Request: heatmap\r\n",
+  "\r\n", "\n", "0", "5", "a", ":", ";", " ", "FFFF", "1\r\nx\r\n", "12345", "4294967296",
+};
+
+// Random responses built from pieces of real ones: whatever the split,
+// the outcome matches feeding it whole, bytes are never over-read, and
+// nothing is allocated
+static void testFuzz() {
+  const int INPUTS = 200000;
+  const size_t fragmentCount = sizeof(FRAGMENTS) / sizeof(FRAGMENTS[0]);
+  uint32_t seed = 42;
+  unsigned long done = 0, rejected = 0, mismatched = 0, overRead = 0;
+  size_t allocated = 0;
+  std::string input;
+  input.reserve(1024);
+
+  for (int i = 0; i < INPUTS; i++) {
+    input.clear();
+    seed = seed * 1103515245 + 12345;
+    size_t length = (seed >> 16) % 400;
+    while (input.size() < length) {
+      seed = seed * 1103515245 + 12345;
+      uint32_t r = seed >> 8;
+      if (r % 4) {
+        input += FRAGMENTS[(r >> 4) % fragmentCount];
+      } else {
+        input += (char)(r >> 4);
+      }
+    }
+
+    size_t before = allocations;
+    HttpResponseParser whole, split;
+    whole.begin(CAPTURE);
+    split.begin(CAPTURE);
+    bool shortWhole, shortSplit;
+    Outcome a = feedSplit(whole, input, 0, 0, shortWhole);
+    Outcome b = feedSplit(split, input, seed, 1 + i % 31, shortSplit);
+    allocated += allocations - before;
+
+    if (shortWhole || shortSplit || a.used > input.size()) overRead++;
+    if (!(a == b)) mismatched++;
+    if (a.result == HTTP_PARSE_DONE) done++;
+    if (a.result == HTTP_PARSE_ERROR) rejected++;
+  }
+
+  printf("fuzz: %d inputs, %lu complete, %lu rejected, %lu split mismatches, %lu over-reads, "
+         "%lu allocations\n",
+         INPUTS, done, rejected, mismatched, overRead, (unsigned long)allocated);
+  CHECK(mismatched == 0 && overRead == 0 && allocated == 0);
+  CHECK(done > 0 && rejected > 0);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testKnownResponses();
+  testStats();
+  testFuzz();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * SwanFlow - HTTP Connection Test
+ *
+ * HttpConnection against stand_in_server.js over a host socket: keep-alive
+ * reuse, a slow answer on a reused connection (must not be sent twice),
+ * and a connection the server closed while idle (retried once). Skipped
+ * without Node.js.
+ */
+
+#include "http_connection.h"
+#include "tcp_client.h"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static const uint16_t PORT = 18431;
+static const uint32_t SERVER_KEEPALIVE_MS = 500;
+
+static HostTcpClient client;
+static HttpConnection http;
+static uint8_t body[260];  // About a JSON stats upload
+
+static bool post(const char* url) {
+  if (!http.start(url, "application/json", body, sizeof(body))) return false;
+  while (http.poll()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+  return http.succeeded();
+}
+
+// Requests the server has received, from the last response
+static int serverRequests() {
+  return atoi(http.getCapturedHeader());
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+static void testKeepAlive() {
+  CHECK(post("http://127.0.0.1:18431/api/detections"));
+  CHECK(post("http://127.0.0.1:18431/api/detections"));
+  CHECK(http.getStats().connects == 1 && http.getStats().reused == 1);
+  CHECK(serverRequests() == 2);
+}
+
+// Slower than the old 5 s first-byte limit for reused connections, which
+// sent the POST again
+static void testSlowAnswer() {
+  uint32_t connects = http.getStats().connects;
+  CHECK(post("http://127.0.0.1:18431/api/incidents?delay=6000"));
+  CHECK(http.getStats().stale == 0 && http.getStats().connects == connects);
+  CHECK(serverRequests() == 3);
+}
+
+// The server drops the idle connection; the client only finds out when it
+// reuses it, and sends the request again on a new one
+static void testClosedWhileIdle() {
+  // Node closes idle sockets up to a second after keepAliveTimeout
+  std::this_thread::sleep_for(std::chrono::milliseconds(SERVER_KEEPALIVE_MS + 1500));
+  uint32_t connects = http.getStats().connects;
+  CHECK(post("http://127.0.0.1:18431/api/detections"));
+  CHECK(http.getStats().stale == 1 && http.getStats().connects == connects + 1);
+  CHECK(serverRequests() == 4);
+}
+
+// Connection: close from the server is honoured
+static void testServerClose() {
+  uint32_t connects = http.getStats().connects;
+  CHECK(post("http://127.0.0.1:18431/api/detections?close=1"));
+  CHECK(post("http://127.0.0.1:18431/api/detections"));
+  CHECK(http.getStats().connects == connects + 1 && http.getStats().stale == 1);
+  CHECK(serverRequests() == 6);
+}
+
+int main() {
+  hostSerialOutput(false);
+  hostRealClock(true);
+
+  if (!hostStandInStart(PORT, SERVER_KEEPALIVE_MS)) {
+    printf("skipped: Node.js not found\n");
+    return 0;
+  }
+
+  memset(body, 'x', sizeof(body));
+  http.begin(client);
+  http.setCaptureHeader("X-Requests");
+
+  testKeepAlive();
+  testSlowAnswer();
+  testClosedWhileIdle();
+  testServerClose();
+  hostStandInStop();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
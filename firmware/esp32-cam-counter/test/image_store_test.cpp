@@ -0,0 +1,266 @@
+/**
+ * SwanFlow - Image Store Test
+ *
+ * ImageStore on the host file system, filled past its quota: the files
+ * stay at their preallocated size, each store replaces the image with the
+ * lowest retention score (the oldest, unless flagged as worth keeping),
+ * whether the victim came from the maintain() sweep or a full scan, and
+ * the index loads again after writes torn by a reset.
+ */
+
+#include "image_store.h"
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static const char* ROOT = "/tmp/swanflow-test-images";
+static const uint32_t SLOTS = ImageStore::SLOTS;
+static const uint32_t BONUS = SLOTS * IMAGE_KEEP_BONUS_PERCENT / 100;
+
+static fs::FS sd(ROOT);
+static ImageStore* store = nullptr;
+static uint8_t image[ImageStore::SLOT_SIZE];
+static uint8_t readBack[ImageStore::SLOT_SIZE];
+
+// What the test stored and expects still to be there, by seq
+static std::map<uint32_t, ImageEntry> held;
+static uint32_t lastSeq = 0;
+
+static void open() {
+  delete store;  // Closes its files
+  store = new ImageStore();
+  CHECK(store->begin(sd));
+}
+
+// A recognisable image for seq: its size and bytes follow from it
+static size_t makeImage(uint32_t seq) {
+  size_t length = 100 + (seq * 37) % 700;
+  for (size_t i = 0; i < length; i++) image[i] = (uint8_t)(seq * 131 + i * 7);
+  memcpy(image, &seq, 4);
+  return length;
+}
+
+static uint32_t score(const ImageEntry& entry) {
+  uint32_t s = entry.seq;
+  if (entry.flags & IMAGE_LOW_CONFIDENCE) s += BONUS;
+  if (entry.flags & IMAGE_HIGH_VALUE) s += BONUS;
+  return s;
+}
+
+static bool present(const ImageEntry& entry) {
+  return store->read(entry, readBack, sizeof(readBack)) == IMAGE_READ_OK;
+}
+
+// Store the next image and check what it replaced: nothing while there
+// are free slots, then one of the lowest-scoring images held
+static void storeNext(uint8_t flags) {
+  uint32_t lowest = UINT32_MAX;
+  for (std::map<uint32_t, ImageEntry>::const_iterator it = held.begin(); it != held.end(); ++it) {
+    lowest = min(lowest, score(it->second));
+  }
+
+  ImageMeta meta;
+  memset(&meta, 0, sizeof(meta));
+  meta.timestamp = lastSeq * 1000;
+  meta.vehicles = 1;
+  meta.flags = flags;
+  size_t length = makeImage(lastSeq + 1);
+  uint32_t evicted = store->getStats().evicted;
+  CHECK(store->store(meta, image, length));
+
+  ImageEntry entry;
+  CHECK(store->find(lastSeq, entry) && entry.seq == lastSeq + 1 && entry.size == length);
+  lastSeq = entry.seq;
+
+  if (held.size() < SLOTS) {
+    CHECK(store->getStats().evicted == evicted);
+  } else {
+    CHECK(store->getStats().evicted == evicted + 1);
+    int gone = 0;
+    for (std::map<uint32_t, ImageEntry>::iterator it = held.begin(); it != held.end();) {
+      if (score(it->second) == lowest && !present(it->second)) {
+        held.erase(it++);
+        gone++;
+      } else {
+        ++it;
+      }
+    }
+    CHECK(gone == 1);
+  }
+  held[entry.seq] = entry;
+}
+
+static void checkAllHeld() {
+  int wrong = 0;
+  for (std::map<uint32_t, ImageEntry>::const_iterator it = held.begin(); it != held.end(); ++it) {
+    size_t length = makeImage(it->first);
+    if (store->read(it->second, readBack, sizeof(readBack)) != IMAGE_READ_OK ||
+        it->second.size != length || memcmp(readBack, image, length) != 0) {
+      wrong++;
+    }
+  }
+  CHECK(wrong == 0);
+}
+
+// Slot an image's data is in (images start with their seq)
+static int32_t slotOf(uint32_t seq) {
+  File data = sd.open("/images/data.bin", FILE_READ);
+  for (uint32_t slot = 0; slot < SLOTS; slot++) {
+    uint32_t first = 0;
+    data.seek(slot * ImageStore::SLOT_SIZE);
+    data.read((uint8_t*)&first, 4);
+    if (first == seq) return slot;
+  }
+  return -1;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// Past the quota, with no idle time: each store scans for its victim,
+// and the oldest goes first
+static void testOldestFirst() {
+  sd.clear();
+  open();
+  CHECK(store->isReady() && store->getStats().images == 0);
+
+  for (uint32_t i = 0; i < SLOTS + 200; i++) storeNext(0);
+
+  ImageStoreStats stats = store->getStats();
+  CHECK(stats.images == SLOTS && stats.evicted == 200 && stats.stored == SLOTS + 200);
+  CHECK(held.size() == SLOTS && held.begin()->first == 201);
+  ImageEntry oldest;
+  CHECK(store->find(0, oldest) && oldest.seq == 201);
+
+  uint32_t used = 0;
+  for (std::map<uint32_t, ImageEntry>::const_iterator it = held.begin(); it != held.end(); ++it) {
+    used += it->second.size;
+  }
+  CHECK(stats.usedBytes == used);
+
+  // The files never grow past what was preallocated
+  File data = sd.open("/images/data.bin", FILE_READ);
+  CHECK(data.size() == SLOTS * ImageStore::SLOT_SIZE);
+  checkAllHeld();
+}
+
+// Flagged images outlive BONUS stores' worth of unflagged ones; with the
+// sweep given idle time between stores, no store has to scan
+static void testRetentionWithSweep() {
+  uint32_t scans = store->getStats().fullScans;
+  for (uint32_t i = 0; i < SLOTS + SLOTS / 2; i++) {
+    for (uint32_t step = 0; step <= SLOTS / IMAGE_MAINTAIN_ENTRIES; step++) store->maintain();
+    uint8_t flags = 0;
+    if (i % 7 == 0) flags |= IMAGE_LOW_CONFIDENCE;
+    if (i % 11 == 0) flags |= IMAGE_HIGH_VALUE;
+    storeNext(flags);
+  }
+  CHECK(store->getStats().fullScans == scans);
+
+  // Held: recent unflagged images, and flagged ones further back
+  uint32_t oldestPlain = UINT32_MAX, oldestFlagged = UINT32_MAX;
+  for (std::map<uint32_t, ImageEntry>::const_iterator it = held.begin(); it != held.end(); ++it) {
+    uint32_t& oldest = it->second.flags ? oldestFlagged : oldestPlain;
+    oldest = min(oldest, it->first);
+  }
+  CHECK(oldestFlagged < oldestPlain);
+  checkAllHeld();
+}
+
+// The index reloads from the card as it was left
+static void testReopen() {
+  open();
+  ImageStoreStats stats = store->getStats();
+  CHECK(stats.images == SLOTS && stats.evicted == 0);
+  checkAllHeld();
+
+  // Numbering carries on after the newest image on the card
+  storeNext(0);
+  CHECK(held.rbegin()->first == lastSeq);
+}
+
+// A reset in the middle of an index sector write leaves the sector half
+// new and half old; a reset between an image's data and its entry leaves
+// the old entry over new data. The index still loads: torn entries free
+// their slots, and an entry whose data changed is never served.
+static void testTornWrites() {
+  delete store;
+  store = nullptr;
+
+  // Half of index sector 3 overwritten with another sector's bytes
+  File index = sd.open("/images/index.bin", "r+");
+  uint8_t sector[ImageStore::SECTOR_SIZE];
+  index.seek(10 * ImageStore::SECTOR_SIZE);
+  index.read(sector, sizeof(sector));
+  index.seek(3 * ImageStore::SECTOR_SIZE + ImageStore::SECTOR_SIZE / 2 + 8);
+  index.write(sector, ImageStore::SECTOR_SIZE / 2 - 8);
+  index.close();
+
+  // New data in the slot of a held image, its entry not yet rewritten
+  uint32_t overwritten = held.rbegin()->first - 100;
+  int32_t slot = slotOf(overwritten);
+  CHECK(slot >= 0);
+  File data = sd.open("/images/data.bin", "r+");
+  data.seek(slot * ImageStore::SLOT_SIZE);
+  data.write(image, 64);
+  data.close();
+
+  open();
+  ImageStoreStats stats = store->getStats();
+  uint32_t torn = SLOTS - stats.images;
+  CHECK(torn >= ImageStore::ENTRIES_PER_SECTOR / 2 - 1 && torn <= ImageStore::ENTRIES_PER_SECTOR / 2);
+
+  // Exactly the held images without a valid entry are gone from find()
+  uint32_t listed = 0;
+  ImageEntry entry;
+  for (uint32_t after = 0; store->find(after, entry); after = entry.seq) {
+    CHECK(held.count(entry.seq) == 1);
+    listed++;
+  }
+  CHECK(listed == stats.images);
+  CHECK(!present(held[overwritten]));
+  held.erase(overwritten);
+
+  int wrong = 0;
+  for (std::map<uint32_t, ImageEntry>::iterator it = held.begin(); it != held.end();) {
+    if (!present(it->second)) {
+      held.erase(it++);
+      continue;
+    }
+    if (store->read(it->second, readBack, sizeof(readBack)) != IMAGE_READ_OK) wrong++;
+    ++it;
+  }
+  CHECK(wrong == 0 && held.size() == stats.images - 1);
+
+  // The freed slots are used before anything else is replaced
+  uint32_t evicted = stats.evicted;
+  for (uint32_t i = 0; i < torn; i++) storeNext(0);
+  CHECK(store->getStats().evicted == evicted);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testOldestFirst();
+  testRetentionWithSweep();
+  testReopen();
+  testTornWrites();
+  delete store;
+  sd.clear();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
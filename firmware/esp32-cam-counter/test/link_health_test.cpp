@@ -0,0 +1,142 @@
+/**
+ * SwanFlow - Link Health Test
+ *
+ * The reconnect backoff: MODEM_RETRY_DELAY_MS doubling with each failure
+ * to MODEM_BACKOFF_MAX_MS, doubled again while the score is below 50,
+ * jittered to between half and all of that, and back to the start once
+ * connected. Also the score's blend of outcomes and signal.
+ */
+
+#include "link_health.h"
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static const int DRAWS = 2000;
+
+// MODEM_RETRY_DELAY_MS times multiple, at most MODEM_BACKOFF_MAX_MS
+static uint32_t capped(uint32_t multiple) {
+  uint64_t ms = (uint64_t)MODEM_RETRY_DELAY_MS * multiple;
+  return ms < MODEM_BACKOFF_MAX_MS ? (uint32_t)ms : MODEM_BACKOFF_MAX_MS;
+}
+
+// Many waits all within [nominal / 2, nominal], and spread across it
+static bool jitteredWithin(const LinkHealth& link, uint32_t nominal) {
+  uint32_t lo = UINT32_MAX, hi = 0;
+  for (int i = 0; i < DRAWS; i++) {
+    uint32_t ms = link.backoffMs();
+    lo = min(lo, ms);
+    hi = max(hi, ms);
+  }
+  bool ok = lo >= nominal / 2 && hi <= nominal && lo < nominal / 2 + nominal / 20 &&
+            hi > nominal - nominal / 20;
+  if (!ok) printf("  nominal %lu: waits %lu to %lu\n", (unsigned long)nominal, (unsigned long)lo,
+                  (unsigned long)hi);
+  return ok;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// Failures in a row with unknown signal, so the score is the outcomes
+// alone: 75, 56, then below 50 from the third failure on
+static void testGrowth() {
+  struct Step {
+    uint8_t failures;
+    uint8_t score;
+    uint32_t multiple;  // Of MODEM_RETRY_DELAY_MS, before the cap
+  };
+  const Step steps[] = {
+    { 1, 75, 1 }, { 2, 56, 2 }, { 3, 42, 8 }, { 4, 32, 16 }, { 5, 24, 32 },
+    { 6, 18, 64 }, { 7, 14, 128 }, { 8, 11, 256 }, { 9, 8, 512 }, { 10, 6, 1024 }
+  };
+
+  LinkHealth link;
+  CHECK(link.score() == 100 && link.getFailures() == 0);
+  CHECK(jitteredWithin(link, capped(1)));
+
+  for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+    link.connectFailed();
+    CHECK(link.getFailures() == steps[i].failures);
+    CHECK(link.score() == steps[i].score);
+    CHECK(jitteredWithin(link, capped(steps[i].multiple)));
+  }
+
+  // Failures stop counting at 255; the wait stays at the cap
+  for (int i = 0; i < 300; i++) link.connectFailed();
+  CHECK(link.getFailures() == 255);
+  CHECK(jitteredWithin(link, MODEM_BACKOFF_MAX_MS));
+}
+
+// A good signal keeps the score up longer, so the extra doubling comes
+// later (score 49 at the fourth failure)
+static void testSignal() {
+  LinkHealth link;
+  link.setSignal(31);  // Above 20 counts as full
+  CHECK(link.score() == 100);
+  link.setSignal(10);
+  CHECK(link.score() == (100 * 3 + 50) / 4);
+
+  link.setSignal(25);
+  const uint32_t multiples[] = { 1, 2, 4, 16 };
+  for (size_t i = 0; i < sizeof(multiples) / sizeof(multiples[0]); i++) {
+    link.connectFailed();
+    CHECK(jitteredWithin(link, capped(multiples[i])));
+  }
+  CHECK(link.score() == 49);
+}
+
+// Connecting resets the count; the score takes a few good outcomes to
+// get back over 50, and the wait stays doubled until it does
+static void testResetOnSuccess() {
+  LinkHealth link;
+  for (int i = 0; i < 12; i++) link.connectFailed();
+  CHECK(jitteredWithin(link, MODEM_BACKOFF_MAX_MS));
+
+  link.connected();
+  CHECK(link.getFailures() == 0);
+  CHECK(link.score() < 50);
+  CHECK(jitteredWithin(link, capped(2)));
+
+  // The next failure starts the schedule again
+  link.connectFailed();
+  CHECK(link.getFailures() == 1);
+  CHECK(jitteredWithin(link, capped(2)));
+
+  link.connected();
+  int uploads = 0;
+  while (link.score() < 50 && uploads < 10) {
+    link.uploadResult(true);
+    uploads++;
+  }
+  CHECK(uploads > 0 && uploads < 10);
+  CHECK(jitteredWithin(link, capped(1)));
+
+  // Failed uploads lower the score but don't count as failures
+  for (int i = 0; i < 10; i++) link.uploadResult(false);
+  CHECK(link.getFailures() == 0 && link.score() < 50);
+  CHECK(jitteredWithin(link, capped(2)));
+}
+
+int main() {
+  hostSerialOutput(false);
+  srand(1);
+  testGrowth();
+  testSignal();
+  testResetOnSuccess();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,260 @@
+/**
+ * SwanFlow - LZ Block Test
+ *
+ * LzCompressor output decoded by the backend's lz4Decode()
+ * (backend/api/telemetry.js, through telemetry_decode.js) must give back
+ * the input byte for byte: batches of IntervalRecords as they are logged
+ * and as SFTM bodies, incompressible input, literal runs and matches
+ * either side of each length-byte boundary (15, 15 + 255, ...), the
+ * longest of each the 64 KB input limit allows, and the farthest offset.
+ */
+
+#include "lz_block.h"
+#include "stats_backlog.h"
+#include "telemetry.h"
+#include "backend_decode.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+typedef std::vector<uint8_t> Bytes;
+
+static uint32_t seed = 3;
+static uint8_t randomByte() {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static Bytes randomBytes(size_t n) {
+  Bytes b(n);
+  for (size_t i = 0; i < n; i++) b[i] = randomByte();
+  return b;
+}
+
+static LzCompressor lz;
+static uint8_t packed[LzCompressor::MAX_INPUT + LzCompressor::MAX_INPUT / 255 + 16];
+
+// ============================================================================
+// Inputs
+// ============================================================================
+struct Input {
+  std::string name;
+  Bytes raw;
+  Bytes packed;
+};
+
+static std::vector<Input> inputs;
+
+// Compress, check the LZ4 worst-case bound, and queue for decoding
+static Bytes add(const std::string& name, const Bytes& raw) {
+  size_t n = lz.compress(raw.data(), raw.size(), packed, sizeof(packed));
+  CHECK(n > 0 && n <= raw.size() + raw.size() / 255 + 16);
+  if (n == 0) printf("  (%s, %zu bytes)\n", name.c_str(), raw.size());
+
+  Input in;
+  in.name = name;
+  in.raw = raw;
+  in.packed.assign(packed, packed + n);
+  inputs.push_back(in);
+  return in.packed;
+}
+
+// A day of intervals a minute apart, as StatsBacklog logs them
+static void addIntervalBatches() {
+  static IntervalRecord day[1440];
+  uint32_t total = 0;
+  for (size_t i = 0; i < 1440; i++) {
+    IntervalRecord& r = day[i];
+    memset(&r, 0, sizeof(r));
+    uint32_t vehicles = 10 + randomByte() % 40;
+    total += vehicles;
+    r.interval = 500 + i;
+    r.stream = 0x6A09E667;
+    r.bootId = i < 700 ? 0xBB67AE85 : 0x3C6EF372;  // A reboot midway
+    r.timestamp = 60000 * (i % 700) + randomByte() % 30;
+    r.epoch = i < 300 ? 0 : 1791000000 + i * 60;
+    r.totalCount = total;
+    r.lastHourCount = 1500 + randomByte() * 3;
+    r.lastMinuteCount = vehicles;
+    r.avgConfidence = 0.6f + randomByte() / 1000.0f;
+    r.uptime = 60 * (i % 700);
+  }
+
+  const size_t sizes[] = { 1, 5, 60, 1440 };
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    const uint8_t* bytes = (const uint8_t*)day;
+    add("intervals x" + std::to_string(sizes[s]), Bytes(bytes, bytes + sizes[s] * sizeof(IntervalRecord)));
+  }
+
+  // The same day as an SFTM batch body (what TELEMETRY_LZ compresses)
+  static uint8_t record[TelemetryEncoder::maxSize(1440)];
+  TelemetryEncoder encoder(record, sizeof(record));
+  size_t length = encoder.encode(3, day, 1440, nullptr, nullptr, nullptr, nullptr);
+  CHECK(length > TelemetryEncoder::HEADER_SIZE);
+  add("SFTM body x1440", Bytes(record + TelemetryEncoder::HEADER_SIZE, record + length));
+}
+
+// Random bytes don't compress: one literal run, at most the bound above
+static void addIncompressible() {
+  const size_t lengths[] = { 0, 1, 4, 5, 12, 13, 14, 15, 16, 269, 270, 271, 524, 525, 526,
+                             LzCompressor::MAX_INPUT };
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    add("random " + std::to_string(lengths[i]), randomBytes(lengths[i]));
+  }
+}
+
+// A literal run of each boundary length, then a match to its last bytes:
+// the first sequence must carry exactly that many literals
+static void addLiteralRuns() {
+  const size_t runs[] = { 4, 14, 15, 16, 269, 270, 271, 524, 525, 526, 60000 };
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    Bytes raw = randomBytes(runs[i]);
+    Bytes again(raw.end() - 4, raw.end());
+    raw.insert(raw.end(), again.begin(), again.end());
+    Bytes tail = randomBytes(16);
+    raw.insert(raw.end(), tail.begin(), tail.end());
+    Bytes block = add("literals " + std::to_string(runs[i]) + " then match", raw);
+
+    size_t literals = block[0] >> 4;
+    size_t p = 1;
+    if (literals == 15) {
+      while (block[p] == 255) literals += block[p++];
+      literals += block[p];
+    }
+    CHECK(literals == runs[i]);
+  }
+}
+
+// One byte repeated n times: a literal, a match of n - 6 at offset 1,
+// and the five literals a block must end with
+static void addMatches() {
+  const size_t codes[] = { 0, 1, 14, 15, 16, 269, 270, 271, 524, 525, 526 };
+  for (size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++) {
+    size_t n = codes[i] + 4 + 6;
+    add("match " + std::to_string(codes[i] + 4), Bytes(n, 'A'));
+  }
+  add("longest match", Bytes(LzCompressor::MAX_INPUT, 0));
+
+  // Far back (table positions are 16-bit): zeros between the two copies,
+  // so nothing in the way takes the first copy's hash slot
+  Bytes raw = randomBytes(LzCompressor::MAX_INPUT);
+  memset(&raw[32], 0, 65500 - 32);
+  memcpy(&raw[65500], &raw[0], 32);
+  Bytes packedFar = add("offset 65500", raw);
+  bool found = false;
+  for (size_t i = 0; i + 1 < packedFar.size(); i++) {
+    if (packedFar[i] == (65500 & 0xFF) && packedFar[i + 1] == (65500 >> 8)) found = true;
+  }
+  CHECK(found && packedFar.size() < raw.size());
+}
+
+// Runs, repeats and noise mixed, for everything between the cases above
+static void addMixed() {
+  for (int i = 0; i < 200; i++) {
+    Bytes raw;
+    size_t length = 1 + (randomByte() << 8 | randomByte()) % 6000;
+    while (raw.size() < length) {
+      uint8_t kind = randomByte() % 3;
+      size_t n = 1 + randomByte() % (kind == 0 ? 40 : 400);
+      if (kind == 0 || raw.size() < 8) {
+        Bytes noise = randomBytes(n);
+        raw.insert(raw.end(), noise.begin(), noise.end());
+      } else if (kind == 1) {
+        raw.insert(raw.end(), n, randomByte());
+      } else {
+        size_t from = raw.size() - 1 - (randomByte() << 8 | randomByte()) % raw.size();
+        for (size_t k = 0; k < n; k++) raw.push_back(raw[from + k]);
+      }
+    }
+    raw.resize(length);
+    add("mixed " + std::to_string(i), raw);
+  }
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// Token, literal, offset and length bytes where the match length crosses
+// 15 + 255: the overflow ends in an explicit 0
+static void testGoldenBytes() {
+  Bytes raw(4 + 270 + 6, 'A');  // Match of 274 = 4 + 15 + 255 + 0
+  size_t n = lz.compress(raw.data(), raw.size(), packed, sizeof(packed));
+  const uint8_t golden[] = { 0x1F, 'A', 0x01, 0x00, 0xFF, 0x00, 0x50, 'A', 'A', 'A', 'A', 'A' };
+  CHECK(n == sizeof(golden) && memcmp(packed, golden, n) == 0);
+
+  raw.assign(15, 'x');
+  for (size_t i = 0; i < raw.size(); i++) raw[i] = 'a' + i;
+  n = lz.compress(raw.data(), raw.size(), packed, sizeof(packed));
+  CHECK(n == 17 && packed[0] == 0xF0 && packed[1] == 0x00 && memcmp(packed + 2, raw.data(), 15) == 0);
+}
+
+// Too little room, or too much input, gives 0 rather than a cut-off block
+static void testLimits() {
+  Bytes raw = randomBytes(1000);
+  size_t n = lz.compress(raw.data(), raw.size(), packed, sizeof(packed));
+  for (size_t capacity = 0; capacity < n; capacity += 1 + capacity / 4) {
+    CHECK(lz.compress(raw.data(), raw.size(), packed, capacity) == 0);
+  }
+  CHECK(lz.compress(raw.data(), raw.size(), packed, n) == n);
+
+  Bytes big(LzCompressor::MAX_INPUT + 1, 0);
+  CHECK(lz.compress(big.data(), big.size(), packed, sizeof(packed)) == 0);
+}
+
+static void testDecode() {
+  std::vector<std::string> requests;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    requests.push_back("lz " + std::to_string(inputs[i].raw.size()) + " " +
+                       hostHex(inputs[i].packed.data(), inputs[i].packed.size()));
+  }
+
+  std::vector<std::string> answers;
+  CHECK(hostBackendDecode(requests, answers));
+  if (answers.size() != requests.size()) return;
+
+  int wrong = 0;
+  size_t rawBytes = 0, packedBytes = 0;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    std::string expected = "raw " + hostHex(inputs[i].raw.data(), inputs[i].raw.size()) + "\n";
+    if (answers[i] != expected) {
+      if (wrong++ < 3) printf("FAIL %s: %.120s\n", inputs[i].name.c_str(), answers[i].c_str());
+    }
+    rawBytes += inputs[i].raw.size();
+    packedBytes += inputs[i].packed.size();
+    if (inputs[i].name.compare(0, 10, "intervals ") == 0 || inputs[i].name.compare(0, 5, "SFTM ") == 0) {
+      printf("%-18s %6zu B -> %6zu B\n", inputs[i].name.c_str(), inputs[i].raw.size(),
+             inputs[i].packed.size());
+    }
+  }
+  CHECK(wrong == 0);
+  printf("%zu blocks decoded (%d wrong), %zu B -> %zu B\n", inputs.size(), wrong, rawBytes, packedBytes);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testGoldenBytes();
+  testLimits();
+  addIntervalBatches();
+  addIncompressible();
+  addLiteralRuns();
+  addMatches();
+  addMixed();
+  testDecode();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
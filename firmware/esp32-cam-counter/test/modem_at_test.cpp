@@ -0,0 +1,294 @@
+/**
+ * SwanFlow - Modem AT Test
+ *
+ * The raw AT exchanges (ModemAt, and ModemUdp, ModemTls and ModemPower
+ * on top of it) against a simulated SIM7000: it echoes commands, answers
+ * the ones used here, and can slip unsolicited result codes in between
+ * exchanges or into the middle of one, as the modem does while TinyGSM's
+ * socket is open. Those have to reach TinyGSM through ModemStream, in
+ * order, rather than be thrown away.
+ */
+
+#include "modem_power.h"
+#include "modem_tls.h"
+#include "modem_udp.h"
+#include <stdio.h>
+#include <deque>
+#include <string>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+// ============================================================================
+// Simulated Modem
+// ============================================================================
+struct FakeModem : Stream {
+  std::string out;       // Modem to host, not yet read
+  size_t outPos;
+  std::string line;      // Command being received
+  size_t rawLeft;        // Bytes of binary data still to come
+  std::string raw;
+  std::string commands;  // Everything received, "|" separated
+  std::string urcInReply;  // Slipped in before the next reply
+  std::string later;       // Sent at laterAt
+  unsigned long laterAt;
+  std::deque<std::string> datagrams, sent;
+  bool failOpen, failSend;
+
+  FakeModem() : outPos(0), rawLeft(0), laterAt(0), failOpen(false), failSend(false) {}
+
+  void reply(const std::string& s) { out += s; }
+  void unsolicited(const std::string& urc) { reply("\r\n" + urc + "\r\n"); }
+
+  size_t write(uint8_t c) override {
+    if (rawLeft > 0) {
+      raw += (char)c;
+      if (--rawLeft == 0) {
+        sent.push_back(raw);
+        raw.clear();
+        reply(failSend ? "\r\nERROR\r\n" : "\r\nOK\r\n");
+      }
+      return 1;
+    }
+    line += (char)c;
+    if (line.size() >= 2 && line.compare(line.size() - 2, 2, "\r\n") == 0) {
+      std::string cmd = line.substr(0, line.size() - 2);
+      line.clear();
+      handle(cmd);
+    }
+    return 1;
+  }
+  using Print::write;
+
+  void handle(const std::string& cmd) {
+    commands += cmd + "|";
+    reply(cmd + "\r\r\n");  // Echo
+    if (!urcInReply.empty()) {
+      unsolicited(urcInReply);
+      urcInReply.clear();
+    }
+
+    if (cmd.compare(0, 10, "AT+CAOPEN=") == 0) {
+      reply(failOpen ? "\r\n+CAOPEN: 3,1\r\n\r\nOK\r\n" : "\r\n+CAOPEN: 3,0\r\n\r\nOK\r\n");
+    } else if (cmd.compare(0, 12, "AT+CASEND=3,") == 0) {
+      rawLeft = atoi(cmd.c_str() + 12);
+      reply("> ");
+    } else if (cmd.compare(0, 12, "AT+CARECV=3,") == 0) {
+      if (datagrams.empty()) {
+        reply("\r\n+CARECV: 0\r\n\r\nOK\r\n");
+      } else {
+        std::string d = datagrams.front();
+        datagrams.pop_front();
+        reply("\r\n+CARECV: " + std::to_string(d.size()) + "," + d + "\r\n\r\nOK\r\n");
+      }
+    } else {
+      reply("\r\nOK\r\n");
+    }
+  }
+
+  int available() override {
+    if (!later.empty() && (long)(millis() - laterAt) >= 0) {
+      out += later;
+      later.clear();
+    }
+    return (int)(out.size() - outPos);
+  }
+  int read() override { return outPos < out.size() ? (uint8_t)out[outPos++] : -1; }
+  int peek() override { return outPos < out.size() ? (uint8_t)out[outPos] : -1; }
+};
+
+// What TinyGSM would read next: held lines, then the port
+static std::string tinyGsmReads(ModemStream& stream) {
+  std::string s;
+  while (stream.available() > 0) s += (char)stream.read();
+  return s;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// An URC that arrived while nothing was in flight, before a UDP poll
+static void testUrcBetweenExchanges() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemUdp udp;
+  udp.begin(stream);
+
+  CHECK(udp.beginPacket("gw.example.com", 1885) == 1);
+  modem.unsolicited("+CADATAIND: 0");
+  CHECK(udp.parsePacket() == 0);
+  CHECK(tinyGsmReads(stream) == "+CADATAIND: 0\r\n");
+}
+
+// URCs in the middle of an exchange, before its answer
+static void testUrcDuringExchange() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemUdp udp;
+  udp.begin(stream);
+
+  modem.urcInReply = "+CASTATE: 0,0";
+  CHECK(udp.beginPacket("gw.example.com", 1885) == 1 && udp.isOpen());
+
+  std::string datagram("\x07\x0D" "st\x00\x01\x00" "\r\n", 9);
+  modem.datagrams.push_back(datagram);
+  modem.urcInReply = "+CADATAIND: 0";
+  CHECK(udp.parsePacket() == (int)datagram.size());
+  CHECK(tinyGsmReads(stream) == "+CASTATE: 0,0\r\n+CADATAIND: 0\r\n");
+}
+
+// Held lines come before whatever the port has after them
+static void testHeldBeforePort() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemPower power;
+  power.begin(stream);
+
+  modem.urcInReply = "+CEREG: 5";
+  CHECK(power.configure());
+  modem.unsolicited("+CADATAIND: 1");
+  CHECK(tinyGsmReads(stream) == "+CEREG: 5\r\n\r\n+CADATAIND: 1\r\n");
+  CHECK(modem.commands.find("AT+CEREG=4|") != std::string::npos);
+}
+
+// A reply that came too late, or an error, would be taken by TinyGSM for
+// the answer to its own next command: they aren't passed on
+static void testLateRepliesDropped() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemAt at;
+  at.begin(stream);
+
+  modem.reply("\r\nOK\r\n\r\n+CME ERROR: 3\r\nAT+CFSTERM\r\r\n");
+  CHECK(at.command("+CFSINIT"));
+  CHECK(tinyGsmReads(stream).empty());
+}
+
+// A line still arriving when a command is sent is waited for and kept
+// whole; one that never ends isn't passed on in pieces
+static void testPartialLine() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemAt at;
+  at.begin(stream);
+
+  modem.reply("\r\n+CASTATE: 0,");
+  modem.later = "0\r\n";
+  modem.laterAt = millis() + 5;
+  CHECK(at.command("+CFSINIT"));
+  CHECK(tinyGsmReads(stream) == "+CASTATE: 0,0\r\n");
+
+  modem.reply("\r\n+CASTATE: 1,");
+  CHECK(at.command("+CFSINIT"));
+  CHECK(tinyGsmReads(stream).empty());
+}
+
+// More than fits is dropped whole, counted; what was kept stays intact
+static void testHoldOverflow() {
+  ModemStream stream;
+  FakeModem modem;
+  stream.begin(modem);
+
+  char line[32];
+  size_t kept = 0;
+  for (int i = 0; i < 40; i++) {
+    snprintf(line, sizeof(line), "+CADATAIND: %d", i % 10);
+    if (stream.hold(line)) kept++;
+  }
+  CHECK(kept == ModemStream::HOLD_SIZE / 15 && stream.getDropped() == 40 - kept);
+
+  std::string s = tinyGsmReads(stream);
+  CHECK(s.size() == kept * 15 && s.compare(0, 15, "+CADATAIND: 0\r\n") == 0);
+  CHECK(stream.hold("+CASTATE: 0,0") && tinyGsmReads(stream) == "+CASTATE: 0,0\r\n");
+}
+
+// The UDP socket: binary data with line endings in it both ways, a send
+// the modem refuses, a socket that doesn't open, a datagram too large
+static void testUdp() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemUdp udp;
+  udp.begin(stream);
+
+  const uint8_t datagram[] = { 0x07, 0x0C, '\n', '\r', '3', ',', 'O' };
+  CHECK(udp.beginPacket("gw.example.com", 1885) == 1);
+  udp.write(datagram, 4);
+  udp.write(datagram + 4, 3);
+  CHECK(udp.endPacket() == 1);
+  CHECK(modem.sent.size() == 1 && modem.sent.back() == std::string((const char*)datagram, 7));
+
+  // Kept open for the same host
+  size_t opens = modem.commands.find("AT+CAOPEN");
+  CHECK(udp.beginPacket("gw.example.com", 1885) == 1);
+  CHECK(modem.commands.find("AT+CAOPEN", opens + 1) == std::string::npos);
+
+  std::string in("\x07\x0D" "st\x00\x01\x00" "\x05\x0D\r\n\n", 12);
+  modem.datagrams.push_back(in);
+  uint8_t buffer[64];
+  CHECK(udp.parsePacket() == (int)in.size());
+  int n = udp.read(buffer, sizeof(buffer));
+  CHECK(n == (int)in.size() && std::string((const char*)buffer, n) == in && udp.available() == 0);
+
+  modem.failSend = true;
+  udp.write(datagram, sizeof(datagram));
+  CHECK(udp.endPacket() == 0 && !udp.isOpen());
+  modem.failSend = false;
+
+  modem.failOpen = true;
+  CHECK(udp.beginPacket("gw.example.com", 1885) == 0 && !udp.isOpen());
+  modem.failOpen = false;
+
+  static uint8_t big[MQTTSN_MAX_PACKET + 1];
+  CHECK(udp.beginPacket("gw.example.com", 1885) == 1);
+  udp.write(big, sizeof(big));
+  CHECK(udp.endPacket() == 0);
+  CHECK(tinyGsmReads(stream).find_first_not_of(" \r\n") == std::string::npos);  // Blank lines only
+}
+
+// No CA certificate configured: TLS is refused before touching the modem
+static void testTlsNeedsCa() {
+  FakeModem modem;
+  ModemStream stream;
+  stream.begin(modem);
+  ModemTls tls;
+  tls.begin(stream);
+
+  if (strlen(TLS_CA_CERT) == 0) {
+    CHECK(!tls.configure("api.example.com") && !tls.isConfigured());
+    CHECK(modem.commands.empty());
+  } else {
+    CHECK(tls.configure("api.example.com") && tls.isConfigured());
+  }
+}
+
+int main() {
+  hostSerialOutput(false);
+  testUrcBetweenExchanges();
+  testUrcDuringExchange();
+  testHeldBeforePort();
+  testLateRepliesDropped();
+  testPartialLine();
+  testHoldOverflow();
+  testUdp();
+  testTlsNeedsCa();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
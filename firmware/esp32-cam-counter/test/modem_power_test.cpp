@@ -0,0 +1,223 @@
+/**
+ * SwanFlow - Modem Power Test
+ *
+ * The PSM and eDRX codes ModemPower writes and reads back, against the
+ * tables of 3GPP TS 24.008: GPRS timer 3 for the periodic TAU (T3412,
+ * 10.5.7.4a), GPRS timer 2 for the active time (T3324, 10.5.7.3) and the
+ * WB-S1 eDRX cycle (10.5.5.32). Also the radio-time account sampled by
+ * update() on the simulated clock.
+ */
+
+#include "modem_power.h"
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+struct TimerVector {
+  const char* bits;
+  uint32_t seconds;
+};
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+// ============================================================================
+// 24.008 Vectors
+// ============================================================================
+// GPRS timer 3: unit in bits 8-6, value in bits 5-1
+static const TimerVector TAU_DECODE[] = {
+  { "00000001", 600 },        // 000: 10 minutes
+  { "00000110", 3600 },
+  { "00011111", 18600 },
+  { "00100001", 3600 },       // 001: 1 hour
+  { "00111000", 86400 },
+  { "01000001", 36000 },      // 010: 10 hours
+  { "01011111", 1116000 },
+  { "01100001", 2 },          // 011: 2 seconds
+  { "01111111", 62 },
+  { "10000001", 30 },         // 100: 30 seconds
+  { "10010100", 600 },
+  { "10100001", 60 },         // 101: 1 minute
+  { "10111111", 1860 },
+  { "11000001", 1152000 },    // 110: 320 hours
+  { "11011111", 35712000 },
+  { "00000000", 0 },          // Zero timer
+  { "11100000", 0 },          // 111: deactivated
+  { "11111111", 0 }
+};
+
+// GPRS timer 2: 000 2 s, 001 1 min, 010 6 min (decihours), 111
+// deactivated; the others read as 1 minute
+static const TimerVector ACTIVE_DECODE[] = {
+  { "00000001", 2 },
+  { "00001111", 30 },
+  { "00011111", 62 },
+  { "00100001", 60 },
+  { "00101010", 600 },
+  { "00111111", 1860 },
+  { "01000001", 360 },
+  { "01011111", 11160 },
+  { "01100010", 120 },        // 011
+  { "10000011", 180 },        // 100
+  { "10100001", 60 },         // 101
+  { "11011111", 1860 },       // 110
+  { "00000000", 0 },
+  { "11100000", 0 },
+  { "11110101", 0 }
+};
+
+// Encoding: the finest unit that reaches the time, rounded up
+static const TimerVector TAU_ENCODE[] = {
+  { "11100000", 0 },
+  { "01100001", 1 },
+  { "01100001", 2 },
+  { "01100010", 3 },
+  { "01111111", 62 },
+  { "10000011", 63 },         // 90 s
+  { "10010100", 600 },
+  { "10111111", 1860 },
+  { "00000100", 1861 },       // 40 minutes
+  { "00000110", 3600 },
+  { "00111000", 86400 },      // 24 hours
+  { "01011111", 1116000 },
+  { "11000001", 1116001 },    // 320 hours
+  { "11011111", 35712000 },
+  { "11011111", 4000000000UL }  // Longest there is
+};
+
+static const TimerVector ACTIVE_ENCODE[] = {
+  { "11100000", 0 },
+  { "00000001", 1 },
+  { "00001111", 30 },
+  { "00011111", 62 },
+  { "00100010", 63 },         // 2 minutes
+  { "00111111", 1860 },
+  { "01000110", 1861 },       // 36 minutes
+  { "01011111", 11160 },
+  { "01011111", 100000 }
+};
+
+// WB-S1 mode eDRX cycle lengths, by code
+static const uint32_t EDRX_MS[16] = {
+  5120, 10240, 20480, 40960, 61440, 81920, 102400, 122880,
+  143360, 163840, 327680, 655360, 1310720, 2621440, 5242880, 10485760
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+static void testTimerDecode() {
+  for (size_t i = 0; i < COUNT(TAU_DECODE); i++) {
+    uint32_t seconds = ModemPower::decodeTau(TAU_DECODE[i].bits);
+    if (seconds != TAU_DECODE[i].seconds) printf("  TAU %s -> %lu\n", TAU_DECODE[i].bits, (unsigned long)seconds);
+    CHECK(seconds == TAU_DECODE[i].seconds);
+  }
+  for (size_t i = 0; i < COUNT(ACTIVE_DECODE); i++) {
+    uint32_t seconds = ModemPower::decodeActiveTime(ACTIVE_DECODE[i].bits);
+    if (seconds != ACTIVE_DECODE[i].seconds) printf("  T3324 %s -> %lu\n", ACTIVE_DECODE[i].bits, (unsigned long)seconds);
+    CHECK(seconds == ACTIVE_DECODE[i].seconds);
+  }
+}
+
+static void testTimerEncode() {
+  char bits[9];
+  for (size_t i = 0; i < COUNT(TAU_ENCODE); i++) {
+    ModemPower::encodeTau(TAU_ENCODE[i].seconds, bits);
+    if (strcmp(bits, TAU_ENCODE[i].bits) != 0) printf("  TAU %lu -> %s\n", (unsigned long)TAU_ENCODE[i].seconds, bits);
+    CHECK(strcmp(bits, TAU_ENCODE[i].bits) == 0);
+  }
+  for (size_t i = 0; i < COUNT(ACTIVE_ENCODE); i++) {
+    ModemPower::encodeActiveTime(ACTIVE_ENCODE[i].seconds, bits);
+    if (strcmp(bits, ACTIVE_ENCODE[i].bits) != 0) printf("  T3324 %lu -> %s\n", (unsigned long)ACTIVE_ENCODE[i].seconds, bits);
+    CHECK(strcmp(bits, ACTIVE_ENCODE[i].bits) == 0);
+  }
+}
+
+// One step of the unit a code is in
+static uint32_t stepOf(const char* bits, uint32_t (*decode)(const char*)) {
+  char one[9];
+  memcpy(one, bits, 3);
+  strcpy(one + 3, "00001");
+  return decode(one);
+}
+
+// Whatever is asked for, the network is asked for at least that much and
+// less than one step of the chosen unit more
+static void testTimerRoundTrip() {
+  char bits[9];
+  int wrong = 0;
+  for (uint32_t seconds = 1; seconds <= 35712000; seconds += 1 + seconds / 64) {
+    ModemPower::encodeTau(seconds, bits);
+    uint32_t back = ModemPower::decodeTau(bits);
+    if (back < seconds || back - seconds >= stepOf(bits, ModemPower::decodeTau)) wrong++;
+
+    if (seconds > 11160) continue;
+    ModemPower::encodeActiveTime(seconds, bits);
+    back = ModemPower::decodeActiveTime(bits);
+    if (back < seconds || back - seconds >= stepOf(bits, ModemPower::decodeActiveTime)) wrong++;
+  }
+  CHECK(wrong == 0);
+}
+
+static void testEdrx() {
+  for (uint8_t code = 0; code < 16; code++) {
+    CHECK(ModemPower::decodeEdrx(code) == EDRX_MS[code]);
+    CHECK(ModemPower::encodeEdrx(EDRX_MS[code]) == code);
+    if (code > 0) CHECK(ModemPower::encodeEdrx(EDRX_MS[code] - 1) == code - 1);
+  }
+  CHECK(ModemPower::decodeEdrx(0x15) == EDRX_MS[5]);  // Only the low 4 bits
+  CHECK(ModemPower::encodeEdrx(0) == 0);
+  CHECK(ModemPower::encodeEdrx(100000000) == 15);
+}
+
+// Connected: an upload and the RRC tail after it; awake: all but PSM
+// sleep. Sampled at the end of each second, so the tail's last second
+// reads as idle.
+static void testRadioTime() {
+  ModemPower power;
+  hostSetMillis(1000);
+  power.update(false, false, false);
+
+  power.activity();  // Upload starts...
+  for (int i = 0; i < 60; i++) {
+    hostAdvance(1000);
+    if (i == 4) power.activity();  // ...and ends 5 s later
+    power.update(false, i < 4, i >= 40);
+  }
+  RadioStats stats = power.getStats();
+  CHECK(stats.periodMs == 60000);
+  CHECK(stats.activeMs == 5000 + MODEM_RRC_TAIL_MS - 1000);
+  CHECK(stats.awakeMs == 40000);
+  CHECK(stats.wakes == 1);
+
+  power.activity();  // Long after the tail: a new wake
+  hostAdvance(MODEM_RRC_TAIL_MS - 1);
+  power.activity();  // Within it: the same one
+  CHECK(power.getStats().wakes == 2);
+
+  power.reported(stats);
+  CHECK(power.getStats().periodMs == 0 && power.getStats().wakes == 1);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testTimerDecode();
+  testTimerEncode();
+  testTimerRoundTrip();
+  testEdrx();
+  testRadioTime();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * SwanFlow - MQTT-SN Client Test
+ *
+ * MqttSnClient against the backend's MQTT-SN gateway (stand_in_gateway.js)
+ * forwarding to stand_in_server.js, over a host UDP socket: CONNECT and a
+ * QoS 1 PUBLISH to a short topic (no REGISTER), a lost PUBACK (resent
+ * with DUP, forwarded once), a late PUBACK to an earlier message ID
+ * (ignored), and a gateway that stops answering (the upload goes over
+ * HTTP, and the gateway is passed over for MQTTSN_FALLBACK_MS). Skipped
+ * without Node.js.
+ */
+
+#include "mqtt_sn.h"
+#include "http_connection.h"
+#include "tcp_client.h"
+#include "udp_client.h"
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static const uint16_t HTTP_PORT = 18433;
+static const uint16_t GATEWAY_PORT = 18434;
+
+// Message types and PUBLISH flags (MQTT-SN v1.2)
+static const uint8_t CONNECT = 0x04;
+static const uint8_t REGISTER = 0x0A;
+static const uint8_t REGACK = 0x0B;
+static const uint8_t PUBLISH = 0x0C;
+static const uint8_t PUBACK = 0x0D;
+static const uint8_t FLAG_DUP = 0x80;
+static const uint8_t FLAG_QOS1 = 0x20;
+static const uint8_t TOPIC_SHORT = 0x02;
+
+static HostUdp udp;
+static MqttSnClient mqtt;
+static uint8_t body[180];  // About an SFTM record of a few intervals
+
+// Run the publish in flight to its end on the simulated clock
+static void run() {
+  while (mqtt.poll()) delay(MQTTSN_RECEIVE_POLL_MS);
+}
+
+// Datagrams sent since index from
+static std::vector<std::vector<uint8_t> > sentSince(size_t from) {
+  const std::vector<std::vector<uint8_t> >& all = udp.sent();
+  return std::vector<std::vector<uint8_t> >(all.begin() + from, all.end());
+}
+
+// Type of a datagram with a one-byte length
+static uint8_t typeOf(const std::vector<uint8_t>& datagram) {
+  return datagram.size() >= 2 ? datagram[1] : 0;
+}
+
+static uint16_t msgIdOf(const std::vector<uint8_t>& publish) {
+  return (publish[5] << 8) | publish[6];
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// The gateway only takes short topic names, which is why the client
+// never registers one
+static void testRegisterRefused() {
+  HostUdp raw;
+  raw.setReplyWait(2000);
+  const uint8_t reg[] = { 8, REGISTER, 0, 0, 0, 7, 's', 't' };
+  CHECK(raw.beginPacket("127.0.0.1", GATEWAY_PORT) && raw.write(reg, sizeof(reg)) && raw.endPacket());
+  uint8_t answer[16];
+  int n = raw.parsePacket() > 0 ? raw.read(answer, sizeof(answer)) : 0;
+  CHECK(n == 7 && answer[1] == REGACK && answer[4] == 0 && answer[5] == 7 && answer[6] == 0x03);
+}
+
+// CONNECT, CONNACK, then PUBLISH at QoS 1 and its PUBACK; the next
+// publish reuses the session
+static void testPublish() {
+  size_t from = udp.sent().size();
+  CHECK(mqtt.publish("st", body, sizeof(body)));
+  run();
+  CHECK(mqtt.succeeded() && mqtt.isAvailable());
+
+  std::vector<std::vector<uint8_t> > sent = sentSince(from);
+  CHECK(sent.size() == 2 && typeOf(sent[0]) == CONNECT && typeOf(sent[1]) == PUBLISH);
+  if (sent.size() == 2) {
+    CHECK(sent[1][2] == (FLAG_QOS1 | TOPIC_SHORT) && sent[1][3] == 's' && sent[1][4] == 't');
+    CHECK(sent[1].size() == 7 + sizeof(body) && sent[1][0] == 7 + sizeof(body));
+  }
+
+  from = udp.sent().size();
+  CHECK(mqtt.publish("st", body, sizeof(body)));
+  run();
+  CHECK(mqtt.succeeded());
+  sent = sentSince(from);
+  CHECK(sent.size() == 1 && typeOf(sent[0]) == PUBLISH);
+
+  const MqttSnStats& stats = mqtt.getStats();
+  CHECK(stats.connects == 1 && stats.acked == 2 && stats.retransmits == 0);
+}
+
+// The PUBACK is lost: the PUBLISH goes again with DUP and the same
+// message ID, and the gateway answers it without forwarding it again
+static void testLostPuback() {
+  size_t from = udp.sent().size();
+  uint32_t retransmits = mqtt.getStats().retransmits;
+  udp.dropIncoming(1);
+  CHECK(mqtt.publish("st", body, sizeof(body)));
+  run();
+  CHECK(mqtt.succeeded());
+  CHECK(mqtt.getStats().retransmits == retransmits + 1);
+
+  std::vector<std::vector<uint8_t> > sent = sentSince(from);
+  CHECK(sent.size() == 2);
+  if (sent.size() == 2) {
+    CHECK(!(sent[0][2] & FLAG_DUP) && (sent[1][2] & FLAG_DUP));
+    CHECK(msgIdOf(sent[0]) == msgIdOf(sent[1]));
+  }
+}
+
+// A PUBACK to the previous message ID arrives late: it doesn't end the
+// publish in flight, its own does
+static void testStalePuback() {
+  size_t from = udp.sent().size();
+  CHECK(mqtt.publish("st", body, sizeof(body)));
+  uint16_t msgId = msgIdOf(udp.sent()[from]);
+  uint16_t previous = msgId - 1;
+  const uint8_t stale[] = { 7, PUBACK, 's', 't', (uint8_t)(previous >> 8), (uint8_t)previous, 0 };
+  udp.inject(std::vector<uint8_t>(stale, stale + sizeof(stale)));
+
+  delay(MQTTSN_RECEIVE_POLL_MS);
+  CHECK(mqtt.poll() && mqtt.isBusy());
+  run();
+  CHECK(mqtt.succeeded() && udp.sent().size() == from + 1);
+}
+
+// The gateway goes away: after MQTTSN_RETRIES resends the publish fails
+// unanswered and goes over HTTP, as LTEModem::pollMqttSn() sends it; the
+// gateway is then passed over for MQTTSN_FALLBACK_MS
+static void testGatewayGone() {
+  hostGatewayStop();
+  udp.setReplyWait(0);
+  size_t from = udp.sent().size();
+  CHECK(mqtt.publish("st", body, sizeof(body)));
+  run();
+  CHECK(!mqtt.succeeded() && mqtt.getReturnCode() == MQTTSN_NO_ANSWER);
+  CHECK(udp.sent().size() == from + 1 + MQTTSN_RETRIES);
+  CHECK(!mqtt.isAvailable());
+
+  HostTcpClient client;
+  HttpConnection http;
+  http.begin(client);
+  http.setCaptureHeader("X-Requests");
+  CHECK(http.start("http://127.0.0.1:18433/api/detections", "application/octet-stream", body, sizeof(body)));
+  while (http.poll()) std::this_thread::sleep_for(std::chrono::microseconds(200));
+  CHECK(http.succeeded());
+  // Four publishes forwarded once each (the resent one too), then this
+  CHECK(atoi(http.getCapturedHeader()) == 5);
+
+  hostAdvance(MQTTSN_FALLBACK_MS - 1);
+  CHECK(!mqtt.isAvailable());
+  hostAdvance(1);
+  CHECK(mqtt.isAvailable());
+}
+
+int main() {
+  hostSerialOutput(false);
+
+  if (!hostStandInStart(HTTP_PORT, 5000)) {
+    printf("skipped: Node.js not found\n");
+    return 0;
+  }
+  if (!hostGatewayStart(GATEWAY_PORT, HTTP_PORT)) {
+    hostStandInStop();
+    printf("skipped: Node.js not found\n");
+    return 0;
+  }
+
+  memset(body, 'x', sizeof(body));
+  udp.setReplyWait(2000);
+  mqtt.begin(udp, "127.0.0.1", GATEWAY_PORT, "test-site");
+
+  testRegisterRefused();
+  testPublish();
+  testLostPuback();
+  testStalePuback();
+  testGatewayGone();
+  hostGatewayStop();
+  hostStandInStop();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
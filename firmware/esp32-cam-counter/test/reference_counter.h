@@ -0,0 +1,114 @@
+/**
+ * SwanFlow - Reference Counter
+ *
+ * The tracker as it was before BasicVehicleCounter: float positions in
+ * an array of structs, normalized by the frame height at run time. Kept
+ * only as the baseline for bench_counter.cpp.
+ */
+
+#ifndef REFERENCE_COUNTER_H
+#define REFERENCE_COUNTER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+class ReferenceCounter {
+public:
+  explicit ReferenceCounter(float frameHeight) : height(frameHeight), totalCount(0) {
+    for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
+      tracked[i].lastY = 0;
+      tracked[i].counted = false;
+      tracked[i].lastSeen = 0;
+    }
+  }
+
+  // One frame of detections (normalized boxes); returns vehicles counted
+  int track(const float* ys, const float* confidences, size_t count, uint32_t now) {
+    int newVehicles = 0;
+    int detectionCount = 0;
+
+    for (size_t ix = 0; ix < count; ix++) {
+      if (confidences[ix] < DETECTION_CONFIDENCE_THRESHOLD) continue;
+      if (detectionCount >= MAX_DETECTIONS_PER_FRAME) break;
+
+      int trackIdx = findClosestTrack(ys[ix], now);
+      if (trackIdx >= 0) {
+        float currentY = ys[ix] * height;
+        float previousY = tracked[trackIdx].lastY;
+
+        if (!tracked[trackIdx].counted && hasCrossedLine(currentY, previousY)) {
+          totalCount++;
+          newVehicles++;
+          tracked[trackIdx].counted = true;
+        }
+
+        tracked[trackIdx].lastY = currentY;
+        tracked[trackIdx].lastSeen = now;
+      }
+
+      detectionCount++;
+    }
+
+    pruneOldTracks(now);
+    return newVehicles;
+  }
+
+  uint32_t getTotalCount() const { return totalCount; }
+
+private:
+  struct TrackedVehicle {
+    float lastY;
+    bool counted;
+    uint32_t lastSeen;
+  };
+
+  float height;
+  uint32_t totalCount;
+  TrackedVehicle tracked[MAX_DETECTIONS_PER_FRAME];
+
+  bool hasCrossedLine(float currentY, float previousY) {
+    float lineY = COUNTING_LINE_Y;
+    float margin = COUNTING_ZONE_MARGIN;
+    return previousY < lineY - margin && currentY > lineY + margin;
+  }
+
+  int findClosestTrack(float y, uint32_t now) {
+    const float MAX_DISTANCE = 0.1;  // Max distance to match (normalized)
+    int closestIdx = -1;
+    float closestDist = MAX_DISTANCE;
+
+    for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
+      if (tracked[i].lastSeen == 0) continue;
+
+      float dist = fabsf(y * height - tracked[i].lastY);
+      if (dist < closestDist * height) {
+        closestDist = dist / height;
+        closestIdx = i;
+      }
+    }
+
+    if (closestIdx == -1) {
+      for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
+        if (tracked[i].lastSeen == 0) {
+          tracked[i].lastY = y * height;
+          tracked[i].counted = false;
+          tracked[i].lastSeen = now;
+          return i;
+        }
+      }
+    }
+
+    return closestIdx;
+  }
+
+  void pruneOldTracks(uint32_t now) {
+    for (int i = 0; i < MAX_DETECTIONS_PER_FRAME; i++) {
+      if (tracked[i].lastSeen > 0 && now - tracked[i].lastSeen > 2000) {
+        tracked[i].lastSeen = 0;
+        tracked[i].counted = false;
+      }
+    }
+  }
+};
+
+#endif // REFERENCE_COUNTER_H
@@ -0,0 +1,171 @@
+/**
+ * SwanFlow - SeqLock Stress Test
+ *
+ * One writer thread and two reader threads, as the firmware would have
+ * with readers on the other core. Readers check that every copy they
+ * accept is consistent. Run under ThreadSanitizer (make tsan) to check
+ * nothing is shared outside the lock.
+ */
+
+#include "../src/vehicle_counter.cpp"
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <thread>
+
+static std::atomic<bool> writing(true);
+static std::atomic<long> failures(0);
+
+static void check(bool ok, const char* what) {
+  if (!ok && failures.fetch_add(1) < 10) printf("FAIL: %s\n", what);
+}
+
+// ============================================================================
+// Bare SeqLock
+// ============================================================================
+struct Payload {
+  uint32_t generation;
+  uint32_t values[15];  // generation * (i + 1), so a torn copy shows
+};
+
+static SeqLock payloadLock;
+static Payload payload;
+
+static void payloadWriter(uint32_t writes) {
+  for (uint32_t g = 1; g <= writes; g++) {
+    payloadLock.writeBegin();
+    payload.generation = g;
+    for (int i = 0; i < 15; i++) payload.values[i] = g * (i + 1);
+    payloadLock.writeEnd();
+
+    // Leave the readers gaps now and then (see counterWriter)
+    if (g % 64 == 0) std::this_thread::sleep_for(std::chrono::microseconds(1));
+  }
+  writing = false;
+}
+
+static void payloadReader(long& reads) {
+  uint32_t last = 0;
+  while (writing) {
+    Payload copy;
+    uint32_t seq;
+    do {
+      seq = payloadLock.readBegin();
+      memcpy(&copy, &payload, sizeof(copy));
+    } while (payloadLock.readRetry(seq));
+
+    bool consistent = true;
+    for (int i = 0; i < 15; i++) consistent &= copy.values[i] == copy.generation * (i + 1);
+    check(consistent, "torn payload copy");
+    check(copy.generation >= last, "payload went backwards");
+    last = copy.generation;
+    reads++;
+  }
+}
+
+static void testPayload() {
+  writing = true;
+  long reads[2] = {0, 0};
+  std::thread w(payloadWriter, 500000);
+  std::thread r1(payloadReader, std::ref(reads[0]));
+  std::thread r2(payloadReader, std::ref(reads[1]));
+  w.join();
+  r1.join();
+  r2.join();
+  check(reads[0] > 1000 && reads[1] > 1000, "readers starved");
+  printf("payload: %ld consistent reads during 500000 writes\n", reads[0] + reads[1]);
+}
+
+// ============================================================================
+// VehicleCounter
+// ============================================================================
+// VGA, where vehicles can be counted (see bench_counter.cpp)
+typedef BasicVehicleCounter<640, 480, 10, 2> StressCounter;
+static StressCounter* counter;
+
+// One vehicle at a time, alternating lanes, each counted once
+static void counterWriter(uint32_t vehicles) {
+  const uint16_t step = 44;
+  const uint16_t phase = 10;
+  uint32_t frame = 0;
+  for (uint32_t v = 0; v < vehicles; v++) {
+    for (uint16_t y = phase; y < 480; y += step) {
+      Detection det = {};
+      det.x = (v % 2) ? 0.75f : 0.25f;
+      det.y = y / 480.0f;
+      det.width = 0.1f;
+      det.height = 0.1f;
+      det.confidence = 0.8f;
+      det.timestamp = ++frame * 100;
+      counter->trackDetections(&det, 1, det.timestamp);
+
+      // Frames arrive with gaps, as from the camera. Back-to-back writes
+      // would starve the readers: each copy would overlap a write.
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+    // Let the track expire before the next vehicle
+    frame += 25;
+    counter->trackDetections(nullptr, 0, frame * 100);
+  }
+  writing = false;
+}
+
+static void counterReader(long& reads) {
+  uint32_t lastTotal = 0;
+  uint32_t lastSeq = 0;
+  while (writing) {
+    StressCounter::Totals totals;
+    counter->getTotals(totals);
+    check(totals.totalCount == totals.zoneCounts[0] + totals.zoneCounts[1],
+          "total differs from the zone counts");
+    check(totals.totalCount >= lastTotal, "total went backwards");
+    lastTotal = totals.totalCount;
+
+    CrossingEvent events[8];
+    size_t n = counter->getCrossings(lastSeq, events, 8);
+    for (size_t i = 0; i < n; i++) {
+      check(events[i].seq > lastSeq, "crossing out of order");
+      check(events[i].zone == (events[i].seq % 2 ? 0 : 1), "crossing in the wrong zone");
+      check(events[i].direction == 1 && events[i].trackId != 0, "crossing half written");
+      lastSeq = events[i].seq;
+    }
+
+    CounterStats stats = counter->getStats();
+    check(stats.totalCount >= totals.totalCount, "stats older than totals");
+    reads++;
+  }
+}
+
+static void testCounter() {
+  const uint32_t vehicles = 2000;
+  counter = new StressCounter();
+  counter->begin();
+  writing = true;
+  long reads[2] = {0, 0};
+  std::thread w(counterWriter, vehicles);
+  std::thread r1(counterReader, std::ref(reads[0]));
+  std::thread r2(counterReader, std::ref(reads[1]));
+  w.join();
+  r1.join();
+  r2.join();
+
+  StressCounter::Totals totals;
+  counter->getTotals(totals);
+  check(totals.totalCount == vehicles, "not every vehicle counted");
+  check(reads[0] > 1000 && reads[1] > 1000, "readers starved");
+  printf("counter: %ld consistent reads, %u of %u vehicles counted\n",
+         reads[0] + reads[1], totals.totalCount, vehicles);
+  delete counter;
+}
+
+int main() {
+  hostSerialOutput(false);
+  testPayload();
+  testCounter();
+  if (failures) {
+    printf("%ld failures\n", (long)failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
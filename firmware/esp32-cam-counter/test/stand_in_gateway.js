@@ -0,0 +1,25 @@
+/**
+ * SwanFlow - Stand-in MQTT-SN Gateway for Host Tests
+ *
+ * The backend's MQTT-SN gateway (backend/api/scripts/mqttsn-gateway.js)
+ * on a local UDP port, forwarding publishes to stand_in_server.js in
+ * place of the API. Prints "ready <pid>" once listening.
+ *
+ *   node stand_in_gateway.js <udpPort> <httpPort>
+ */
+
+const path = require('path');
+const { createGateway } = require(path.join(__dirname, '../../../backend/api/scripts/mqttsn-gateway.js'));
+
+const udpPort = parseInt(process.argv[2] || '18432', 10);
+const httpPort = parseInt(process.argv[3] || '18080', 10);
+
+const gateway = createGateway({
+  backendUrl: `http://127.0.0.1:${httpPort}`,
+  apiKey: 'test',
+  log: () => {}
+});
+
+gateway.bind(udpPort, '127.0.0.1', () => {
+  console.log(`ready ${process.pid}`);
+});
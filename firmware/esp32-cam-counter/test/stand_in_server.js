@@ -0,0 +1,50 @@
+/**
+ * SwanFlow - Stand-in Server for Host Tests
+ *
+ * A plain Node HTTP server in place of backend/api for the host tests
+ * and benchmarks. Answers every POST with a small JSON body, keeping
+ * connections alive for keepAliveMs.
+ *
+ *   node stand_in_server.js <port> [keepAliveMs]
+ *
+ * Query options: ?delay=ms holds the response back, ?close=1 answers
+ * with Connection: close. Each response carries X-Requests (requests
+ * received so far) and X-Connections (connections accepted so far), so a
+ * test can tell whether a request arrived twice. Prints "ready <pid>"
+ * once listening.
+ */
+
+const http = require('http');
+
+const port = parseInt(process.argv[2] || '18080', 10);
+const keepAliveMs = parseInt(process.argv[3] || '120000', 10);
+
+let requests = 0;
+let connections = 0;
+
+const server = http.createServer((req, res) => {
+  const url = new URL(req.url, 'http://localhost');
+  const delay = parseInt(url.searchParams.get('delay') || '0', 10);
+  let bytes = 0;
+
+  req.on('data', chunk => { bytes += chunk.length; });
+  req.on('end', () => {
+    requests++;
+    setTimeout(() => {
+      res.setHeader('Content-Type', 'application/json');
+      res.setHeader('X-Requests', String(requests));
+      res.setHeader('X-Connections', String(connections));
+      if (url.searchParams.get('close')) res.setHeader('Connection', 'close');
+      res.statusCode = 201;
+      res.end(JSON.stringify({ success: true, bytes }));
+    }, delay);
+  });
+});
+
+server.on('connection', () => { connections++; });
+server.keepAliveTimeout = keepAliveMs;
+server.headersTimeout = keepAliveMs + 5000;
+
+server.listen(port, '127.0.0.1', () => {
+  console.log(`ready ${process.pid}`);
+});
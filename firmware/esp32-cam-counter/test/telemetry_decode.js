@@ -0,0 +1,81 @@
+/**
+ * SwanFlow - Telemetry Decoder for Host Tests
+ *
+ * Runs the backend's own decoder (backend/api/telemetry.js) over records
+ * the firmware encoder wrote, so a host test can check what the backend
+ * would read. One record per input line, as hex:
+ *
+ *   sftm <hex>          a telemetry record (site N is named "site<N>")
+ *   lz <length> <hex>   an LZ4 block that decodes to length bytes
+ *
+ * Each answer is printed as plain lines, ended by "end":
+ *
+ *   site <name>
+ *   i <interval> <stream> <millis> <uptime> <total> <hour> <minute> <confidence per mille> <unix s>
+ *   m <seq> <ms> <vehicles> h <n> <sum> <bucket count ...> (x3) c <20 bins>
+ *   sd <8 fields> / net <7 fields> / radio <8 fields>
+ *   raw <hex>   (a decoded LZ4 block)
+ *
+ * or "error <message>" if the decoder rejects it.
+ */
+
+const path = require('path');
+const readline = require('readline');
+const { decodeTelemetry, lz4Decode } = require(path.join(__dirname, '../../../backend/api/telemetry.js'));
+
+const findSite = id => ({ name: `site${id}`, latitude: null, longitude: null });
+
+const histogram = h => `h ${h.n} ${h.sum} ${h.b.join(' ')}`.trim();
+
+function describe(body) {
+  const lines = [`site ${body.site}`];
+
+  // Version 1 is shaped like the JSON upload; version 2 has records
+  const records = body.records || [{
+    interval: body.interval,
+    stream: body.stream,
+    timestamp: body.timestamp,
+    uptime: body.uptime,
+    totalCount: body.total_count,
+    hourCount: body.hour_count,
+    minuteCount: body.minute_count,
+    avgConfidence: body.avg_confidence,
+    recordedAt: body.recorded_at
+  }];
+
+  for (const r of records) {
+    lines.push(['i', r.interval, r.stream, r.timestamp, r.uptime, r.totalCount, r.hourCount,
+                r.minuteCount, Math.round(r.avgConfidence * 1000),
+                r.recordedAt ? r.recordedAt / 1000 : 0].join(' '));
+  }
+
+  if (body.metrics) {
+    const m = body.metrics;
+    lines.push([`m ${m.seq} ${m.interval_ms} ${m.vehicles}`, histogram(m.headway_ms),
+                histogram(m.gap_ms), histogram(m.speed_dkmh), `c ${m.confidence.join(' ')}`].join(' '));
+  }
+  if (body.sd) lines.push(`sd ${Object.values(body.sd).join(' ')}`);
+  if (body.net) lines.push(`net ${Object.values(body.net).join(' ')}`);
+  if (body.radio) lines.push(`radio ${Object.values(body.radio).join(' ')}`);
+  return lines.join('\n');
+}
+
+const input = readline.createInterface({ input: process.stdin });
+
+input.on('line', line => {
+  const words = line.split(' ');
+  let answer;
+  try {
+    if (words[0] === 'sftm') {
+      answer = describe(decodeTelemetry(Buffer.from(words[1] || '', 'hex'), findSite));
+    } else if (words[0] === 'lz') {
+      const raw = lz4Decode(Buffer.from(words[2] || '', 'hex'), parseInt(words[1], 10));
+      answer = `raw ${raw.toString('hex')}`;
+    } else {
+      throw new Error(`Unknown input ${words[0]}`);
+    }
+  } catch (error) {
+    answer = `error ${error.message}`;
+  }
+  process.stdout.write(`${answer}\nend\n`);
+});
@@ -0,0 +1,456 @@
+/**
+ * SwanFlow - Telemetry Test
+ *
+ * SFTM records from TelemetryEncoder, read back by the backend's decoder
+ * (backend/api/telemetry.js, through telemetry_decode.js): every field
+ * must come back as it went in, for version 2 batches (plain and LZ),
+ * version 1 records and varint/zigzag edge values. Truncated records
+ * must be refused rather than read short.
+ */
+
+#include "telemetry.h"
+#include "backend_decode.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+// Values either side of each varint length and of the sign bit
+static const uint32_t EDGES[] = {
+  0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456,
+  0x7FFFFFFF, 0x80000000, 0xFFFFFFFE, 0xFFFFFFFF,
+};
+static const size_t EDGE_COUNT = sizeof(EDGES) / sizeof(EDGES[0]);
+
+static uint32_t seed = 1;
+static uint32_t random32() {
+  seed = seed * 1103515245 + 12345;
+  uint32_t high = seed >> 16;
+  seed = seed * 1103515245 + 12345;
+  return (high << 16) | (seed >> 16);
+}
+
+// ============================================================================
+// Expected Decoder Output (as telemetry_decode.js prints it)
+// ============================================================================
+static uint32_t mille(float confidence) {
+  return (uint32_t)(constrain(confidence, 0.0f, 1.0f) * 1000 + 0.5f);
+}
+
+static std::string line(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  return std::string(buffer) + "\n";
+}
+
+static std::string expectInterval(const IntervalRecord& r, bool epoch) {
+  return line("i %lu %lu %lu %lu %lu %lu %lu %lu %lu", (unsigned long)r.interval,
+              (unsigned long)r.stream, (unsigned long)r.timestamp, (unsigned long)r.uptime,
+              (unsigned long)r.totalCount, (unsigned long)r.lastHourCount,
+              (unsigned long)r.lastMinuteCount, (unsigned long)mille(r.avgConfidence),
+              (unsigned long)(epoch ? r.epoch : 0));
+}
+
+static std::string expectHistogram(const LogHistogram& hist) {
+  std::string s = " h " + std::to_string(hist.total) + " " + std::to_string(hist.sum);
+  for (int i = 0; i < LogHistogram::BUCKETS; i++) {
+    if (hist.counts[i]) s += " " + std::to_string(i) + " " + std::to_string(hist.counts[i]);
+  }
+  return s;
+}
+
+static std::string expect(uint32_t siteId, const IntervalRecord* intervals, size_t count,
+                          const MetricsSummary* metrics, const SdWriterStats* sd,
+                          const HttpStats* net, const RadioStats* radio) {
+  bool epoch = false;
+  for (size_t i = 0; i < count; i++) {
+    if (intervals[i].epoch) epoch = true;
+  }
+
+  std::string s = line("site site%lu", (unsigned long)siteId);
+  for (size_t i = 0; i < count; i++) {
+    s += expectInterval(intervals[i], epoch);
+  }
+  if (metrics) {
+    s += "m " + std::to_string(metrics->seq) + " " + std::to_string(metrics->duration) + " " +
+         std::to_string(metrics->vehicles) + expectHistogram(metrics->headwayMs) +
+         expectHistogram(metrics->gapMs) + expectHistogram(metrics->speedDkmh) + " c";
+    for (int i = 0; i < 20; i++) {
+      s += " " + std::to_string(metrics->confidence[i]);
+    }
+    s += "\n";
+  }
+  if (sd) {
+    s += line("sd %lu %lu %lu %u %u %lu %lu %lu", (unsigned long)sd->written,
+              (unsigned long)sd->failed, (unsigned long)sd->dropped, sd->queueDepth,
+              sd->maxQueueDepth, (unsigned long)sd->latencyP50Us, (unsigned long)sd->latencyP95Us,
+              (unsigned long)sd->latencyP99Us);
+  }
+  if (net) {
+    s += line("net %lu %lu %lu %lu %lu %lu %lu", (unsigned long)net->lastRttMs,
+              (unsigned long)net->lastConnectMs, (unsigned long)net->lastBytesSent,
+              (unsigned long)net->lastBytesReceived, (unsigned long)net->connects,
+              (unsigned long)net->reused, (unsigned long)net->stale);
+  }
+  if (radio) {
+    s += line("radio %lu %lu %lu %lu %u %lu %lu %lu", (unsigned long)radio->periodMs,
+              (unsigned long)radio->activeMs, (unsigned long)radio->awakeMs,
+              (unsigned long)radio->wakes, radio->linkHealth, (unsigned long)radio->tauS,
+              (unsigned long)radio->activeTimeS, (unsigned long)radio->edrxMs);
+  }
+  return s;
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+struct Record {
+  std::string name;
+  std::vector<uint8_t> bytes;
+  std::string expected;
+};
+
+static std::vector<Record> records;
+
+static void add(const char* name, const uint8_t* bytes, size_t length, const std::string& expected) {
+  Record r;
+  r.name = name;
+  r.bytes.assign(bytes, bytes + length);
+  r.expected = expected;
+  records.push_back(r);
+}
+
+// Encode with TelemetryEncoder, plain and (when it comes out smaller) LZ
+static size_t addEncoded(const char* name, uint32_t siteId, const IntervalRecord* intervals,
+                         size_t count, const MetricsSummary* metrics = nullptr,
+                         const SdWriterStats* sd = nullptr, const HttpStats* net = nullptr,
+                         const RadioStats* radio = nullptr) {
+  static uint8_t buffer[TelemetryEncoder::maxSize(2000)];
+  static uint8_t packed[sizeof(buffer)];
+  static LzCompressor lz;
+
+  TelemetryEncoder encoder(buffer, TelemetryEncoder::maxSize(count));
+  size_t length = encoder.encode(siteId, intervals, count, metrics, sd, net, radio);
+  CHECK(length > 0);
+  std::string expected = expect(siteId, intervals, count, metrics, sd, net, radio);
+  add(name, buffer, length, expected);
+
+  size_t packedLength = encoder.compress(lz, packed, sizeof(packed));
+  if (packedLength) {
+    CHECK(packed[5] & TELEMETRY_LZ);
+    add((std::string(name) + " (LZ)").c_str(), packed, packedLength, expected);
+  }
+  return packedLength;
+}
+
+static IntervalRecord interval(uint32_t n, uint32_t timestamp, uint32_t total) {
+  IntervalRecord r = {};
+  r.interval = n;
+  r.stream = 0x5EED0001;
+  r.timestamp = timestamp;
+  r.totalCount = total;
+  r.avgConfidence = 0.5f;
+  return r;
+}
+
+// A day of uploads a minute apart, with every optional section
+static void addRealistic() {
+  static IntervalRecord day[1440];
+  uint32_t total = 0;
+  for (size_t i = 0; i < 1440; i++) {
+    uint32_t vehicles = 20 + random32() % 30;
+    total += vehicles;
+    day[i] = interval(1000 + i, 5000 + i * 60000 + random32() % 50, total);
+    day[i].uptime = 5 + i * 60;
+    day[i].epoch = 1791000000 + i * 60;
+    day[i].lastMinuteCount = vehicles;
+    day[i].lastHourCount = vehicles * 60;
+    day[i].avgConfidence = 0.6f + (random32() % 300) / 1000.0f;
+  }
+
+  static MetricsSummary metrics;
+  memset(&metrics, 0, sizeof(metrics));
+  metrics.seq = 77;
+  metrics.duration = 60000;
+  metrics.vehicles = 41;
+  for (int i = 0; i < 41; i++) {
+    metrics.headwayMs.add(800 + random32() % 5000);
+    metrics.gapMs.add(random32() % 4000);
+    metrics.speedDkmh.add(300 + random32() % 500);
+    metrics.confidence[12 + i % 8]++;
+  }
+  SdWriterStats sd = { 3, 17, 123456, 2, 9, 850, 4100, 19000, 2200 };
+  HttpStats net = {};
+  net.lastRttMs = 640;
+  net.lastConnectMs = 2100;
+  net.lastBytesSent = 412;
+  net.lastBytesReceived = 225;
+  net.connects = 12;
+  net.reused = 300;
+  net.stale = 2;
+  RadioStats radio = { 3600000, 210000, 260000, 61, 93, 3240, 60, 81920 };
+
+  addEncoded("v2 one interval", 7, day, 1);
+  addEncoded("v2 one interval, all sections", 7, day, 1, &metrics, &sd, &net, &radio);
+  CHECK(addEncoded("v2 hour", 7, day, 60, &metrics, &sd, &net, &radio) > 0);
+  CHECK(addEncoded("v2 day", 7, day, 1440) > 0);
+
+  // Without Unix time, and with it known for only part of the batch
+  for (size_t i = 0; i < 30; i++) day[i].epoch = 0;
+  addEncoded("v2 no epoch", 7, day, 30);
+  addEncoded("v2 epoch from midway", 7, day, 60);
+}
+
+// Every edge value in every field, and deltas between them both ways
+static void addEdges() {
+  static IntervalRecord edges[EDGE_COUNT * 2];
+  for (size_t i = 0; i < EDGE_COUNT * 2; i++) {
+    IntervalRecord& r = edges[i];
+    r.interval = EDGES[(i * 3) % EDGE_COUNT];
+    r.stream = EDGES[EDGE_COUNT - 1 - i % EDGE_COUNT];
+    r.timestamp = EDGES[(i * 5) % EDGE_COUNT];
+    r.epoch = EDGES[(i * 7) % EDGE_COUNT];
+    r.totalCount = EDGES[i % EDGE_COUNT];
+    r.lastHourCount = EDGES[EDGE_COUNT - 1 - i % EDGE_COUNT];
+    r.lastMinuteCount = EDGES[(i * 11) % EDGE_COUNT];
+    r.uptime = EDGES[(i * 13) % EDGE_COUNT];
+    r.avgConfidence = i % 3 == 0 ? 0.0f : i % 3 == 1 ? 1.0f : 0.999f;
+  }
+  edges[0].stream = 0x80000001;  // One stream per batch
+  for (size_t i = 1; i < EDGE_COUNT * 2; i++) edges[i].stream = edges[0].stream;
+  addEncoded("v2 edge values", 1, edges, EDGE_COUNT * 2);
+
+  // Zigzag extremes: deltas of -2^31 and 2^31 - 1, and wrapping clocks
+  uint32_t totals[] = { 0, 0x80000000, 0, 0x7FFFFFFF, 0xFFFFFFFF, 0, 1, 0 };
+  IntervalRecord zigzag[8];
+  for (size_t i = 0; i < 8; i++) {
+    zigzag[i] = interval(0xFFFFFFFC + i, 0xFFFF0000 + i * 0x4000, totals[i]);
+    zigzag[i].uptime = i % 2 ? 0xFFFFFFFF : 0;
+    zigzag[i].epoch = 0xFFFFFFF0 + i * 4;  // Wraps
+  }
+  addEncoded("v2 zigzag extremes", 1, zigzag, 8);
+
+  // Confidence out of range is clamped, not wrapped
+  IntervalRecord clamp[3] = { interval(1, 0, 0), interval(2, 0, 0), interval(3, 0, 0) };
+  clamp[0].avgConfidence = 1.5f;
+  clamp[1].avgConfidence = -0.5f;
+  clamp[2].avgConfidence = 0.0004f;
+  addEncoded("v2 confidence clamped", 1, clamp, 3);
+
+  // Site IDs at each varint length
+  for (size_t i = 0; i < EDGE_COUNT; i++) {
+    IntervalRecord r = interval(1, 1, 1);
+    addEncoded("v2 site ID", EDGES[i], &r, 1);
+  }
+}
+
+// Random fields of random widths, in batches of random size
+static void addRandom() {
+  static IntervalRecord batch[300];
+  for (int b = 0; b < 20; b++) {
+    size_t count = 1 + random32() % 300;
+    for (size_t i = 0; i < count; i++) {
+      uint32_t* fields[] = { &batch[i].interval, &batch[i].timestamp, &batch[i].epoch,
+                             &batch[i].totalCount, &batch[i].lastHourCount,
+                             &batch[i].lastMinuteCount, &batch[i].uptime };
+      for (size_t f = 0; f < 7; f++) {
+        *fields[f] = random32() >> (random32() % 32);
+      }
+      batch[i].stream = 42;
+      batch[i].avgConfidence = (random32() % 1001) / 1000.0f;
+    }
+    addEncoded("v2 random", random32() >> (random32() % 32), batch, count);
+  }
+}
+
+// ============================================================================
+// Version 1 (written here: the firmware only sends version 2 now)
+// ============================================================================
+struct Writer {
+  std::vector<uint8_t> bytes;
+
+  void varint(uint32_t v) {
+    while (v >= 0x80) {
+      bytes.push_back((v & 0x7F) | 0x80);
+      v >>= 7;
+    }
+    bytes.push_back(v);
+  }
+  void le32(uint32_t v) {
+    for (int i = 0; i < 4; i++) bytes.push_back(v >> (i * 8));
+  }
+};
+
+static void addVersion1(uint32_t siteId, const IntervalRecord& r, const SdWriterStats* sd) {
+  Writer w;
+  const uint8_t header[] = { 'S', 'F', 'T', 'M', 1,
+                             (uint8_t)((r.epoch ? TELEMETRY_EPOCH : 0) | (sd ? TELEMETRY_SD : 0)) };
+  w.bytes.assign(header, header + sizeof(header));
+  w.varint(siteId);
+  w.varint(r.interval);
+  w.le32(r.stream);
+  w.varint(r.timestamp);
+  w.varint(r.uptime);
+  w.varint(r.totalCount);
+  w.varint(r.lastHourCount);
+  w.varint(r.lastMinuteCount);
+  w.varint(mille(r.avgConfidence));
+  if (r.epoch) w.varint(r.epoch);
+  if (sd) {
+    const uint32_t fields[] = { sd->written, sd->failed, sd->dropped, sd->queueDepth,
+                                sd->maxQueueDepth, sd->latencyP50Us, sd->latencyP95Us,
+                                sd->latencyP99Us };
+    for (size_t i = 0; i < 8; i++) w.varint(fields[i]);
+  }
+  add("v1", w.bytes.data(), w.bytes.size(), expect(siteId, &r, 1, nullptr, sd, nullptr, nullptr));
+}
+
+static void addVersion1Records() {
+  SdWriterStats sd = { 0, 0xFFFF, 0xFFFFFFFF, 128, 0, 16384, 1, 0x80000000, 0 };
+  for (size_t i = 0; i < EDGE_COUNT; i++) {
+    IntervalRecord r = interval(EDGES[i], EDGES[EDGE_COUNT - 1 - i], EDGES[(i * 5) % EDGE_COUNT]);
+    r.stream = EDGES[(i * 3) % EDGE_COUNT];
+    r.uptime = EDGES[(i * 7) % EDGE_COUNT];
+    r.lastHourCount = EDGES[(i * 9) % EDGE_COUNT];
+    r.lastMinuteCount = EDGES[(i * 11) % EDGE_COUNT];
+    r.epoch = i % 2 ? 0 : 1791000000 + i;
+    r.avgConfidence = (i * 77 % 1001) / 1000.0f;
+    addVersion1(EDGES[i], r, i % 3 == 0 ? &sd : nullptr);
+  }
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// The exact bytes of a small batch: varints low 7 bits first, deltas zigzag
+static void testGoldenBytes() {
+  IntervalRecord batch[2] = { interval(1, 1000, 5), interval(2, 2000, 4) };
+  batch[0].stream = batch[1].stream = 0x01020304;
+  batch[0].uptime = 10;
+  batch[1].uptime = 11;
+  batch[0].lastHourCount = batch[1].lastHourCount = 2;
+  batch[0].lastMinuteCount = 1;
+
+  const uint8_t golden[] = {
+    'S', 'F', 'T', 'M', 2, 0,
+    0x01, 0x04, 0x03, 0x02, 0x01, 0x02,          // Site 1, stream, 2 intervals
+    0x01, 0xE8, 0x07, 0x0A, 0x05, 0x02, 0x01, 0xF4, 0x03,  // 1, 1000 ms, 10 s, 5, 2, 1, 500
+    0x00, 0xD0, 0x0F, 0x02, 0x01, 0x00, 0x01, 0x00,        // +1, +1000 ms, +1 s, -1, 0, -1, 0
+  };
+
+  uint8_t buffer[64];
+  TelemetryEncoder encoder(buffer, sizeof(buffer));
+  size_t length = encoder.encode(1, batch, 2, nullptr, nullptr, nullptr, nullptr);
+  CHECK(length == sizeof(golden) && memcmp(buffer, golden, length) == 0);
+  add("golden", buffer, length, expect(1, batch, 2, nullptr, nullptr, nullptr, nullptr));
+
+  // Site IDs: one byte to 127, five for the top of the range
+  IntervalRecord r = interval(1, 1, 1);
+  encoder.encode(128, &r, 1, nullptr, nullptr, nullptr, nullptr);
+  CHECK(buffer[6] == 0x80 && buffer[7] == 0x01);
+  encoder.encode(0xFFFFFFFF, &r, 1, nullptr, nullptr, nullptr, nullptr);
+  CHECK(buffer[6] == 0xFF && buffer[9] == 0xFF && buffer[10] == 0x0F);
+}
+
+// A record that doesn't fit is refused, and maxSize() covers the worst case
+static void testCapacity() {
+  static IntervalRecord worst[50];
+  for (size_t i = 0; i < 50; i++) {
+    worst[i] = interval(i % 2 ? 0 : 0x80000000, i % 2 ? 0 : 0x80000000, i % 2 ? 0 : 0x80000000);
+    worst[i].uptime = worst[i].epoch = worst[i].lastHourCount = worst[i].lastMinuteCount =
+        worst[i].totalCount;
+  }
+  static MetricsSummary metrics;
+  memset(&metrics, 0xFF, sizeof(metrics));
+  SdWriterStats sd;
+  memset(&sd, 0xFF, sizeof(sd));
+  HttpStats net;
+  memset(&net, 0xFF, sizeof(net));
+  RadioStats radio;
+  memset(&radio, 0xFF, sizeof(radio));
+
+  static uint8_t buffer[TelemetryEncoder::maxSize(50)];
+  TelemetryEncoder encoder(buffer, sizeof(buffer));
+  size_t length = encoder.encode(0xFFFFFFFF, worst, 50, &metrics, &sd, &net, &radio);
+  CHECK(length > 0 && length <= sizeof(buffer));
+  add("worst case", buffer, length, expect(0xFFFFFFFF, worst, 50, &metrics, &sd, &net, &radio));
+
+  TelemetryEncoder small(buffer, length - 1);
+  CHECK(small.encode(0xFFFFFFFF, worst, 50, &metrics, &sd, &net, &radio) == 0);
+  CHECK(small.encode(1, worst, 0, nullptr, nullptr, nullptr, nullptr) == 0);
+}
+
+// Everything above through the backend's decoder, then every strict
+// prefix of a few records, which must be refused
+static void testDecode() {
+  std::vector<std::string> requests;
+  for (size_t i = 0; i < records.size(); i++) {
+    requests.push_back("sftm " + hostHex(records[i].bytes.data(), records[i].bytes.size()));
+  }
+
+  size_t prefixesFrom = requests.size();
+  const char* truncated[] = { "golden", "v2 one interval, all sections", "v2 hour (LZ)", "v1" };
+  for (size_t t = 0; t < sizeof(truncated) / sizeof(truncated[0]); t++) {
+    for (size_t i = 0; i < records.size(); i++) {
+      if (records[i].name != truncated[t]) continue;
+      for (size_t n = 0; n < records[i].bytes.size(); n++) {
+        requests.push_back("sftm " + hostHex(records[i].bytes.data(), n));
+      }
+      break;
+    }
+  }
+
+  std::vector<std::string> answers;
+  CHECK(hostBackendDecode(requests, answers));
+  if (answers.size() != requests.size()) return;
+
+  int wrong = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (answers[i] == records[i].expected) continue;
+    if (wrong++ < 3) {
+      printf("FAIL %s:\n  expected %.300s\n  decoded  %.300s\n", records[i].name.c_str(),
+             records[i].expected.c_str(), answers[i].c_str());
+    }
+  }
+  CHECK(wrong == 0);
+
+  int accepted = 0;
+  for (size_t i = prefixesFrom; i < answers.size(); i++) {
+    if (answers[i].compare(0, 6, "error ") != 0) accepted++;
+  }
+  CHECK(accepted == 0);
+
+  printf("%zu records decoded (%d wrong), %zu truncations (%d accepted)\n", records.size(), wrong,
+         answers.size() - prefixesFrom, accepted);
+}
+
+int main() {
+  hostSerialOutput(false);
+  testGoldenBytes();
+  testCapacity();
+  addRealistic();
+  addEdges();
+  addRandom();
+  addVersion1Records();
+  testDecode();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,358 @@
+/**
+ * SwanFlow - Training Export Test
+ *
+ * LOG_TRAINING records written the way the capture loop writes them
+ * (TrainingCapture::buildSidecar() and a two-part SdWriter::submit() into
+ * the EventLog), among other records and with one torn on the card, then
+ * read back by tools/export_training.py: the JPEGs byte for byte, file
+ * names from the header's time and the record's seq, boxes in pixels
+ * (clipped to the frame, filtered by confidence) and the reason counts.
+ * Labels are read through training_labels.py. Skipped without Python 3.
+ */
+
+#include "training_capture.h"
+#include "sd_writer.h"
+#include "event_log.h"
+#include "image_store.h"
+#include <stdio.h>
+#include <dirent.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef TEST_DIR
+#define TEST_DIR "."
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+static const char* ROOT = "/tmp/swanflow-test-training";
+static const float MIN_CONFIDENCE = 0.5f;  // Passed to the exporter
+
+static fs::FS sd(ROOT);
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Box {
+  uint16_t x, y, width, height;
+};
+
+// A logged frame and what the exporter should make of it
+struct Frame {
+  uint8_t reasons;
+  uint32_t timestamp;
+  uint32_t epoch;
+  std::vector<Detection> detections;
+  Bytes jpeg;
+  uint32_t seq;            // Its record's
+  std::vector<Box> boxes;  // Expected labels (confidence >= MIN_CONFIDENCE)
+  bool torn;
+};
+
+// A JPEG-shaped frame whose bytes follow from seed
+static Bytes makeJpeg(size_t length, uint8_t seed) {
+  Bytes jpeg(length);
+  for (size_t i = 0; i < length; i++) jpeg[i] = (uint8_t)(seed * 29 + i * 13 + (i >> 7));
+  jpeg[0] = 0xFF;
+  jpeg[1] = 0xD8;
+  jpeg[length - 2] = 0xFF;
+  jpeg[length - 1] = 0xD9;
+  return jpeg;
+}
+
+// Sizes are multiples of 1/32 so the expected pixels are exact
+static_assert(frameWidth(CAMERA_FRAME_SIZE) == 320 && frameHeight(CAMERA_FRAME_SIZE) == 240,
+              "Expected boxes are in QVGA pixels");
+
+static Detection detection(float x, float y, float width, float height, float confidence,
+                           uint16_t trackId) {
+  Detection det;
+  memset(&det, 0, sizeof(det));
+  det.x = x;
+  det.y = y;
+  det.width = width;
+  det.height = height;
+  det.confidence = confidence;
+  det.trackId = trackId;
+  return det;
+}
+
+static std::vector<Frame> makeFrames() {
+  std::vector<Frame> frames(5);
+
+  // Reasons are spread so each is counted a different number of times
+
+  // Night, nothing in view
+  frames[0].reasons = TRAIN_NIGHT | TRAIN_UNIFORM | TRAIN_NEAR_CROSSING;
+  frames[0].timestamp = 1000;
+  frames[0].epoch = 1760000000;
+  frames[0].jpeg = makeJpeg(3000, 1);
+
+  // Before network time (named by millis); the low-confidence box is left out
+  frames[1].reasons = TRAIN_UNIFORM | TRAIN_LOW_CONFIDENCE;
+  frames[1].timestamp = 61000;
+  frames[1].epoch = 0;
+  frames[1].detections.push_back(detection(0.5f, 0.5f, 0.25f, 0.5f, 0.4f, 7));
+  frames[1].detections.push_back(detection(0.25f, 0.75f, 0.125f, 0.125f, 0.9f, 8));
+  frames[1].boxes.push_back(Box{ 60, 165, 40, 30 });
+  frames[1].jpeg = makeJpeg(4500, 2);
+
+  // A full frame of boxes, the last over the top-right corner
+  frames[2].reasons = TRAIN_NEAR_CROSSING | TRAIN_UNIFORM;
+  frames[2].timestamp = 125000;
+  frames[2].epoch = 1760000100;
+  for (int i = 0; i < MAX_DETECTIONS_PER_FRAME - 1; i++) {
+    float confidence = i == 0 ? 0.2f : 0.55f + 0.04f * i;
+    frames[2].detections.push_back(detection((i + 1) / 16.0f, 0.5f, 1 / 16.0f, 0.25f, confidence, i + 1));
+    if (i > 0) frames[2].boxes.push_back(Box{ (uint16_t)(10 * (2 * i + 1)), 90, 20, 60 });
+  }
+  frames[2].detections.push_back(detection(0.9375f, 0.0625f, 0.25f, 0.25f, 0.8f, 20));
+  frames[2].boxes.push_back(Box{ 260, 0, 60, 45 });
+  frames[2].jpeg = makeJpeg(12000, 3);
+
+  // Torn on the card after it was written
+  frames[3].reasons = TRAIN_UNIFORM;
+  frames[3].timestamp = 361000;
+  frames[3].epoch = 1760000400;
+  frames[3].detections.push_back(detection(0.5f, 0.5f, 0.25f, 0.25f, 0.9f, 21));
+  frames[3].jpeg = makeJpeg(2000, 4);
+  frames[3].torn = true;
+
+  // After the torn one
+  frames[4].reasons = TRAIN_UNIFORM | TRAIN_NEAR_CROSSING | TRAIN_LOW_CONFIDENCE;
+  frames[4].timestamp = 371000;
+  frames[4].epoch = 1760000410;
+  frames[4].detections.push_back(detection(0.5f, 0.4375f, 0.125f, 0.25f, 0.7f, 22));
+  frames[4].boxes.push_back(Box{ 140, 75, 40, 60 });
+  frames[4].jpeg = makeJpeg(800, 5);
+  return frames;
+}
+
+// ============================================================================
+// Writing the Log
+// ============================================================================
+struct Device {
+  EventLog log;
+  ImageStore images;  // Not started: no images in this test
+  SdWriter writer;
+  TrainingCapture training;
+  uint32_t submitted;
+  uint32_t nextSeq;
+
+  Device() : submitted(0), nextSeq(0) {}
+
+  bool begin() {
+    if (!log.begin(sd) || !writer.begin(log, images)) return false;
+    nextSeq = log.getNextSeq();
+    return true;
+  }
+
+  // As loop() logs a sampled frame
+  void logFrame(Frame& frame) {
+    static TrainingSidecar sidecar;
+    size_t length = training.buildSidecar(sidecar, frame.reasons, frame.detections.data(),
+                                          frame.detections.size(), frame.timestamp, frame.epoch,
+                                          frame.jpeg.size());
+    CHECK(length == sizeof(TrainingHeader) + frame.detections.size() * sizeof(TrainingBox));
+    CHECK(writer.submit(LOG_TRAINING, frame.timestamp, &sidecar, length, frame.jpeg.data(),
+                        frame.jpeg.size()));
+    frame.seq = nextSeq++;
+    submitted++;
+  }
+
+  void logCrossing() {
+    uint8_t crossing[28];
+    memset(crossing, 'c', sizeof(crossing));
+    CHECK(writer.submit(LOG_CROSSING, millis(), crossing, sizeof(crossing)));
+    nextSeq++;
+    submitted++;
+  }
+
+  // Wait until the writer task has appended everything, then flush
+  void settle() {
+    for (;;) {
+      SdWriterStats stats = writer.getStats();
+      if (stats.written + stats.failed >= submitted) break;
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    CHECK(writer.getStats().failed == 0 && writer.getStats().dropped == 0);
+    log.flush();
+  }
+};
+
+// Flip a byte in the middle of a frame's JPEG where it lies in the log
+static bool tear(const Frame& frame) {
+  File file = sd.open("/log/events.bin", "r+");
+  std::vector<uint8_t> head(1 << 20);
+  size_t n = file.read(head.data(), head.size());
+  for (size_t pos = 0; pos + frame.jpeg.size() <= n; pos++) {
+    if (memcmp(&head[pos], frame.jpeg.data(), frame.jpeg.size()) != 0) continue;
+    uint8_t flipped = head[pos + frame.jpeg.size() / 2] ^ 0x20;
+    file.seek(pos + frame.jpeg.size() / 2);
+    file.write(&flipped, 1);
+    return true;
+  }
+  return false;
+}
+
+// ============================================================================
+// Reading the Export
+// ============================================================================
+static std::vector<std::string> run(const std::string& command, int& status) {
+  std::vector<std::string> lines;
+  FILE* pipe = popen(command.c_str(), "r");
+  if (!pipe) {
+    status = -1;
+    return lines;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), pipe)) {
+    lines.push_back(line);
+    if (!lines.back().empty() && lines.back().back() == '\n') lines.back().pop_back();
+  }
+  status = pclose(pipe);
+  return lines;
+}
+
+static bool contains(const std::vector<std::string>& lines, const std::string& line) {
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (lines[i] == line) return true;
+  }
+  return false;
+}
+
+// "<epoch or millis>-<generation>-<seq>.jpg" among the exported files
+static std::string findFile(const std::vector<std::string>& files, const Frame& frame) {
+  char prefix[16], suffix[24];
+  snprintf(prefix, sizeof(prefix), "%lu-", (unsigned long)(frame.epoch ? frame.epoch : frame.timestamp));
+  snprintf(suffix, sizeof(suffix), "-%lu.jpg", (unsigned long)frame.seq);
+  for (size_t i = 0; i < files.size(); i++) {
+    const std::string& name = files[i];
+    if (name.size() == strlen(prefix) + 8 + strlen(suffix) && name.compare(0, strlen(prefix), prefix) == 0 &&
+        name.compare(name.size() - strlen(suffix), std::string::npos, suffix) == 0) {
+      return name;
+    }
+  }
+  return "";
+}
+
+static Bytes readFile(const std::string& path) {
+  Bytes data;
+  FILE* file = fopen(path.c_str(), "rb");
+  if (!file) return data;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), file)) > 0) data.insert(data.end(), buf, buf + n);
+  fclose(file);
+  return data;
+}
+
+// ============================================================================
+// Test
+// ============================================================================
+static void testExport() {
+  sd.clear();
+  std::vector<Frame> frames = makeFrames();
+
+  Device device;
+  CHECK(device.begin());
+  device.logCrossing();
+  device.logFrame(frames[0]);
+  device.logCrossing();
+  device.logFrame(frames[1]);
+  device.logFrame(frames[2]);
+  device.logCrossing();
+  device.logFrame(frames[3]);
+  device.logFrame(frames[4]);
+  device.settle();
+  CHECK(tear(frames[3]));
+
+  const std::string output = std::string(ROOT) + "/export";
+  char minConfidence[16];
+  snprintf(minConfidence, sizeof(minConfidence), "%.2f", MIN_CONFIDENCE);
+  int status;
+  std::vector<std::string> summary = run(std::string("python3 ") + TEST_DIR + "/../tools/export_training.py --log " +
+                                         ROOT + "/log/events.bin --output " + output +
+                                         " --min-confidence " + minConfidence + " 2>&1", status);
+  CHECK(status == 0);
+  CHECK(contains(summary, "Exported 4 frames to " + output));
+  CHECK(contains(summary, "  uniform: 4") && contains(summary, "  low-confidence: 2"));
+  CHECK(contains(summary, "  near-crossing: 3") && contains(summary, "  night: 1"));
+
+  // The JPEGs, and nothing else but the labels
+  std::vector<std::string> files;
+  DIR* dir = opendir(output.c_str());
+  CHECK(dir != nullptr);
+  if (!dir) return;
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') files.push_back(entry->d_name);
+  }
+  closedir(dir);
+  CHECK(files.size() == 5);
+
+  std::vector<std::string> labels = run(std::string("python3 ") + TEST_DIR + "/training_labels.py " + output, status);
+  CHECK(status == 0);
+  CHECK(!labels.empty() && labels[0] == "labels 1 bounding-box-labels");
+
+  size_t frameLines = 0;
+  for (size_t i = 0; i < labels.size(); i++) {
+    if (labels[i].compare(0, 6, "frame ") == 0) frameLines++;
+  }
+  CHECK(frameLines == 4);
+
+  for (size_t f = 0; f < frames.size(); f++) {
+    const Frame& frame = frames[f];
+    std::string name = findFile(files, frame);
+    if (frame.torn) {
+      CHECK(name.empty());
+      continue;
+    }
+    CHECK(!name.empty());
+    if (name.empty()) continue;
+    CHECK(readFile(output + "/" + name) == frame.jpeg);
+
+    // Its labels: the frame line, then its boxes in order
+    char line[128];
+    snprintf(line, sizeof(line), "frame %s %u", name.c_str(), (unsigned)frame.boxes.size());
+    size_t at = 0;
+    while (at < labels.size() && labels[at] != line) at++;
+    CHECK(at < labels.size());
+    for (size_t b = 0; b < frame.boxes.size(); b++) {
+      const Box& box = frame.boxes[b];
+      snprintf(line, sizeof(line), "box vehicle %u %u %u %u", box.x, box.y, box.width, box.height);
+      bool match = at + 1 + b < labels.size() && labels[at + 1 + b] == line;
+      if (!match) printf("  %s: expected \"%s\"\n", name.c_str(), line);
+      CHECK(match);
+    }
+  }
+}
+
+int main() {
+  hostSerialOutput(false);
+
+  int status;
+  run("python3 --version", status);
+  if (status != 0) {
+    printf("skipped: Python 3 not found\n");
+    return 0;
+  }
+
+  testExport();
+  sd.clear();
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
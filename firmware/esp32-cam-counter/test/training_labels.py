@@ -0,0 +1,29 @@
+"""
+SwanFlow - Training Labels Reader for Host Tests
+
+Prints the bounding_boxes.labels file tools/export_training.py wrote as
+plain lines, so a host test can check it without a JSON parser:
+
+    labels <version> <type>
+    frame <file name> <boxes>
+    box <label> <x> <y> <width> <height>    (one per box, after its frame)
+
+Usage: python3 training_labels.py <output dir>
+"""
+
+import json
+import sys
+from pathlib import Path
+
+
+def main():
+    labels = json.loads((Path(sys.argv[1]) / 'bounding_boxes.labels').read_text())
+    print(f"labels {labels['version']} {labels['type']}")
+    for name, boxes in sorted(labels['boundingBoxes'].items()):
+        print(f"frame {name} {len(boxes)}")
+        for box in boxes:
+            print(f"box {box['label']} {box['x']} {box['y']} {box['width']} {box['height']}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,258 @@
+/**
+ * SwanFlow - Warm State Test
+ *
+ * Restore after a reset, with RTC memory and NVS shimmed (host/Arduino.h,
+ * host/Preferences.h) so they outlast the objects each simulated boot
+ * creates: a valid RTC block brings back everything, one with a bad CRC
+ * (or after power-on) falls back to the NVS totals, and an NVS record in
+ * an older format or from another build is refused. Vehicles on the line
+ * at the reset are counted once: not again if they were, and still if
+ * they weren't.
+ */
+
+#include "warm_state.h"
+#include <Preferences.h>
+#include "esp_system.h"
+#include "esp32/rom/crc.h"
+#include <stdio.h>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond)                                              \
+  do {                                                           \
+    if (!(cond)) {                                               \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);     \
+      failures++;                                                \
+    }                                                            \
+  } while (0)
+
+typedef std::vector<uint8_t> Bytes;
+
+// One boot's objects
+static VehicleCounter* counter = nullptr;
+static WarmState* warm = nullptr;
+static UploadState upload;
+
+// A reset: RTC memory and NVS stay, the rest starts over
+static WarmSource reboot(esp_reset_reason_t reason) {
+  delete counter;
+  delete warm;
+  hostResetReason() = reason;
+  hostSetMillis(300);
+
+  counter = new VehicleCounter();
+  counter->begin();
+  warm = new WarmState();
+  memset(&upload, 0, sizeof(upload));
+  upload.incidentStream = 0xF00D;  // This boot's fresh values
+  return warm->restore(*counter, upload);
+}
+
+// RTC memory after power-on: whatever the cells came up as
+static void powerLoss() {
+  size_t length;
+  uint8_t* rtc = hostRtcMemory(&length);
+  for (size_t i = 0; i < length; i++) rtc[i] = rand();
+}
+
+static uint32_t total() {
+  VehicleCounter::Totals totals;
+  counter->getTotals(totals);
+  return totals.totalCount;
+}
+
+// One frame with a vehicle in each lane given a y (pixels, < 0 = none)
+static void frame(int left, int right) {
+  Detection det[2];
+  size_t n = 0;
+  const int ys[2] = { left, right };
+  for (int lane = 0; lane < 2; lane++) {
+    if (ys[lane] < 0) continue;
+    memset(&det[n], 0, sizeof(det[n]));
+    det[n].x = lane ? 0.75f : 0.25f;
+    det[n].y = ys[lane] / 240.0f;
+    det[n].width = 0.1f;
+    det[n].height = 0.1f;
+    det[n].confidence = 0.8f;
+    det[n].timestamp = millis();
+    n++;
+  }
+  counter->trackDetections(det, n, millis());
+  hostAdvance(100);
+}
+
+// ============================================================================
+// Raw Records
+// ============================================================================
+// Both end in a CRC32 of everything before it
+static void fixCrc(uint8_t* record, size_t size) {
+  uint32_t crc = crc32_le(0, record, size - 4);
+  memcpy(record + size - 4, &crc, 4);
+}
+
+static Bytes readNvs() {
+  Bytes record(256);
+  Preferences prefs;
+  prefs.begin("swanflow", true);
+  record.resize(prefs.getBytes("totals", record.data(), record.size()));
+  prefs.end();
+  return record;
+}
+
+static void writeNvs(const Bytes& record) {
+  Preferences prefs;
+  prefs.begin("swanflow", false);
+  prefs.putBytes("totals", record.data(), record.size());
+  prefs.end();
+}
+
+// NvsRecord starts size (4), version (2), build (2)
+static void setNvsField(Bytes& record, size_t offset, uint16_t value) {
+  memcpy(&record[offset], &value, 2);
+  fixCrc(record.data(), record.size());
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+// Nothing saved yet: RTC memory is noise and NVS is empty
+static void testColdStart() {
+  hostNvsErase();
+  powerLoss();
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NONE);
+  CHECK(total() == 0 && warm->getWarmBoots() == 0 && upload.incidentStream == 0xF00D);
+}
+
+// A vehicle past the line and one short of it at the reset: the first
+// isn't counted again, the second is counted when it crosses
+static void testRtcRestore() {
+  for (int y = 10; y <= 150; y += 20) frame(y, y - 60);  // Left counted, right at 90
+  CHECK(total() == 1);
+
+  upload.lastIncidentSeq = 7;
+  upload.lastRollupMinute = 29850001;
+  upload.lastUploadMinute = 29850000;
+  upload.backlog.stream = 0xBEEF;
+  upload.backlog.nextInterval = 42;
+  upload.lastImageSeq = 3;
+  upload.incidentStream = 0xCAFE;
+  UploadState saved = upload;
+  warm->saveRTC(*counter, upload);
+
+  CHECK(reboot(ESP_RST_SW) == WARM_RTC);
+  CHECK(memcmp(&upload, &saved, sizeof(saved)) == 0);
+  CHECK(warm->getWarmBoots() == 1 && total() == 1);
+
+  for (int y = 170; y <= 230; y += 20) frame(y, y - 60);
+  VehicleCounter::Totals totals;
+  counter->getTotals(totals);
+  CHECK(totals.totalCount == 2 && totals.zoneCounts[0] == 1 && totals.zoneCounts[1] == 1);
+
+  // Resets with nothing counted in between carry the same count
+  for (int i = 0; i < 3; i++) {
+    warm->saveRTC(*counter, upload);
+    CHECK(reboot(ESP_RST_PANIC) == WARM_RTC);
+    CHECK(total() == 2 && warm->getWarmBoots() == (uint32_t)i + 2);
+  }
+}
+
+// A reset in the middle of saveRTC() leaves a bad CRC: the totals come
+// from NVS, the RTC-only cursors keep this boot's fresh values
+static void testBadCrcFallsBackToNvs() {
+  upload.lastUploadMinute = 29850010;
+  upload.lastImageSeq = 5;
+  upload.lastIncidentSeq = 9;
+  CHECK(warm->saveNVS(*counter, upload));
+  warm->saveRTC(*counter, upload);
+
+  size_t length;
+  uint8_t* rtc = hostRtcMemory(&length);
+  CHECK(length > 64);
+  rtc[length / 2] ^= 0x01;
+
+  CHECK(reboot(ESP_RST_SW) == WARM_NVS);
+  CHECK(total() == 2 && warm->getWarmBoots() == 0);
+  CHECK(upload.lastUploadMinute == 29850010 && upload.lastImageSeq == 5);
+  CHECK(upload.lastIncidentSeq == 0 && upload.incidentStream == 0xF00D);
+
+  // NVS totals aren't added to: counting goes on from them
+  frame(10, -1);
+  for (int y = 30; y <= 230; y += 20) frame(y, -1);
+  CHECK(total() == 3);
+}
+
+// After power-on RTC memory isn't trusted even if it checks out
+static void testPowerOnUsesNvs() {
+  CHECK(warm->saveNVS(*counter, upload));
+  warm->saveRTC(*counter, upload);
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NVS);
+  CHECK(total() == 3);
+}
+
+// Records in an older format, from another build, or torn, are refused
+static void testNvsRejected() {
+  Bytes good = readNvs();
+  CHECK(good.size() > 8);
+  if (good.size() <= 8) return;
+
+  Bytes old = good;
+  setNvsField(old, 4, 1);
+  writeNvs(old);
+  powerLoss();
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NONE && total() == 0);
+
+  Bytes other = good;
+  setNvsField(other, 6, WARM_BUILD_ID + 1);
+  writeNvs(other);
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NONE && total() == 0);
+
+  Bytes torn = good;
+  torn[torn.size() / 2] ^= 0x40;
+  writeNvs(torn);
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NONE && total() == 0);
+
+  Bytes shorter(good.begin(), good.end() - 4);
+  fixCrc(shorter.data(), shorter.size());
+  writeNvs(shorter);
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NONE && total() == 0);
+
+  writeNvs(good);
+  CHECK(reboot(ESP_RST_POWERON) == WARM_NVS && total() == 3);
+}
+
+// RTC memory left by another build is not restored either
+static void testRtcOtherBuild() {
+  warm->saveRTC(*counter, upload);
+  size_t length;
+  uint8_t* rtc = hostRtcMemory(&length);
+  uint32_t size, build = WARM_BUILD_ID + 1;
+  memcpy(&size, rtc + 4, 4);  // magic, size, build
+  CHECK(size <= length);
+  if (size > length) return;
+  memcpy(rtc + 8, &build, 4);
+  fixCrc(rtc, size);
+
+  hostNvsErase();
+  CHECK(reboot(ESP_RST_SW) == WARM_NONE && total() == 0);
+}
+
+int main() {
+  hostSerialOutput(false);
+  srand(35);
+  testColdStart();
+  testRtcRestore();
+  testBadCrcFallsBackToNvs();
+  testPowerOnUsesNvs();
+  testNvsRejected();
+  testRtcOtherBuild();
+  delete counter;
+  delete warm;
+
+  if (failures) {
+    printf("%d failures\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+"""
+Export training frames from a SwanFlow SD card for Edge Impulse
+Usage: python export_training.py --log /media/sd/log/events.bin --output training
+
+Reads the LOG_TRAINING records that TRAINING_CAPTURE writes to the event
+log, saves each frame as a JPEG and writes bounding_boxes.labels next to
+them, which the Edge Impulse uploader picks up:
+
+    edge-impulse-uploader --category split training/*.jpg
+"""
+
+import argparse
+import json
+import mmap
+import struct
+import sys
+import zlib
+from pathlib import Path
+
+# event_log.h
+RECORD_HEADER = struct.Struct('<HBBIIIIIII')
+RECORD_MAGIC = b'RS'
+RECORD_ALIGN = 32
+LOG_TRAINING = 4
+LOG_DATA_OFFSET = 2 * 512  # Two checkpoint sectors before the ring
+
+# training_capture.h
+TRAINING_HEADER = struct.Struct('<IBBBBIIHHI')
+TRAINING_BOX = struct.Struct('<HHHHHBB')
+TRAINING_MAGIC = 0x4C545346
+REASONS = {0x01: 'uniform', 0x02: 'low-confidence', 0x04: 'near-crossing', 0x08: 'night'}
+
+
+def read_records(data):
+    """Yield (generation, seq, payload) for every intact training record."""
+    pos = data.find(RECORD_MAGIC, LOG_DATA_OFFSET)
+    while pos >= 0:
+        if (pos - LOG_DATA_OFFSET) % RECORD_ALIGN == 0 and pos + RECORD_HEADER.size <= len(data):
+            header = data[pos:pos + RECORD_HEADER.size]
+            _, rtype, _, seq, generation, _, length, payload_crc, _, header_crc = RECORD_HEADER.unpack(header)
+            end = pos + RECORD_HEADER.size + length
+            if (zlib.crc32(header[:-4]) == header_crc and rtype == LOG_TRAINING and end <= len(data)):
+                payload = data[pos + RECORD_HEADER.size:end]
+                if zlib.crc32(payload) == payload_crc:
+                    yield generation, seq, payload
+        pos = data.find(RECORD_MAGIC, pos + 1)
+
+
+def parse_training(payload):
+    """Split a training record into (header fields, boxes, jpeg), or None."""
+    if len(payload) < TRAINING_HEADER.size:
+        return None
+    (magic, version, reasons, box_count, _, timestamp, epoch,
+     width, height, jpeg_length) = TRAINING_HEADER.unpack_from(payload)
+    if magic != TRAINING_MAGIC or version != 1:
+        return None
+
+    offset = TRAINING_HEADER.size
+    boxes = []
+    for _ in range(box_count):
+        x, y, w, h, track_id, confidence, _ = TRAINING_BOX.unpack_from(payload, offset)
+        boxes.append({'x': x, 'y': y, 'width': w, 'height': h,
+                      'track': track_id, 'confidence': confidence / 255})
+        offset += TRAINING_BOX.size
+
+    jpeg = payload[offset:offset + jpeg_length]
+    if len(jpeg) != jpeg_length:
+        return None
+
+    info = {'reasons': reasons, 'timestamp': timestamp, 'epoch': epoch,
+            'width': width, 'height': height}
+    return info, boxes, jpeg
+
+
+def export(log_path, output_dir, label, min_confidence):
+    output_path = Path(output_dir)
+    output_path.mkdir(parents=True, exist_ok=True)
+
+    labels = {}
+    by_reason = {name: 0 for name in REASONS.values()}
+    seen = set()
+
+    with open(log_path, 'rb') as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        for generation, seq, payload in read_records(data):
+            if (generation, seq) in seen:
+                continue
+            seen.add((generation, seq))
+
+            parsed = parse_training(bytes(payload))
+            if not parsed:
+                continue
+            info, boxes, jpeg = parsed
+
+            # Epoch time when the device had it, so names sort by capture time
+            stamp = info['epoch'] if info['epoch'] else info['timestamp']
+            name = f"{stamp}-{generation:08x}-{seq}.jpg"
+            (output_path / name).write_bytes(jpeg)
+
+            labels[name] = [
+                {'label': label, 'x': b['x'], 'y': b['y'],
+                 'width': b['width'], 'height': b['height']}
+                for b in boxes if b['confidence'] >= min_confidence
+            ]
+            for bit, reason in REASONS.items():
+                if info['reasons'] & bit:
+                    by_reason[reason] += 1
+        data.close()
+
+    # Edge Impulse bounding box label format
+    label_file = {'version': 1, 'type': 'bounding-box-labels', 'boundingBoxes': labels}
+    (output_path / 'bounding_boxes.labels').write_text(json.dumps(label_file, indent=2))
+
+    print(f"Exported {len(labels)} frames to {output_path}")
+    for reason, count in by_reason.items():
+        print(f"  {reason}: {count}")
+    print("Boxes are the on-device detections: review them in Edge Impulse before training")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Export SwanFlow training frames for Edge Impulse')
+    parser.add_argument('--log', required=True, help='Event log from the SD card (log/events.bin)')
+    parser.add_argument('--output', default='training', help='Output directory')
+    parser.add_argument('--label', default='vehicle', help='Label for every box')
+    parser.add_argument('--min-confidence', type=float, default=0.0,
+                        help='Leave out boxes below this confidence (0-1)')
+    args = parser.parse_args()
+
+    if not Path(args.log).exists():
+        print(f"Error: {args.log} not found")
+        sys.exit(1)
+
+    export(args.log, args.output, args.label, args.min_confidence)
+
+
+if __name__ == '__main__':
+    main()